@@ -14,6 +14,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <Uefi/UefiBaseType.h>
 #include <Uefi/UefiSpec.h>
@@ -22,6 +23,24 @@ extern "C" {
 /** An EFI boot entry */
 struct efi_boot_entry;
 
+/** A published snapshot of EFI boot entries */
+struct efi_boot_snapshot;
+
+/** An EFI boot entry snapshot publication point */
+struct efi_boot_publisher;
+
+/** An SBAT component table */
+struct efi_boot_sbat;
+
+/** An EFI boot entry iterator */
+struct efi_boot_iter;
+
+/** A hardware inventory for boot resolution */
+struct efi_boot_inventory;
+
+/** A set of platform quirks */
+struct efi_boot_quirk;
+
 /** EFI boot load option types */
 enum efi_boot_option_type {
 	EFIBOOT_TYPE_BOOT = 1,
@@ -30,12 +49,50 @@ enum efi_boot_option_type {
 	EFIBOOT_TYPE_MAX = EFIBOOT_TYPE_SYSPREP
 };
 
+/** EFI boot entry optional data formats */
+enum efi_boot_data_format {
+	/** No optional data */
+	EFIBOOT_DATA_NONE = 0,
+	/** Unrecognised binary data */
+	EFIBOOT_DATA_BINARY,
+	/** UCS-2 text (e.g. kernel command line or shim arguments) */
+	EFIBOOT_DATA_UCS2,
+	/** ASCII text */
+	EFIBOOT_DATA_ASCII,
+	/** Windows Boot Manager BCD object reference */
+	EFIBOOT_DATA_WINDOWS,
+	EFIBOOT_DATA_MAX = EFIBOOT_DATA_WINDOWS
+};
+
+/** EFI boot resolution verdicts */
+enum efi_boot_verdict {
+	/** Entry would be booted */
+	EFIBOOT_VERDICT_BOOT = 0,
+	/** Entry is skipped since it is inactive */
+	EFIBOOT_VERDICT_INACTIVE,
+	/** Entry is skipped since it is not in the boot category */
+	EFIBOOT_VERDICT_NOT_BOOTABLE,
+	/** Entry fails since its device is missing */
+	EFIBOOT_VERDICT_NO_DEVICE,
+	/** Entry fails since its file is missing */
+	EFIBOOT_VERDICT_NO_FILE,
+	/** Entry is not reached since an earlier entry would be booted */
+	EFIBOOT_VERDICT_UNREACHED,
+	EFIBOOT_VERDICT_MAX = EFIBOOT_VERDICT_UNREACHED
+};
+
 /** Maximum valid boot index */
 #define EFIBOOT_INDEX_MAX 0xffffU
 
 /** Auto-assigned boot index */
 #define EFIBOOT_INDEX_AUTO -1U
 
+/** Device paths were shortened to fit variable size budget */
+#define EFIBOOT_FIT_SHORT_PATHS 0x0001
+
+/** Optional data was trimmed to fit variable size budget */
+#define EFIBOOT_FIT_TRIM_DATA 0x0002
+
 extern void efiboot_free ( struct efi_boot_entry *entry );
 extern struct efi_boot_entry *
 efiboot_from_option ( const EFI_LOAD_OPTION *option, size_t len );
@@ -67,6 +124,13 @@ extern int efiboot_set_paths ( struct efi_boot_entry *entry,
 			       unsigned int count );
 extern int efiboot_set_path ( struct efi_boot_entry *entry, unsigned int index,
 			      const EFI_DEVICE_PATH_PROTOCOL *path );
+extern int efiboot_insert_path ( struct efi_boot_entry *entry,
+				 unsigned int index,
+				 const EFI_DEVICE_PATH_PROTOCOL *path );
+extern int efiboot_append_path ( struct efi_boot_entry *entry,
+				 const EFI_DEVICE_PATH_PROTOCOL *path );
+extern int efiboot_remove_path ( struct efi_boot_entry *entry,
+				 unsigned int index );
 extern int efiboot_set_paths_text ( struct efi_boot_entry *entry,
 				    const char **texts, unsigned int count );
 extern int efiboot_set_path_text ( struct efi_boot_entry *entry,
@@ -75,17 +139,106 @@ extern const void * efiboot_data ( const struct efi_boot_entry *entry );
 extern size_t efiboot_data_len ( const struct efi_boot_entry *entry );
 extern int efiboot_set_data ( struct efi_boot_entry *entry, const void *data,
 			      size_t len );
+extern int efiboot_take_data ( struct efi_boot_entry *entry, void *data,
+			       size_t len );
 extern void efiboot_clear_data ( struct efi_boot_entry *entry );
+extern enum efi_boot_data_format
+efiboot_data_format ( const struct efi_boot_entry *entry );
+extern const char *
+efiboot_data_format_name ( enum efi_boot_data_format format );
+extern const char * efiboot_data_text ( const struct efi_boot_entry *entry );
 extern struct efi_boot_entry * efiboot_new ( void );
+extern struct efi_boot_entry * efiboot_clone ( struct efi_boot_entry *orig );
 extern struct efi_boot_entry * efiboot_load ( enum efi_boot_option_type type,
 					      unsigned int index );
+extern int efiboot_fit ( struct efi_boot_entry *entry, size_t max_len,
+			 unsigned int *fallbacks );
 extern int efiboot_save ( struct efi_boot_entry *entry );
 extern int efiboot_del ( struct efi_boot_entry *entry );
+extern uint16_t * efiboot_load_order ( enum efi_boot_option_type type,
+				       unsigned int *count );
+extern int efiboot_save_order ( enum efi_boot_option_type type,
+				const uint16_t *order, unsigned int count );
+extern int efiboot_load_next ( unsigned int *index );
+extern int efiboot_space ( size_t *space );
+extern int efiboot_capacity ( size_t *capacity );
+extern int efiboot_plan_save ( const struct efi_boot_entry *entry,
+			       size_t *space );
+extern int efiboot_plan_del ( const struct efi_boot_entry *entry,
+			      size_t *space );
+extern int efiboot_plan_order ( enum efi_boot_option_type type,
+				const uint16_t *order, unsigned int count,
+				size_t *space );
+extern unsigned int efiboot_order_restore ( const uint16_t *order,
+					    unsigned int count,
+					    const uint16_t *intended,
+					    unsigned int intended_count,
+					    uint16_t *restored );
+extern int efiboot_watch ( void );
+extern int efiboot_watch_drain ( int fd );
 extern void efiboot_free_all ( struct efi_boot_entry **entries );
 extern struct efi_boot_entry **
 efiboot_load_all ( enum efi_boot_option_type type );
+extern struct efi_boot_iter *
+efiboot_iter_open ( enum efi_boot_option_type type );
+extern int efiboot_iter_next ( struct efi_boot_iter *iter,
+			       struct efi_boot_entry **entry,
+			       unsigned int *pos );
+extern void efiboot_iter_close ( struct efi_boot_iter *iter );
 extern int efiboot_save_all ( enum efi_boot_option_type type,
 			      struct efi_boot_entry **entries );
+extern int efiboot_compact ( enum efi_boot_option_type type );
+extern struct efi_boot_snapshot *
+efiboot_snapshot_take ( struct efi_boot_entry **entries );
+extern struct efi_boot_snapshot *
+efiboot_snapshot ( enum efi_boot_option_type type );
+extern unsigned int
+efiboot_snapshot_count ( const struct efi_boot_snapshot *snapshot );
+extern const struct efi_boot_entry *
+efiboot_snapshot_entry ( const struct efi_boot_snapshot *snapshot,
+			 unsigned int index );
+extern void efiboot_snapshot_put ( struct efi_boot_snapshot *snapshot );
+extern struct efi_boot_publisher * efiboot_publisher_new ( void );
+extern void efiboot_publisher_free ( struct efi_boot_publisher *publisher );
+extern struct efi_boot_snapshot *
+efiboot_pin ( struct efi_boot_publisher *publisher );
+extern void efiboot_publish ( struct efi_boot_publisher *publisher,
+			      struct efi_boot_snapshot *snapshot );
+extern struct efi_boot_sbat * efiboot_sbat_parse ( const char *csv,
+						   size_t len );
+extern struct efi_boot_sbat * efiboot_sbat_level ( void );
+extern struct efi_boot_sbat * efiboot_sbat_image ( const void *image,
+						   size_t len );
+extern unsigned int efiboot_sbat_count ( const struct efi_boot_sbat *sbat );
+extern const char * efiboot_sbat_component ( const struct efi_boot_sbat *sbat,
+					     unsigned int index,
+					     unsigned long *generation );
+extern unsigned long efiboot_sbat_generation ( const struct efi_boot_sbat *sbat,
+					       const char *name );
+extern const char * efiboot_sbat_revoked ( const struct efi_boot_sbat *level,
+					   const struct efi_boot_sbat *image );
+extern void efiboot_sbat_free ( struct efi_boot_sbat *sbat );
+extern struct efi_boot_inventory * efiboot_inventory_new ( void );
+extern int
+efiboot_inventory_add_partition ( struct efi_boot_inventory *inventory,
+				  const void *signature, size_t len );
+extern int efiboot_inventory_add_file ( struct efi_boot_inventory *inventory,
+					const void *signature, size_t len,
+					const char *path );
+extern int efiboot_inventory_add_nic ( struct efi_boot_inventory *inventory,
+				       const uint8_t *mac );
+extern void efiboot_inventory_free ( struct efi_boot_inventory *inventory );
+extern int efiboot_resolve ( const struct efi_boot_inventory *inventory,
+			     const struct efi_boot_entry *entry, bool next );
+extern int efiboot_reorder_paths ( const struct efi_boot_inventory *inventory,
+				   struct efi_boot_entry *entry,
+				   bool *reordered );
+extern const char * efiboot_verdict_name ( enum efi_boot_verdict verdict );
+extern const char * efiboot_removable_file ( void );
+extern const struct efi_boot_quirk * efiboot_quirk ( const char *root,
+						     size_t capacity );
+extern const char * efiboot_quirk_name ( const struct efi_boot_quirk *quirk );
+extern size_t efiboot_quirk_max_len ( const struct efi_boot_quirk *quirk );
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -115,13 +115,27 @@ extern "C" {
 	.FvName = guid,							\
 	}
 
+struct efidp_index;
+
 extern bool efidp_valid ( const void *path, size_t max_len );
 extern bool efidp_plausible ( const EFI_DEVICE_PATH_PROTOCOL *path );
 extern size_t efidp_len ( const EFI_DEVICE_PATH_PROTOCOL *path );
 extern EFI_DEVICE_PATH_PROTOCOL * efidp_from_text ( const char *text,
 						    bool allow_implausible );
+extern void * efidp_from_texts ( const char **texts, unsigned int count,
+				 bool allow_implausible, size_t offset,
+				 size_t *len );
 extern char * efidp_to_text ( const EFI_DEVICE_PATH_PROTOCOL *path,
 			      bool display_only, bool allow_shortcuts );
+extern struct efidp_index * efidp_index_new ( void );
+extern int efidp_index_add ( struct efidp_index *index,
+			     const EFI_DEVICE_PATH_PROTOCOL *path );
+extern EFI_DEVICE_PATH_PROTOCOL *
+efidp_index_expand ( const struct efidp_index *index,
+		     const EFI_DEVICE_PATH_PROTOCOL *path );
+extern void efidp_index_free ( struct efidp_index *index );
+extern const EFI_DEVICE_PATH_PROTOCOL *
+efidp_shorten ( const EFI_DEVICE_PATH_PROTOCOL *path );
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot configuration comparison
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <Guid/GlobalVariable.h>
+#include <efibootdev.h>
+
+#include "efivarstore.h"
+#include "bootdiff.h"
+
+/** EFI global variable GUID */
+static const EFI_GUID global_guid = EFI_GLOBAL_VARIABLE;
+
+/**
+ * Parse boot variable name
+ *
+ * @v var		Variable
+ * @v number		Boot entry number to fill in
+ * @ret type		1 for a boot entry, 2 for the boot order, or 0
+ */
+static int diff_var_type ( const struct var *var, unsigned int *number ) {
+	char name[ 4 /* "Boot" */ + 5 /* "Order" */ + 1 /* NUL */ ];
+	unsigned int i;
+
+	/* Ignore anything other than short ASCII global variables */
+	if ( memcmp ( &var->guid, &global_guid, sizeof ( var->guid ) ) != 0 )
+		return 0;
+	for ( i = 0 ; i < sizeof ( name ) ; i++ ) {
+		if ( var->name[i] >= 0x80 )
+			return 0;
+		name[i] = var->name[i];
+		if ( ! name[i] )
+			break;
+	}
+	if ( i == sizeof ( name ) )
+		return 0;
+
+	/* Identify boot order and boot entries */
+	if ( strcmp ( name, "BootOrder" ) == 0 )
+		return 2;
+	if ( ( strlen ( name ) != 8 ) || ( strncmp ( name, "Boot", 4 ) != 0 ) ||
+	     ( strspn ( ( name + 4 ), "0123456789ABCDEF" ) != 4 ) )
+		return 0;
+	*number = strtoul ( ( name + 4 ), NULL, 16 );
+	return 1;
+}
+
+/**
+ * Compare boot entries by number
+ *
+ * @v first		First entry
+ * @v second		Second entry
+ * @ret diff		Difference
+ */
+static int diff_entry_cmp ( const void *first, const void *second ) {
+	const struct diff_entry *a = first;
+	const struct diff_entry *b = second;
+
+	return ( ( int ) a->number - ( int ) b->number );
+}
+
+/**
+ * Add variable to boot configuration
+ *
+ * @v config		Boot configuration
+ * @v var		Variable
+ * @ret ok		Success indicator
+ *
+ * Only the raw bytes of each boot entry are retained, so that
+ * matching may be performed without decoding any load options.
+ * Variables other than boot entries and the boot order are ignored.
+ */
+int diff_add ( struct diff_config *config, const struct var *var ) {
+	struct diff_entry *entry;
+	struct diff_entry *tmp;
+	unsigned int number;
+	unsigned int max;
+	uint16_t *order;
+
+	switch ( diff_var_type ( var, &number ) ) {
+	case 1:
+		if ( config->count == config->max ) {
+			max = ( config->max ? ( config->max * 2 ) : 16 );
+			tmp = realloc ( config->entries,
+					( max * sizeof ( *tmp ) ) );
+			if ( ! tmp )
+				return 0;
+			config->entries = tmp;
+			config->max = max;
+		}
+		entry = &config->entries[ config->count++ ];
+		memset ( entry, 0, sizeof ( *entry ) );
+		entry->number = number;
+		entry->option = g_bytes_new ( var->value.data, var->len );
+		entry->position = -1;
+		break;
+	case 2:
+		order = malloc ( var->len + 1 /* non-zero */ );
+		if ( ! order )
+			return 0;
+		memcpy ( order, var->value.data, var->len );
+		free ( config->order );
+		config->order = order;
+		config->order_count = ( var->len / sizeof ( order[0] ) );
+		break;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+/**
+ * Index boot configuration
+ *
+ * @v config		Boot configuration
+ *
+ * Entries are sorted, then indexed by number and by raw load option.
+ * Where several entries have identical contents, the lowest numbered
+ * entry is indexed.  This must be called once all variables have
+ * been added.
+ */
+void diff_index ( struct diff_config *config ) {
+	struct diff_entry *entry;
+	unsigned int i;
+
+	/* Sort and index entries */
+	qsort ( config->entries, config->count, sizeof ( *entry ),
+		diff_entry_cmp );
+	config->numbers = g_hash_table_new ( g_direct_hash, g_direct_equal );
+	config->options = g_hash_table_new ( g_bytes_hash, g_bytes_equal );
+	for ( i = 0 ; i < config->count ; i++ ) {
+		entry = &config->entries[i];
+		g_hash_table_insert ( config->numbers,
+				      GUINT_TO_POINTER ( entry->number ),
+				      entry );
+		if ( ! g_hash_table_contains ( config->options,
+					       entry->option ) ) {
+			g_hash_table_insert ( config->options,
+					      entry->option, entry );
+		}
+	}
+
+	/* Record boot order positions */
+	for ( i = 0 ; i < config->order_count ; i++ ) {
+		entry = g_hash_table_lookup ( config->numbers,
+					      GUINT_TO_POINTER
+					      ( config->order[i] ) );
+		if ( entry && ( entry->position < 0 ) )
+			entry->position = i;
+	}
+}
+
+/**
+ * Load boot configuration
+ *
+ * @v config		Boot configuration
+ * @ret ok		Success indicator
+ */
+int diff_load ( struct diff_config *config ) {
+	static struct var var;
+	struct var_stream stream;
+	int rc;
+
+	/* Open variable store */
+	memset ( &stream, 0, sizeof ( stream ) );
+	stream.path = config->path;
+	if ( ! config->format->open_read ( &stream ) )
+		return 0;
+
+	/* Read boot entries and boot order */
+	while ( ( rc = config->format->read ( &stream, &var ) ) > 0 ) {
+		if ( ! diff_add ( config, &var ) ) {
+			rc = -1;
+			break;
+		}
+	}
+	var_close ( &stream );
+	if ( rc < 0 )
+		return 0;
+
+	/* Index entries */
+	diff_index ( config );
+
+	return 1;
+}
+
+/**
+ * Free boot configuration
+ *
+ * @v config		Boot configuration
+ */
+void diff_free ( struct diff_config *config ) {
+	struct diff_entry *entry;
+	unsigned int i;
+
+	for ( i = 0 ; i < config->count ; i++ ) {
+		entry = &config->entries[i];
+		if ( entry->decoded )
+			efiboot_free ( entry->decoded );
+		g_bytes_unref ( entry->option );
+	}
+	if ( config->numbers )
+		g_hash_table_destroy ( config->numbers );
+	if ( config->options )
+		g_hash_table_destroy ( config->options );
+	free ( config->entries );
+	free ( config->order );
+}
+
+/**
+ * Join boot configurations
+ *
+ * @v old		Old boot configuration
+ * @v new		New boot configuration
+ *
+ * Entries are first joined by number where the raw contents are
+ * identical, then by raw contents alone (to identify renumbered
+ * entries), and finally by number alone (to identify modified
+ * entries).
+ */
+void diff_join ( struct diff_config *old, struct diff_config *new ) {
+	struct diff_entry *entry;
+	struct diff_entry *match;
+	unsigned int i;
+
+	/* Join unchanged entries by number */
+	for ( i = 0 ; i < old->count ; i++ ) {
+		entry = &old->entries[i];
+		match = g_hash_table_lookup ( new->numbers,
+					      GUINT_TO_POINTER
+					      ( entry->number ) );
+		if ( match && g_bytes_equal ( entry->option, match->option ) ) {
+			entry->match = match;
+			match->match = entry;
+		}
+	}
+
+	/* Join renumbered entries by content */
+	for ( i = 0 ; i < old->count ; i++ ) {
+		entry = &old->entries[i];
+		if ( entry->match )
+			continue;
+		match = g_hash_table_lookup ( new->options, entry->option );
+		if ( match && ( ! match->match ) ) {
+			entry->match = match;
+			match->match = entry;
+		}
+	}
+
+	/* Join modified entries by number */
+	for ( i = 0 ; i < old->count ; i++ ) {
+		entry = &old->entries[i];
+		if ( entry->match )
+			continue;
+		match = g_hash_table_lookup ( new->numbers,
+					      GUINT_TO_POINTER
+					      ( entry->number ) );
+		if ( match && ( ! match->match ) ) {
+			entry->match = match;
+			match->match = entry;
+		}
+	}
+}
+
+/**
+ * Identify reordered entries
+ *
+ * @v old		Old boot configuration (joined to new configuration)
+ * @ret count		Number of reordered entries, or negative on error
+ *
+ * Entries present in both boot orders are treated as reordered only
+ * if they fall outside the longest subsequence whose relative order
+ * is unchanged, so that inserting or removing a single entry does not
+ * cause every subsequent entry to be reported.  Reordered entries
+ * are marked within the old boot configuration.
+ */
+int diff_order ( struct diff_config *old ) {
+	struct diff_entry **seq;
+	struct diff_entry *entry;
+	unsigned int *tail;
+	unsigned int *prev;
+	bool *kept;
+	int reordered = -1;
+	unsigned int count = 0;
+	unsigned int len = 0;
+	unsigned int low;
+	unsigned int high;
+	unsigned int mid;
+	unsigned int i;
+
+	/* Allocate working space */
+	seq = calloc ( ( old->order_count + 1 ), sizeof ( seq[0] ) );
+	tail = calloc ( ( old->order_count + 1 ), sizeof ( tail[0] ) );
+	prev = calloc ( ( old->order_count + 1 ), sizeof ( prev[0] ) );
+	kept = calloc ( ( old->order_count + 1 ), sizeof ( kept[0] ) );
+	if ( ! ( seq && tail && prev && kept ) )
+		goto err_alloc;
+
+	/* Construct old boot order restricted to entries that remain
+	 * within the new boot order.
+	 */
+	for ( i = 0 ; i < old->order_count ; i++ ) {
+		entry = g_hash_table_lookup ( old->numbers,
+					      GUINT_TO_POINTER
+					      ( old->order[i] ) );
+		if ( entry && ( entry->position == ( ( int ) i ) ) &&
+		     entry->match && ( entry->match->position >= 0 ) )
+			seq[count++] = entry;
+	}
+
+	/* Find longest increasing subsequence of new positions */
+	for ( i = 0 ; i < count ; i++ ) {
+		for ( low = 0, high = len ; low < high ; ) {
+			mid = ( ( low + high ) / 2 );
+			if ( seq[ tail[mid] ]->match->position <
+			     seq[i]->match->position ) {
+				low = ( mid + 1 );
+			} else {
+				high = mid;
+			}
+		}
+		prev[i] = ( low ? tail[ low - 1 ] : i );
+		tail[low] = i;
+		if ( low == len )
+			len++;
+	}
+	if ( len ) {
+		for ( i = tail[ len - 1 ] ; ; i = prev[i] ) {
+			kept[i] = true;
+			if ( prev[i] == i )
+				break;
+		}
+	}
+
+	/* Mark entries outside the longest subsequence */
+	reordered = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( kept[i] )
+			continue;
+		seq[i]->reordered = true;
+		reordered++;
+	}
+
+ err_alloc:
+	free ( kept );
+	free ( prev );
+	free ( tail );
+	free ( seq );
+	return reordered;
+}
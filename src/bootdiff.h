@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot configuration comparison
+ *
+ */
+
+#ifndef _BOOTDIFF_H
+#define _BOOTDIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <glib.h>
+#include <efibootdev.h>
+
+#include "efivarstore.h"
+
+/** A boot entry within a boot configuration */
+struct diff_entry {
+	/** Boot entry number */
+	unsigned int number;
+	/** Raw load option */
+	GBytes *option;
+	/** Position within boot order (or -1 if not present) */
+	int position;
+	/** Matching entry in other configuration (if any) */
+	struct diff_entry *match;
+	/** Entry was moved within boot order */
+	bool reordered;
+	/** Decoded load option (if decoded) */
+	struct efi_boot_entry *decoded;
+};
+
+/** A boot configuration */
+struct diff_config {
+	/** Variable store format */
+	const struct var_format *format;
+	/** Variable store path */
+	const char *path;
+	/** Entries (sorted by number) */
+	struct diff_entry *entries;
+	/** Number of entries */
+	unsigned int count;
+	/** Allocated number of entries */
+	unsigned int max;
+	/** Entries indexed by number */
+	GHashTable *numbers;
+	/** Entries indexed by raw load option */
+	GHashTable *options;
+	/** Boot order */
+	uint16_t *order;
+	/** Number of boot order entries */
+	unsigned int order_count;
+};
+
+extern int diff_add ( struct diff_config *config, const struct var *var );
+extern void diff_index ( struct diff_config *config );
+extern int diff_load ( struct diff_config *config );
+extern void diff_free ( struct diff_config *config );
+extern void diff_join ( struct diff_config *old, struct diff_config *new );
+extern int diff_order ( struct diff_config *old );
+
+#endif /* _BOOTDIFF_H */
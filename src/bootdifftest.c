@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot configuration comparison self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <Uefi/UefiBaseType.h>
+#include <Guid/GlobalVariable.h>
+
+#include "bootdiff.h"
+#include "bootdifftest.h"
+
+/** A test boot entry */
+struct diff_test_entry {
+	/** Boot entry number */
+	unsigned int number;
+	/** Raw load option contents */
+	const char *option;
+};
+
+/** Number of entries in array */
+#define DIFF_COUNT( array ) ( sizeof ( array ) / sizeof ( array[0] ) )
+
+/** EFI global variable GUID */
+static const EFI_GUID diff_test_guid = EFI_GLOBAL_VARIABLE;
+
+/** Variable buffer (too large for the stack) */
+static struct var diff_test_var;
+
+/**
+ * Set test variable name
+ *
+ * @v name		Variable name
+ */
+static void diff_test_name ( const char *name ) {
+	unsigned int i;
+
+	memset ( &diff_test_var, 0, sizeof ( diff_test_var ) );
+	memcpy ( &diff_test_var.guid, &diff_test_guid,
+		 sizeof ( diff_test_var.guid ) );
+	for ( i = 0 ; name[i] ; i++ )
+		diff_test_var.name[i] = name[i];
+	diff_test_var.name_len = ( ( i + 1 ) *
+				   sizeof ( diff_test_var.name[0] ) );
+}
+
+/**
+ * Construct test boot configuration
+ *
+ * @v config		Boot configuration to fill in
+ * @v entries		Boot entries
+ * @v count		Number of boot entries
+ * @v order		Boot order
+ * @v order_count	Number of boot order entries
+ */
+static void diff_test_config ( struct diff_config *config,
+			       const struct diff_test_entry *entries,
+			       unsigned int count, const uint16_t *order,
+			       unsigned int order_count ) {
+	char name[ 4 /* "Boot" */ + 4 /* "XXXX" */ + 1 /* NUL */ ];
+	unsigned int i;
+
+	memset ( config, 0, sizeof ( *config ) );
+
+	/* Add boot entries */
+	for ( i = 0 ; i < count ; i++ ) {
+		snprintf ( name, sizeof ( name ), "Boot%04X",
+			   entries[i].number );
+		diff_test_name ( name );
+		diff_test_var.len = strlen ( entries[i].option );
+		memcpy ( diff_test_var.value.data, entries[i].option,
+			 diff_test_var.len );
+		assert_true ( diff_add ( config, &diff_test_var ) );
+	}
+
+	/* Add an unrelated variable, which should be ignored */
+	diff_test_name ( "BootCurrent" );
+	diff_test_var.len = sizeof ( order[0] );
+	assert_true ( diff_add ( config, &diff_test_var ) );
+
+	/* Add boot order */
+	diff_test_name ( "BootOrder" );
+	diff_test_var.len = ( order_count * sizeof ( order[0] ) );
+	memcpy ( diff_test_var.value.data, order, diff_test_var.len );
+	assert_true ( diff_add ( config, &diff_test_var ) );
+
+	diff_index ( config );
+	assert_int_equal ( config->count, count );
+}
+
+/**
+ * Get test boot entry
+ *
+ * @v config		Boot configuration
+ * @v number		Boot entry number
+ * @ret entry		Boot entry
+ */
+static struct diff_entry * diff_test_entry ( struct diff_config *config,
+					     unsigned int number ) {
+	struct diff_entry *entry;
+
+	entry = g_hash_table_lookup ( config->numbers,
+				      GUINT_TO_POINTER ( number ) );
+	assert_non_null ( entry );
+	return entry;
+}
+
+/**
+ * Check boot entry match
+ *
+ * @v old		Old boot configuration
+ * @v number		Old boot entry number
+ * @v new		New boot configuration
+ * @v match		Expected new boot entry number (or -1 if none)
+ */
+static void assert_diff_match ( struct diff_config *old, unsigned int number,
+				struct diff_config *new, int match ) {
+	struct diff_entry *entry = diff_test_entry ( old, number );
+
+	if ( match < 0 ) {
+		assert_null ( entry->match );
+		return;
+	}
+	assert_ptr_equal ( entry->match,
+			   diff_test_entry ( new, match ) );
+	assert_ptr_equal ( entry->match->match, entry );
+}
+
+/** Test joining of boot entries */
+void test_diffjoin ( void **state ) {
+	static const struct diff_test_entry before[] = {
+		{ 0x0001, "disk" }, { 0x0002, "network" },
+		{ 0x0003, "shell" }, { 0x0004, "usb" },
+		{ 0x0005, "cdrom" },
+	};
+	static const struct diff_test_entry after[] = {
+		{ 0x0001, "disk" }, { 0x0003, "shell v2" },
+		{ 0x0005, "cdrom" }, { 0x0007, "network" },
+		{ 0x0008, "http" },
+	};
+	static const struct diff_test_entry swapped[] = {
+		{ 0x0001, "network" }, { 0x0002, "disk" },
+	};
+	static const uint16_t order[] = { 1, 2, 3 };
+	struct diff_config old;
+	struct diff_config new;
+	unsigned int i;
+
+	( void ) state;
+
+	/* Check that identical configurations match completely */
+	diff_test_config ( &old, before, DIFF_COUNT ( before ),
+			   order, DIFF_COUNT ( order ) );
+	diff_test_config ( &new, before, DIFF_COUNT ( before ),
+			   order, DIFF_COUNT ( order ) );
+	diff_join ( &old, &new );
+	for ( i = 0 ; i < DIFF_COUNT ( before ) ; i++ ) {
+		assert_diff_match ( &old, before[i].number, &new,
+				    before[i].number );
+	}
+	assert_int_equal ( diff_order ( &old ), 0 );
+	diff_free ( &new );
+	diff_free ( &old );
+
+	/* Check added, removed, renumbered, and modified entries */
+	diff_test_config ( &old, before, DIFF_COUNT ( before ),
+			   order, DIFF_COUNT ( order ) );
+	diff_test_config ( &new, after, DIFF_COUNT ( after ),
+			   order, DIFF_COUNT ( order ) );
+	diff_join ( &old, &new );
+	assert_diff_match ( &old, 0x0001, &new, 0x0001 );
+	assert_diff_match ( &old, 0x0002, &new, 0x0007 );
+	assert_diff_match ( &old, 0x0003, &new, 0x0003 );
+	assert_diff_match ( &old, 0x0004, &new, -1 );
+	assert_diff_match ( &old, 0x0005, &new, 0x0005 );
+	assert_null ( diff_test_entry ( &new, 0x0008 )->match );
+	diff_free ( &new );
+	diff_free ( &old );
+
+	/* Check that swapped contents are treated as renumbering */
+	diff_test_config ( &old, before, DIFF_COUNT ( swapped ),
+			   order, DIFF_COUNT ( swapped ) );
+	diff_test_config ( &new, swapped, DIFF_COUNT ( swapped ),
+			   order, DIFF_COUNT ( swapped ) );
+	diff_join ( &old, &new );
+	assert_diff_match ( &old, 0x0001, &new, 0x0002 );
+	assert_diff_match ( &old, 0x0002, &new, 0x0001 );
+	diff_free ( &new );
+	diff_free ( &old );
+}
+
+/**
+ * Check boot order comparison
+ *
+ * @v before		Old boot order
+ * @v after		New boot order
+ * @v count		Number of entries in each boot order
+ * @v expected		Expected number of reordered entries
+ * @v moved		Bitmask of entry numbers that may be reordered
+ *
+ * Where several minimal sets of moves exist, @c moved may include
+ * every candidate entry.
+ */
+static void assert_diff_order ( const uint16_t *before, const uint16_t *after,
+				unsigned int count, unsigned int expected,
+				unsigned int moved ) {
+	static const struct diff_test_entry entries[] = {
+		{ 0x0001, "one" }, { 0x0002, "two" }, { 0x0003, "three" },
+		{ 0x0004, "four" }, { 0x0005, "five" }, { 0x0006, "six" },
+	};
+	struct diff_config old;
+	struct diff_config new;
+	struct diff_entry *entry;
+	unsigned int reordered = 0;
+	unsigned int i;
+
+	/* Compare boot orders */
+	diff_test_config ( &old, entries, DIFF_COUNT ( entries ),
+			   before, count );
+	diff_test_config ( &new, entries, DIFF_COUNT ( entries ),
+			   after, count );
+	diff_join ( &old, &new );
+	assert_int_equal ( diff_order ( &old ), expected );
+
+	/* Check that only candidate entries were reordered */
+	for ( i = 0 ; i < DIFF_COUNT ( entries ) ; i++ ) {
+		entry = diff_test_entry ( &old, entries[i].number );
+		if ( entry->reordered )
+			reordered |= ( 1 << entry->number );
+	}
+	assert_int_equal ( ( reordered & ~moved ), 0 );
+
+	diff_free ( &new );
+	diff_free ( &old );
+}
+
+/** Test boot order comparison */
+void test_difforder ( void **state ) {
+	static const uint16_t sorted[] = { 1, 2, 3, 4, 5 };
+	static const uint16_t rotated[] = { 2, 3, 4, 5, 1 };
+	static const uint16_t swapped[] = { 5, 2, 3, 4, 1 };
+	static const uint16_t reversed[] = { 5, 4, 3, 2, 1 };
+	static const uint16_t inserted[] = { 1, 6, 2, 3, 4 };
+	static const uint16_t deferred[] = { 1, 3, 4, 5, 2 };
+	static const uint16_t shortened[] = { 1, 3, 4, 5 };
+
+	( void ) state;
+
+	/* Check that an unchanged boot order has no reordered entries */
+	assert_diff_order ( sorted, sorted, 5, 0, 0 );
+
+	/* Check that moving one entry reports only that entry */
+	assert_diff_order ( sorted, rotated, 5, 1, ( 1 << 1 ) );
+
+	/* Check that swapping two distant entries reports only those */
+	assert_diff_order ( sorted, swapped, 5, 2,
+			    ( ( 1 << 1 ) | ( 1 << 5 ) ) );
+
+	/* Check that reversal retains a single entry in place */
+	assert_diff_order ( sorted, reversed, 5, 4, 0x3e );
+
+	/* Check that insertion does not reorder subsequent entries */
+	assert_diff_order ( sorted, inserted, 5, 0, 0 );
+
+	/* Check that moving to the end reports only the moved entry */
+	assert_diff_order ( sorted, deferred, 5, 1, ( 1 << 2 ) );
+
+	/* Check that removal from the boot order is not a reordering */
+	assert_diff_order ( sorted, shortened, 4, 0, 0 );
+}
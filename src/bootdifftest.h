@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot configuration comparison self-tests
+ *
+ */
+
+#ifndef _BOOTDIFFTEST_H
+#define _BOOTDIFFTEST_H
+
+extern void test_diffjoin ( void **state );
+extern void test_difforder ( void **state );
+
+#endif /* _BOOTDIFFTEST_H */
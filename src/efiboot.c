@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot device command-line tool
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "efibootcli.h"
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	struct efi_boot_command *cmd;
+
+	/* Identify subcommand */
+	if ( argc < 2 ) {
+		cmd = NULL;
+	} else if ( strcmp ( argv[1], "--serve-stdio" ) == 0 ) {
+		cmd = &efibootserve;
+	} else {
+		cmd = efiboot_named_command ( argv[1] );
+	}
+	if ( ! cmd ) {
+		fprintf ( stderr, "Usage: %s show|add|mod|del|compact "
+			  "[OPTION...]\n"
+			  "       %s --serve-stdio [--type=TYPE]\n",
+			  argv[0], argv[0] );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Invoke subcommand */
+	if ( ! efiboot_command ( ( argc - 1 ), ( argv + 1 ), cmd ) )
+		exit ( EXIT_FAILURE );
+
+	exit ( EXIT_SUCCESS );
+}
@@ -12,15 +12,20 @@
 #include <stdio.h>
 #include <errno.h>
 #include <glib.h>
+#include <efidevpath.h>
 #include <efibootdev.h>
 #include "efibootcli.h"
 
 /** An EFI boot device subcommand */
 struct efi_boot_command {
+	/** Name */
+	const char *name;
 	/** Description */
 	const char *description;
 	/** Options */
 	GOptionEntry *options;
+	/** Load all entries in advance */
+	bool load_all;
 	/** Execution method */
 	int ( * exec ) ( int argc, char **argv );
 };
@@ -28,7 +33,12 @@ struct efi_boot_command {
 /** Load option type */
 static enum efi_boot_option_type type_value = EFIBOOT_TYPE_BOOT;
 
-/** List of boot entries, with space for one additional entry */
+/** Boot order, with space for one additional entry */
+static uint16_t *order;
+
+/** List of boot entries (or NULL if not yet loaded), with space for
+ * one additional entry
+ */
 static struct efi_boot_entry **entries;
 
 /** Number of boot entries */
@@ -70,9 +80,33 @@ static gboolean data_flag = FALSE;
 /** Additional data value (base64-encoded) */
 static const char *data_value = NULL;
 
+/** Additional data as text flag */
+static gboolean data_text_flag = FALSE;
+
+/** Additional data file name */
+static const char *data_file_value = NULL;
+
+/** Additional data file descriptor */
+static int data_fd_value = -1;
+
 /** Quiet flag */
 static gboolean quiet_flag = FALSE;
 
+/** Expand short-form paths flag */
+static gboolean expand_flag = FALSE;
+
+/** Short-form device path expansion index (if applicable) */
+static struct efidp_index *expand_index;
+
+/** Serving requests, with changes deferred until committed */
+static bool serving;
+
+/** Deleted entries awaiting commit */
+static struct efi_boot_entry **deleted;
+
+/** Number of deleted entries awaiting commit */
+static unsigned int deleted_count;
+
 /**
  * Parse load option type
  *
@@ -138,11 +172,19 @@ static int parse_position ( const char *arg ) {
  * @ret pos		Boot order position, or negative on error
  */
 static int parse_id ( const char *arg ) {
+	const char *prefix = efiboot_type_name ( type_value );
+	char name[ 7 /* "SysPrep" */ + 4 /* "XXXX" */ + 1 /* NUL */ ];
 	int pos;
 
-	/* Try matching against variable names */
+	/* Try matching against variable names, ignoring any new
+	 * entries that have not yet been assigned an index.
+	 */
 	for ( pos = 0 ; pos < ( ( int ) entry_count ) ; pos++ ) {
-		if ( strcasecmp ( arg, efiboot_name ( entries[pos] ) ) == 0 )
+		if ( entries[pos] && ( ! efiboot_name ( entries[pos] ) ) )
+			continue;
+		snprintf ( name, sizeof ( name ), "%s%04X", prefix,
+			   order[pos] );
+		if ( strcasecmp ( arg, name ) == 0 )
 			return pos;
 	}
 
@@ -151,14 +193,85 @@ static int parse_id ( const char *arg ) {
 }
 
 /**
- * Show boot entry properties
+ * Get boot entry, loading it if necessary
  *
  * @v pos		Boot order position
+ * @ret entry		EFI boot entry, or NULL on error
  */
-static void show_entry ( int pos ) {
+static struct efi_boot_entry * get_entry ( int pos ) {
+
+	/* Load entry, if not already loaded */
+	if ( ! entries[pos] ) {
+		entries[pos] = efiboot_load ( type_value, order[pos] );
+		if ( ! entries[pos] )
+			perror ( "Could not load entry" );
+	}
+
+	return entries[pos];
+}
+
+/**
+ * Move boot entry within boot order
+ *
+ * @v pos		Boot order position
+ * @v new_pos		New boot order position
+ */
+static void move_entry ( int pos, int new_pos ) {
 	struct efi_boot_entry *entry = entries[pos];
+	uint16_t index = order[pos];
+
+	if ( new_pos > pos ) {
+		memmove ( &entries[pos], &entries[pos + 1],
+			  ( ( new_pos - pos ) * sizeof ( entries[0] ) ) );
+		memmove ( &order[pos], &order[pos + 1],
+			  ( ( new_pos - pos ) * sizeof ( order[0] ) ) );
+	} else if ( new_pos < pos ) {
+		memmove ( &entries[new_pos + 1], &entries[new_pos],
+			  ( ( pos - new_pos ) * sizeof ( entries[0] ) ) );
+		memmove ( &order[new_pos + 1], &order[new_pos],
+			  ( ( pos - new_pos ) * sizeof ( order[0] ) ) );
+	}
+	entries[new_pos] = entry;
+	order[new_pos] = index;
+}
+
+/**
+ * Get boot entry path text, expanded to a full device path
+ *
+ * @v entry		EFI boot entry
+ * @v index		Path index
+ * @ret text		Full device path text, or NULL if not expandable
+ */
+static char * expand_path_text ( const struct efi_boot_entry *entry,
+				 unsigned int index ) {
+	EFI_DEVICE_PATH_PROTOCOL *full;
+	char *text;
+
+	/* Expand device path */
+	full = efidp_index_expand ( expand_index,
+				    efiboot_path ( entry, index ) );
+	if ( ! full )
+		return NULL;
+
+	/* Convert to text */
+	text = efidp_to_text ( full, false, true );
+	free ( full );
+
+	return text;
+}
+
+/**
+ * Show boot entry properties
+ *
+ * @v pos		Boot order position
+ * @v entry		EFI boot entry
+ */
+static void show_entry ( int pos, const struct efi_boot_entry *entry ) {
 	const char *sep = "";
+	const char *name;
+	const char *text;
 	char *encoded;
+	char *full;
 	bool all;
 	unsigned int count;
 	unsigned int i;
@@ -166,7 +279,7 @@ static void show_entry ( int pos ) {
 	/* Show all fields if no fields are specified */
 	all = ( ! ( position_flag || name_flag || attributes_flag ||
 		    description_flag || path_flag || paths_flag ||
-		    data_flag ) );
+		    data_flag || data_text_flag ) );
 
 	/* Show boot order position, if applicable */
 	if ( all || position_flag ) {
@@ -174,9 +287,10 @@ static void show_entry ( int pos ) {
 		sep = " ";
 	}
 
-	/* Show variable name, if applicable */
+	/* Show variable name (if yet assigned), if applicable */
 	if ( all || name_flag ) {
-		printf ( "%s%s", sep, efiboot_name ( entry ) );
+		name = efiboot_name ( entry );
+		printf ( "%s%s", sep, ( name ? name : "-" ) );
 		sep = " ";
 	}
 
@@ -196,8 +310,11 @@ static void show_entry ( int pos ) {
 	count = ( ( all || paths_flag ) ? efiboot_path_count ( entry ) :
 		  path_flag ? 1 : 0 );
 	for ( i = 0 ; i < count ; i++ ) {
-		printf ( "%s%s", sep, efiboot_path_text ( entry, i ) );
+		full = ( expand_index ? expand_path_text ( entry, i ) : NULL );
+		text = ( full ? full : efiboot_path_text ( entry, i ) );
+		printf ( "%s%s", sep, text );
 		sep = " ";
+		free ( full );
 	}
 
 	/* Show additional data, if applicable */
@@ -209,10 +326,255 @@ static void show_entry ( int pos ) {
 		g_free ( encoded );
 	}
 
+	/* Show additional data as text, if applicable */
+	if ( data_text_flag && efiboot_data_len ( entry ) ) {
+		text = efiboot_data_text ( entry );
+		encoded = ( text ? NULL :
+			    g_base64_encode ( efiboot_data ( entry ),
+					      efiboot_data_len ( entry ) ) );
+		printf ( "%s%s", sep, ( text ? text : encoded ) );
+		sep = " ";
+		g_free ( encoded );
+	}
+
 	/* Terminate line */
 	printf ( "\n" );
 }
 
+/**
+ * Set boot entry additional data from file
+ *
+ * @v entry		EFI boot entry
+ * @v mapped		Memory-mapped file
+ * @ret ok		Success indicator
+ */
+static int set_mapped_data ( struct efi_boot_entry *entry,
+			     GMappedFile *mapped ) {
+	int ok;
+
+	/* Copy directly from the mapped file contents */
+	ok = efiboot_set_data ( entry, g_mapped_file_get_contents ( mapped ),
+				g_mapped_file_get_length ( mapped ) );
+	if ( ! ok )
+		perror ( "Could not set additional data" );
+
+	/* Unmap file */
+	g_mapped_file_unref ( mapped );
+
+	return ok;
+}
+
+/**
+ * Set boot entry additional data from file descriptor
+ *
+ * @v entry		EFI boot entry
+ * @v fd		File descriptor
+ * @ret ok		Success indicator
+ */
+static int set_fd_data ( struct efi_boot_entry *entry, int fd ) {
+	GError *error = NULL;
+	GMappedFile *mapped;
+	GIOChannel *ioc;
+	GIOStatus status;
+	gchar *data;
+	gsize len;
+
+	/* Map file descriptor, if possible */
+	mapped = g_mapped_file_new_from_fd ( fd, FALSE, NULL );
+	if ( mapped )
+		return set_mapped_data ( entry, mapped );
+
+	/* Otherwise (e.g. for a pipe), read until end of file */
+	ioc = g_io_channel_unix_new ( fd );
+	g_io_channel_set_encoding ( ioc, NULL, NULL );
+	status = g_io_channel_read_to_end ( ioc, &data, &len, &error );
+	g_io_channel_unref ( ioc );
+	if ( status != G_IO_STATUS_NORMAL ) {
+		fprintf ( stderr, "Could not read additional data: %s\n",
+			  error->message );
+		g_error_free ( error );
+		errno = EIO;
+		return 0;
+	}
+
+	/* Hand over buffer without copying (GLib 2.46 and later
+	 * always allocates using malloc(), as required by the library).
+	 */
+	if ( ! efiboot_take_data ( entry, data, len ) ) {
+		perror ( "Could not set additional data" );
+		g_free ( data );
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Set boot entry additional data
+ *
+ * @v entry		EFI boot entry
+ * @ret ok		Success indicator
+ *
+ * Additional data may be provided as a base64-encoded string, as a
+ * file name, or as a file descriptor.  Files are memory-mapped to
+ * avoid both the command-line length limit and the base64 decoding
+ * overhead.
+ *
+ * Buffers allocated by GLib may be handed over to the boot entry,
+ * since g_malloc() always uses the system malloc() as of GLib 2.46.
+ */
+static int set_data ( struct efi_boot_entry *entry ) {
+	GError *error = NULL;
+	GMappedFile *mapped;
+	guchar *data;
+	gsize len;
+
+	/* Allow at most one source of additional data */
+	if ( ( ( data_value ? 1 : 0 ) + ( data_file_value ? 1 : 0 ) +
+	       ( ( data_fd_value >= 0 ) ? 1 : 0 ) ) > 1 ) {
+		fprintf ( stderr, "Conflicting additional data options\n" );
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Set additional data from base64 string, if applicable */
+	if ( data_value ) {
+		data = g_base64_decode ( data_value, &len );
+		if ( ! data ) {
+			fprintf ( stderr, "Invalid base64 additional data\n" );
+			errno = EINVAL;
+			return 0;
+		}
+		/* Hand over buffer without copying (see above) */
+		if ( ! efiboot_take_data ( entry, data, len ) ) {
+			perror ( "Could not set additional data" );
+			g_free ( data );
+			return 0;
+		}
+	}
+
+	/* Set additional data from file, if applicable */
+	if ( data_file_value ) {
+		mapped = g_mapped_file_new ( data_file_value, FALSE, &error );
+		if ( ! mapped ) {
+			fprintf ( stderr, "Could not open \"%s\": %s\n",
+				  data_file_value, error->message );
+			g_error_free ( error );
+			errno = ENOENT;
+			return 0;
+		}
+		if ( ! set_mapped_data ( entry, mapped ) )
+			return 0;
+	}
+
+	/* Set additional data from file descriptor, if applicable */
+	if ( data_fd_value >= 0 ) {
+		if ( ! set_fd_data ( entry, data_fd_value ) )
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Fit boot entry within platform variable size limit
+ *
+ * @v entry		Boot entry
+ * @ret ok		Success indicator
+ *
+ * Some platforms reject variables larger than a fixed limit well
+ * below the size of the variable store.  An entry that would exceed
+ * the limit for the identified platform is made to fit by using
+ * short-form device paths and then by trimming textual additional
+ * data, with a warning describing any such fallback.
+ */
+static int fit_entry ( struct efi_boot_entry *entry ) {
+	static const struct efi_boot_quirk *quirk;
+	const char *name;
+	unsigned int fallbacks;
+	size_t capacity;
+
+	/* Identify platform, if not already done */
+	if ( ! quirk ) {
+		if ( ! efiboot_capacity ( &capacity ) )
+			capacity = 0;
+		quirk = efiboot_quirk ( "", capacity );
+	}
+
+	/* Fit entry within limit */
+	if ( ! efiboot_fit ( entry, efiboot_quirk_max_len ( quirk ),
+			     &fallbacks ) ) {
+		perror ( "Could not fit entry within variable size limit" );
+		return 0;
+	}
+
+	/* Warn about any fallbacks used (noting that a new entry has
+	 * no variable name until it is saved).
+	 */
+	name = efiboot_name ( entry );
+	if ( ! name )
+		name = "new entry";
+	if ( fallbacks & EFIBOOT_FIT_SHORT_PATHS ) {
+		fprintf ( stderr, "Using short-form paths for %s to fit %s "
+			  "variable size limit\n", name,
+			  efiboot_quirk_name ( quirk ) );
+	}
+	if ( fallbacks & EFIBOOT_FIT_TRIM_DATA ) {
+		fprintf ( stderr, "Trimmed additional data for %s to fit %s "
+			  "variable size limit\n", name,
+			  efiboot_quirk_name ( quirk ) );
+	}
+
+	return 1;
+}
+
+/**
+ * Check that pending changes will fit within the variable store
+ *
+ * @ret ok		Success indicator
+ *
+ * The space required by all pending changes is calculated before
+ * anything is written, so that running out of variable store space
+ * cannot leave a partially applied set of changes.  Deletions are
+ * applied first, and so the space that they release is available
+ * to all subsequent writes.  The check is skipped if the remaining
+ * space cannot be determined.
+ */
+static int check_space ( void ) {
+	size_t space;
+	unsigned int i;
+
+	/* Get remaining space, if known */
+	if ( ! efiboot_space ( &space ) ) {
+		if ( errno == ENOTSUP )
+			return 1;
+		perror ( "Could not determine variable store space" );
+		return 0;
+	}
+
+	/* Release space occupied by deleted entries */
+	for ( i = 0 ; i < deleted_count ; i++ ) {
+		if ( ! efiboot_plan_del ( deleted[i], &space ) )
+			goto err_plan;
+	}
+
+	/* Charge space for saved entries and boot order */
+	for ( i = 0 ; i < entry_count ; i++ ) {
+		if ( entries[i] && ( ! efiboot_plan_save ( entries[i],
+							    &space ) ) )
+			goto err_plan;
+	}
+	if ( ! efiboot_plan_order ( type_value, order, entry_count,
+				    &space ) )
+		goto err_plan;
+
+	return 1;
+
+ err_plan:
+	perror ( "Could not fit changes in variable store" );
+	return 0;
+}
+
 /**
  * Set boot entry properties
  *
@@ -220,12 +582,15 @@ static void show_entry ( int pos ) {
  * @ret ok		Success indicator
  */
 static int set_entry ( int pos ) {
-	struct efi_boot_entry *entry = entries[pos];
-	uint8_t *data = NULL;
+	struct efi_boot_entry *entry;
 	unsigned int path_count;
-	size_t len;
 	int new_pos;
 
+	/* Get entry */
+	entry = get_entry ( pos );
+	if ( ! entry )
+		goto err_get_entry;
+
 	/* Set attributes */
 	if ( attributes_value ) {
 		if ( ! efiboot_set_attributes ( entry, attributes_value ) ) {
@@ -255,55 +620,55 @@ static int set_entry ( int pos ) {
 	}
 
 	/* Set additional data, if applicable */
-	if ( data_value ) {
-		data = g_base64_decode ( data_value, &len );
-		if ( ! data ) {
-			fprintf ( stderr, "Invalid base64 additional data\n" );
-			errno = EINVAL;
-			goto err_base64_decode;
-		}
-		if ( ! efiboot_set_data ( entry, data, len ) ) {
-			perror ( "Could not set additional data" );
-			goto err_set_data;
-		}
-	}
+	if ( ! set_data ( entry ) )
+		goto err_set_data;
+
+	/* Fit within platform variable size limit */
+	if ( ! fit_entry ( entry ) )
+		goto err_fit;
 
 	/* Set boot order position, if applicable */
 	if ( position_value ) {
 		new_pos = parse_position ( position_value );
 		if ( new_pos < 0 )
 			goto err_position;
-		if ( new_pos > pos ) {
-			memmove ( &entries[pos], &entries[pos + 1],
-				  ( ( new_pos - pos ) *
-				    sizeof ( entries[0] ) ) );
-		} else if ( new_pos < pos ) {
-			memmove ( &entries[new_pos + 1], &entries[new_pos],
-				  ( ( pos - new_pos ) *
-				    sizeof ( entries[0] ) ) );
-		}
-		entries[new_pos] = entry;
+		move_entry ( pos, new_pos );
+		pos = new_pos;
 	}
 
-	/* Save entries */
-	if ( ! efiboot_save_all ( type_value, entries ) ) {
-		perror ( "Could not save entries" );
-		goto err_save_all;
+	/* Defer saving until committed, if applicable */
+	if ( serving )
+		return 1;
+
+	/* Check available space */
+	if ( ! check_space() )
+		goto err_space;
+
+	/* Save entry (which may assign an index) */
+	if ( ! efiboot_save ( entry ) ) {
+		perror ( "Could not save entry" );
+		goto err_save;
 	}
+	order[pos] = efiboot_index ( entry );
 
-	/* Free decoded additional data */
-	g_free ( data );
+	/* Save boot order */
+	if ( ! efiboot_save_order ( type_value, order, entry_count ) ) {
+		perror ( "Could not update boot order" );
+		goto err_save_order;
+	}
 
 	return 1;
 
- err_save_all:
+ err_save_order:
+ err_save:
+ err_space:
  err_position:
+ err_fit:
  err_set_data:
-	g_free ( data );
- err_base64_decode:
  err_set_paths_text:
  err_set_description:
  err_set_attributes:
+ err_get_entry:
 	return 0;
 }
 
@@ -314,26 +679,64 @@ static int set_entry ( int pos ) {
  * @ret ok		Success indicator
  */
 static int delete_entry ( int pos ) {
-	struct efi_boot_entry *entry = entries[pos];
+	struct efi_boot_entry **tmp;
+	struct efi_boot_entry *entry;
+
+	/* Get entry */
+	entry = get_entry ( pos );
+	if ( ! entry )
+		goto err_get_entry;
+
+	/* Create space for deferred deletion, if applicable */
+	if ( serving ) {
+		tmp = realloc ( deleted, ( ( deleted_count + 1 ) *
+					   sizeof ( deleted[0] ) ) );
+		if ( ! tmp )
+			goto err_alloc_deleted;
+		deleted = tmp;
+	}
 
 	/* Remove from boot order list */
-	memmove ( &entries[pos], &entries[pos + 1],
-		  ( ( entry_count - pos ) * sizeof ( entries[0] ) ) );
+	move_entry ( pos, ( entry_count - 1 ) );
+	entries[entry_count - 1] = NULL;
 	entry_count--;
 
+	/* Defer deletion until committed, if applicable.  An entry
+	 * that has not yet been assigned an index was never saved, and
+	 * so can simply be discarded.
+	 */
+	if ( serving ) {
+		if ( efiboot_name ( entry ) ) {
+			deleted[deleted_count++] = entry;
+		} else {
+			efiboot_free ( entry );
+		}
+		return 1;
+	}
+
 	/* Save boot order list */
-	if ( ! efiboot_save_all ( type_value, entries ) ) {
+	if ( ! efiboot_save_order ( type_value, order, entry_count ) ) {
 		perror ( "Could not update boot order" );
-		return 0;
+		goto err_save_order;
 	}
 
 	/* Delete removed entry */
 	if ( ! efiboot_del ( entry ) ) {
 		perror ( "Could not delete entry" );
-		return 0;
+		goto err_del;
 	}
 
+	/* Free removed entry */
+	efiboot_free ( entry );
+
 	return 1;
+
+ err_del:
+ err_save_order:
+	efiboot_free ( entry );
+ err_alloc_deleted:
+ err_get_entry:
+	return 0;
 }
 
 /**
@@ -344,14 +747,74 @@ static int delete_entry ( int pos ) {
  * @ret ok		Success indicator
  */
 static int efibootshow_exec ( int argc, char **argv ) {
+	const EFI_DEVICE_PATH_PROTOCOL *path;
+	struct efi_boot_entry *entry;
+	struct efi_boot_iter *iter;
+	unsigned int order_pos;
+	unsigned int i;
 	int pos;
+	int ok = 0;
+
+	/* Index all paths, if applicable.  Short-form paths are
+	 * expanded against any full-form paths used by other entries.
+	 */
+	if ( expand_flag ) {
+		expand_index = efidp_index_new();
+		if ( ! expand_index ) {
+			perror ( "Could not index paths" );
+			goto err_index;
+		}
+		for ( pos = 0 ; pos < ( ( int ) entry_count ) ; pos++ ) {
+			entry = get_entry ( pos );
+			if ( ! entry )
+				goto err_add;
+			for ( i = 0 ; i < efiboot_path_count ( entry ) ; i++ ) {
+				path = efiboot_path ( entry, i );
+				if ( ! efidp_index_add ( expand_index,
+							 path ) ) {
+					perror ( "Could not index paths" );
+					goto err_add;
+				}
+			}
+		}
+	}
 
 	/* Show all or specified entries, as applicable */
-	if ( argc == 1 ) {
+	if ( ( argc == 1 ) && ( expand_index || serving ) ) {
+
+		/* Show all entries from the in-memory state */
+		for ( pos = 0 ; pos < ( ( int ) entry_count ) ; pos++ ) {
+			entry = get_entry ( pos );
+			if ( ! entry )
+				goto err_id;
+			show_entry ( pos, entry );
+		}
 
-		/* Show all entries */
-		for ( pos = 0 ; pos < ( ( int ) entry_count ) ; pos++ )
-			show_entry ( pos );
+	} else if ( argc == 1 ) {
+
+		/* Show all entries, loading each only as it is shown
+		 * so that output starts immediately and only a single
+		 * entry is held in memory at any time.  Entries are
+		 * shown with their boot order positions, which allow
+		 * for any boot order entries skipped by the iterator.
+		 */
+		iter = efiboot_iter_open ( type_value );
+		if ( ! iter ) {
+			perror ( "Could not load entries" );
+			goto err_iter;
+		}
+		while ( 1 ) {
+			if ( ! efiboot_iter_next ( iter, &entry,
+						   &order_pos ) ) {
+				perror ( "Could not load entry" );
+				efiboot_iter_close ( iter );
+				goto err_iter;
+			}
+			if ( ! entry )
+				break;
+			show_entry ( order_pos, entry );
+		}
+		efiboot_iter_close ( iter );
 
 	} else {
 
@@ -361,14 +824,26 @@ static int efibootshow_exec ( int argc, char **argv ) {
 			/* Parse entry ID */
 			pos = parse_id ( *argv );
 			if ( pos < 0 )
-				return 0;
+				goto err_id;
 
-			/* Show entry */
-			show_entry ( pos );
+			/* Load and show entry */
+			entry = get_entry ( pos );
+			if ( ! entry )
+				goto err_id;
+			show_entry ( pos, entry );
 		}
 	}
 
-	return 1;
+	/* Success */
+	ok = 1;
+
+ err_id:
+ err_iter:
+ err_add:
+	efidp_index_free ( expand_index );
+	expand_index = NULL;
+ err_index:
+	return ok;
 }
 
 /** "efibootshow" subcommand options */
@@ -389,11 +864,16 @@ static GOptionEntry efibootshow_options[] = {
 	  "Show all paths", NULL },
 	{ "data", 'x', 0, G_OPTION_ARG_NONE, &data_flag,
 	  "Show additional data", NULL },
+	{ "data-text", 'T', 0, G_OPTION_ARG_NONE, &data_text_flag,
+	  "Show additional data as text, where possible", NULL },
+	{ "expand", 'E', 0, G_OPTION_ARG_NONE, &expand_flag,
+	  "Show short-form paths expanded to full paths", NULL },
 	{}
 };
 
 /** "efibootshow" subcommand */
 struct efi_boot_command efibootshow = {
+	.name = "show",
 	.description = "[<position>|<name>...] - Show EFI boot entries",
 	.options = efibootshow_options,
 	.exec = efibootshow_exec,
@@ -407,6 +887,7 @@ struct efi_boot_command efibootshow = {
  * @ret ok		Success indicator
  */
 static int efibootmod_exec ( int argc, char **argv ) {
+	struct efi_boot_entry *orig = NULL;
 	int pos;
 
 	/* Identify entry */
@@ -422,9 +903,29 @@ static int efibootmod_exec ( int argc, char **argv ) {
 	if ( pos < 0 )
 		return 0;
 
+	/* Retain original entry while serving, so that a failed
+	 * modification leaves the in-memory state unchanged.
+	 */
+	if ( serving ) {
+		if ( ! get_entry ( pos ) )
+			return 0;
+		orig = efiboot_clone ( entries[pos] );
+		if ( ! orig ) {
+			perror ( "Could not clone entry" );
+			return 0;
+		}
+	}
+
 	/* Update entry */
-	if ( ! set_entry ( pos ) )
+	if ( ! set_entry ( pos ) ) {
+		if ( orig ) {
+			efiboot_free ( entries[pos] );
+			entries[pos] = orig;
+		}
 		return 0;
+	}
+	if ( orig )
+		efiboot_free ( orig );
 
 	return 1;
 }
@@ -443,11 +944,16 @@ static GOptionEntry efibootmod_options[] = {
 	  "Modify path(s)", "<path>..." },
 	{ "data", 'x', 0, G_OPTION_ARG_STRING, &data_value,
 	  "Modify additional data", "<base64 data>" },
+	{ "data-file", 'X', 0, G_OPTION_ARG_FILENAME, &data_file_value,
+	  "Modify additional data from file", "<file>" },
+	{ "data-fd", 0, 0, G_OPTION_ARG_INT, &data_fd_value,
+	  "Modify additional data from file descriptor", "<fd>" },
 	{}
 };
 
 /** "efibootmod" subcommand */
 struct efi_boot_command efibootmod = {
+	.name = "mod",
 	.description = "<position>|<name> - Modify EFI boot entry",
 	.options = efibootmod_options,
 	.exec = efibootmod_exec,
@@ -462,6 +968,7 @@ struct efi_boot_command efibootmod = {
  */
 static int efibootadd_exec ( int argc, char **argv ) {
 	struct efi_boot_entry *entry;
+	int pos;
 
 	/* Check arguments */
 	if ( argc > 1 ) {
@@ -483,11 +990,11 @@ static int efibootadd_exec ( int argc, char **argv ) {
 	if ( ! entry )
 		goto err_new;
 
-	/* Add to start of list */
-	memmove ( &entries[1], &entries[0],
-		  ( entry_count * sizeof ( entries[0] ) ) );
-	entries[0] = entry;
+	/* Add to start of list (with index to be assigned when saved) */
+	entries[entry_count] = entry;
+	order[entry_count] = 0;
 	entry_count++;
+	move_entry ( ( entry_count - 1 ), 0 );
 
 	/* Set type */
 	if ( ! efiboot_set_type ( entry, type_value ) ) {
@@ -499,17 +1006,19 @@ static int efibootadd_exec ( int argc, char **argv ) {
 	if ( ! set_entry ( 0 ) )
 		goto err_set_entry;
 
-	/* Show created variable name, if applicable */
-	if ( ! quiet_flag )
+	/* Show created variable name (which is not known until the
+	 * entry is saved), if applicable
+	 */
+	if ( ! ( quiet_flag || serving ) )
 		printf ( "%s\n", efiboot_name ( entry ) );
 
-	/* Free new entry */
-	efiboot_free ( entry );
-
 	return 1;
 
  err_set_entry:
  err_set_type:
+	for ( pos = 0 ; entries[pos] != entry ; pos++ ) {}
+	move_entry ( pos, ( entry_count - 1 ) );
+	entries[--entry_count] = NULL;
 	efiboot_free ( entry );
  err_new:
  err_args:
@@ -530,6 +1039,10 @@ static GOptionEntry efibootadd_options[] = {
 	  "Path(s)", "<path>..." },
 	{ "data", 'x', 0, G_OPTION_ARG_STRING, &data_value,
 	  "Additional data", "<base64 data>" },
+	{ "data-file", 'X', 0, G_OPTION_ARG_FILENAME, &data_file_value,
+	  "Additional data from file", "<file>" },
+	{ "data-fd", 0, 0, G_OPTION_ARG_INT, &data_fd_value,
+	  "Additional data from file descriptor", "<fd>" },
 	{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet_flag,
 	  "Do not show created variable name", NULL },
 	{}
@@ -537,6 +1050,7 @@ static GOptionEntry efibootadd_options[] = {
 
 /** "efibootadd" subcommand */
 struct efi_boot_command efibootadd = {
+	.name = "add",
 	.description = "- Add EFI boot entry",
 	.options = efibootadd_options,
 	.exec = efibootadd_exec,
@@ -581,82 +1095,480 @@ static GOptionEntry efibootdel_options[] = {
 
 /** "efibootdel" subcommand */
 struct efi_boot_command efibootdel = {
+	.name = "del",
 	.description = "<position>|<name> - Delete EFI boot entry",
 	.options = efibootdel_options,
 	.exec = efibootdel_exec,
 };
 
 /**
- * Invoke subcommand
+ * Compact entry indices
+ *
+ * @v argc		Number of remaining command-line arguments
+ * @v argv		Remaining command-line arguments
+ * @ret ok		Success indicator
+ */
+static int efibootcompact_exec ( int argc, char **argv ) {
+
+	/* Check arguments */
+	( void ) argv;
+	if ( argc > 1 ) {
+		fprintf ( stderr, "Too many arguments\n" );
+		return 0;
+	}
+
+	/* Refuse while serving, since loaded entries would be stale */
+	if ( serving ) {
+		fprintf ( stderr, "Cannot compact while serving\n" );
+		errno = ENOTSUP;
+		return 0;
+	}
+
+	/* Compact indices */
+	if ( ! efiboot_compact ( type_value ) ) {
+		perror ( "Could not compact entries" );
+		return 0;
+	}
+
+	return 1;
+}
+
+/** "efibootcompact" subcommand options */
+static GOptionEntry efibootcompact_options[] = {
+	{ "type", 't', 0, G_OPTION_ARG_CALLBACK, parse_type,
+	  "Load option type", "boot|driver|sysprep" },
+	{}
+};
+
+/** "efibootcompact" subcommand */
+struct efi_boot_command efibootcompact = {
+	.name = "compact",
+	.description = "- Renumber EFI boot entries into the lowest indices",
+	.options = efibootcompact_options,
+	.exec = efibootcompact_exec,
+};
+
+/** Subcommands available by name */
+static struct efi_boot_command *commands[] = {
+	&efibootshow,
+	&efibootadd,
+	&efibootmod,
+	&efibootdel,
+	&efibootcompact,
+};
+
+/**
+ * Find subcommand by name
  *
+ * @v name		Subcommand name
+ * @ret cmd		Subcommand, or NULL if not found
+ */
+struct efi_boot_command * efiboot_named_command ( const char *name ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < ( sizeof ( commands ) / sizeof ( commands[0] ) ) ;
+	      i++ ) {
+		if ( strcmp ( commands[i]->name, name ) == 0 )
+			return commands[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Parse subcommand options
+ *
+ * @v cmd		Subcommand
  * @v argc		Number of command-line arguments
  * @v argv		Command-line arguments
- * @v cmd		Subcommand
  * @ret ok		Success indicator
  */
-int efiboot_command ( int argc, char **argv, struct efi_boot_command *cmd ) {
-	struct efi_boot_entry **tmp;
+static int parse_options ( struct efi_boot_command *cmd, int *argc,
+			   char ***argv ) {
 	GError *error = NULL;
 	GOptionContext *context;
+	int ok = 0;
 	int i;
 
-	/* Parse command-line options */
+	/* Parse options.  Help is disabled while serving requests,
+	 * since GLib would otherwise exit after showing help.
+	 */
 	context = g_option_context_new ( cmd->description );
 	g_option_context_add_main_entries ( context, cmd->options, NULL );
-	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+	g_option_context_set_help_enabled ( context, ( ! serving ) );
+	if ( ! g_option_context_parse ( context, argc, argv, &error ) ) {
 		g_printerr ( "Could not parse options: %s\n", error->message );
-		goto err_args;
+		g_error_free ( error );
+		goto err_parse;
 	}
 
 	/* Strip trailing "--" if present.  Not sure why GLib doesn't
 	 * do this automatically.
 	 */
-	if ( ( argc > 1 ) && ( strcmp ( argv[1], "--" ) == 0 ) ) {
-		argc--;
-		for ( i = 1 ; i < argc ; i++ )
-			argv[i] = argv[i + 1];
+	if ( ( *argc > 1 ) && ( strcmp ( (*argv)[1], "--" ) == 0 ) ) {
+		(*argc)--;
+		for ( i = 1 ; i < *argc ; i++ )
+			(*argv)[i] = (*argv)[i + 1];
 	}
 
-	/* Get list of boot entries */
-	tmp = efiboot_load_all ( type_value );
-	if ( ! tmp ) {
+	/* Success */
+	ok = 1;
+
+ err_parse:
+	g_option_context_free ( context );
+	return ok;
+}
+
+/**
+ * Invoke subcommand
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @v cmd		Subcommand
+ * @ret ok		Success indicator
+ */
+int efiboot_command ( int argc, char **argv, struct efi_boot_command *cmd ) {
+	uint16_t *tmp;
+	int ok = 0;
+	int i;
+
+	/* Parse command-line options */
+	if ( ! parse_options ( cmd, &argc, &argv ) )
+		goto err_args;
+
+	/* Get boot order.  Individual entries are loaded only when
+	 * needed, so that modifying or deleting a single entry does
+	 * not require reading every entry.
+	 */
+	order = efiboot_load_order ( type_value, &entry_count );
+	if ( ! order ) {
 		perror ( "No entries found" );
-		goto err_load_all;
+		goto err_load_order;
 	}
 
-	/* Create copy of boot entries with space for additional entry */
-	entry_count = 0;
-	while ( tmp[entry_count] )
-		entry_count++;
-	entries = malloc ( ( entry_count + 1 /* extra */ + 1 /* NULL */ ) *
+	/* Create space for additional entry */
+	tmp = realloc ( order, ( ( entry_count + 1 /* extra */ ) *
+				 sizeof ( order[0] ) ) );
+	if ( ! tmp )
+		goto err_alloc_order;
+	order = tmp;
+	entries = calloc ( ( entry_count + 1 /* extra */ ),
 			   sizeof ( entries[0] ) );
 	if ( ! entries )
 		goto err_alloc_entries;
-	memcpy ( entries, tmp, ( entry_count * sizeof ( entries[0] ) ) );
-	entries[entry_count] = NULL;
-	entries[entry_count + 1] = NULL;
+
+	/* Load all entries in advance, if applicable */
+	if ( cmd->load_all ) {
+		for ( i = 0 ; i < ( ( int ) entry_count ) ; i++ ) {
+			if ( ! get_entry ( i ) )
+				goto err_load;
+		}
+	}
 
 	/* Invoke subcommand */
 	if ( ! cmd->exec ( argc, argv ) )
 		goto err_exec;
 
-	/* Free copy of boot entries */
+	/* Success */
+	ok = 1;
+
+ err_exec:
+ err_load:
+	for ( i = 0 ; i < ( ( int ) entry_count ) ; i++ ) {
+		if ( entries[i] )
+			efiboot_free ( entries[i] );
+	}
 	free ( entries );
+ err_alloc_entries:
+ err_alloc_order:
+	free ( order );
+ err_load_order:
+ err_args:
+	return ok;
+}
 
-	/* Free original list of boot entries */
-	efiboot_free_all ( tmp );
+/**
+ * Reset subcommand options to their default values
+ *
+ * Option values parsed by GLib are freed, since they would otherwise
+ * leak on every request.
+ */
+static void reset_options ( void ) {
+
+	position_flag = FALSE;
+	g_free ( ( void * ) position_value );
+	position_value = NULL;
+	name_flag = FALSE;
+	attributes_flag = FALSE;
+	attributes_value = 0;
+	description_flag = FALSE;
+	g_free ( ( void * ) description_value );
+	description_value = NULL;
+	path_flag = FALSE;
+	paths_flag = FALSE;
+	g_strfreev ( ( gchar ** ) paths_value );
+	paths_value = NULL;
+	data_flag = FALSE;
+	g_free ( ( void * ) data_value );
+	data_value = NULL;
+	data_text_flag = FALSE;
+	g_free ( ( void * ) data_file_value );
+	data_file_value = NULL;
+	data_fd_value = -1;
+	quiet_flag = FALSE;
+	expand_flag = FALSE;
+}
 
-	/* Free option context */
-	g_option_context_free ( context );
+/**
+ * Reserve space for one additional entry
+ *
+ * @ret ok		Success indicator
+ */
+static int reserve_entry ( void ) {
+	struct efi_boot_entry **tmp_entries;
+	uint16_t *tmp_order;
+
+	/* Extend boot order */
+	tmp_order = realloc ( order, ( ( entry_count + 1 /* extra */ ) *
+				       sizeof ( order[0] ) ) );
+	if ( ! tmp_order )
+		return 0;
+	order = tmp_order;
+
+	/* Extend list of entries */
+	tmp_entries = realloc ( entries, ( ( entry_count + 1 /* extra */ ) *
+					   sizeof ( entries[0] ) ) );
+	if ( ! tmp_entries )
+		return 0;
+	entries = tmp_entries;
+	entries[entry_count] = NULL;
 
 	return 1;
+}
 
- err_exec:
-	free ( entries );
- err_alloc_entries:
-	efiboot_free_all ( tmp );
- err_load_all:
-	g_option_context_free ( context );
- err_args:
-	return 0;
+/**
+ * Commit deferred changes
+ *
+ * @ret ok		Success indicator
+ *
+ * The variable name of each newly created entry is shown as it is
+ * saved.
+ */
+static int commit ( void ) {
+	struct efi_boot_entry *entry;
+	bool created;
+	int pos;
+
+	/* Check available space before writing anything */
+	if ( ! check_space() )
+		return 0;
+
+	/* Delete removed entries */
+	while ( deleted_count ) {
+		entry = deleted[ deleted_count - 1 ];
+		if ( ! efiboot_del ( entry ) ) {
+			perror ( "Could not delete entry" );
+			return 0;
+		}
+		efiboot_free ( entry );
+		deleted_count--;
+	}
+
+	/* Save loaded entries (which may assign indices) */
+	for ( pos = 0 ; pos < ( ( int ) entry_count ) ; pos++ ) {
+		entry = entries[pos];
+		if ( ! entry )
+			continue;
+		created = ( ! efiboot_name ( entry ) );
+		if ( ! efiboot_save ( entry ) ) {
+			perror ( "Could not save entry" );
+			return 0;
+		}
+		order[pos] = efiboot_index ( entry );
+		if ( created )
+			printf ( "%s\n", efiboot_name ( entry ) );
+	}
+
+	/* Save boot order */
+	if ( ! efiboot_save_order ( type_value, order, entry_count ) ) {
+		perror ( "Could not update boot order" );
+		return 0;
+	}
+
+	return 1;
 }
+
+/**
+ * Handle request
+ *
+ * @v argc		Number of request arguments
+ * @v argv		Request arguments
+ * @ret ok		Success indicator
+ */
+static int serve_request ( int argc, char **argv ) {
+	enum efi_boot_option_type type = type_value;
+	struct efi_boot_command *cmd;
+
+	/* Reset options left over from any previous request */
+	reset_options();
+
+	/* Handle commit request */
+	if ( strcmp ( argv[0], "commit" ) == 0 ) {
+		if ( argc > 1 ) {
+			fprintf ( stderr, "Too many arguments\n" );
+			return 0;
+		}
+		return commit();
+	}
+
+	/* Identify subcommand */
+	cmd = efiboot_named_command ( argv[0] );
+	if ( ! cmd ) {
+		fprintf ( stderr, "Unknown request \"%s\"\n", argv[0] );
+		return 0;
+	}
+
+	/* Parse options */
+	if ( ! parse_options ( cmd, &argc, &argv ) )
+		return 0;
+	if ( type_value != type ) {
+		fprintf ( stderr, "Cannot change type while serving\n" );
+		type_value = type;
+		return 0;
+	}
+
+	/* Create space for additional entry */
+	if ( ! reserve_entry() )
+		return 0;
+
+	/* Invoke subcommand */
+	return cmd->exec ( argc, argv );
+}
+
+/**
+ * Read request line
+ *
+ * @v line		Line to fill in
+ * @ret ok		Success indicator (or false at end of input)
+ *
+ * The line is read one character at a time, since getline() is not
+ * available on all platforms and fgets() cannot report the length
+ * of a line containing NUL bytes.  Any NUL bytes are retained, so
+ * that the caller may reject the request.
+ */
+static int read_request ( GString *line ) {
+	int c;
+
+	g_string_truncate ( line, 0 );
+	while ( ( c = getchar() ) != EOF ) {
+		g_string_append_c ( line, c );
+		if ( c == '\n' )
+			break;
+	}
+	return ( line->len != 0 );
+}
+
+/**
+ * Serve requests
+ *
+ * @v argc		Number of remaining command-line arguments
+ * @v argv		Remaining command-line arguments
+ * @ret ok		Success indicator
+ */
+static int efibootserve_exec ( int argc, char **argv ) {
+	GError *error = NULL;
+	gchar **reqv;
+	gchar **args;
+	gint reqc;
+	GString *line;
+	int ok;
+
+	/* Check arguments */
+	if ( argc > 1 ) {
+		fprintf ( stderr, "Too many arguments\n" );
+		return 0;
+	}
+	( void ) argv;
+
+	/* Handle requests until end of input */
+	serving = true;
+	line = g_string_new ( NULL );
+	while ( read_request ( line ) ) {
+
+		/* Reject requests containing NUL bytes */
+		if ( strlen ( line->str ) != line->len ) {
+			fprintf ( stderr, "Invalid request: contains NUL\n" );
+			printf ( "ERROR\n" );
+			fflush ( stdout );
+			continue;
+		}
+
+		/* Split request into arguments */
+		if ( ! g_shell_parse_argv ( line->str, &reqc, &reqv,
+					    &error ) ) {
+			fprintf ( stderr, "Invalid request: %s\n",
+				  error->message );
+			g_clear_error ( &error );
+			printf ( "ERROR\n" );
+			fflush ( stdout );
+			continue;
+		}
+		if ( strcmp ( reqv[0], "quit" ) == 0 ) {
+			g_strfreev ( reqv );
+			break;
+		}
+
+		/* Handle request.  Option parsing may rearrange the
+		 * argument list, so pass a copy of the list to ensure
+		 * that all arguments are eventually freed.
+		 */
+		args = g_new ( gchar *, ( reqc + 1 ) );
+		memcpy ( args, reqv, ( ( reqc + 1 ) * sizeof ( args[0] ) ) );
+		ok = serve_request ( reqc, args );
+		g_free ( args );
+		g_strfreev ( reqv );
+
+		/* Terminate response */
+		printf ( "%s\n", ( ok ? "OK" : "ERROR" ) );
+		fflush ( stdout );
+	}
+	serving = false;
+	reset_options();
+	g_string_free ( line, TRUE );
+
+	/* Discard any uncommitted deletions */
+	while ( deleted_count )
+		efiboot_free ( deleted[--deleted_count] );
+	free ( deleted );
+	deleted = NULL;
+
+	return 1;
+}
+
+/** "efiboot --serve-stdio" subcommand options */
+static GOptionEntry efibootserve_options[] = {
+	{ "type", 't', 0, G_OPTION_ARG_CALLBACK, parse_type,
+	  "Load option type", "boot|driver|sysprep" },
+	{}
+};
+
+/** "efiboot --serve-stdio" subcommand
+ *
+ * Each request is a single line holding a subcommand name ("show",
+ * "add", "mod" or "del") followed by its options and arguments,
+ * "commit", or "quit".  Arguments are split as for a POSIX shell.
+ * Each response consists of any output from the request followed by
+ * a line containing either "OK" or "ERROR".  Error messages are
+ * written to standard error.
+ *
+ * Boot entries are loaded once and held in memory.  Changes are
+ * made only to the in-memory state until a "commit" request writes
+ * them to EFI variables, showing the name of each created entry.
+ * Uncommitted changes are discarded at end of input or on "quit".
+ */
+struct efi_boot_command efibootserve = {
+	.name = "--serve-stdio",
+	.description = "- Serve EFI boot entry requests on standard input",
+	.options = efibootserve_options,
+	.exec = efibootserve_exec,
+};
@@ -16,6 +16,10 @@ extern struct efi_boot_command efibootshow;
 extern struct efi_boot_command efibootmod;
 extern struct efi_boot_command efibootadd;
 extern struct efi_boot_command efibootdel;
+extern struct efi_boot_command efibootcompact;
+extern struct efi_boot_command efibootserve;
+
+extern struct efi_boot_command * efiboot_named_command ( const char *name );
 
 extern int efiboot_command ( int argc, char **argv,
 			     struct efi_boot_command *cmd );
@@ -9,13 +9,16 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <setjmp.h>
 #include <string.h>
+#include <errno.h>
 #include <cmocka.h>
 #include <efibootdev.h>
 
 #include "efidevpathtest.h"
 #include "efibootdevtest.h"
+#include "config.h"
 
 /** An EFI boot entry test point */
 struct efi_boot_entry_test {
@@ -377,3 +380,740 @@ void test_varname ( void **state ) {
 	assert_null ( efiboot_name ( entry ) );
 	efiboot_free ( entry );
 }
+
+/** Test optional data ownership transfer */
+void test_takedata ( void **state ) {
+	struct efi_boot_entry *entry;
+	uint8_t *data;
+
+	( void ) state;
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	data = malloc ( 3 );
+	assert_non_null ( data );
+	data[0] = 0x01;
+	data[1] = 0x02;
+	data[2] = 0x03;
+	assert_true ( efiboot_take_data ( entry, data, 3 ) );
+	assert_ptr_equal ( efiboot_data ( entry ), data );
+	assert_int_equal ( efiboot_data_len ( entry ), 3 );
+	data = malloc ( 1 );
+	assert_non_null ( data );
+	assert_true ( efiboot_take_data ( entry, data, 0 ) );
+	assert_null ( efiboot_data ( entry ) );
+	assert_int_equal ( efiboot_data_len ( entry ), 0 );
+	efiboot_free ( entry );
+}
+
+/** Windows Boot Manager BCD object reference */
+#define BCDOBJECT "BCDOBJECT={9dea862c-5cdd-4e70-acc1-f32b344d4795}"
+
+/** Test optional data format identification */
+void test_dataformat ( void **state ) {
+	static const CHAR16 cmdline[] = L"root=/dev/sda1 quiet";
+	static const char ascii[] = "console=ttyS0";
+	static const uint8_t binary[] = { 0x01, 0x02, 0x03, 0x04 };
+	static const struct {
+		char signature[8];
+		uint32_t version;
+		uint32_t len;
+		uint32_t offset;
+		CHAR16 bcdobject[50];
+	} __attribute__ (( packed )) windows = {
+		.signature = "WINDOWS",
+		.version = 1,
+		.len = sizeof ( windows ),
+		.offset = 0x10,
+		.bcdobject = L"" BCDOBJECT,
+	};
+	struct efi_boot_entry *entry;
+
+	( void ) state;
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	assert_int_equal ( efiboot_data_format ( entry ), EFIBOOT_DATA_NONE );
+	assert_null ( efiboot_data_text ( entry ) );
+	assert_true ( efiboot_set_data ( entry, cmdline, sizeof ( cmdline ) ) );
+	assert_int_equal ( efiboot_data_format ( entry ), EFIBOOT_DATA_UCS2 );
+	assert_string_equal ( efiboot_data_text ( entry ),
+			      "root=/dev/sda1 quiet" );
+	assert_true ( efiboot_set_data ( entry, cmdline,
+					 ( sizeof ( cmdline ) - 2 ) ) );
+	assert_string_equal ( efiboot_data_text ( entry ),
+			      "root=/dev/sda1 quiet" );
+	assert_true ( efiboot_set_data ( entry, ascii, sizeof ( ascii ) ) );
+	assert_int_equal ( efiboot_data_format ( entry ), EFIBOOT_DATA_ASCII );
+	assert_string_equal ( efiboot_data_text ( entry ), "console=ttyS0" );
+	assert_ptr_equal ( efiboot_data_text ( entry ),
+			   efiboot_data ( entry ) );
+	assert_true ( efiboot_set_data ( entry, &windows,
+					 sizeof ( windows ) ) );
+	assert_int_equal ( efiboot_data_format ( entry ),
+			   EFIBOOT_DATA_WINDOWS );
+	assert_string_equal ( efiboot_data_text ( entry ), BCDOBJECT );
+	assert_true ( efiboot_set_data ( entry, binary, sizeof ( binary ) ) );
+	assert_int_equal ( efiboot_data_format ( entry ),
+			   EFIBOOT_DATA_BINARY );
+	assert_null ( efiboot_data_text ( entry ) );
+	assert_string_equal ( efiboot_data_format_name ( EFIBOOT_DATA_UCS2 ),
+			      "ucs2" );
+	efiboot_free ( entry );
+}
+
+/**
+ * Test EFI boot entry device paths
+ *
+ * @v entry		EFI boot entry
+ * @v texts		Expected device path textual representations
+ * @v count		Expected number of device paths
+ */
+static void assert_efiboot_paths ( const struct efi_boot_entry *entry,
+				   const char **texts, unsigned int count ) {
+	unsigned int i;
+
+	assert_int_equal ( efiboot_path_count ( entry ), count );
+	for ( i = 0 ; i < count ; i++ ) {
+		assert_efidp_from_text ( texts[i], efiboot_path ( entry, i ) );
+		assert_efidp_from_text ( efiboot_path_text ( entry, i ),
+					 efiboot_path ( entry, i ) );
+	}
+}
+
+/** Test in-place device path editing */
+void test_splicepath ( void **state ) {
+	static const char *paths[2] = {
+		"PciRoot(0x0)/Pci(0x1,0x2)/Ata(0x0)",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *inserted[3] = {
+		"PciRoot(0x0)/Pci(0x1,0x2)/Ata(0x0)",
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *removed[2] = {
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *appended[3] = {
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+	};
+	static const char *replaced[3] = {
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+		"PciRoot(0x0)/Pci(0x1,0x2)/Ata(0x0)",
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+	};
+	struct efi_boot_entry *entry;
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	const char *text;
+
+	( void ) state;
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	assert_true ( efiboot_set_paths_text ( entry, paths, 2 ) );
+	assert_efiboot_paths ( entry, paths, 2 );
+
+	/* Insert path, retaining cached text of untouched paths */
+	text = efiboot_path_text ( entry, 1 );
+	path = efidp_from_text ( inserted[1], false );
+	assert_non_null ( path );
+	assert_true ( efiboot_insert_path ( entry, 1, path ) );
+	assert_ptr_equal ( efiboot_path_text ( entry, 2 ), text );
+	assert_efiboot_paths ( entry, inserted, 3 );
+
+	/* Remove path */
+	assert_false ( efiboot_remove_path ( entry, 3 ) );
+	assert_true ( efiboot_remove_path ( entry, 0 ) );
+	assert_ptr_equal ( efiboot_path_text ( entry, 1 ), text );
+	assert_efiboot_paths ( entry, removed, 2 );
+
+	/* Append a path from within the entry itself */
+	assert_true ( efiboot_append_path ( entry,
+					    efiboot_path ( entry, 0 ) ) );
+	assert_efiboot_paths ( entry, appended, 3 );
+
+	/* Replace path */
+	free ( path );
+	path = efidp_from_text ( replaced[1], false );
+	assert_non_null ( path );
+	assert_true ( efiboot_set_path ( entry, 1, path ) );
+	assert_efiboot_paths ( entry, replaced, 3 );
+
+	/* Check that final path cannot be removed */
+	assert_true ( efiboot_remove_path ( entry, 2 ) );
+	assert_true ( efiboot_remove_path ( entry, 1 ) );
+	assert_false ( efiboot_remove_path ( entry, 0 ) );
+	assert_int_equal ( efiboot_path_count ( entry ), 1 );
+
+	free ( path );
+	efiboot_free ( entry );
+}
+
+/** Test copy-on-write cloning */
+void test_clone ( void **state ) {
+	static const char *paths[2] = {
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+	};
+	static const char *modified[2] = {
+		"PciRoot(0x0)/Pci(0x4,0x0)/MAC(525400abcdef,0x1)",
+		"Uri(http://boot.ipxe.org/demo/boot.php)",
+	};
+	static const char data[] = "console=ttyS0";
+	struct efi_boot_entry *orig;
+	struct efi_boot_entry *clone;
+	const char *text;
+
+	( void ) state;
+	orig = efiboot_new();
+	assert_non_null ( orig );
+	assert_true ( efiboot_set_type ( orig, EFIBOOT_TYPE_DRIVER ) );
+	assert_true ( efiboot_set_index ( orig, 0x0042 ) );
+	assert_true ( efiboot_set_description ( orig, "iPXE" ) );
+	assert_true ( efiboot_set_paths_text ( orig, paths, 2 ) );
+	assert_true ( efiboot_set_data ( orig, data, sizeof ( data ) ) );
+	text = efiboot_path_text ( orig, 1 );
+	assert_non_null ( text );
+
+	/* Check that clone shares storage with original */
+	clone = efiboot_clone ( orig );
+	assert_non_null ( clone );
+	assert_int_equal ( efiboot_type ( clone ), EFIBOOT_TYPE_DRIVER );
+	assert_int_equal ( efiboot_index ( clone ), EFIBOOT_INDEX_AUTO );
+	assert_ptr_equal ( efiboot_description ( clone ),
+			   efiboot_description ( orig ) );
+	assert_ptr_equal ( efiboot_path ( clone, 0 ),
+			   efiboot_path ( orig, 0 ) );
+	assert_ptr_equal ( efiboot_data ( clone ), efiboot_data ( orig ) );
+	assert_string_equal ( efiboot_data_text ( clone ), data );
+	assert_efiboot_paths ( clone, paths, 2 );
+
+	/* Modify clone without affecting original */
+	assert_true ( efiboot_set_path_text ( clone, 0, modified[0] ) );
+	assert_efiboot_paths ( clone, modified, 2 );
+	assert_efiboot_paths ( orig, paths, 2 );
+	assert_ptr_equal ( efiboot_path_text ( orig, 1 ), text );
+	assert_true ( efiboot_set_description ( clone, "iPXE (NIC 2)" ) );
+	assert_string_equal ( efiboot_description ( clone ), "iPXE (NIC 2)" );
+	assert_string_equal ( efiboot_description ( orig ), "iPXE" );
+	efiboot_clear_data ( clone );
+	assert_null ( efiboot_data ( clone ) );
+	assert_memory_equal ( efiboot_data ( orig ), data, sizeof ( data ) );
+
+	/* Check that clone outlives original */
+	efiboot_free ( orig );
+	assert_string_equal ( efiboot_description ( clone ), "iPXE (NIC 2)" );
+	assert_efiboot_paths ( clone, modified, 2 );
+	efiboot_free ( clone );
+}
+
+/**
+ * Create list of boot entries for snapshot tests
+ *
+ * @v description	Description
+ * @v count		Number of boot entries
+ * @ret entries		Boot entries (NULL-terminated)
+ */
+static struct efi_boot_entry ** snapshot_entries ( const char *description,
+						   unsigned int count ) {
+	static const char *path = "Uri(http://boot.ipxe.org/demo/boot.php)";
+	struct efi_boot_entry **entries;
+	unsigned int i;
+
+	entries = calloc ( ( count + 1 ), sizeof ( entries[0] ) );
+	assert_non_null ( entries );
+	for ( i = 0 ; i < count ; i++ ) {
+		entries[i] = efiboot_new();
+		assert_non_null ( entries[i] );
+		assert_true ( efiboot_set_index ( entries[i], i ) );
+		assert_true ( efiboot_set_description ( entries[i],
+							description ) );
+		assert_true ( efiboot_set_paths_text ( entries[i], &path, 1 ) );
+	}
+	return entries;
+}
+
+/** Test snapshot publication */
+void test_snapshot ( void **state ) {
+	struct efi_boot_publisher *publisher;
+	struct efi_boot_snapshot *snapshot;
+	struct efi_boot_snapshot *old;
+	struct efi_boot_snapshot *new;
+	const struct efi_boot_entry *entry;
+
+	( void ) state;
+	publisher = efiboot_publisher_new();
+	assert_non_null ( publisher );
+
+	/* Check that nothing is initially published */
+	assert_null ( efiboot_pin ( publisher ) );
+
+	/* Publish and pin initial snapshot */
+	snapshot = efiboot_snapshot_take ( snapshot_entries ( "old", 2 ) );
+	assert_non_null ( snapshot );
+	assert_int_equal ( efiboot_snapshot_count ( snapshot ), 2 );
+	efiboot_publish ( publisher, snapshot );
+	old = efiboot_pin ( publisher );
+	assert_ptr_equal ( old, snapshot );
+	entry = efiboot_snapshot_entry ( old, 1 );
+	assert_non_null ( entry );
+	assert_int_equal ( efiboot_index ( entry ), 1 );
+	assert_null ( efiboot_snapshot_entry ( old, 2 ) );
+
+	/* Publish replacement snapshot */
+	snapshot = efiboot_snapshot_take ( snapshot_entries ( "new", 3 ) );
+	assert_non_null ( snapshot );
+	efiboot_publish ( publisher, snapshot );
+	new = efiboot_pin ( publisher );
+	assert_ptr_equal ( new, snapshot );
+	assert_int_equal ( efiboot_snapshot_count ( new ), 3 );
+	assert_string_equal ( efiboot_description ( efiboot_snapshot_entry (
+						    new, 2 ) ), "new" );
+
+	/* Check that pinned snapshot remains unchanged */
+	assert_int_equal ( efiboot_snapshot_count ( old ), 2 );
+	assert_ptr_equal ( efiboot_snapshot_entry ( old, 1 ), entry );
+	assert_string_equal ( efiboot_description ( entry ), "old" );
+	assert_string_equal ( efiboot_path_text ( entry, 0 ),
+			      "Uri(http://boot.ipxe.org/demo/boot.php)" );
+
+	/* Check that snapshots outlive publication point */
+	efiboot_snapshot_put ( old );
+	efiboot_publisher_free ( publisher );
+	assert_string_equal ( efiboot_description ( efiboot_snapshot_entry (
+						    new, 0 ) ), "new" );
+	efiboot_snapshot_put ( new );
+}
+
+/**
+ * Check restored boot order
+ *
+ * @v order		Current boot order
+ * @v count		Number of current boot order entries
+ * @v intended		Intended boot order
+ * @v intended_count	Number of intended boot order entries
+ * @v expected		Expected restored boot order
+ * @v expected_count	Number of expected boot order entries
+ */
+static void assert_order_restore ( const uint16_t *order, unsigned int count,
+				   const uint16_t *intended,
+				   unsigned int intended_count,
+				   const uint16_t *expected,
+				   unsigned int expected_count ) {
+	uint16_t restored[16];
+
+	assert_true ( ( count + intended_count ) <=
+		      ( sizeof ( restored ) / sizeof ( restored[0] ) ) );
+	assert_int_equal ( efiboot_order_restore ( order, count, intended,
+						   intended_count, restored ),
+			   expected_count );
+	assert_memory_equal ( restored, expected,
+			      ( expected_count * sizeof ( expected[0] ) ) );
+}
+
+/** Test boot order restoration */
+void test_orderrestore ( void **state ) {
+	static const uint16_t intended[] = { 3, 1, 2 };
+	static const uint16_t intact[] = { 3, 1, 2, 7 };
+	static const uint16_t prepended[] = { 9, 3, 1, 8, 2 };
+	static const uint16_t restored[] = { 3, 1, 2, 9, 8 };
+	static const uint16_t reordered[] = { 2, 7, 1, 3 };
+	static const uint16_t removed[] = { 9, 2 };
+	static const uint16_t reinstated[] = { 3, 1, 2, 9 };
+
+	( void ) state;
+
+	/* Intact boot order is left unchanged */
+	assert_order_restore ( intact, 4, intended, 3, intact, 4 );
+
+	/* Prepended entries are moved after intended entries */
+	assert_order_restore ( prepended, 5, intended, 3, restored, 5 );
+
+	/* Reordered entries are put back in order */
+	assert_order_restore ( reordered, 4, intended, 3, intact, 4 );
+
+	/* Removed entries are reinstated */
+	assert_order_restore ( removed, 2, intended, 3, reinstated, 4 );
+
+	/* Empty intended boot order leaves boot order unchanged */
+	assert_order_restore ( prepended, 5, intended, 0, prepended, 5 );
+}
+
+/**
+ * Get length of EFI load option for boot entry
+ *
+ * @v entry		EFI boot entry
+ * @ret len		Length of EFI load option
+ */
+static size_t option_len ( const struct efi_boot_entry *entry ) {
+	EFI_LOAD_OPTION *option;
+	size_t len;
+
+	option = efiboot_to_option ( entry, &len );
+	assert_non_null ( option );
+	free ( option );
+	return len;
+}
+
+/** Test fitting boot entries within a size limit */
+void test_fit ( void **state ) {
+	static const char *paths[1] = {
+		"PciRoot(0x0)/Pci(0x1,0x1)/Ata(0x0)/"
+		"HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x800,0x12C000)/"
+		"\\EFI\\BOOT\\BOOTX64.EFI",
+	};
+	static const CHAR16 cmdline[] = L"root=/dev/sda1 quiet";
+	static const uint8_t binary[] = { 0x01, 0x02, 0x03, 0x04 };
+	struct efi_boot_entry *entry;
+	unsigned int fallbacks;
+	size_t len;
+
+	( void ) state;
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	assert_true ( efiboot_set_description ( entry, "Linux" ) );
+	assert_true ( efiboot_set_paths_text ( entry, paths, 1 ) );
+	assert_true ( efiboot_set_data ( entry, cmdline, sizeof ( cmdline ) ) );
+	len = option_len ( entry );
+
+	/* Entries within the limit are left unchanged */
+	assert_true ( efiboot_fit ( entry, len, &fallbacks ) );
+	assert_int_equal ( fallbacks, 0 );
+	assert_true ( efiboot_fit ( entry, 0, &fallbacks ) );
+	assert_int_equal ( fallbacks, 0 );
+	assert_int_equal ( option_len ( entry ), len );
+
+	/* Paths are shortened first */
+	assert_true ( efiboot_fit ( entry, ( len - 1 ), &fallbacks ) );
+	assert_int_equal ( fallbacks, EFIBOOT_FIT_SHORT_PATHS );
+	assert_int_equal ( strncmp ( efiboot_path_text ( entry, 0 ), "HD(",
+				     3 ), 0 );
+	assert_int_equal ( efiboot_data_len ( entry ), sizeof ( cmdline ) );
+	len = option_len ( entry );
+
+	/* Textual data is then trimmed */
+	assert_true ( efiboot_fit ( entry, ( len - 12 ), &fallbacks ) );
+	assert_int_equal ( fallbacks, EFIBOOT_FIT_TRIM_DATA );
+	assert_int_equal ( option_len ( entry ), ( len - 12 ) );
+	assert_string_equal ( efiboot_data_text ( entry ), "root=/dev/sda1" );
+
+	/* Data cannot be trimmed beyond its terminating NUL */
+	len = ( option_len ( entry ) - efiboot_data_len ( entry ) );
+	assert_false ( efiboot_fit ( entry, len, &fallbacks ) );
+	assert_int_equal ( errno, E2BIG );
+
+	/* Binary data is never trimmed */
+	assert_true ( efiboot_set_data ( entry, binary, sizeof ( binary ) ) );
+	len = option_len ( entry );
+	assert_false ( efiboot_fit ( entry, ( len - 1 ), &fallbacks ) );
+	assert_int_equal ( errno, E2BIG );
+	assert_int_equal ( efiboot_data_len ( entry ), sizeof ( binary ) );
+
+	efiboot_free ( entry );
+}
+
+#ifdef EFIVAR_SIMULATED
+
+/** Device path used for stored test entries */
+#define STORED_PATH "PciRoot(0x0)/Pci(0x1,0x1)/Ata(0x0)"
+
+/**
+ * Create stored boot entry
+ *
+ * @v index		Boot entry index
+ * @ret ok		Success indicator
+ *
+ * The entry is given a description derived from its original index,
+ * so that it can be identified after renumbering.
+ */
+static int store_entry ( unsigned int index ) {
+	struct efi_boot_entry *entry;
+	char description[16];
+	int ok;
+
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	snprintf ( description, sizeof ( description ), "Entry %04X", index );
+	assert_true ( efiboot_set_index ( entry, index ) );
+	assert_true ( efiboot_set_attributes ( entry, LOAD_OPTION_ACTIVE ) );
+	assert_true ( efiboot_set_description ( entry, description ) );
+	assert_true ( efiboot_set_path_text ( entry, 0, STORED_PATH ) );
+	ok = efiboot_save ( entry );
+	efiboot_free ( entry );
+	return ok;
+}
+
+/**
+ * Create stored boot entries
+ *
+ * @v indices		Boot entry indices
+ * @v count		Number of boot entries
+ */
+static void store_entries ( const uint16_t *indices, unsigned int count ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < count ; i++ )
+		assert_true ( store_entry ( indices[i] ) );
+}
+
+/**
+ * Fill variable store with boot entries
+ *
+ * @v first		First boot entry index
+ * @ret last		Last boot entry index
+ *
+ * Entries are created until the variable store is full, and the last
+ * entry is then removed, leaving space for one more entry but not two.
+ */
+static unsigned int fill_entries ( unsigned int first ) {
+	struct efi_boot_entry *entry;
+	unsigned int index;
+
+	for ( index = first ; store_entry ( index ) ; index++ ) {}
+	assert_int_equal ( errno, ENOSPC );
+	assert_true ( index > first );
+	entry = efiboot_load ( EFIBOOT_TYPE_BOOT, --index );
+	assert_non_null ( entry );
+	assert_true ( efiboot_del ( entry ) );
+	efiboot_free ( entry );
+	return index;
+}
+
+/**
+ * Check stored boot entry
+ *
+ * @v index		Boot entry index
+ * @v original		Original boot entry index (or -1 if absent)
+ */
+static void assert_stored_entry ( unsigned int index, int original ) {
+	struct efi_boot_entry *entry;
+	char description[16];
+
+	entry = efiboot_load ( EFIBOOT_TYPE_BOOT, index );
+	if ( original < 0 ) {
+		assert_null ( entry );
+		assert_int_equal ( errno, ENOENT );
+		return;
+	}
+	assert_non_null ( entry );
+	snprintf ( description, sizeof ( description ), "Entry %04X",
+		   original );
+	assert_string_equal ( efiboot_description ( entry ), description );
+	efiboot_free ( entry );
+}
+
+/**
+ * Check stored boot order
+ *
+ * @v expected		Expected boot order
+ * @v count		Number of expected boot order entries
+ */
+static void assert_stored_order ( const uint16_t *expected,
+				  unsigned int count ) {
+	uint16_t *order;
+	unsigned int order_count;
+
+	order = efiboot_load_order ( EFIBOOT_TYPE_BOOT, &order_count );
+	assert_non_null ( order );
+	assert_int_equal ( order_count, count );
+	if ( count ) {
+		assert_memory_equal ( order, expected,
+				      ( count * sizeof ( order[0] ) ) );
+	}
+	free ( order );
+}
+
+/**
+ * Remove stored boot entries and boot order
+ *
+ * @v max		Maximum boot entry index to remove
+ */
+static void unstore_entries ( unsigned int max ) {
+	struct efi_boot_entry *entry;
+	uint16_t *order;
+	unsigned int count;
+	unsigned int i;
+
+	for ( i = 0 ; i <= max ; i++ ) {
+		entry = efiboot_load ( EFIBOOT_TYPE_BOOT, i );
+		if ( ! entry )
+			continue;
+		assert_true ( efiboot_del ( entry ) );
+		efiboot_free ( entry );
+	}
+	order = efiboot_load_order ( EFIBOOT_TYPE_BOOT, &count );
+	assert_non_null ( order );
+	if ( count ) {
+		assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT,
+						   order, 0 ) );
+	}
+	free ( order );
+}
+
+/** Test compaction of boot entry indices */
+void test_compact ( void **state ) {
+	static const uint16_t gaps[] = { 0, 1, 3, 7 };
+	static const uint16_t gaps_order[] = { 7, 0, 3 };
+	static const uint16_t gaps_compact[] = { 1, 0, 2 };
+	static const uint16_t dups[] = { 0, 5, 9 };
+	static const uint16_t dups_order[] = { 5, 5, 9, 0, 9 };
+	static const uint16_t dups_compact[] = { 1, 2, 0 };
+	static const uint16_t missing[] = { 6 };
+	static const uint16_t missing_order[] = { 4, 6 };
+	static const uint16_t missing_compact[] = { 4, 0 };
+	static const uint16_t full[] = { 0, 5, 6 };
+	static const uint16_t full_order[] = { 5, 6 };
+	unsigned int last;
+
+	( void ) state;
+
+	/* Gaps are filled, moving entries not in boot order out of the way */
+	store_entries ( gaps, 4 );
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, gaps_order, 3 ) );
+	assert_true ( efiboot_compact ( EFIBOOT_TYPE_BOOT ) );
+	assert_stored_order ( gaps_compact, 3 );
+	assert_stored_entry ( 0, 0 );
+	assert_stored_entry ( 1, 7 );
+	assert_stored_entry ( 2, 3 );
+	assert_stored_entry ( 3, -1 );
+	assert_stored_entry ( 4, 1 );
+	assert_stored_entry ( 7, -1 );
+	unstore_entries ( 7 );
+
+	/* Duplicate boot order entries are removed before renumbering */
+	store_entries ( dups, 3 );
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, dups_order, 5 ) );
+	assert_true ( efiboot_compact ( EFIBOOT_TYPE_BOOT ) );
+	assert_stored_order ( dups_compact, 3 );
+	assert_stored_entry ( 0, 0 );
+	assert_stored_entry ( 1, 5 );
+	assert_stored_entry ( 2, 9 );
+	assert_stored_entry ( 5, -1 );
+	assert_stored_entry ( 9, -1 );
+	unstore_entries ( 9 );
+
+	/* Boot order entries without variables are left in place */
+	store_entries ( missing, 1 );
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, missing_order,
+					   2 ) );
+	assert_true ( efiboot_compact ( EFIBOOT_TYPE_BOOT ) );
+	assert_stored_order ( missing_compact, 2 );
+	assert_stored_entry ( 0, 6 );
+	assert_stored_entry ( 4, -1 );
+	assert_stored_entry ( 6, -1 );
+	unstore_entries ( 6 );
+
+	/* Nothing is written if the relocated entries will not fit */
+	store_entries ( full, 3 );
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, full_order, 2 ) );
+	last = fill_entries ( 0x0100 );
+	assert_false ( efiboot_compact ( EFIBOOT_TYPE_BOOT ) );
+	assert_int_equal ( errno, ENOSPC );
+	assert_stored_order ( full_order, 2 );
+	assert_stored_entry ( 0, 0 );
+	assert_stored_entry ( 1, -1 );
+	assert_stored_entry ( 2, -1 );
+	assert_stored_entry ( 5, 5 );
+	assert_stored_entry ( 6, 6 );
+	unstore_entries ( last );
+
+	/* Compacting an empty store does nothing */
+	assert_true ( efiboot_compact ( EFIBOOT_TYPE_BOOT ) );
+	assert_stored_order ( NULL, 0 );
+}
+
+/**
+ * Check boot entry iteration
+ *
+ * @v expected		Expected boot entry indices
+ * @v positions		Expected boot order positions
+ * @v count		Number of expected boot entries
+ */
+static void assert_iter ( const uint16_t *expected,
+			  const unsigned int *positions, unsigned int count ) {
+	struct efi_boot_iter *iter;
+	struct efi_boot_entry *entry;
+	struct efi_boot_entry **entries;
+	char description[16];
+	unsigned int pos;
+	unsigned int i;
+
+	/* Check iteration */
+	iter = efiboot_iter_open ( EFIBOOT_TYPE_BOOT );
+	assert_non_null ( iter );
+	for ( i = 0 ; i < count ; i++ ) {
+		assert_true ( efiboot_iter_next ( iter, &entry, &pos ) );
+		assert_non_null ( entry );
+		assert_int_equal ( efiboot_index ( entry ), expected[i] );
+		assert_int_equal ( pos, positions[i] );
+		snprintf ( description, sizeof ( description ), "Entry %04X",
+			   expected[i] );
+		assert_string_equal ( efiboot_description ( entry ),
+				      description );
+	}
+	assert_true ( efiboot_iter_next ( iter, &entry, &pos ) );
+	assert_null ( entry );
+	assert_true ( efiboot_iter_next ( iter, &entry, &pos ) );
+	assert_null ( entry );
+	efiboot_iter_close ( iter );
+
+	/* Check that loading all entries skips the same entries */
+	entries = efiboot_load_all ( EFIBOOT_TYPE_BOOT );
+	assert_non_null ( entries );
+	for ( i = 0 ; i < count ; i++ ) {
+		assert_non_null ( entries[i] );
+		assert_int_equal ( efiboot_index ( entries[i] ), expected[i] );
+	}
+	assert_null ( entries[count] );
+	efiboot_free_all ( entries );
+}
+
+/** Test boot entry iteration */
+void test_iter ( void **state ) {
+	static const uint16_t stored[] = { 0, 1, 3 };
+	static const uint16_t missing_order[] = { 2, 1, 4, 3, 5 };
+	static const uint16_t missing_iter[] = { 1, 3 };
+	static const unsigned int missing_pos[] = { 1, 3 };
+	static const uint16_t unordered_order[] = { 3 };
+	static const uint16_t full_order[] = { 3, 0, 1 };
+	static const unsigned int full_pos[] = { 0, 1, 2 };
+	struct efi_boot_iter *iter;
+	struct efi_boot_entry *entry;
+	unsigned int pos;
+
+	( void ) state;
+
+	/* Iterating over an empty store produces no entries */
+	assert_iter ( NULL, NULL, 0 );
+
+	/* Boot order entries without variables are skipped */
+	store_entries ( stored, 3 );
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, missing_order,
+					   5 ) );
+	assert_iter ( missing_iter, missing_pos, 2 );
+
+	/* Stored entries not in boot order are not returned */
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, unordered_order,
+					   1 ) );
+	assert_iter ( unordered_order, full_pos, 1 );
+
+	/* Iterators may be closed part-way through */
+	assert_true ( efiboot_save_order ( EFIBOOT_TYPE_BOOT, full_order,
+					   3 ) );
+	assert_iter ( full_order, full_pos, 3 );
+	iter = efiboot_iter_open ( EFIBOOT_TYPE_BOOT );
+	assert_non_null ( iter );
+	efiboot_iter_close ( iter );
+	iter = efiboot_iter_open ( EFIBOOT_TYPE_BOOT );
+	assert_non_null ( iter );
+	assert_true ( efiboot_iter_next ( iter, &entry, &pos ) );
+	assert_non_null ( entry );
+	assert_int_equal ( efiboot_index ( entry ), full_order[0] );
+	assert_int_equal ( pos, 0 );
+	efiboot_iter_close ( iter );
+	efiboot_iter_close ( NULL );
+	unstore_entries ( 5 );
+}
+
+#endif /* EFIVAR_SIMULATED */
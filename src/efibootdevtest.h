@@ -16,5 +16,14 @@ extern void test_shellopt ( void **state );
 extern void test_fedoraopt ( void **state );
 extern void test_typename ( void **state );
 extern void test_varname ( void **state );
+extern void test_takedata ( void **state );
+extern void test_dataformat ( void **state );
+extern void test_splicepath ( void **state );
+extern void test_clone ( void **state );
+extern void test_snapshot ( void **state );
+extern void test_orderrestore ( void **state );
+extern void test_fit ( void **state );
+extern void test_compact ( void **state );
+extern void test_iter ( void **state );
 
 #endif /* _EFIBOOTDEVTEST_H */
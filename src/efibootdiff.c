@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot configuration comparison tool
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <efibootdev.h>
+
+#include "efivarstore.h"
+#include "bootdiff.h"
+
+/** Exit status when configurations differ */
+#define EXIT_DIFFERENT 1
+
+/** Exit status on error */
+#define EXIT_TROUBLE 2
+
+/** Old configuration format name */
+static char *old_format = "snapshot";
+
+/** New configuration format name */
+static char *new_format = "snapshot";
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "from", 'f', 0, G_OPTION_ARG_STRING, &old_format,
+	  "Old configuration format (efivarfs, edk2, snapshot)", "FORMAT" },
+	{ "to", 't', 0, G_OPTION_ARG_STRING, &new_format,
+	  "New configuration format (efivarfs, edk2, snapshot)", "FORMAT" },
+	{}
+};
+
+/**
+ * Decode boot entry
+ *
+ * @v entry		Boot entry
+ * @ret decoded		Decoded load option, or NULL if undecodable
+ */
+static struct efi_boot_entry * diff_decode ( struct diff_entry *entry ) {
+	const EFI_LOAD_OPTION *option;
+	gsize len;
+
+	if ( ! entry->decoded ) {
+		option = g_bytes_get_data ( entry->option, &len );
+		entry->decoded = efiboot_from_option ( option, len );
+	}
+	return entry->decoded;
+}
+
+/**
+ * Show boot entry summary
+ *
+ * @v action		Action description
+ * @v entry		Boot entry
+ */
+static void diff_show ( const char *action, struct diff_entry *entry ) {
+	struct efi_boot_entry *decoded = diff_decode ( entry );
+
+	printf ( "%s Boot%04X", action, entry->number );
+	if ( decoded ) {
+		printf ( " \"%s\"", efiboot_description ( decoded ) );
+		if ( efiboot_path_count ( decoded ) )
+			printf ( " %s", efiboot_path_text ( decoded, 0 ) );
+	}
+	printf ( "\n" );
+}
+
+/**
+ * Show field-level differences between boot entries
+ *
+ * @v old		Old boot entry
+ * @v new		New boot entry
+ */
+static void diff_fields ( struct diff_entry *old, struct diff_entry *new ) {
+	struct efi_boot_entry *before = diff_decode ( old );
+	struct efi_boot_entry *after = diff_decode ( new );
+	const char *old_text;
+	const char *new_text;
+	unsigned int count;
+	unsigned int i;
+
+	printf ( "modified Boot%04X\n", new->number );
+
+	/* Compare raw lengths if either entry is undecodable */
+	if ( ! ( before && after ) ) {
+		printf ( "\toption: %zu -> %zu bytes\n",
+			 g_bytes_get_size ( old->option ),
+			 g_bytes_get_size ( new->option ) );
+		return;
+	}
+
+	/* Compare attributes */
+	if ( efiboot_attributes ( before ) != efiboot_attributes ( after ) ) {
+		printf ( "\tattributes: %08x -> %08x\n",
+			 efiboot_attributes ( before ),
+			 efiboot_attributes ( after ) );
+	}
+
+	/* Compare descriptions */
+	if ( strcmp ( efiboot_description ( before ),
+		      efiboot_description ( after ) ) != 0 ) {
+		printf ( "\tdescription: \"%s\" -> \"%s\"\n",
+			 efiboot_description ( before ),
+			 efiboot_description ( after ) );
+	}
+
+	/* Compare paths */
+	count = efiboot_path_count ( before );
+	if ( count < efiboot_path_count ( after ) )
+		count = efiboot_path_count ( after );
+	for ( i = 0 ; i < count ; i++ ) {
+		old_text = ( ( i < efiboot_path_count ( before ) ) ?
+			     efiboot_path_text ( before, i ) : "-" );
+		new_text = ( ( i < efiboot_path_count ( after ) ) ?
+			     efiboot_path_text ( after, i ) : "-" );
+		if ( strcmp ( old_text, new_text ) != 0 ) {
+			printf ( "\tpath %d: %s -> %s\n",
+				 i, old_text, new_text );
+		}
+	}
+
+	/* Compare additional data */
+	if ( ( efiboot_data_len ( before ) != efiboot_data_len ( after ) ) ||
+	     ( efiboot_data_len ( after ) &&
+	       ( memcmp ( efiboot_data ( before ), efiboot_data ( after ),
+			  efiboot_data_len ( after ) ) != 0 ) ) ) {
+		printf ( "\tdata: %zu -> %zu bytes\n",
+			 efiboot_data_len ( before ),
+			 efiboot_data_len ( after ) );
+	}
+}
+
+/**
+ * Report entries added to or removed from boot order
+ *
+ * @v new		New boot configuration
+ * @ret count		Number of reported entries
+ */
+static unsigned int diff_order_membership ( struct diff_config *new ) {
+	struct diff_entry *entry;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for ( i = 0 ; i < new->count ; i++ ) {
+		entry = &new->entries[i];
+		if ( ( ! entry->match ) ||
+		     ( ( entry->position < 0 ) ==
+		       ( entry->match->position < 0 ) ) )
+			continue;
+		printf ( "%s Boot%04X boot order\n",
+			 ( ( entry->position < 0 ) ?
+			   "removed from" : "added to" ), entry->number );
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Report reordered entries
+ *
+ * @v old		Old boot configuration (joined to new configuration)
+ * @ret count		Number of reported entries
+ */
+static unsigned int diff_order_report ( struct diff_config *old ) {
+	struct diff_entry *entry;
+	unsigned int i;
+	int count;
+
+	/* Identify reordered entries */
+	count = diff_order ( old );
+	if ( count < 0 ) {
+		perror ( "Could not compare boot order" );
+		exit ( EXIT_TROUBLE );
+	}
+
+	/* Report reordered entries in old boot order */
+	for ( i = 0 ; i < old->order_count ; i++ ) {
+		entry = g_hash_table_lookup ( old->numbers,
+					      GUINT_TO_POINTER
+					      ( old->order[i] ) );
+		if ( ! ( entry && entry->reordered &&
+			 ( entry->position == ( ( int ) i ) ) ) )
+			continue;
+		printf ( "reordered Boot%04X position %d -> %d\n",
+			 entry->match->number, entry->position,
+			 entry->match->position );
+	}
+
+	return count;
+}
+
+/**
+ * Open boot configuration
+ *
+ * @v config		Boot configuration
+ * @v format		Variable store format name
+ * @v path		Variable store path
+ */
+static void diff_open ( struct diff_config *config, const char *format,
+			const char *path ) {
+
+	memset ( config, 0, sizeof ( *config ) );
+	config->format = var_format ( format );
+	if ( ! config->format ) {
+		g_printerr ( "Unknown format \"%s\"\n", format );
+		exit ( EXIT_TROUBLE );
+	}
+	config->path = path;
+	if ( ! diff_load ( config ) ) {
+		fprintf ( stderr, "Could not read %s: %s\n",
+			  path, strerror ( errno ) );
+		exit ( EXIT_TROUBLE );
+	}
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	struct diff_config old;
+	struct diff_config new;
+	struct diff_entry *entry;
+	unsigned int count = 0;
+	unsigned int i;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( "OLD NEW - Compare EFI boot "
+					 "configurations" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_TROUBLE );
+	}
+	if ( argc != 3 ) {
+		g_printerr ( "Old and new configurations must be "
+			     "specified\n" );
+		exit ( EXIT_TROUBLE );
+	}
+
+	/* Load and join configurations */
+	diff_open ( &old, old_format, argv[1] );
+	diff_open ( &new, new_format, argv[2] );
+	diff_join ( &old, &new );
+
+	/* Report removed entries */
+	for ( i = 0 ; i < old.count ; i++ ) {
+		entry = &old.entries[i];
+		if ( ! entry->match ) {
+			diff_show ( "removed", entry );
+			count++;
+		}
+	}
+
+	/* Report added, renumbered, and modified entries */
+	for ( i = 0 ; i < new.count ; i++ ) {
+		entry = &new.entries[i];
+		if ( ! entry->match ) {
+			diff_show ( "added", entry );
+			count++;
+		} else if ( entry->match->number != entry->number ) {
+			printf ( "renumbered Boot%04X -> Boot%04X\n",
+				 entry->match->number, entry->number );
+			count++;
+		} else if ( ! g_bytes_equal ( entry->option,
+					      entry->match->option ) ) {
+			diff_fields ( entry->match, entry );
+			count++;
+		}
+	}
+
+	/* Report boot order changes */
+	count += diff_order_membership ( &new );
+	count += diff_order_report ( &old );
+
+	diff_free ( &new );
+	diff_free ( &old );
+	g_option_context_free ( context );
+	exit ( count ? EXIT_DIFFERENT : EXIT_SUCCESS );
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * TCG event log boot entry correlation tool
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efidevpath.h>
+#include <efibootdev.h>
+
+#include "tcglog.h"
+
+/** Default TCG event log location */
+#define TCG_LOG_PATH "/sys/kernel/security/tpm0/binary_bios_measurements"
+
+/** An expanded boot entry device path */
+struct tcg_expanded {
+	/** Boot entry */
+	struct efi_boot_entry *entry;
+	/** Full device path */
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	/** Length of full device path */
+	size_t len;
+};
+
+/** TCG event log file */
+static char *log_file = TCG_LOG_PATH;
+
+/** Show all extracted events */
+static gboolean verbose = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "log", 'l', 0, G_OPTION_ARG_FILENAME, &log_file,
+	  "TCG event log file", "FILE" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Show all extracted events", NULL },
+	{}
+};
+
+/**
+ * Correlate boot services application events with boot entries
+ *
+ * @v events		Events
+ * @v count		Number of events
+ * @v entries		Boot entries
+ * @ret ok		Success indicator
+ *
+ * Boot entries often use short-form device paths (e.g. starting with
+ * a hard disk partition node).  These are expanded against the full
+ * device paths of the loaded images, as firmware would expand them,
+ * and an image is correlated with the first boot entry having a
+ * device path that expands to exactly the loaded image device path.
+ */
+static int tcg_correlate ( struct tcg_event *events, unsigned int count,
+			   struct efi_boot_entry **entries ) {
+	struct efidp_index *index;
+	struct efi_boot_entry **entry;
+	struct tcg_event *event;
+	struct tcg_expanded *expanded;
+	const EFI_DEVICE_PATH_PROTOCOL *orig;
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	unsigned int max = 0;
+	unsigned int used = 0;
+	unsigned int i;
+	unsigned int j;
+	size_t len;
+	int ok = 0;
+
+	/* Index full device paths of all loaded images */
+	index = efidp_index_new();
+	if ( ! index )
+		goto err_index;
+	for ( i = 0 ; i < count ; i++ ) {
+		orig = events[i].path;
+		if ( orig && ( ! efidp_index_add ( index, orig ) ) )
+			goto err_add;
+	}
+
+	/* Expand all boot entry device paths */
+	for ( entry = entries ; *entry ; entry++ )
+		max += efiboot_path_count ( *entry );
+	expanded = calloc ( ( max + 1 /* avoid zero-length allocation */ ),
+			    sizeof ( expanded[0] ) );
+	if ( ! expanded )
+		goto err_expanded;
+	for ( entry = entries ; *entry ; entry++ ) {
+		for ( i = 0 ; i < efiboot_path_count ( *entry ) ; i++ ) {
+			orig = efiboot_path ( *entry, i );
+			path = efidp_index_expand ( index, orig );
+			if ( ( ! path ) && ( errno == ENOENT ) )
+				continue;
+			if ( ! path )
+				goto err_expand;
+			expanded[used].entry = *entry;
+			expanded[used].path = path;
+			expanded[used].len = efidp_len ( path );
+			used++;
+		}
+	}
+
+	/* Correlate each loaded image with first matching boot entry */
+	for ( i = 0 ; i < count ; i++ ) {
+		event = &events[i];
+		if ( ! event->path )
+			continue;
+		len = efidp_len ( event->path );
+		for ( j = 0 ; j < used ; j++ ) {
+			if ( ( expanded[j].len == len ) &&
+			     ( memcmp ( expanded[j].path, event->path,
+					len ) == 0 ) ) {
+				event->entry = expanded[j].entry;
+				break;
+			}
+		}
+	}
+
+	/* Success */
+	ok = 1;
+
+ err_expand:
+	for ( j = 0 ; j < used ; j++ )
+		free ( expanded[j].path );
+	free ( expanded );
+ err_expanded:
+ err_add:
+	efidp_index_free ( index );
+ err_index:
+	return ok;
+}
+
+/**
+ * Show extracted event
+ *
+ * @v event		Event
+ */
+static void tcg_show ( const struct tcg_event *event ) {
+
+	printf ( "PCR%u %s", event->pcr, tcg_type_name ( event->type ) );
+	if ( event->name[0] )
+		printf ( " %s", event->name );
+	if ( event->option )
+		printf ( " \"%s\"", efiboot_description ( event->option ) );
+	if ( event->text )
+		printf ( " %s", event->text );
+	if ( event->entry && ( event->type ==
+			       EV_EFI_BOOT_SERVICES_APPLICATION ) )
+		printf ( " => %s", efiboot_name ( event->entry ) );
+	if ( event->modified )
+		printf ( " (modified since boot)" );
+	printf ( "\n" );
+}
+
+/**
+ * Read TCG event log
+ *
+ * @v fd		File descriptor
+ * @v mapped		Memory-mapped file to fill in (if mapped)
+ * @v data		Log contents to fill in
+ * @v len		Length of log to fill in
+ * @ret ok		Success indicator
+ */
+static int read_log ( int fd, GMappedFile **mapped, gchar **data,
+		      gsize *len ) {
+	GError *error = NULL;
+	GIOChannel *ioc;
+	GIOStatus status;
+
+	/* Map file descriptor, if possible */
+	*mapped = g_mapped_file_new_from_fd ( fd, FALSE, NULL );
+	if ( *mapped && g_mapped_file_get_length ( *mapped ) ) {
+		*data = g_mapped_file_get_contents ( *mapped );
+		*len = g_mapped_file_get_length ( *mapped );
+		return 1;
+	}
+	if ( *mapped )
+		g_mapped_file_unref ( *mapped );
+	*mapped = NULL;
+
+	/* Otherwise (e.g. for securityfs, which reports a zero
+	 * length), read until end of file.
+	 */
+	ioc = g_io_channel_unix_new ( fd );
+	g_io_channel_set_encoding ( ioc, NULL, NULL );
+	status = g_io_channel_read_to_end ( ioc, data, len, &error );
+	g_io_channel_unref ( ioc );
+	if ( status != G_IO_STATUS_NORMAL ) {
+		fprintf ( stderr, "Could not read event log: %s\n",
+			  error->message );
+		g_error_free ( error );
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	GMappedFile *mapped;
+	struct efi_boot_entry **entries;
+	struct efi_boot_entry *booted = NULL;
+	struct tcg_event *events = NULL;
+	struct tcg_event *event;
+	struct tcg_event *tmp;
+	struct tcg_log log;
+	unsigned int count = 0;
+	unsigned int max = 0;
+	unsigned int i;
+	gchar *data;
+	gsize len;
+	int fd;
+	int rc;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( " - Identify EFI boot entries from "
+					 "the TCG event log" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( argc > 1 ) {
+		g_printerr ( "Too many arguments\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Read event log */
+	fd = open ( log_file, O_RDONLY );
+	if ( fd < 0 ) {
+		perror ( "Could not open event log" );
+		exit ( EXIT_FAILURE );
+	}
+	if ( ! read_log ( fd, &mapped, &data, &len ) )
+		exit ( EXIT_FAILURE );
+	close ( fd );
+
+	/* Extract boot events in a single pass, without copying */
+	if ( ! tcg_open ( &log, data, len ) ) {
+		perror ( "Could not parse event log" );
+		exit ( EXIT_FAILURE );
+	}
+	do {
+		if ( count == max ) {
+			max = ( max ? ( max * 2 ) : 16 );
+			tmp = realloc ( events,
+					( max * sizeof ( events[0] ) ) );
+			if ( ! tmp ) {
+				perror ( "Could not extract events" );
+				exit ( EXIT_FAILURE );
+			}
+			events = tmp;
+		}
+		event = &events[count];
+		rc = tcg_next ( &log, event );
+		if ( rc < 0 ) {
+			perror ( "Could not parse event log" );
+			exit ( EXIT_FAILURE );
+		}
+		if ( ( rc > 0 ) &&
+		     ( ( event->type == EV_EFI_VARIABLE_BOOT ) ||
+		       ( event->type == EV_EFI_BOOT_SERVICES_APPLICATION ) ||
+		       ( event->type == EV_EFI_VARIABLE_BOOT2 ) ) )
+			count++;
+	} while ( rc > 0 );
+
+	/* Load boot entries, if possible (e.g. not when examining a
+	 * log captured from another host).
+	 */
+	entries = efiboot_load_all ( EFIBOOT_TYPE_BOOT );
+	if ( ! entries )
+		perror ( "Could not load boot entries" );
+
+	/* Decode all extracted events as a batch */
+	for ( i = 0 ; i < count ; i++ ) {
+		event = &events[i];
+		if ( ! tcg_decode ( event, entries ) ) {
+			perror ( "Could not decode event" );
+			exit ( EXIT_FAILURE );
+		}
+	}
+
+	/* Correlate loaded images with boot entries */
+	if ( entries && ( ! tcg_correlate ( events, count, entries ) ) ) {
+		perror ( "Could not correlate events" );
+		exit ( EXIT_FAILURE );
+	}
+	for ( i = 0 ; i < count ; i++ ) {
+		event = &events[i];
+		if ( verbose )
+			tcg_show ( event );
+		if ( event->entry && ( ! booted ) &&
+		     ( event->type == EV_EFI_BOOT_SERVICES_APPLICATION ) )
+			booted = event->entry;
+	}
+
+	/* Show booted entry */
+	if ( booted ) {
+		printf ( "%s %s\n", efiboot_name ( booted ),
+			 efiboot_description ( booted ) );
+	} else {
+		fprintf ( stderr, "No boot entry found in event log\n" );
+	}
+
+	/* Free events */
+	for ( i = 0 ; i < count ; i++ )
+		tcg_clear ( &events[i] );
+	free ( events );
+	if ( entries )
+		efiboot_free_all ( entries );
+	if ( mapped ) {
+		g_mapped_file_unref ( mapped );
+	} else {
+		g_free ( data );
+	}
+	g_option_context_free ( context );
+	exit ( booted ? EXIT_SUCCESS : EXIT_FAILURE );
+}
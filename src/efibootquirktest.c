@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI platform quirk self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <cmocka.h>
+#include <efibootdev.h>
+
+#include "efibootquirktest.h"
+
+/** Fixture subdirectories (in creation order) */
+static const char *fixture_dirs[] = {
+	"/sys", "/sys/class", "/sys/class/dmi", "/sys/class/dmi/id",
+};
+
+/** Number of fixture subdirectories */
+#define FIXTURE_DIRS ( sizeof ( fixture_dirs ) / sizeof ( fixture_dirs[0] ) )
+
+/** Fixture SMBIOS identification fields */
+static const char *fixture_fields[] = {
+	"sys_vendor", "product_name",
+};
+
+/** Number of fixture SMBIOS identification fields */
+#define FIXTURE_FIELDS \
+	( sizeof ( fixture_fields ) / sizeof ( fixture_fields[0] ) )
+
+/** Maximum length of a fixture path */
+#define FIXTURE_PATH_LEN 256
+
+/**
+ * Construct fixture path
+ *
+ * @v path		Path buffer to fill in
+ * @v root		Fixture root directory
+ * @v dir		Subdirectory
+ * @v name		File name (or NULL)
+ */
+static void fixture_path ( char *path, const char *root, const char *dir,
+			   const char *name ) {
+	int len;
+
+	len = snprintf ( path, FIXTURE_PATH_LEN, "%s%s%s%s", root, dir,
+			 ( name ? "/" : "" ), ( name ? name : "" ) );
+	assert_in_range ( len, 0, ( FIXTURE_PATH_LEN - 1 ) );
+}
+
+/**
+ * Write fixture SMBIOS identification
+ *
+ * @v root		Fixture root directory
+ * @v vendor		System vendor
+ * @v product		Product name
+ */
+static void write_fixture ( const char *root, const char *vendor,
+			    const char *product ) {
+	const char *values[FIXTURE_FIELDS] = { vendor, product };
+	char path[FIXTURE_PATH_LEN];
+	FILE *fh;
+	unsigned int i;
+
+	for ( i = 0 ; i < FIXTURE_DIRS ; i++ ) {
+		fixture_path ( path, root, fixture_dirs[i], NULL );
+		assert_true ( ( g_mkdir ( path, 0755 ) == 0 ) ||
+			      g_file_test ( path, G_FILE_TEST_IS_DIR ) );
+	}
+	for ( i = 0 ; i < FIXTURE_FIELDS ; i++ ) {
+		fixture_path ( path, root, fixture_dirs[ FIXTURE_DIRS - 1 ],
+			       fixture_fields[i] );
+		fh = fopen ( path, "w" );
+		assert_non_null ( fh );
+		fprintf ( fh, "%s\n", values[i] );
+		fclose ( fh );
+	}
+}
+
+/**
+ * Remove fixture
+ *
+ * @v root		Fixture root directory
+ */
+static void remove_fixture ( const char *root ) {
+	char path[FIXTURE_PATH_LEN];
+	unsigned int i;
+
+	for ( i = 0 ; i < FIXTURE_FIELDS ; i++ ) {
+		fixture_path ( path, root, fixture_dirs[ FIXTURE_DIRS - 1 ],
+			       fixture_fields[i] );
+		g_unlink ( path );
+	}
+	for ( i = FIXTURE_DIRS ; i-- ; ) {
+		fixture_path ( path, root, fixture_dirs[i], NULL );
+		g_rmdir ( path );
+	}
+	g_rmdir ( root );
+}
+
+/** Test platform quirk identification */
+void test_quirk ( void **state ) {
+	const struct efi_boot_quirk *quirk;
+	gchar *root;
+
+	( void ) state;
+	root = g_dir_make_tmp ( "efikittest.XXXXXX", NULL );
+	assert_non_null ( root );
+
+	/* Check default quirks when SMBIOS is unavailable */
+	quirk = efiboot_quirk ( root, 0 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "default" );
+	assert_int_equal ( efiboot_quirk_max_len ( quirk ), 0 );
+
+	/* Check default quirks for unknown platform */
+	write_fixture ( root, "Example Corp", "QEMU" );
+	quirk = efiboot_quirk ( root, 0xe000 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "default" );
+
+	/* Check known platform with unknown variable store capacity */
+	write_fixture ( root, "QEMU", "Standard PC (Q35 + ICH9, 2009)" );
+	quirk = efiboot_quirk ( root, 0 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "QEMU" );
+	assert_int_equal ( efiboot_quirk_max_len ( quirk ), 0 );
+
+	/* Check known platform, allowing for variable overhead */
+	quirk = efiboot_quirk ( root, 0xdfb8 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "QEMU" );
+	assert_int_equal ( efiboot_quirk_max_len ( quirk ), ( 0x2000 - 84 ) );
+	quirk = efiboot_quirk ( root, 0x3ffb8 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "QEMU" );
+	assert_int_equal ( efiboot_quirk_max_len ( quirk ), ( 0x8400 - 84 ) );
+
+	/* Check known platform with an unrecognised store capacity */
+	quirk = efiboot_quirk ( root, 0x100000 );
+	assert_string_equal ( efiboot_quirk_name ( quirk ), "QEMU" );
+	assert_int_equal ( efiboot_quirk_max_len ( quirk ), 0 );
+
+	remove_fixture ( root );
+	g_free ( root );
+}
@@ -0,0 +1,15 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI platform quirk self-tests
+ *
+ */
+
+#ifndef _EFIBOOTQUIRKTEST_H
+#define _EFIBOOTQUIRKTEST_H
+
+extern void test_quirk ( void **state );
+
+#endif /* _EFIBOOTQUIRKTEST_H */
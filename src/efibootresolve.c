@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot resolution simulator tool
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <Uefi/UefiBaseType.h>
+#include <efidevpath.h>
+#include <efibootdev.h>
+
+#include "guid.h"
+
+/** Default EFI system partition mount point */
+#define ESP_PATH "/boot/efi"
+
+/** Partition UUID directory */
+#define PARTUUID_PATH "/dev/disk/by-partuuid"
+
+/** Network interface directory */
+#define NET_PATH "/sys/class/net"
+
+/* Block devices do not exist on all platforms */
+#ifndef S_ISBLK
+#define S_ISBLK( mode ) 0
+#endif
+
+/** EFI system partition mount point */
+static char *esp_dir = ESP_PATH;
+
+/** Show inventory gathered from the running system */
+static gboolean verbose = FALSE;
+
+/** Move first available device path of each entry to front */
+static gboolean reorder = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "esp", 'e', 0, G_OPTION_ARG_FILENAME, &esp_dir,
+	  "EFI system partition mount point", "DIR" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Show inventory gathered from the running system", NULL },
+	{ "reorder", 'r', 0, G_OPTION_ARG_NONE, &reorder,
+	  "Move first available path of each entry to front", NULL },
+	{}
+};
+
+/** Hardware inventory */
+static struct efi_boot_inventory *inventory;
+
+/** EFI system partition signature */
+static union {
+	/** GPT partition GUID */
+	EFI_GUID guid;
+	/** MBR disk signature */
+	uint32_t mbr;
+} esp_signature;
+
+/** Length of EFI system partition signature (or zero if unknown) */
+static size_t esp_signature_len;
+
+/** Number of files found on EFI system partition */
+static unsigned int esp_files;
+
+/** Short-form device path expansion index (if showing paths) */
+static struct efidp_index *expand_index;
+
+/** Boot entries providing full device paths for expansion index */
+static struct efi_boot_entry **expand_entries;
+
+/**
+ * Parse partition UUID
+ *
+ * @v text		Partition UUID
+ * @v signature		Partition signature to fill in
+ * @ret len		Length of partition signature, or zero on error
+ *
+ * GPT partitions are identified by the partition GUID.  MBR
+ * partitions are identified by a UUID of the form "xxxxxxxx-NN",
+ * constructed from the disk signature and the partition number.
+ */
+static size_t parse_partuuid ( const char *text, void *signature ) {
+	uint32_t mbr;
+	char *end;
+
+	/* Try parsing as a GPT partition GUID */
+	if ( strlen ( text ) == GUID_TEXT_LEN ) {
+		end = ( ( char * ) guid_from_text ( text, signature ) );
+		return ( ( end && ( ! *end ) ) ? sizeof ( EFI_GUID ) : 0 );
+	}
+
+	/* Try parsing as an MBR disk signature and partition number */
+	mbr = strtoul ( text, &end, 16 );
+	if ( ( ( end - text ) != 8 ) || ( *end != '-' ) )
+		return 0;
+	memcpy ( signature, &mbr, sizeof ( mbr ) );
+	return sizeof ( mbr );
+}
+
+/**
+ * Add partitions to inventory
+ *
+ * @v esp		EFI system partition device number
+ * @ret ok		Success indicator
+ *
+ * The signature of the partition holding the EFI system partition
+ * mount point is recorded, if found.
+ */
+static int add_partitions ( dev_t esp ) {
+	union {
+		EFI_GUID guid;
+		uint32_t mbr;
+	} signature;
+	struct dirent *dirent;
+	GStatBuf st;
+	DIR *dir;
+	size_t len;
+	char *path;
+
+	/* Scan partition UUIDs */
+	dir = opendir ( PARTUUID_PATH );
+	if ( ! dir ) {
+		perror ( "Could not open " PARTUUID_PATH );
+		return 0;
+	}
+	while ( ( dirent = readdir ( dir ) ) ) {
+
+		/* Parse partition UUID */
+		len = parse_partuuid ( dirent->d_name, &signature );
+		if ( ! len )
+			continue;
+
+		/* Add partition */
+		if ( ! efiboot_inventory_add_partition ( inventory, &signature,
+							 len ) ) {
+			perror ( "Could not add partition" );
+			closedir ( dir );
+			return 0;
+		}
+		if ( verbose )
+			printf ( "partition %s\n", dirent->d_name );
+
+		/* Record EFI system partition signature, if applicable */
+		path = g_build_filename ( PARTUUID_PATH, dirent->d_name, NULL );
+		if ( ( g_stat ( path, &st ) == 0 ) && S_ISBLK ( st.st_mode ) &&
+		     ( st.st_rdev == esp ) ) {
+			memcpy ( &esp_signature, &signature, len );
+			esp_signature_len = len;
+		}
+		g_free ( path );
+	}
+	closedir ( dir );
+
+	return 1;
+}
+
+/**
+ * Add EFI system partition directory contents to inventory
+ *
+ * @v dirname		Directory path
+ * @v relative		Directory path relative to mount point
+ * @ret ok		Success indicator
+ */
+static int add_esp_dir ( const char *dirname, const char *relative ) {
+	struct dirent *dirent;
+	GStatBuf st;
+	DIR *dir;
+	char *path;
+	char *name;
+	int ok = 0;
+
+	/* Scan directory */
+	dir = opendir ( dirname );
+	if ( ! dir ) {
+		perror ( dirname );
+		goto err_opendir;
+	}
+	while ( ( dirent = readdir ( dir ) ) ) {
+
+		/* Ignore current and parent directories */
+		if ( ( strcmp ( dirent->d_name, "." ) == 0 ) ||
+		     ( strcmp ( dirent->d_name, ".." ) == 0 ) )
+			continue;
+
+		/* Add file or scan subdirectory, ignoring anything else
+		 * (such as symbolic links) and anything that cannot be
+		 * examined.
+		 */
+		path = g_build_filename ( dirname, dirent->d_name, NULL );
+		name = g_build_filename ( relative, dirent->d_name, NULL );
+		ok = 1;
+		if ( g_lstat ( path, &st ) != 0 ) {
+			perror ( path );
+		} else if ( S_ISDIR ( st.st_mode ) ) {
+			ok = add_esp_dir ( path, name );
+		} else if ( S_ISREG ( st.st_mode ) ) {
+			ok = efiboot_inventory_add_file ( inventory,
+							  &esp_signature,
+							  esp_signature_len,
+							  name );
+			if ( ! ok )
+				perror ( "Could not add file" );
+			esp_files++;
+		}
+		g_free ( name );
+		g_free ( path );
+		if ( ! ok )
+			goto err_add;
+	}
+
+	/* Success */
+	ok = 1;
+
+ err_add:
+	closedir ( dir );
+ err_opendir:
+	return ok;
+}
+
+/**
+ * Add EFI system partition files to inventory
+ *
+ * @ret ok		Success indicator
+ */
+static int add_esp_files ( void ) {
+
+	/* Do nothing unless EFI system partition was identified */
+	if ( ! esp_signature_len ) {
+		fprintf ( stderr, "Could not identify partition for %s; "
+			  "assuming all files are present\n", esp_dir );
+		return 1;
+	}
+
+	/* Scan files */
+	if ( ! add_esp_dir ( esp_dir, "/" ) )
+		return 0;
+	if ( verbose )
+		printf ( "files %u on %s\n", esp_files, esp_dir );
+
+	return 1;
+}
+
+/**
+ * Add network interfaces to inventory
+ *
+ * @ret ok		Success indicator
+ */
+static int add_nics ( void ) {
+	static const uint8_t zero[6];
+	struct dirent *dirent;
+	uint8_t mac[6];
+	gchar *contents;
+	DIR *dir;
+	char *path;
+	int count;
+
+	/* Scan network interfaces */
+	dir = opendir ( NET_PATH );
+	if ( ! dir ) {
+		perror ( "Could not open " NET_PATH );
+		return 0;
+	}
+	while ( ( dirent = readdir ( dir ) ) ) {
+
+		/* Read MAC address */
+		if ( dirent->d_name[0] == '.' )
+			continue;
+		path = g_build_filename ( NET_PATH, dirent->d_name, "address",
+					  NULL );
+		contents = NULL;
+		g_file_get_contents ( path, &contents, NULL, NULL );
+		g_free ( path );
+		if ( ! contents )
+			continue;
+		count = sscanf ( contents, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+				 &mac[0], &mac[1], &mac[2], &mac[3], &mac[4],
+				 &mac[5] );
+		g_free ( contents );
+
+		/* Ignore interfaces without an Ethernet MAC address */
+		if ( ( count != 6 ) ||
+		     ( memcmp ( mac, zero, sizeof ( mac ) ) == 0 ) )
+			continue;
+
+		/* Add network interface */
+		if ( ! efiboot_inventory_add_nic ( inventory, mac ) ) {
+			perror ( "Could not add network interface" );
+			closedir ( dir );
+			return 0;
+		}
+		if ( verbose )
+			printf ( "nic %s\n", dirent->d_name );
+	}
+	closedir ( dir );
+
+	return 1;
+}
+
+/**
+ * Index full device paths used by boot entries
+ *
+ * @ret ok		Success indicator
+ *
+ * Short-form device paths are shown expanded against the full device
+ * paths used by other boot entries, so that the physical disk to
+ * which an entry refers can be identified.  Userspace has no way to
+ * construct the firmware's own full device paths for the running
+ * hardware, so these are the only full device paths available.
+ */
+static int index_paths ( void ) {
+	const EFI_DEVICE_PATH_PROTOCOL *path;
+	struct efi_boot_entry **entry;
+	unsigned int i;
+
+	/* Create index */
+	expand_index = efidp_index_new();
+	if ( ! expand_index ) {
+		perror ( "Could not create index" );
+		return 0;
+	}
+
+	/* Index all paths of all entries */
+	expand_entries = efiboot_load_all ( EFIBOOT_TYPE_BOOT );
+	if ( ! expand_entries ) {
+		perror ( "Could not load entries" );
+		return 0;
+	}
+	for ( entry = expand_entries ; *entry ; entry++ ) {
+		for ( i = 0 ; i < efiboot_path_count ( *entry ) ; i++ ) {
+			path = efiboot_path ( *entry, i );
+			if ( ! efidp_index_add ( expand_index, path ) ) {
+				perror ( "Could not index paths" );
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Predict boot entry outcome
+ *
+ * @v label		Label prefix (e.g. "BootNext ")
+ * @v index		Boot entry index
+ * @v next		Entry is selected by BootNext
+ * @v booted		Boot entry has already been selected
+ * @ret booted		Boot entry has now been selected
+ *
+ * Firmware skips over any boot order entry for which the boot
+ * variable does not exist.
+ */
+static bool try_entry ( const char *label, unsigned int index, bool next,
+			bool booted ) {
+	EFI_DEVICE_PATH_PROTOCOL *full;
+	struct efi_boot_entry *entry;
+	char *text;
+	int verdict;
+
+	/* Load boot entry */
+	entry = efiboot_load ( EFIBOOT_TYPE_BOOT, index );
+	if ( ! entry ) {
+		if ( errno != ENOENT ) {
+			perror ( "Could not load entry" );
+			exit ( EXIT_FAILURE );
+		}
+		printf ( "%sBoot%04X variable missing\n", label, index );
+		return booted;
+	}
+
+	/* Predict outcome */
+	if ( booted ) {
+		verdict = EFIBOOT_VERDICT_UNREACHED;
+	} else {
+		verdict = efiboot_resolve ( inventory, entry, next );
+		if ( verdict < 0 ) {
+			perror ( "Could not resolve entry" );
+			exit ( EXIT_FAILURE );
+		}
+	}
+
+	/* Show outcome */
+	printf ( "%s%s %s\n", label, efiboot_name ( entry ),
+		 efiboot_verdict_name ( verdict ) );
+	if ( verbose ) {
+		full = efidp_index_expand ( expand_index,
+					    efiboot_path ( entry, 0 ) );
+		text = ( full ? efidp_to_text ( full, false, true ) : NULL );
+		printf ( "  %s %s\n", efiboot_description ( entry ),
+			 ( text ? text : efiboot_path_text ( entry, 0 ) ) );
+		free ( text );
+		free ( full );
+	}
+
+	efiboot_free ( entry );
+	return ( booted || ( verdict == EFIBOOT_VERDICT_BOOT ) );
+}
+
+/**
+ * Move first available device path of boot entry to front
+ *
+ * @v index		Boot entry index
+ *
+ * Only entries with more than one device path are considered, and
+ * only entries whose device paths were reordered are written back.
+ */
+static void reorder_entry ( unsigned int index ) {
+	struct efi_boot_entry *entry;
+	bool reordered;
+
+	/* Load boot entry */
+	entry = efiboot_load ( EFIBOOT_TYPE_BOOT, index );
+	if ( ! entry ) {
+		if ( errno != ENOENT ) {
+			perror ( "Could not load entry" );
+			exit ( EXIT_FAILURE );
+		}
+		return;
+	}
+
+	/* Reorder device paths, if applicable */
+	if ( efiboot_path_count ( entry ) > 1 ) {
+		if ( ! efiboot_reorder_paths ( inventory, entry,
+					       &reordered ) ) {
+			perror ( "Could not reorder paths" );
+			exit ( EXIT_FAILURE );
+		}
+		if ( reordered ) {
+			if ( ! efiboot_save ( entry ) ) {
+				perror ( "Could not save entry" );
+				exit ( EXIT_FAILURE );
+			}
+			printf ( "%s paths reordered\n",
+				 efiboot_name ( entry ) );
+		}
+	}
+
+	efiboot_free ( entry );
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	GStatBuf st;
+	uint16_t *order;
+	unsigned int count;
+	unsigned int next;
+	unsigned int i;
+	bool booted = false;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( " - Predict which EFI boot entry "
+					 "will be booted" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( argc > 1 ) {
+		g_printerr ( "Too many arguments\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Gather hardware inventory */
+	inventory = efiboot_inventory_new();
+	if ( ! inventory ) {
+		perror ( "Could not create inventory" );
+		exit ( EXIT_FAILURE );
+	}
+	if ( g_stat ( esp_dir, &st ) != 0 ) {
+		perror ( "Could not access EFI system partition" );
+		exit ( EXIT_FAILURE );
+	}
+	if ( ! ( add_partitions ( st.st_dev ) && add_esp_files() &&
+		 add_nics() ) )
+		exit ( EXIT_FAILURE );
+
+	/* Index full device paths, if applicable */
+	if ( verbose && ( ! index_paths() ) )
+		exit ( EXIT_FAILURE );
+
+	/* Load boot order */
+	order = efiboot_load_order ( EFIBOOT_TYPE_BOOT, &count );
+	if ( ! order ) {
+		perror ( "Could not load boot order" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Reorder device paths, if applicable */
+	if ( reorder ) {
+		for ( i = 0 ; i < count ; i++ )
+			reorder_entry ( order[i] );
+	}
+
+	/* Try BootNext, if present */
+	if ( efiboot_load_next ( &next ) ) {
+		booted = try_entry ( "BootNext ", next, true, booted );
+	} else if ( errno != ENOENT ) {
+		perror ( "Could not read BootNext" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Try each entry in boot order */
+	for ( i = 0 ; i < count ; i++ )
+		booted = try_entry ( "", order[i], false, booted );
+	free ( order );
+
+	if ( expand_entries )
+		efiboot_free_all ( expand_entries );
+	efidp_index_free ( expand_index );
+	efiboot_inventory_free ( inventory );
+	g_option_context_free ( context );
+	exit ( booted ? EXIT_SUCCESS : EXIT_FAILURE );
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot resolution simulator self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <Uefi/UefiBaseType.h>
+#include <Uefi/UefiSpec.h>
+#include <efibootdev.h>
+
+#include "efibootresolvetest.h"
+
+/** EFI system partition signature */
+static const EFI_GUID esp_signature = {
+	0xc8f57909, 0xd589, 0x41a1,
+	{ 0x99, 0x58, 0x44, 0xc7, 0xf2, 0x29, 0xe1, 0x50 }
+};
+
+/** EFI system partition device path */
+#define ESP_PATH \
+	"HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x800,0x12C000)"
+
+/** Other partition signature (with no known files) */
+static const EFI_GUID other_signature = {
+	0x2b8d4e1f, 0x6c3a, 0x4f52,
+	{ 0x8e, 0x91, 0x0d, 0x7a, 0x35, 0xc4, 0x62, 0xb8 }
+};
+
+/** Other partition device path */
+#define OTHER_PATH \
+	"HD(3,GPT,2B8D4E1F-6C3A-4F52-8E91-0D7A35C462B8,0x12C800,0x100000)"
+
+/** Missing partition device path */
+#define MISSING_PATH \
+	"HD(2,GPT,DB2E3A1C-0F5E-4B7B-9D3A-6F0B2C9E4A11,0x800,0x1000)"
+
+/** Network interface MAC address */
+static const uint8_t nic_mac[] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+
+/**
+ * Create test hardware inventory
+ *
+ * @ret inventory	Hardware inventory
+ */
+static struct efi_boot_inventory * test_inventory ( void ) {
+	struct efi_boot_inventory *inventory;
+	size_t len = sizeof ( EFI_GUID );
+
+	inventory = efiboot_inventory_new();
+	assert_non_null ( inventory );
+	assert_true ( efiboot_inventory_add_partition ( inventory,
+							&esp_signature, len ) );
+	assert_true ( efiboot_inventory_add_partition ( inventory,
+							&other_signature,
+							len ) );
+	assert_true ( efiboot_inventory_add_file ( inventory, &esp_signature,
+						   len,
+						   "EFI/fedora/shimx64.efi" ) );
+	assert_true ( efiboot_inventory_add_nic ( inventory, nic_mac ) );
+	return inventory;
+}
+
+/**
+ * Check boot resolution verdict
+ *
+ * @v inventory		Hardware inventory
+ * @v attributes	Boot entry attributes
+ * @v path		Boot entry device path text
+ * @v next		Entry is selected by BootNext
+ * @v expected		Expected verdict
+ */
+static void assert_efiboot_resolve ( struct efi_boot_inventory *inventory,
+				     uint32_t attributes, const char *path,
+				     bool next, int expected ) {
+	struct efi_boot_entry *entry;
+
+	/* Construct boot entry */
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	assert_true ( efiboot_set_attributes ( entry, attributes ) );
+	assert_true ( efiboot_set_path_text ( entry, 0, path ) );
+
+	/* Check verdict */
+	assert_int_equal ( efiboot_resolve ( inventory, entry, next ),
+			   expected );
+
+	/* Free boot entry */
+	efiboot_free ( entry );
+}
+
+/** Test resolution of hard disk boot entries */
+void test_resolvedisk ( void **state ) {
+	struct efi_boot_inventory *inventory;
+
+	( void ) state;
+	inventory = test_inventory();
+
+	/* Check file on present partition, ignoring case */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 ESP_PATH "/\\EFI\\FEDORA\\SHIMX64.EFI", false,
+				 EFIBOOT_VERDICT_BOOT );
+
+	/* Check attributes, which are ignored for BootNext */
+	assert_efiboot_resolve ( inventory, 0,
+				 ESP_PATH "/\\EFI\\fedora\\shimx64.efi", false,
+				 EFIBOOT_VERDICT_INACTIVE );
+	assert_efiboot_resolve ( inventory, 0,
+				 ESP_PATH "/\\EFI\\fedora\\shimx64.efi", true,
+				 EFIBOOT_VERDICT_BOOT );
+	assert_efiboot_resolve ( inventory, ( LOAD_OPTION_ACTIVE |
+					      LOAD_OPTION_CATEGORY_APP ),
+				 ESP_PATH "/\\EFI\\fedora\\shimx64.efi", false,
+				 EFIBOOT_VERDICT_NOT_BOOTABLE );
+
+	/* Check missing partition */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+				 false, EFIBOOT_VERDICT_NO_DEVICE );
+
+	/* Check missing file, and missing removable media boot file */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 ESP_PATH "/\\EFI\\fedora\\grubx64.efi", false,
+				 EFIBOOT_VERDICT_NO_FILE );
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE, ESP_PATH,
+				 false, ( efiboot_removable_file() ?
+					  EFIBOOT_VERDICT_NO_FILE :
+					  EFIBOOT_VERDICT_BOOT ) );
+
+	/* Check file on partition with no known files */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 OTHER_PATH "/\\EFI\\debian\\grubx64.efi",
+				 false, EFIBOOT_VERDICT_BOOT );
+
+	/* Check short-form file paths */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 "\\EFI\\fedora\\shimx64.efi", false,
+				 EFIBOOT_VERDICT_BOOT );
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 "\\EFI\\fedora\\grubx64.efi", false,
+				 EFIBOOT_VERDICT_NO_FILE );
+
+	efiboot_inventory_free ( inventory );
+}
+
+/** Test resolution of other boot entries */
+void test_resolveother ( void **state ) {
+	struct efi_boot_inventory *inventory;
+
+	( void ) state;
+	inventory = test_inventory();
+
+	/* Check network boot */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 "PciRoot(0x0)/Pci(0x3,0x0)/"
+				 "MAC(525400123456,0x1)", false,
+				 EFIBOOT_VERDICT_BOOT );
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 "PciRoot(0x0)/Pci(0x3,0x0)/"
+				 "MAC(525400654321,0x1)", false,
+				 EFIBOOT_VERDICT_NO_DEVICE );
+
+	/* Check firmware application (which cannot be checked) */
+	assert_efiboot_resolve ( inventory, LOAD_OPTION_ACTIVE,
+				 "Fv(7CB8BDC9-F8EB-4F34-AAEA-3EE4AF6516A1)/"
+				 "FvFile(7C04A583-9E3E-4F1C-AD65-E05268D0B4D1)",
+				 false, EFIBOOT_VERDICT_BOOT );
+
+	/* Check verdict names */
+	assert_string_equal ( efiboot_verdict_name ( EFIBOOT_VERDICT_NO_FILE ),
+			      "file missing" );
+	assert_null ( efiboot_verdict_name ( EFIBOOT_VERDICT_MAX + 1 ) );
+
+	efiboot_inventory_free ( inventory );
+}
+
+/**
+ * Check device path reordering
+ *
+ * @v inventory		Hardware inventory
+ * @v paths		Boot entry device path texts
+ * @v count		Number of device paths
+ * @v first		Index of expected first device path
+ */
+static void assert_efiboot_reorder ( struct efi_boot_inventory *inventory,
+				     const char **paths, unsigned int count,
+				     unsigned int first ) {
+	struct efi_boot_entry *entry;
+	struct efi_boot_entry *orig;
+	const char *texts[8];
+	unsigned int i;
+	unsigned int j;
+	bool reordered;
+
+	/* Construct boot entry, and an unshared copy for comparison */
+	entry = efiboot_new();
+	assert_non_null ( entry );
+	assert_true ( efiboot_set_paths_text ( entry, paths, count ) );
+	orig = efiboot_new();
+	assert_non_null ( orig );
+	assert_true ( efiboot_set_paths_text ( orig, paths, count ) );
+	assert_true ( count <= ( sizeof ( texts ) / sizeof ( texts[0] ) ) );
+	for ( j = 0 ; j < count ; j++ )
+		texts[j] = efiboot_path_text ( entry, j );
+
+	/* Reorder device paths */
+	assert_true ( efiboot_reorder_paths ( inventory, entry,
+					      &reordered ) );
+	assert_int_equal ( reordered, ( first != 0 ) );
+
+	/* Check that other device paths retain their relative order,
+	 * and are moved without discarding their cached text.
+	 */
+	assert_int_equal ( efiboot_path_count ( entry ), count );
+	assert_string_equal ( efiboot_path_text ( entry, 0 ),
+			      efiboot_path_text ( orig, first ) );
+	for ( i = 1, j = 0 ; i < count ; i++, j++ ) {
+		if ( j == first )
+			j++;
+		assert_string_equal ( efiboot_path_text ( entry, i ),
+				      efiboot_path_text ( orig, j ) );
+		assert_ptr_equal ( efiboot_path_text ( entry, i ), texts[j] );
+	}
+
+	/* Free boot entries */
+	efiboot_free ( orig );
+	efiboot_free ( entry );
+}
+
+/** Test reordering of device paths by availability */
+void test_reorderpaths ( void **state ) {
+	static const char *absent_nic[] = {
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400654321,0x1)",
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		ESP_PATH "/\\EFI\\fedora\\shimx64.efi",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *present[] = {
+		ESP_PATH "/\\EFI\\fedora\\shimx64.efi",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *unavailable[] = {
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		ESP_PATH "/\\EFI\\fedora\\grubx64.efi",
+	};
+	static const char *short_form[] = {
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		"\\EFI\\fedora\\shimx64.efi",
+	};
+	static const char *present_nic[] = {
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *unscanned[] = {
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		OTHER_PATH "/\\EFI\\debian\\grubx64.efi",
+	};
+	static const char *firmware[] = {
+		MISSING_PATH "/\\EFI\\fedora\\shimx64.efi",
+		"Fv(7CB8BDC9-F8EB-4F34-AAEA-3EE4AF6516A1)/"
+		"FvFile(7C04A583-9E3E-4F1C-AD65-E05268D0B4D1)",
+	};
+	struct efi_boot_inventory *inventory;
+
+	( void ) state;
+	inventory = test_inventory();
+
+	/* Check first available path is moved to front */
+	assert_efiboot_reorder ( inventory, absent_nic, 4, 2 );
+
+	/* Check entries are unchanged if first path is available */
+	assert_efiboot_reorder ( inventory, present, 2, 0 );
+
+	/* Check entries are unchanged if no path is available */
+	assert_efiboot_reorder ( inventory, unavailable, 2, 0 );
+
+	/* Check verified short-form file paths are moved to front */
+	assert_efiboot_reorder ( inventory, short_form, 2, 1 );
+
+	/* Check entries are unchanged if the first available path is
+	 * only assumed to be available.
+	 */
+	assert_efiboot_reorder ( inventory, present_nic, 2, 0 );
+	assert_efiboot_reorder ( inventory, unscanned, 2, 0 );
+	assert_efiboot_reorder ( inventory, firmware, 2, 0 );
+
+	efiboot_inventory_free ( inventory );
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot resolution simulator self-tests
+ *
+ */
+
+#ifndef _EFIBOOTRESOLVETEST_H
+#define _EFIBOOTRESOLVETEST_H
+
+extern void test_resolvedisk ( void **state );
+extern void test_resolveother ( void **state );
+extern void test_reorderpaths ( void **state );
+
+#endif /* _EFIBOOTRESOLVETEST_H */
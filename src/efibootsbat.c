@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * SBAT policy evaluation tool
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efibootdev.h>
+
+#include "strconvert.h"
+
+/** Default EFI system partition mount point */
+#define ESP_PATH "/boot/efi"
+
+/** EFI system partition mount point */
+static char *esp_dir = ESP_PATH;
+
+/** Proposed SBAT level file */
+static char *level_file = NULL;
+
+/** Show SBAT metadata for each loader */
+static gboolean verbose = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "esp", 'e', 0, G_OPTION_ARG_FILENAME, &esp_dir,
+	  "EFI system partition mount point", "DIR" },
+	{ "level", 'l', 0, G_OPTION_ARG_FILENAME, &level_file,
+	  "Evaluate a proposed SBAT level", "FILE" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Show SBAT metadata for each loader", NULL },
+	{}
+};
+
+/**
+ * Construct loader file name from boot entry
+ *
+ * @v entry		Boot entry
+ * @ret filename	Loader file name, or NULL if entry has no file path
+ *
+ * The file path nodes of the first device path are concatenated and
+ * resolved relative to the EFI system partition mount point.  The
+ * file name must eventually be freed by the caller.
+ */
+static char * loader_filename ( const struct efi_boot_entry *entry ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	const FILEPATH_DEVICE_PATH *filepath;
+	GString *name;
+	char *component;
+	char *filename;
+	size_t len;
+
+	/* Ignore entries with no device path */
+	if ( ! efiboot_path_count ( entry ) )
+		return NULL;
+
+	/* Concatenate file path nodes */
+	name = g_string_new ( NULL );
+	for ( node = efiboot_path ( entry, 0 ) ;
+	      node->Type != END_DEVICE_PATH_TYPE ;
+	      node = ( ( ( const void * ) node ) + len ) ) {
+		len = ( node->Length[0] | ( node->Length[1] << 8 ) );
+		if ( ( node->Type != MEDIA_DEVICE_PATH ) ||
+		     ( node->SubType != MEDIA_FILEPATH_DP ) )
+			continue;
+		filepath = ( ( const void * ) node );
+		component = efin_to_utf8 ( filepath->PathName,
+					   ( len - sizeof ( *node ) ) );
+		if ( ! component )
+			continue;
+		g_string_append_c ( name, '/' );
+		g_string_append ( name, component );
+		free ( component );
+	}
+
+	/* Ignore entries with no file path (e.g. network boot) */
+	if ( ! name->len ) {
+		g_string_free ( name, TRUE );
+		return NULL;
+	}
+
+	/* Convert to local path */
+	g_strdelimit ( name->str, "\\", '/' );
+	filename = g_build_filename ( esp_dir, name->str, NULL );
+	g_string_free ( name, TRUE );
+	return filename;
+}
+
+/**
+ * Show SBAT metadata
+ *
+ * @v level		SBAT level
+ * @v sbat		PE image SBAT metadata
+ */
+static void show_sbat ( const struct efi_boot_sbat *level,
+			const struct efi_boot_sbat *sbat ) {
+	unsigned long generation;
+	const char *name;
+	unsigned int i;
+
+	for ( i = 0 ; i < efiboot_sbat_count ( sbat ) ; i++ ) {
+		name = efiboot_sbat_component ( sbat, i, &generation );
+		printf ( "  %s,%lu (level %lu)\n", name, generation,
+			 efiboot_sbat_generation ( level, name ) );
+	}
+}
+
+/**
+ * Load SBAT level
+ *
+ * @ret level		SBAT level, or NULL on error
+ */
+static struct efi_boot_sbat * load_level ( void ) {
+	struct efi_boot_sbat *level;
+	GError *error = NULL;
+	gchar *data;
+	gsize len;
+
+	/* Use current SBAT level if no proposed level was specified */
+	if ( ! level_file ) {
+		level = efiboot_sbat_level();
+		if ( ! level )
+			perror ( "Could not read SBAT level" );
+		return level;
+	}
+
+	/* Read proposed SBAT level */
+	if ( ! g_file_get_contents ( level_file, &data, &len, &error ) ) {
+		g_printerr ( "Could not read SBAT level: %s\n",
+			     error->message );
+		g_error_free ( error );
+		return NULL;
+	}
+	level = efiboot_sbat_parse ( data, len );
+	if ( ! level )
+		perror ( "Could not parse SBAT level" );
+	g_free ( data );
+	return level;
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	GMappedFile *mapped;
+	struct efi_boot_entry **entries;
+	struct efi_boot_entry **entry;
+	struct efi_boot_sbat *level;
+	struct efi_boot_sbat *sbat;
+	const char *revoked;
+	unsigned int count = 0;
+	char *filename;
+	gchar *data;
+	gsize len;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( " - Check EFI boot entry loaders "
+					 "against the SBAT level" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( argc > 1 ) {
+		g_printerr ( "Too many arguments\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Load SBAT level */
+	level = load_level();
+	if ( ! level )
+		exit ( EXIT_FAILURE );
+
+	/* Load boot entries */
+	entries = efiboot_load_all ( EFIBOOT_TYPE_BOOT );
+	if ( ! entries ) {
+		perror ( "Could not load boot entries" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Check loader for each boot entry */
+	for ( entry = entries ; *entry ; entry++ ) {
+
+		/* Identify loader */
+		filename = loader_filename ( *entry );
+		if ( ! filename ) {
+			if ( verbose ) {
+				printf ( "%s skipped (no file path)\n",
+					 efiboot_name ( *entry ) );
+			}
+			continue;
+		}
+
+		/* Map and parse loader */
+		mapped = g_mapped_file_new ( filename, FALSE, &error );
+		if ( ! mapped ) {
+			printf ( "%s missing %s\n", efiboot_name ( *entry ),
+				 filename );
+			g_clear_error ( &error );
+			g_free ( filename );
+			continue;
+		}
+		data = g_mapped_file_get_contents ( mapped );
+		len = g_mapped_file_get_length ( mapped );
+		sbat = efiboot_sbat_image ( data, len );
+		g_mapped_file_unref ( mapped );
+		if ( ! sbat ) {
+			printf ( "%s invalid %s\n", efiboot_name ( *entry ),
+				 filename );
+			g_free ( filename );
+			continue;
+		}
+
+		/* Check against SBAT level */
+		revoked = efiboot_sbat_revoked ( level, sbat );
+		if ( revoked ) {
+			printf ( "%s revoked (%s) %s\n",
+				 efiboot_name ( *entry ), revoked, filename );
+			count++;
+		} else {
+			printf ( "%s ok %s\n", efiboot_name ( *entry ),
+				 filename );
+		}
+		if ( verbose )
+			show_sbat ( level, sbat );
+
+		efiboot_sbat_free ( sbat );
+		g_free ( filename );
+	}
+
+	efiboot_free_all ( entries );
+	efiboot_sbat_free ( level );
+	g_option_context_free ( context );
+	exit ( count ? EXIT_FAILURE : EXIT_SUCCESS );
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * SBAT policy evaluation self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+#include <Uefi/UefiBaseType.h>
+#include <IndustryStandard/PeImage.h>
+#include <efibootdev.h>
+
+#include "efibootsbattest.h"
+
+/** An SBAT level including a grub revocation */
+static const char sbat_level[] =
+	"sbat,1,2022052400\n"
+	"grub,2\n";
+
+/** SBAT metadata for a revoked grub image */
+static const char sbat_grub1[] =
+	"sbat,1,SBAT Version,sbat,1,https://example.com/SBAT.md\n"
+	"grub,1,Free Software Foundation,grub,2.04,https://example.com\n"
+	"grub.fedora,1,The Fedora Project,grub2,2.04-31.fc33,"
+	"https://example.com\n";
+
+/** SBAT metadata for a current grub image */
+static const char sbat_grub2[] =
+	"sbat,1,SBAT Version,sbat,1,https://example.com/SBAT.md\r\n"
+	"grub,2,Free Software Foundation,grub,2.06,https://example.com\r\n";
+
+/** A minimal PE image containing a .sbat section */
+struct sbat_test_image {
+	/** DOS header */
+	EFI_IMAGE_DOS_HEADER dos;
+	/** PE signature */
+	uint32_t signature;
+	/** File header */
+	EFI_IMAGE_FILE_HEADER file;
+	/** Section headers */
+	EFI_IMAGE_SECTION_HEADER sections[2];
+	/** Section contents */
+	char sbat[256];
+} __attribute__ (( packed ));
+
+/** Test SBAT level parsing */
+void test_sbatparse ( void **state ) {
+	static const char duplicate[] = "sbat,1\ngrub,3\ngrub,2\n";
+	struct efi_boot_sbat *sbat;
+	unsigned long generation;
+
+	( void ) state;
+
+	/* Check parsing of SBAT level */
+	sbat = efiboot_sbat_parse ( sbat_level, sizeof ( sbat_level ) );
+	assert_non_null ( sbat );
+	assert_int_equal ( efiboot_sbat_count ( sbat ), 2 );
+	assert_int_equal ( efiboot_sbat_generation ( sbat, "sbat" ), 1 );
+	assert_int_equal ( efiboot_sbat_generation ( sbat, "grub" ), 2 );
+	assert_int_equal ( efiboot_sbat_generation ( sbat, "shim" ), 0 );
+	assert_string_equal ( efiboot_sbat_component ( sbat, 1, &generation ),
+			      "grub" );
+	assert_int_equal ( generation, 2 );
+	efiboot_sbat_free ( sbat );
+
+	/* Check that duplicate components record highest generation */
+	sbat = efiboot_sbat_parse ( duplicate, strlen ( duplicate ) );
+	assert_non_null ( sbat );
+	assert_int_equal ( efiboot_sbat_count ( sbat ), 3 );
+	assert_int_equal ( efiboot_sbat_generation ( sbat, "grub" ), 3 );
+	efiboot_sbat_free ( sbat );
+
+	/* Check rejection of malformed lines */
+	assert_null ( efiboot_sbat_parse ( "grub\n", 5 ) );
+	assert_null ( efiboot_sbat_parse ( ",1\n", 3 ) );
+	assert_null ( efiboot_sbat_parse ( "grub,x\n", 7 ) );
+	assert_null ( efiboot_sbat_parse ( "grub,2x,y\n", 10 ) );
+}
+
+/** Test SBAT revocation checks */
+void test_sbatrevoke ( void **state ) {
+	struct efi_boot_sbat *level;
+	struct efi_boot_sbat *image;
+
+	( void ) state;
+	level = efiboot_sbat_parse ( sbat_level, strlen ( sbat_level ) );
+	assert_non_null ( level );
+
+	/* Check revoked image */
+	image = efiboot_sbat_parse ( sbat_grub1, strlen ( sbat_grub1 ) );
+	assert_non_null ( image );
+	assert_int_equal ( efiboot_sbat_count ( image ), 3 );
+	assert_string_equal ( efiboot_sbat_revoked ( level, image ), "grub" );
+	efiboot_sbat_free ( image );
+
+	/* Check current image */
+	image = efiboot_sbat_parse ( sbat_grub2, strlen ( sbat_grub2 ) );
+	assert_non_null ( image );
+	assert_int_equal ( efiboot_sbat_count ( image ), 2 );
+	assert_null ( efiboot_sbat_revoked ( level, image ) );
+	efiboot_sbat_free ( image );
+
+	/* Check image with no SBAT metadata */
+	image = efiboot_sbat_parse ( "", 0 );
+	assert_non_null ( image );
+	assert_string_equal ( efiboot_sbat_revoked ( level, image ), "sbat" );
+	efiboot_sbat_free ( image );
+
+	efiboot_sbat_free ( level );
+}
+
+/** Test SBAT metadata extraction from PE images */
+void test_sbatimage ( void **state ) {
+	struct sbat_test_image *image;
+	struct efi_boot_sbat *sbat;
+	size_t len;
+
+	( void ) state;
+	image = calloc ( 1, sizeof ( *image ) );
+	assert_non_null ( image );
+
+	/* Construct image */
+	image->dos.e_magic = EFI_IMAGE_DOS_SIGNATURE;
+	image->dos.e_lfanew = offsetof ( typeof ( *image ), signature );
+	image->signature = EFI_IMAGE_NT_SIGNATURE;
+	image->file.NumberOfSections = 2;
+	memcpy ( image->sections[0].Name, ".text", 5 );
+	memcpy ( image->sections[1].Name, ".sbat", 5 );
+	image->sections[1].Misc.VirtualSize = strlen ( sbat_grub1 );
+	image->sections[1].SizeOfRawData = sizeof ( image->sbat );
+	image->sections[1].PointerToRawData =
+		offsetof ( typeof ( *image ), sbat );
+	memcpy ( image->sbat, sbat_grub1, strlen ( sbat_grub1 ) );
+
+	/* Check extracted metadata */
+	sbat = efiboot_sbat_image ( image, sizeof ( *image ) );
+	assert_non_null ( sbat );
+	assert_int_equal ( efiboot_sbat_count ( sbat ), 3 );
+	assert_int_equal ( efiboot_sbat_generation ( sbat, "grub.fedora" ), 1 );
+	efiboot_sbat_free ( sbat );
+
+	/* Check image with no .sbat section */
+	image->file.NumberOfSections = 1;
+	sbat = efiboot_sbat_image ( image, sizeof ( *image ) );
+	assert_non_null ( sbat );
+	assert_int_equal ( efiboot_sbat_count ( sbat ), 0 );
+	efiboot_sbat_free ( sbat );
+
+	/* Check rejection of truncated images */
+	image->file.NumberOfSections = 2;
+	len = ( offsetof ( typeof ( *image ), sbat ) + strlen ( sbat_grub1 ) );
+	assert_null ( efiboot_sbat_image ( image, ( len - 1 ) ) );
+	assert_null ( efiboot_sbat_image ( image, sizeof ( image->dos ) ) );
+	image->dos.e_magic = 0;
+	assert_null ( efiboot_sbat_image ( image, sizeof ( *image ) ) );
+
+	free ( image );
+}
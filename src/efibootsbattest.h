@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * SBAT policy evaluation self-tests
+ *
+ */
+
+#ifndef _EFIBOOTSBATTEST_H
+#define _EFIBOOTSBATTEST_H
+
+extern void test_sbatparse ( void **state );
+extern void test_sbatrevoke ( void **state );
+extern void test_sbatimage ( void **state );
+
+#endif /* _EFIBOOTSBATTEST_H */
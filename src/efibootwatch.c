@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot order watcher
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <glib.h>
+#include <efibootdev.h>
+
+/** Microseconds per millisecond */
+#define USEC_PER_MSEC 1000
+
+/** Convert milliseconds to monotonic time */
+#define MSEC( msec ) ( ( ( gint64 ) (msec) ) * USEC_PER_MSEC )
+
+/** Convert seconds to monotonic time */
+#define SEC( sec ) ( ( ( gint64 ) (sec) ) * G_USEC_PER_SEC )
+
+/** Debounce delay (in milliseconds) */
+static gint debounce = 2000;
+
+/** Polling interval (in seconds) */
+static gint interval = 300;
+
+/** Initial holdoff after restoring boot order (in seconds) */
+static gint min_holdoff = 60;
+
+/** Maximum holdoff after restoring boot order (in seconds) */
+static gint max_holdoff = 3600;
+
+/** Check boot order once and exit */
+static gboolean once = FALSE;
+
+/** Report each check */
+static gboolean verbose = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "debounce", 'd', 0, G_OPTION_ARG_INT, &debounce,
+	  "Wait for changes to settle", "MSEC" },
+	{ "interval", 'i', 0, G_OPTION_ARG_INT, &interval,
+	  "Check boot order periodically", "SEC" },
+	{ "holdoff", 0, 0, G_OPTION_ARG_INT, &min_holdoff,
+	  "Initial delay between repeated restores", "SEC" },
+	{ "max-holdoff", 0, 0, G_OPTION_ARG_INT, &max_holdoff,
+	  "Maximum delay between repeated restores", "SEC" },
+	{ "once", 'o', 0, G_OPTION_ARG_NONE, &once,
+	  "Check boot order once and exit", NULL },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Report each check", NULL },
+	{}
+};
+
+/** Intended boot order */
+static uint16_t *intended;
+
+/** Number of intended boot order entries */
+static unsigned int intended_count;
+
+/** Time of most recent restore (or zero) */
+static gint64 restored_time;
+
+/** Current holdoff between restores (in microseconds, or zero) */
+static gint64 holdoff;
+
+/**
+ * Parse intended boot order
+ *
+ * @v argc		Number of boot order arguments
+ * @v argv		Boot order arguments (e.g. "Boot0003" or "0003")
+ * @ret ok		Success indicator
+ *
+ * If no boot order arguments are specified, then the current boot
+ * order is used as the intended boot order.
+ */
+static int parse_intended ( int argc, char **argv ) {
+	unsigned long index;
+	const char *text;
+	char *end;
+	int i;
+
+	/* Use current boot order if none was specified */
+	if ( ! argc ) {
+		intended = efiboot_load_order ( EFIBOOT_TYPE_BOOT,
+						&intended_count );
+		if ( ! intended ) {
+			perror ( "Could not load boot order" );
+			return 0;
+		}
+		return 1;
+	}
+
+	/* Parse specified boot order */
+	intended = calloc ( argc, sizeof ( intended[0] ) );
+	if ( ! intended ) {
+		perror ( "Could not allocate boot order" );
+		return 0;
+	}
+	for ( i = 0 ; i < argc ; i++ ) {
+		text = argv[i];
+		if ( strncmp ( text, "Boot", 4 ) == 0 )
+			text += 4;
+		index = strtoul ( text, &end, 16 );
+		if ( ( ! *text ) || *end || ( index > EFIBOOT_INDEX_MAX ) ) {
+			fprintf ( stderr, "Invalid entry \"%s\"\n", argv[i] );
+			return 0;
+		}
+		intended[i] = index;
+	}
+	intended_count = argc;
+
+	return 1;
+}
+
+/**
+ * Construct intended boot order from existing entries
+ *
+ * @v existing		Boot order to fill in
+ * @ret count		Number of boot order entries
+ *
+ * Intended entries whose variables no longer exist are omitted.
+ */
+static unsigned int existing_intended ( uint16_t *existing ) {
+	struct efi_boot_entry *entry;
+	unsigned int count = 0;
+	unsigned int i;
+
+	for ( i = 0 ; i < intended_count ; i++ ) {
+		entry = efiboot_load ( EFIBOOT_TYPE_BOOT, intended[i] );
+		if ( ! entry )
+			continue;
+		efiboot_free ( entry );
+		existing[count++] = intended[i];
+	}
+	return count;
+}
+
+/**
+ * Check and restore boot order
+ *
+ * @v now		Current time
+ * @v force		Ignore any holdoff
+ * @ret next		Time of next required check, or zero on error
+ *
+ * The boot order is written only if it differs from the intended
+ * boot order.  If firmware keeps changing the boot order back, then
+ * the delay between successive restores doubles each time, up to
+ * the maximum holdoff.  The holdoff is cancelled once the boot
+ * order has remained intact for the full holdoff period.
+ */
+static gint64 check ( gint64 now, bool force ) {
+	uint16_t *order;
+	uint16_t *existing;
+	uint16_t *restored;
+	unsigned int count;
+	unsigned int existing_count;
+	unsigned int restored_count;
+	gint64 next = ( now + SEC ( interval ) );
+
+	/* Load current boot order */
+	order = efiboot_load_order ( EFIBOOT_TYPE_BOOT, &count );
+	if ( ! order ) {
+		perror ( "Could not load boot order" );
+		goto err_load;
+	}
+
+	/* Construct restored boot order */
+	existing = calloc ( ( intended_count + 1 ), sizeof ( existing[0] ) );
+	if ( ! existing )
+		goto err_alloc_existing;
+	restored = calloc ( ( count + intended_count + 1 ),
+			    sizeof ( restored[0] ) );
+	if ( ! restored )
+		goto err_alloc_restored;
+	existing_count = existing_intended ( existing );
+	restored_count = efiboot_order_restore ( order, count, existing,
+						 existing_count, restored );
+
+	/* Do nothing if boot order is intact */
+	if ( ( restored_count == count ) &&
+	     ( memcmp ( restored, order,
+			( count * sizeof ( order[0] ) ) ) == 0 ) ) {
+		if ( holdoff && ( now >= ( restored_time + holdoff ) ) ) {
+			if ( verbose )
+				printf ( "Boot order stable\n" );
+			holdoff = 0;
+		} else if ( verbose ) {
+			printf ( "Boot order intact\n" );
+		}
+		goto done;
+	}
+
+	/* Defer restore until holdoff has expired, if applicable */
+	if ( ( ! force ) && ( now < ( restored_time + holdoff ) ) ) {
+		if ( verbose )
+			printf ( "Boot order changed; restore deferred\n" );
+		if ( next > ( restored_time + holdoff ) )
+			next = ( restored_time + holdoff );
+		goto done;
+	}
+
+	/* Restore boot order */
+	if ( ! efiboot_save_order ( EFIBOOT_TYPE_BOOT, restored,
+				    restored_count ) ) {
+		perror ( "Could not restore boot order" );
+		goto err_save;
+	}
+	printf ( "Boot order restored\n" );
+	fflush ( stdout );
+
+	/* Back off exponentially while firmware keeps changing it */
+	restored_time = now;
+	holdoff = ( holdoff ? ( holdoff * 2 ) : SEC ( min_holdoff ) );
+	if ( holdoff > SEC ( max_holdoff ) )
+		holdoff = SEC ( max_holdoff );
+
+ done:
+	free ( restored );
+	free ( existing );
+	free ( order );
+	return next;
+
+ err_save:
+	free ( restored );
+ err_alloc_restored:
+	free ( existing );
+ err_alloc_existing:
+	free ( order );
+ err_load:
+	return 0;
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	GPollFD pollfd;
+	gint64 changed;
+	gint64 deadline;
+	gint64 next;
+	gint64 now;
+	gint timeout;
+	bool pending;
+	int fd;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( "[ENTRY...] - Keep the EFI boot "
+					 "order as intended" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( ( debounce < 0 ) || ( interval <= 0 ) || ( min_holdoff <= 0 ) ||
+	     ( max_holdoff < min_holdoff ) ) {
+		g_printerr ( "Invalid timing options\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Identify intended boot order */
+	if ( ! parse_intended ( ( argc - 1 ), ( argv + 1 ) ) )
+		exit ( EXIT_FAILURE );
+
+	/* Check once, if applicable */
+	if ( once ) {
+		if ( ! check ( g_get_monotonic_time(), true ) )
+			exit ( EXIT_FAILURE );
+		exit ( EXIT_SUCCESS );
+	}
+
+	/* Watch for changes, falling back to polling if unsupported */
+	fd = efiboot_watch();
+	if ( fd < 0 ) {
+		if ( errno != ENOTSUP ) {
+			perror ( "Could not watch variables" );
+			exit ( EXIT_FAILURE );
+		}
+		fprintf ( stderr, "Change notifications unavailable; "
+			  "polling every %ds\n", interval );
+	}
+	memset ( &pollfd, 0, sizeof ( pollfd ) );
+	pollfd.fd = fd;
+	pollfd.events = G_IO_IN;
+
+	/* Check immediately, then whenever changes have settled or the
+	 * next check falls due.
+	 */
+	now = g_get_monotonic_time();
+	changed = ( now - MSEC ( debounce ) );
+	pending = true;
+	next = now;
+	while ( 1 ) {
+
+		/* Wait for next change or deadline */
+		deadline = next;
+		if ( pending && ( deadline > ( changed + MSEC ( debounce ) ) ) )
+			deadline = ( changed + MSEC ( debounce ) );
+		now = g_get_monotonic_time();
+		timeout = ( ( deadline > now ) ?
+			    ( ( deadline - now + USEC_PER_MSEC - 1 ) /
+			      USEC_PER_MSEC ) : 0 );
+		if ( g_poll ( &pollfd, ( ( fd >= 0 ) ? 1 : 0 ),
+			      timeout ) > 0 ) {
+			if ( ! efiboot_watch_drain ( fd ) ) {
+				perror ( "Could not read notifications" );
+				exit ( EXIT_FAILURE );
+			}
+			changed = g_get_monotonic_time();
+			pending = true;
+			continue;
+		}
+		now = g_get_monotonic_time();
+		if ( now < deadline )
+			continue;
+
+		/* Check boot order, retrying later on error */
+		pending = false;
+		next = check ( now, false );
+		if ( ! next )
+			next = ( now + SEC ( interval ) );
+	}
+}
@@ -231,3 +231,140 @@ void test_implausiblepath ( void **state ) {
 		 sizeof ( path.filename ) );
 	assert_true ( efidp_plausible ( &path.hd.Header ) );
 }
+
+/** Test conversion of multiple device paths */
+void test_multipath ( void **state ) {
+	static const char *texts[3] = {
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+		"Fv(7CB8BDC9-F8EB-4F34-AAEA-3EE4AF6516A1)/"
+		"FvFile(7C04A583-9E3E-4F1C-AD65-E05268D0B4D1)",
+		"Uri(http://boot.ipxe.org/ipxe.efi)",
+	};
+	static const char *bad[2] = {
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+		"URI(http://boot.ipxe.org/ipxe.efi)",
+	};
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	void *block;
+	size_t offset = 24;
+	size_t len;
+	unsigned int i;
+
+	( void ) state;
+
+	/* Check that all paths are converted into a single block */
+	block = efidp_from_texts ( texts, 3, false, offset, &len );
+	assert_non_null ( block );
+	path = ( block + offset );
+	for ( i = 0 ; i < 3 ; i++ ) {
+		assert_efidp_from_text ( texts[i], path );
+		len -= efidp_len ( path );
+		path = ( ( ( void * ) path ) + efidp_len ( path ) );
+	}
+	assert_int_equal ( len, 0 );
+	free ( block );
+
+	/* Check that an implausible path fails */
+	assert_null ( efidp_from_texts ( bad, 2, false, 0, &len ) );
+	block = efidp_from_texts ( bad, 2, true, 0, &len );
+	assert_non_null ( block );
+	free ( block );
+}
+
+/**
+ * Test expansion of short-form device path
+ *
+ * @v index		Device path index
+ * @v text		Short-form device path text
+ * @v expected		Expected full device path text
+ */
+void assert_efidp_index_expand ( const struct efidp_index *index,
+				 const char *text, const char *expected ) {
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	EFI_DEVICE_PATH_PROTOCOL *full;
+
+	/* Expand device path */
+	path = efidp_from_text ( text, false );
+	assert_non_null ( path );
+	full = efidp_index_expand ( index, path );
+	assert_non_null ( full );
+
+	/* Check full device path */
+	assert_efidp_to_text ( full, true, true, expected );
+
+	/* Free device paths */
+	free ( full );
+	free ( path );
+}
+
+/** Test short-form device path expansion index */
+void test_indexpath ( void **state ) {
+	static const char *texts[3] = {
+		"HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x800,0x12C000)",
+		"PciRoot(0x0)/Pci(0x1,0x1)/Ata(0x0)/"
+		"HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x800,0x12C000)/"
+		"\\EFI\\BOOT\\BOOTX64.EFI",
+		"PciRoot(0x0)/Pci(0x3,0x0)/MAC(525400123456,0x1)",
+	};
+	static const char *missing =
+		"HD(2,GPT,DB2E3A1C-0F5E-4B7B-9D3A-6F0B2C9E4A11,0x800,0x1000)/"
+		"\\EFI\\BOOT\\BOOTX64.EFI";
+	EFI_DEVICE_PATH_PROTOCOL *paths[3];
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	struct efidp_index *index;
+	unsigned int i;
+
+	( void ) state;
+
+	/* Construct index */
+	index = efidp_index_new();
+	assert_non_null ( index );
+	for ( i = 0 ; i < 3 ; i++ ) {
+		paths[i] = efidp_from_text ( texts[i], false );
+		assert_non_null ( paths[i] );
+		assert_true ( efidp_index_add ( index, paths[i] ) );
+	}
+
+	/* Check expansion by partition signature (ignoring partition
+	 * number, start, and size) in preference to the shorter path.
+	 */
+	assert_efidp_index_expand ( index,
+		"HD(3,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x0,0x0)/"
+		"\\EFI\\fedora\\shimx64.efi",
+		"PciRoot(0x0)/Pci(0x1,0x1)/Ata(0x0)/"
+		"HD(3,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x0,0x0)/"
+		"\\EFI\\fedora\\shimx64.efi" );
+
+	/* Check expansion of file path */
+	assert_efidp_index_expand ( index, "\\EFI\\BOOT\\BOOTX64.EFI",
+		"PciRoot(0x0)/Pci(0x1,0x1)/Ata(0x0)/"
+		"HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,0x800,0x12C000)/"
+		"\\EFI\\BOOT\\BOOTX64.EFI" );
+
+	/* Check expansion of full device path */
+	assert_efidp_index_expand ( index, texts[2], texts[2] );
+
+	/* Check failure to expand unknown partition */
+	path = efidp_from_text ( missing, false );
+	assert_non_null ( path );
+	assert_null ( efidp_index_expand ( index, path ) );
+	free ( path );
+
+	/* Check shortening of partition path, and that shortening is
+	 * the inverse of expansion.
+	 */
+	assert_efidp_to_text ( efidp_shorten ( paths[1] ), true, true,
+			       "HD(1,GPT,C8F57909-D589-41A1-9958-44C7F229E150,"
+			       "0x800,0x12C000)/\\EFI\\BOOT\\BOOTX64.EFI" );
+	assert_efidp_index_expand ( index, "HD(1,GPT,C8F57909-D589-41A1-9958-"
+				    "44C7F229E150,0x800,0x12C000)/"
+				    "\\EFI\\BOOT\\BOOTX64.EFI", texts[1] );
+
+	/* Check that other paths are not shortened */
+	assert_ptr_equal ( efidp_shorten ( paths[2] ), paths[2] );
+
+	/* Free index */
+	efidp_index_free ( index );
+	for ( i = 0 ; i < 3 ; i++ )
+		free ( paths[i] );
+}
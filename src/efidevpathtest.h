@@ -20,11 +20,16 @@ extern void assert_efidp_from_text ( const char *text,
 extern void assert_efidp_text ( const EFI_DEVICE_PATH_PROTOCOL *path,
 				bool display_only, bool allow_shortcuts,
 				const char *text );
+extern void assert_efidp_index_expand ( const struct efidp_index *index,
+					const char *text,
+					const char *expected );
 extern void test_hddpath ( void **state );
 extern void test_macpath ( void **state );
 extern void test_uripath ( void **state );
 extern void test_fvfilepath ( void **state );
 extern void test_hddfilepath ( void **state );
 extern void test_implausiblepath ( void **state );
+extern void test_multipath ( void **state );
+extern void test_indexpath ( void **state );
 
 #endif /* _EFIDEVPATHTEST_H */
@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI device path conversion differential fuzzer
+ *
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efidevpath.h>
+
+#include "guid.h"
+
+/** Maximum length of a generated textual representation */
+#define FUZZ_TEXT_LEN 1024
+
+/** Node templates
+ *
+ * Each template is expanded by replacing the following placeholders
+ * with random values:
+ *
+ *   %b		8-bit hexadecimal value
+ *   %w		16-bit hexadecimal value
+ *   %d		32-bit hexadecimal value
+ *   %q		64-bit hexadecimal value
+ *   %n		Small decimal value
+ *   %g		GUID
+ *   %m		MAC address (as 12 hexadecimal digits)
+ *   %e		EUI-64 (as hyphen-separated hexadecimal bytes)
+ *   %4		IPv4 address
+ *   %6		IPv6 address
+ *   %p		EISA ID (e.g. "PNP0A03")
+ *   %h		Hexadecimal data string
+ *   %s		Short alphanumeric string
+ *   {a|b|c}	One of the listed alternatives
+ */
+static const char *fuzz_nodes[] = {
+	/* Hardware device paths */
+	"Pci(%b,%b)",
+	"PcCard(%b)",
+	"MemoryMapped(%b,%q,%q)",
+	"VenHw(%g)",
+	"VenHw(%g,%h)",
+	"Ctrl(%d)",
+	"BMC(%b,%q)",
+	/* ACPI device paths */
+	"PciRoot(%d)",
+	"PcieRoot(%d)",
+	"Floppy(%d)",
+	"Keyboard(%d)",
+	"Serial(%d)",
+	"ParallelPort(%d)",
+	"Acpi(%p,%d)",
+	"AcpiEx(%p,%p,%d,%s,%s,%s)",
+	"AcpiExp(%p,%p,%s)",
+	"AcpiAdr(%d)",
+	/* Messaging device paths */
+	"Ata({Primary|Secondary},{Master|Slave},%w)",
+	"Scsi(%w,%w)",
+	"Fibre(%q,%q)",
+	"I1394(%q)",
+	"USB(%b,%b)",
+	"I2O(%d)",
+	"Infiniband(%d,%g,%q,%q,%q)",
+	"VenMsg(%g)",
+	"VenMsg(%g,%h)",
+	"VenPcAnsi()",
+	"VenVt100()",
+	"VenVt100Plus()",
+	"VenUtf8()",
+	"UartFlowCtrl({XonXoff|Hardware|None})",
+	"NVMe(%d,%e)",
+	"UFS(%b,%b)",
+	"SD(%b)",
+	"eMMC(%b)",
+	"DebugPort()",
+	"MAC(%m,%b)",
+	"IPv4(%4,{TCP|UDP},{Static|DHCP},%4,%4,%4)",
+	"IPv6(%6,{TCP|UDP},{Static|StatelessAutoConfigure|"
+	"StatefulAutoConfigure},%6,%n,%6)",
+	"Uart({9600|19200|38400|57600|115200},{7|8},{N|E|O},{1|2})",
+	"UsbClass(%w,%w,%b,%b,%b)",
+	"UsbAudio(%w,%w,%b,%b)",
+	"UsbHID(%w,%w,%b,%b)",
+	"UsbMassStorage(%w,%w,%b,%b)",
+	"UsbWwid(%w,%w,%w,%s)",
+	"Unit(%b)",
+	"Vlan(%n)",
+	"Dns(%4)",
+	"Uri(http://%s.example.com/%s)",
+	"Bluetooth(%m)",
+	"BluetoothLE(%m,%b)",
+	"Wi-Fi(%s)",
+	"Sata(%w,%w,%w)",
+	/* Media device paths */
+	"HD(%n,MBR,%d,%q,%q)",
+	"HD(%n,GPT,%g,%q,%q)",
+	"CDROM(%d,%q,%q)",
+	"VenMedia(%g)",
+	"Fv(%g)",
+	"FvFile(%g)",
+	"Offset(%q,%q)",
+	"VirtualDisk(%q,%q,%n)",
+	"VirtualCD(%q,%q,%n)",
+	"PersistentVirtualDisk(%q,%q,%n)",
+	"PersistentVirtualCD(%q,%q,%n)",
+	"RamDisk(%q,%q,%n,%g)",
+	"%s.efi",
+	/* BIOS boot specification device paths */
+	"BBS({Floppy|HD|CDROM|PCMCIA|USB|Network},%s,%w)",
+};
+
+/** Number of paths to generate */
+static gint count = 100000;
+
+/** Maximum number of nodes per path */
+static gint max_nodes = 6;
+
+/** Maximum number of failures to report individually */
+static gint max_reports = 10;
+
+/** Random seed */
+static gint64 seed = 1;
+
+/** Show each generated path */
+static gboolean verbose = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "count", 'n', 0, G_OPTION_ARG_INT, &count,
+	  "Number of paths to generate", "COUNT" },
+	{ "nodes", 'm', 0, G_OPTION_ARG_INT, &max_nodes,
+	  "Maximum number of nodes per path", "NODES" },
+	{ "seed", 's', 0, G_OPTION_ARG_INT64, &seed,
+	  "Random seed", "SEED" },
+	{ "reports", 'r', 0, G_OPTION_ARG_INT, &max_reports,
+	  "Maximum number of failures to report", "COUNT" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Show each generated path", NULL },
+	{}
+};
+
+/** Random number generator state */
+static uint64_t fuzz_state;
+
+/** Conversion statistics */
+static struct {
+	/** Number of paths converted */
+	unsigned long paths;
+	/** Total length of device paths */
+	unsigned long long bytes;
+	/** Number of conversions from text to paths */
+	unsigned long from_count;
+	/** Time spent converting text to paths (in microseconds) */
+	gint64 from_text;
+	/** Time spent converting paths to text (in microseconds) */
+	gint64 to_text;
+	/** Number of failures */
+	unsigned long failures;
+} stats;
+
+/**
+ * Generate random number
+ *
+ * @ret value		Random 64-bit value
+ *
+ * A simple xorshift generator is used, so that any failure may be
+ * reproduced on any platform from the reported seed.
+ */
+static uint64_t fuzz_random ( void ) {
+
+	fuzz_state ^= ( fuzz_state << 13 );
+	fuzz_state ^= ( fuzz_state >> 7 );
+	fuzz_state ^= ( fuzz_state << 17 );
+	return fuzz_state;
+}
+
+/**
+ * Append formatted text
+ *
+ * @v text		Text buffer
+ * @v len		Used length of text buffer (updated)
+ * @v fmt		Format string
+ * @v ...		Arguments
+ */
+static void __attribute__ (( format ( printf, 3, 4 ) ))
+fuzz_append ( char *text, size_t *len, const char *fmt, ... ) {
+	va_list args;
+	int rc;
+
+	va_start ( args, fmt );
+	rc = vsnprintf ( ( text + *len ), ( FUZZ_TEXT_LEN - *len ), fmt,
+			 args );
+	va_end ( args );
+	if ( rc > 0 )
+		*len += rc;
+	if ( *len >= FUZZ_TEXT_LEN )
+		*len = ( FUZZ_TEXT_LEN - 1 );
+}
+
+/**
+ * Expand node template
+ *
+ * @v template		Node template
+ * @v text		Text buffer
+ * @v len		Used length of text buffer (updated)
+ */
+static void fuzz_node ( const char *template, char *text, size_t *len ) {
+	static const char alnum[] = "abcdefghijklmnopqrstuvwxyz"
+				    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				    "0123456789";
+	char guid_text[ GUID_TEXT_LEN + 1 ];
+	const char *alt;
+	const char *end;
+	EFI_GUID guid;
+	unsigned int choices;
+	unsigned int choice;
+	unsigned int i;
+	uint64_t value;
+
+	for ( ; *template ; template++ ) {
+
+		/* Expand alternatives */
+		if ( *template == '{' ) {
+			end = strchr ( template, '}' );
+			for ( choices = 1, alt = template ; alt < end ; alt++ )
+				choices += ( *alt == '|' );
+			choice = ( fuzz_random() % choices );
+			for ( alt = ( template + 1 ) ; choice ; alt++ )
+				choice -= ( *alt == '|' );
+			fuzz_append ( text, len, "%.*s",
+				      ( ( int ) strcspn ( alt, "|}" ) ), alt );
+			template = end;
+			continue;
+		}
+
+		/* Copy literal characters */
+		if ( *template != '%' ) {
+			fuzz_append ( text, len, "%c", *template );
+			continue;
+		}
+
+		/* Expand placeholder */
+		value = fuzz_random();
+		switch ( *(++template) ) {
+		case 'b':
+			fuzz_append ( text, len, "0x%x",
+				      ( ( unsigned int ) ( value & 0xff ) ) );
+			break;
+		case 'w':
+			fuzz_append ( text, len, "0x%x",
+				      ( ( unsigned int ) ( value & 0xffff ) ) );
+			break;
+		case 'd':
+			fuzz_append ( text, len, "0x%x",
+				      ( ( unsigned int ) value ) );
+			break;
+		case 'q':
+			fuzz_append ( text, len, "0x%llx",
+				      ( ( unsigned long long ) value ) );
+			break;
+		case 'n':
+			fuzz_append ( text, len, "%d",
+				      ( ( int ) ( value % 8 ) ) );
+			break;
+		case 'g':
+			memcpy ( &guid, &value, sizeof ( value ) );
+			value = fuzz_random();
+			memcpy ( ( ( ( void * ) &guid ) + sizeof ( value ) ),
+				 &value, sizeof ( value ) );
+			guid_to_text ( &guid, guid_text );
+			fuzz_append ( text, len, "%s", guid_text );
+			break;
+		case 'm':
+			fuzz_append ( text, len, "%012llx",
+				      ( ( unsigned long long )
+					( value & 0xffffffffffffULL ) ) );
+			break;
+		case 'e':
+			for ( i = 0 ; i < 8 ; i++, value >>= 8 ) {
+				fuzz_append ( text, len, "%s%02x",
+					      ( i ? "-" : "" ),
+					      ( ( unsigned int )
+						( value & 0xff ) ) );
+			}
+			break;
+		case '4':
+			fuzz_append ( text, len, "%d.%d.%d.%d",
+				      ( ( int ) ( ( value >> 0 ) & 0xff ) ),
+				      ( ( int ) ( ( value >> 8 ) & 0xff ) ),
+				      ( ( int ) ( ( value >> 16 ) & 0xff ) ),
+				      ( ( int ) ( ( value >> 24 ) & 0xff ) ) );
+			break;
+		case '6':
+			for ( i = 0 ; i < 8 ; i++ ) {
+				fuzz_append ( text, len, "%s%x",
+					      ( i ? ":" : "" ),
+					      ( ( unsigned int )
+						( fuzz_random() & 0xffff ) ) );
+			}
+			break;
+		case 'p':
+			fuzz_append ( text, len, "PNP%04X",
+				      ( ( unsigned int ) ( value & 0xffff ) ) );
+			break;
+		case 'h':
+			for ( i = ( 1 + ( value % 8 ) ) ; i ; i-- ) {
+				fuzz_append ( text, len, "%02x",
+					      ( ( unsigned int )
+						( fuzz_random() & 0xff ) ) );
+			}
+			break;
+		case 's':
+			for ( i = ( 1 + ( value % 8 ) ) ; i ; i-- ) {
+				fuzz_append ( text, len, "%c",
+					      alnum[ fuzz_random() %
+						     ( sizeof ( alnum ) - 1 ) ]
+					      );
+			}
+			break;
+		default:
+			g_assert_not_reached();
+		}
+	}
+}
+
+/**
+ * Generate random device path textual representation
+ *
+ * @v text		Text buffer
+ * @v nodes		Node start offsets to fill in
+ * @ret count		Number of nodes
+ *
+ * An additional offset is recorded following the final node, as if
+ * it were followed by a separator.
+ */
+static unsigned int fuzz_path ( char *text, size_t *nodes ) {
+	unsigned int count;
+	unsigned int i;
+	size_t len = 0;
+
+	count = ( 1 + ( fuzz_random() % max_nodes ) );
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( i )
+			fuzz_append ( text, &len, "/" );
+		nodes[i] = len;
+		fuzz_node ( fuzz_nodes[ fuzz_random() %
+					G_N_ELEMENTS ( fuzz_nodes ) ],
+			    text, &len );
+	}
+	nodes[count] = ( len + 1 /* separator */ );
+	text[len] = '\0';
+	return count;
+}
+
+/**
+ * Get length of device path node
+ *
+ * @v node		Device path node
+ * @ret len		Length of node
+ */
+static size_t fuzz_node_len ( const EFI_DEVICE_PATH_PROTOCOL *node ) {
+	return ( node->Length[0] | ( node->Length[1] << 8 ) );
+}
+
+/**
+ * Report failure
+ *
+ * @v input		Generated textual representation
+ * @v fmt		Format string
+ * @v ...		Arguments
+ */
+static void __attribute__ (( format ( printf, 2, 3 ) ))
+fuzz_fail ( const char *input, const char *fmt, ... ) {
+	va_list args;
+
+	if ( stats.failures++ >= ( ( unsigned long ) max_reports ) )
+		return;
+	fprintf ( stderr, "FAIL: %s\n  ", input );
+	va_start ( args, fmt );
+	vfprintf ( stderr, fmt, args );
+	va_end ( args );
+	fprintf ( stderr, "\n" );
+}
+
+/**
+ * Check that textual representation converts back to device path
+ *
+ * @v input		Generated textual representation
+ * @v text		Textual representation
+ * @v path		Expected EFI device path
+ * @v len		Length of expected EFI device path
+ * @v mode		Text mode
+ */
+static void fuzz_round_trip ( const char *input, const char *text,
+			      const EFI_DEVICE_PATH_PROTOCOL *path, size_t len,
+			      unsigned int mode ) {
+	EFI_DEVICE_PATH_PROTOCOL *copy;
+	gint64 start;
+
+	start = g_get_monotonic_time();
+	copy = efidp_from_text ( text, true );
+	stats.from_text += ( g_get_monotonic_time() - start );
+	stats.from_count++;
+	if ( ! copy ) {
+		fuzz_fail ( input, "could not convert \"%s\" back to path "
+			    "(mode %d)", text, mode );
+	} else if ( ( efidp_len ( copy ) != len ) ||
+		    ( memcmp ( copy, path, len ) != 0 ) ) {
+		fuzz_fail ( input, "\"%s\" does not round-trip (mode %d)",
+			    text, mode );
+	}
+	free ( copy );
+}
+
+/**
+ * Check a single generated device path
+ *
+ * @v input		Generated textual representation
+ * @v nodes		Node start offsets
+ * @v count		Number of nodes
+ *
+ * The generated text is converted to a device path, which is checked
+ * against two independent oracles:
+ *
+ * - each generated node, converted on its own, must produce exactly
+ *   the corresponding node of the complete device path; and
+ *
+ * - each textual representation of the device path (other than the
+ *   lossy display-only forms, which must merely exist) must convert
+ *   back to a byte-identical device path, and the canonical textual
+ *   representation of that device path must be unchanged.
+ */
+static void fuzz_check ( const char *input, const size_t *nodes,
+			 unsigned int count ) {
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	EFI_DEVICE_PATH_PROTOCOL *single;
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	unsigned int mode;
+	unsigned int i;
+	bool display_only;
+	bool allow_shortcuts;
+	char *canonical = NULL;
+	char *text;
+	char *again;
+	gint64 start;
+	size_t len;
+
+	/* Convert generated text to device path */
+	start = g_get_monotonic_time();
+	path = efidp_from_text ( input, true );
+	stats.from_text += ( g_get_monotonic_time() - start );
+	stats.from_count++;
+	if ( ! path ) {
+		fuzz_fail ( input, "could not convert to path" );
+		return;
+	}
+	len = efidp_len ( path );
+	stats.paths++;
+	stats.bytes += len;
+
+	/* Compare each node against the node converted on its own */
+	node = path;
+	for ( i = 0 ; i < count ; i++ ) {
+		text = g_strndup ( ( input + nodes[i] ),
+				   ( nodes[ i + 1 ] - nodes[i] - 1 ) );
+		single = efidp_from_text ( text, true );
+		if ( node->Type == END_DEVICE_PATH_TYPE ) {
+			fuzz_fail ( input, "missing node \"%s\"", text );
+		} else if ( ! single ) {
+			fuzz_fail ( input, "could not convert node \"%s\"",
+				    text );
+		} else if ( ( fuzz_node_len ( single ) !=
+			      fuzz_node_len ( node ) ) ||
+			    ( memcmp ( single, node,
+				       fuzz_node_len ( node ) ) != 0 ) ) {
+			fuzz_fail ( input, "node \"%s\" differs within path",
+				    text );
+		}
+		free ( single );
+		g_free ( text );
+		if ( node->Type == END_DEVICE_PATH_TYPE )
+			break;
+		node = ( ( ( const void * ) node ) + fuzz_node_len ( node ) );
+	}
+	if ( ( i == count ) && ( node->Type != END_DEVICE_PATH_TYPE ) )
+		fuzz_fail ( input, "unexpected additional nodes" );
+
+	/* Check each textual representation */
+	for ( mode = 0 ; mode < 4 ; mode++ ) {
+		display_only = ( mode & 1 );
+		allow_shortcuts = ( mode & 2 );
+		start = g_get_monotonic_time();
+		text = efidp_to_text ( path, display_only, allow_shortcuts );
+		stats.to_text += ( g_get_monotonic_time() - start );
+		if ( ! text ) {
+			fuzz_fail ( input, "could not convert to text (mode "
+				    "%d)", mode );
+			continue;
+		}
+		if ( ! display_only )
+			fuzz_round_trip ( input, text, path, len, mode );
+		if ( mode == 0 ) {
+			canonical = text;
+		} else {
+			free ( text );
+		}
+	}
+
+	/* Check that canonical text is stable */
+	if ( canonical ) {
+		single = efidp_from_text ( canonical, true );
+		again = ( single ? efidp_to_text ( single, false, false ) :
+			  NULL );
+		if ( again && ( strcmp ( again, canonical ) != 0 ) ) {
+			fuzz_fail ( input, "canonical text \"%s\" changes to "
+				    "\"%s\"", canonical, again );
+		}
+		free ( again );
+		free ( single );
+		free ( canonical );
+	}
+
+	free ( path );
+}
+
+/**
+ * Calculate conversion rate
+ *
+ * @v paths		Number of paths
+ * @v usec		Time taken (in microseconds)
+ * @ret rate		Paths per second
+ */
+static double fuzz_rate ( unsigned long paths, gint64 usec ) {
+	return ( usec ? ( ( paths * 1000000.0 ) / usec ) : 0 );
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	GError *error = NULL;
+	GOptionContext *context;
+	char text[FUZZ_TEXT_LEN];
+	size_t *nodes;
+	unsigned int nodes_count;
+	gint i;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( " - Fuzz EFI device path "
+					 "conversions" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( argc > 1 ) {
+		g_printerr ( "Too many arguments\n" );
+		exit ( EXIT_FAILURE );
+	}
+	if ( ( count < 0 ) || ( max_nodes < 1 ) ) {
+		g_printerr ( "Invalid count\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Seed random number generator (which must be nonzero) */
+	fuzz_state = ( seed ? ( ( uint64_t ) seed ) : 1 );
+
+	/* Generate and check paths */
+	nodes = g_new ( size_t, ( max_nodes + 1 ) );
+	for ( i = 0 ; i < count ; i++ ) {
+		nodes_count = fuzz_path ( text, nodes );
+		if ( verbose )
+			printf ( "%s\n", text );
+		fuzz_check ( text, nodes, nodes_count );
+	}
+	g_free ( nodes );
+
+	/* Report statistics */
+	printf ( "%lu paths (%llu bytes), %lu failures\n", stats.paths,
+		 stats.bytes, stats.failures );
+	printf ( "from text: %.0f paths/s\n",
+		 fuzz_rate ( stats.from_count, stats.from_text ) );
+	printf ( "to text:   %.0f paths/s\n",
+		 fuzz_rate ( ( stats.paths * 4 ), stats.to_text ) );
+
+	g_option_context_free ( context );
+	exit ( stats.failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
@@ -13,24 +13,60 @@
 #include <cmocka.h>
 
 #include "memalloctest.h"
+#include "guidtest.h"
 #include "efidevpathtest.h"
 #include "efibootdevtest.h"
+#include "efibootsbattest.h"
+#include "efibootresolvetest.h"
+#include "efibootquirktest.h"
+#include "tcglogtest.h"
+#include "efivarstoretest.h"
+#include "bootdifftest.h"
+#include "config.h"
 
 /** Tests */
 static const struct CMUnitTest tests[] = {
 	cmocka_unit_test ( test_memalloc ),
+	cmocka_unit_test ( test_guid ),
 	cmocka_unit_test ( test_hddpath ),
 	cmocka_unit_test ( test_macpath ),
 	cmocka_unit_test ( test_uripath ),
 	cmocka_unit_test ( test_fvfilepath ),
 	cmocka_unit_test ( test_hddfilepath ),
 	cmocka_unit_test ( test_implausiblepath ),
+	cmocka_unit_test ( test_multipath ),
+	cmocka_unit_test ( test_indexpath ),
 	cmocka_unit_test ( test_hddopt ),
 	cmocka_unit_test ( test_badopt ),
 	cmocka_unit_test ( test_shellopt ),
 	cmocka_unit_test ( test_fedoraopt ),
 	cmocka_unit_test ( test_typename ),
 	cmocka_unit_test ( test_varname ),
+	cmocka_unit_test ( test_takedata ),
+	cmocka_unit_test ( test_dataformat ),
+	cmocka_unit_test ( test_splicepath ),
+	cmocka_unit_test ( test_clone ),
+	cmocka_unit_test ( test_snapshot ),
+	cmocka_unit_test ( test_orderrestore ),
+	cmocka_unit_test ( test_fit ),
+#ifdef EFIVAR_SIMULATED
+	cmocka_unit_test ( test_compact ),
+	cmocka_unit_test ( test_iter ),
+#endif
+	cmocka_unit_test ( test_sbatparse ),
+	cmocka_unit_test ( test_sbatrevoke ),
+	cmocka_unit_test ( test_sbatimage ),
+	cmocka_unit_test ( test_resolvedisk ),
+	cmocka_unit_test ( test_resolveother ),
+	cmocka_unit_test ( test_reorderpaths ),
+	cmocka_unit_test ( test_quirk ),
+	cmocka_unit_test ( test_tcglog ),
+	cmocka_unit_test ( test_tcglogagile ),
+	cmocka_unit_test ( test_varstoreroundtrip ),
+	cmocka_unit_test ( test_varstoreedk2 ),
+	cmocka_unit_test ( test_varstorecorrupt ),
+	cmocka_unit_test ( test_diffjoin ),
+	cmocka_unit_test ( test_difforder ),
 };
 
 /**
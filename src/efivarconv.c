@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI variable store format converter
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+
+#include "guid.h"
+#include "strconvert.h"
+#include "efivarstore.h"
+
+/** Input format name */
+static char *input_format = "efivarfs";
+
+/** Output format name */
+static char *output_format = "snapshot";
+
+/** Size of generated EDK2 variable store image */
+static gint image_size = 0x40000;
+
+/** Show each converted variable */
+static gboolean verbose = FALSE;
+
+/** Command-line options */
+static GOptionEntry options[] = {
+	{ "from", 'f', 0, G_OPTION_ARG_STRING, &input_format,
+	  "Input format (efivarfs, edk2, snapshot)", "FORMAT" },
+	{ "to", 't', 0, G_OPTION_ARG_STRING, &output_format,
+	  "Output format (efivarfs, edk2, snapshot)", "FORMAT" },
+	{ "size", 's', 0, G_OPTION_ARG_INT, &image_size,
+	  "Size of generated EDK2 image", "SIZE" },
+	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+	  "Show each converted variable", NULL },
+	{}
+};
+
+/**
+ * Show converted variable
+ *
+ * @v var		Variable
+ */
+static void var_show ( const struct var *var ) {
+	char guid[ GUID_TEXT_LEN + 1 ];
+	char *name;
+
+	guid_to_text ( &var->guid, guid );
+	name = efi_to_utf8 ( var->name );
+	fprintf ( stderr, "%s-%s attributes %#x length %zu\n",
+		  ( name ? name : "<invalid>" ), guid,
+		  var->value.attributes, var->len );
+	free ( name );
+}
+
+/**
+ * Main entry point
+ *
+ * @v argc		Number of command-line arguments
+ * @v argv		Command-line arguments
+ * @ret exit		Exit status
+ */
+int main ( int argc, char **argv ) {
+	static struct var var;
+	GError *error = NULL;
+	GOptionContext *context;
+	const struct var_format *from;
+	const struct var_format *to;
+	struct var_stream in;
+	struct var_stream out;
+	int rc;
+
+	/* Parse command-line options */
+	context = g_option_context_new ( "INPUT OUTPUT - Convert EFI "
+					 "variable stores" );
+	g_option_context_add_main_entries ( context, options, NULL );
+	if ( ! g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "Could not parse options: %s\n", error->message );
+		exit ( EXIT_FAILURE );
+	}
+	if ( argc != 3 ) {
+		g_printerr ( "Input and output must be specified\n" );
+		exit ( EXIT_FAILURE );
+	}
+	from = var_format ( input_format );
+	to = var_format ( output_format );
+	if ( ! ( from && to ) ) {
+		g_printerr ( "Unknown format \"%s\"\n",
+			     ( from ? output_format : input_format ) );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Open input and output */
+	memset ( &in, 0, sizeof ( in ) );
+	in.path = argv[1];
+	if ( ! from->open_read ( &in ) ) {
+		perror ( "Could not open input" );
+		exit ( EXIT_FAILURE );
+	}
+	memset ( &out, 0, sizeof ( out ) );
+	out.path = argv[2];
+	out.size = ( ( image_size > 0 ) ? image_size : 0 );
+	if ( ! to->open_write ( &out ) ) {
+		perror ( "Could not open output" );
+		exit ( EXIT_FAILURE );
+	}
+
+	/* Convert one variable at a time */
+	while ( ( rc = from->read ( &in, &var ) ) > 0 ) {
+		if ( verbose )
+			var_show ( &var );
+		if ( ! to->write ( &out, &var ) ) {
+			perror ( "Could not write variable" );
+			exit ( EXIT_FAILURE );
+		}
+		in.count++;
+	}
+	if ( rc < 0 ) {
+		perror ( "Could not read variable" );
+		exit ( EXIT_FAILURE );
+	}
+	var_close ( &in );
+
+	/* Finish output */
+	if ( ! to->finish ( &out ) ) {
+		perror ( "Could not finish output" );
+		exit ( EXIT_FAILURE );
+	}
+	if ( verbose )
+		fprintf ( stderr, "%u variables converted\n", in.count );
+
+	g_option_context_free ( context );
+	exit ( EXIT_SUCCESS );
+}
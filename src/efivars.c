@@ -8,6 +8,9 @@
  */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "efivars.h"
 #include "config.h"
 
@@ -17,12 +20,34 @@
  * @v name		Variable name
  * @v data		Data pointer to fill in
  * @v len		Length to fill in
+ * @v attributes	Variable attributes to fill in
+ * @ret ok		Success indicator
+ *
+ * The data storage is allocated using malloc() and must eventually be
+ * freed by the caller.
+ */
+int efivars_read ( const char *name, void **data, size_t *len,
+		   uint32_t *attributes ) {
+
+	return efivars_read_guid ( EFIVARS_GLOBAL_GUID, name, data, len,
+				   attributes );
+}
+
+/**
+ * Read variable
+ *
+ * @v guid		Vendor GUID (in canonical textual form)
+ * @v name		Variable name
+ * @v data		Data pointer to fill in
+ * @v len		Length to fill in
+ * @v attributes	Variable attributes to fill in
  * @ret ok		Success indicator
  *
  * The data storage is allocated using malloc() and must eventually be
  * freed by the caller.
  */
-int efivars_read ( const char *name, void **data, size_t *len );
+int efivars_read_guid ( const char *guid, const char *name, void **data,
+			size_t *len, uint32_t *attributes );
 
 /**
  * Write global variable
@@ -30,9 +55,92 @@ int efivars_read ( const char *name, void **data, size_t *len );
  * @v name		Variable name
  * @v data		Data
  * @v len		Length of data
+ * @v attributes	Variable attributes
  * @ret ok		Success indicator
  */
-int efivars_write ( const char *name, const void *data, size_t len );
+int efivars_write ( const char *name, const void *data, size_t len,
+		    uint32_t attributes ) {
+	struct efivars_iov iov = {
+		.data = data,
+		.len = len,
+	};
+
+	return efivars_writev ( name, &iov, 1, attributes );
+}
+
+/**
+ * Write global variable from scattered fragments
+ *
+ * @v name		Variable name
+ * @v iov		Data fragments
+ * @v count		Number of data fragments
+ * @v attributes	Variable attributes
+ * @ret ok		Success indicator
+ *
+ * The variable data is the concatenation of all fragments.  Backends
+ * that require contiguous data will gather the fragments into a
+ * single buffer only when there is more than one fragment.
+ */
+int efivars_writev ( const char *name, const struct efivars_iov *iov,
+		     unsigned int count, uint32_t attributes );
+
+/**
+ * Gather variable data fragments
+ *
+ * @v iov		Data fragments
+ * @v count		Number of data fragments
+ * @v len		Total length to fill in
+ * @ret data		Contiguous data (or NULL on error)
+ *
+ * If there is only a single fragment, its data is returned directly
+ * (and may be NULL for an empty fragment, which is not an error).
+ * Otherwise, the data is allocated using malloc() and must eventually
+ * be freed by the caller.
+ */
+static __attribute__ (( unused )) void *
+efivars_gather ( const struct efivars_iov *iov, unsigned int count,
+		 size_t *len ) {
+	unsigned int i;
+	void *data;
+	void *tmp;
+
+	/* Use single fragment directly, if applicable */
+	if ( count == 1 ) {
+		*len = iov[0].len;
+		return ( ( void * ) iov[0].data );
+	}
+
+	/* Calculate total length */
+	*len = 0;
+	for ( i = 0 ; i < count ; i++ )
+		*len += iov[i].len;
+
+	/* Allocate and populate contiguous buffer */
+	data = malloc ( *len ? *len : 1 );
+	if ( ! data )
+		return NULL;
+	tmp = data;
+	for ( i = 0 ; i < count ; i++ ) {
+		memcpy ( tmp, iov[i].data, iov[i].len );
+		tmp += iov[i].len;
+	}
+
+	return data;
+}
+
+/**
+ * Free gathered variable data
+ *
+ * @v iov		Data fragments
+ * @v data		Contiguous data
+ */
+static __attribute__ (( unused )) void
+efivars_ungather ( const struct efivars_iov *iov, void *data ) {
+
+	/* Free data only if it was allocated by efivars_gather() */
+	if ( data != iov[0].data )
+		free ( data );
+}
 
 /**
  * Delete global variable
@@ -50,6 +158,81 @@ int efivars_delete ( const char *name );
  */
 int efivars_exists ( const char *name );
 
+/**
+ * Get remaining variable store space
+ *
+ * @v space		Remaining space to fill in
+ * @ret ok		Success indicator
+ *
+ * The remaining space includes any space that the firmware could
+ * recover by reclaiming deleted variables.  If the remaining space
+ * cannot be determined, then errno is set to ENOTSUP.
+ */
+int efivars_space ( size_t *space );
+
+/**
+ * Get total variable store capacity
+ *
+ * @v capacity		Total capacity to fill in
+ * @ret ok		Success indicator
+ *
+ * If the capacity cannot be determined, then errno is set to
+ * ENOTSUP.
+ */
+int efivars_capacity ( size_t *capacity );
+
+/**
+ * Calculate space occupied by variable
+ *
+ * @v name		Variable name
+ * @v len		Length of data
+ * @ret footprint	Space occupied within variable store
+ */
+size_t efivars_footprint ( const char *name, size_t len );
+
+/**
+ * Watch for variable changes
+ *
+ * @ret fd		File descriptor, or negative error
+ *
+ * The file descriptor becomes readable whenever any variable may
+ * have changed.  If change notifications are not supported, then
+ * errno is set to ENOTSUP.
+ */
+int efivars_watch ( void );
+
+/**
+ * Drain variable change notifications
+ *
+ * @v fd		File descriptor
+ * @ret ok		Success indicator
+ */
+int efivars_watch_drain ( int fd );
+
+/** Length of an EDK2 authenticated variable header */
+#define EFIVARS_EDK2_HEADER_LEN 60
+
+/**
+ * Calculate space occupied by variable within an EDK2 variable store
+ *
+ * @v name		Variable name
+ * @v len		Length of data
+ * @ret footprint	Space occupied within variable store
+ *
+ * The name is stored as a NUL-terminated UCS-2 string.  The name and
+ * data are each padded to a multiple of four bytes.  This is the
+ * most common firmware variable store format, and so provides a
+ * reasonable estimate for any firmware.
+ */
+static __attribute__ (( unused )) size_t
+efivars_edk2_footprint ( const char *name, size_t len ) {
+	size_t name_len;
+
+	name_len = ( ( strlen ( name ) + 1 /* NUL */ ) * 2 /* UCS-2 */ );
+	return ( EFIVARS_EDK2_HEADER_LEN + ( ( name_len + 3 ) & ~3UL ) +
+		 ( ( len + 3 ) & ~3UL ) );
+}
+
 /*****************************************************************************
  *
  * Linux: via libefivar
@@ -59,32 +242,52 @@ int efivars_exists ( const char *name );
 
 #ifdef EFIVAR_LIBEFIVAR
 
+#include <errno.h>
+#include <limits.h>
 #include <efivar.h>
+#include <unistd.h>
 #include <sys/types.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
 
-int efivars_read ( const char *name, void **data, size_t *len ) {
-	uint32_t attributes;
+/** efivarfs mount point */
+#define EFIVARS_FS_PATH "/sys/firmware/efi/efivars"
+
+int efivars_read_guid ( const char *guid, const char *name, void **data,
+			size_t *len, uint32_t *attributes ) {
+	efi_guid_t vendor;
+
+	/* Parse vendor GUID */
+	if ( efi_str_to_guid ( guid, &vendor ) < 0 )
+		return 0;
 
 	/* Read variable */
-	if ( efi_get_variable ( EFI_GLOBAL_GUID, name, ( ( uint8_t ** ) data ),
-				len, &attributes ) != 0 )
+	if ( efi_get_variable ( vendor, name, ( ( uint8_t ** ) data ),
+				len, attributes ) != 0 )
 		return 0;
 
 	return 1;
 }
 
-int efivars_write ( const char *name, const void *data, size_t len ) {
+int efivars_writev ( const char *name, const struct efivars_iov *iov,
+		     unsigned int count, uint32_t attributes ) {
+	void *data;
+	size_t len;
+	int rc;
+
+	/* Gather fragments (allowing for an empty single fragment) */
+	data = efivars_gather ( iov, count, &len );
+	if ( ( ! data ) && ( count > 1 ) )
+		return 0;
 
 	/* Write variable */
-	if ( efi_set_variable ( EFI_GLOBAL_GUID, name, ( ( void * ) data ), len,
-				( EFI_VARIABLE_NON_VOLATILE |
-				  EFI_VARIABLE_BOOTSERVICE_ACCESS |
-				  EFI_VARIABLE_RUNTIME_ACCESS ),
-				( S_IRUSR | S_IWUSR |
-				  S_IRGRP | S_IROTH ) ) != 0 )
-		return 0;
+	rc = efi_set_variable ( EFI_GLOBAL_GUID, name, data, len, attributes,
+				( S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH ) );
 
-	return 1;
+	/* Free gathered data */
+	efivars_ungather ( iov, data );
+
+	return ( rc == 0 );
 }
 
 int efivars_delete ( const char *name ) {
@@ -106,6 +309,76 @@ int efivars_exists ( const char *name ) {
 	return 1;
 }
 
+int efivars_space ( size_t *space ) {
+	struct statfs fs;
+
+	/* Query efivarfs, which reports the firmware's own view of
+	 * the remaining variable storage (excluding any space that
+	 * the kernel reserves to avoid triggering firmware bugs).
+	 * Treat efivarfs being unavailable in the same way as older
+	 * kernels that report no storage information, so that callers
+	 * simply skip any space check.
+	 */
+	if ( ( statfs ( EFIVARS_FS_PATH, &fs ) != 0 ) || ( ! fs.f_blocks ) ) {
+		errno = ENOTSUP;
+		return 0;
+	}
+
+	*space = ( fs.f_bavail * fs.f_bsize );
+	return 1;
+}
+
+int efivars_capacity ( size_t *capacity ) {
+	struct statfs fs;
+
+	/* Query efivarfs, as for efivars_space() */
+	if ( ( statfs ( EFIVARS_FS_PATH, &fs ) != 0 ) || ( ! fs.f_blocks ) ) {
+		errno = ENOTSUP;
+		return 0;
+	}
+
+	*capacity = ( fs.f_blocks * fs.f_bsize );
+	return 1;
+}
+
+size_t efivars_footprint ( const char *name, size_t len ) {
+
+	return efivars_edk2_footprint ( name, len );
+}
+
+int efivars_watch ( void ) {
+	int fd;
+
+	/* Watch efivarfs directory for variables being written,
+	 * created, or deleted.  Writes are made by replacing the file
+	 * contents, and so are notified on close.
+	 */
+	fd = inotify_init1 ( IN_NONBLOCK | IN_CLOEXEC );
+	if ( fd < 0 )
+		goto err_init;
+	if ( inotify_add_watch ( fd, EFIVARS_FS_PATH,
+				 ( IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+				   IN_MOVED_TO | IN_ATTRIB ) ) < 0 )
+		goto err_watch;
+
+	return fd;
+
+ err_watch:
+	close ( fd );
+ err_init:
+	return -1;
+}
+
+int efivars_watch_drain ( int fd ) {
+	char buf[ sizeof ( struct inotify_event ) + NAME_MAX + 1 ]
+		__attribute__ (( aligned ( __alignof__ ( struct
+							 inotify_event ) ) ));
+
+	/* Discard all pending events */
+	while ( read ( fd, buf, sizeof ( buf ) ) > 0 ) {}
+	return ( errno == EAGAIN );
+}
+
 #endif /* EFIVAR_LIBEFIVAR */
 
 /*****************************************************************************
@@ -118,6 +391,7 @@ int efivars_exists ( const char *name ) {
 #ifdef EFIVAR_WINDOWS
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <errno.h>
 #include <windows.h>
 
@@ -182,7 +456,13 @@ static int efivars_raise ( void ) {
 	return 1;
 }
 
-int efivars_read ( const char *name, void **data, size_t *len ) {
+int efivars_read_guid ( const char *guid, const char *name, void **data,
+			size_t *len, uint32_t *attributes ) {
+	char vendor[ 1 /* "{" */ + 36 /* GUID */ + 1 /* "}" */ + 1 ];
+	DWORD attrs;
+
+	/* Construct vendor GUID in Windows format */
+	snprintf ( vendor, sizeof ( vendor ), "{%s}", guid );
 
 	/* Obtain privileges */
 	if ( ! efivars_raise() )
@@ -194,8 +474,8 @@ int efivars_read ( const char *name, void **data, size_t *len ) {
 		goto err_alloc;
 
 	/* Read variable */
-	*len = GetFirmwareEnvironmentVariableA ( name, efivars_global,
-						 *data, EFIVARS_MAX_LEN );
+	*len = GetFirmwareEnvironmentVariableExA ( name, vendor, *data,
+						   EFIVARS_MAX_LEN, &attrs );
 	if ( ! *len ) {
 		switch ( GetLastError() ) {
 		case ERROR_INVALID_FUNCTION:
@@ -207,6 +487,7 @@ int efivars_read ( const char *name, void **data, size_t *len ) {
 		}
 		goto err_read;
 	}
+	*attributes = attrs;
 
 	return 1;
 
@@ -218,15 +499,29 @@ int efivars_read ( const char *name, void **data, size_t *len ) {
 	return 0;
 }
 
-int efivars_write ( const char *name, const void *data, size_t len ) {
+int efivars_writev ( const char *name, const struct efivars_iov *iov,
+		     unsigned int count, uint32_t attributes ) {
+	void *data;
+	size_t len;
+	BOOL ok;
 
 	/* Obtain privileges */
 	if ( ! efivars_raise() )
 		return 0;
 
+	/* Gather fragments (allowing for an empty single fragment) */
+	data = efivars_gather ( iov, count, &len );
+	if ( ( ! data ) && ( count > 1 ) )
+		return 0;
+
 	/* Write variable */
-	if ( ! SetFirmwareEnvironmentVariableA ( name, efivars_global,
-						 ( ( void * ) data ), len ) ) {
+	ok = SetFirmwareEnvironmentVariableExA ( name, efivars_global, data,
+						 len, attributes );
+
+	/* Free gathered data */
+	efivars_ungather ( iov, data );
+
+	if ( ! ok ) {
 		errno = EACCES;
 		return 0;
 	}
@@ -237,15 +532,16 @@ int efivars_write ( const char *name, const void *data, size_t len ) {
 int efivars_delete ( const char *name ) {
 
 	/* Delete variable by setting as zero-length */
-	return efivars_write ( name, NULL, 0 );
+	return efivars_write ( name, NULL, 0, EFIVARS_DEFAULT_ATTRIBUTES );
 }
 
 int efivars_exists ( const char *name ) {
+	uint32_t attributes;
 	void *data;
 	size_t len;
 
 	/* Attempt to read variable */
-	if ( ! efivars_read ( name, &data, &len ) )
+	if ( ! efivars_read ( name, &data, &len, &attributes ) )
 		return 0;
 
 	/* Free variable */
@@ -254,6 +550,38 @@ int efivars_exists ( const char *name ) {
 	return 1;
 }
 
+int efivars_space ( size_t *space ) {
+
+	/* QueryVariableInfo() is not exposed by the Windows API */
+	( void ) space;
+	errno = ENOTSUP;
+	return 0;
+}
+
+int efivars_capacity ( size_t *capacity ) {
+
+	/* QueryVariableInfo() is not exposed by the Windows API */
+	( void ) capacity;
+	errno = ENOTSUP;
+	return 0;
+}
+
+size_t efivars_footprint ( const char *name, size_t len ) {
+
+	return efivars_edk2_footprint ( name, len );
+}
+
+int efivars_watch ( void ) {
+	errno = ENOTSUP;
+	return -1;
+}
+
+int efivars_watch_drain ( int fd ) {
+	( void ) fd;
+	errno = ENOTSUP;
+	return 0;
+}
+
 #endif /* EFIVAR_WINDOWS */
 
 /*****************************************************************************
@@ -267,18 +595,23 @@ int efivars_exists ( const char *name ) {
 
 #include <errno.h>
 
-int efivars_read ( const char *name, void **data, size_t *len ) {
+int efivars_read_guid ( const char *guid, const char *name, void **data,
+			size_t *len, uint32_t *attributes ) {
+	( void ) guid;
 	( void ) name;
 	( void ) data;
 	( void ) len;
+	( void ) attributes;
 	errno = ENOTSUP;
 	return 0;
 }
 
-int efivars_write ( const char *name, const void *data, size_t len ) {
+int efivars_writev ( const char *name, const struct efivars_iov *iov,
+		     unsigned int count, uint32_t attributes ) {
 	( void ) name;
-	( void ) data;
-	( void ) len;
+	( void ) iov;
+	( void ) count;
+	( void ) attributes;
 	errno = ENOTSUP;
 	return 0;
 }
@@ -294,4 +627,568 @@ int efivars_exists ( const char *name ) {
 	return 0;
 }
 
+int efivars_space ( size_t *space ) {
+	( void ) space;
+	errno = ENOTSUP;
+	return 0;
+}
+
+int efivars_capacity ( size_t *capacity ) {
+	( void ) capacity;
+	errno = ENOTSUP;
+	return 0;
+}
+
+size_t efivars_footprint ( const char *name, size_t len ) {
+
+	return efivars_edk2_footprint ( name, len );
+}
+
+int efivars_watch ( void ) {
+	errno = ENOTSUP;
+	return -1;
+}
+
+int efivars_watch_drain ( int fd ) {
+	( void ) fd;
+	errno = ENOTSUP;
+	return 0;
+}
+
 #endif /* EFIVAR_DUMMY */
+
+/*****************************************************************************
+ *
+ * Simulated: log-structured non-volatile variable store model
+ *
+ ****************************************************************************
+ *
+ * The simulated store models the behaviour of a typical firmware
+ * variable store held in flash memory.  Each write appends a new
+ * record and marks any previous record for the same variable as
+ * deleted, without ever rewriting existing data in place.  When the
+ * store becomes full, a reclaim operation discards all deleted
+ * records.  Each record write and each reclaim is charged a
+ * simulated latency.
+ *
+ * The store is configured via environment variables:
+ *
+ *   EFIVARS_SIM_FILE		Store image file (omit for in-memory store)
+ *   EFIVARS_SIM_CAPACITY	Store capacity in bytes
+ *   EFIVARS_SIM_WRITE_US	Simulated latency per record write
+ *   EFIVARS_SIM_RECLAIM_US	Simulated latency per reclaim
+ *   EFIVARS_SIM_REPORT		Report store statistics on exit
+ *
+ * The store image file holds the statistics along with the store
+ * contents, so that the cost of a sequence of separate command
+ * invocations may be measured.
+ */
+
+#ifdef EFIVAR_SIMULATED
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+
+/** Default store capacity */
+#define EFIVARS_SIM_CAPACITY 65536
+
+/** Default simulated latency per record write (in microseconds) */
+#define EFIVARS_SIM_WRITE_US 1000
+
+/** Default simulated latency per reclaim (in microseconds) */
+#define EFIVARS_SIM_RECLAIM_US 100000
+
+/** Store image signature */
+#define EFIVARS_SIM_MAGIC "EFIKITNV"
+
+/** Record is valid
+ *
+ * As with flash memory, record states may be changed only by
+ * clearing bits.
+ */
+#define EFIVARS_SIM_VALID 0x3f
+
+/** Record has been deleted */
+#define EFIVARS_SIM_DELETED 0x3c
+
+/** Simulated store image header */
+struct efivars_sim_header {
+	/** Signature */
+	char magic[8];
+	/** Capacity */
+	uint32_t capacity;
+	/** Used length */
+	uint32_t used;
+	/** Number of records written */
+	uint64_t writes;
+	/** Number of records deleted */
+	uint64_t deletes;
+	/** Number of reclaims */
+	uint64_t reclaims;
+	/** Total simulated latency (in microseconds) */
+	uint64_t latency;
+};
+
+/** A simulated store record */
+struct efivars_sim_record {
+	/** State */
+	uint8_t state;
+	/** Reserved */
+	uint8_t reserved[3];
+	/** Variable attributes */
+	uint32_t attributes;
+	/** Length of name (including terminating NUL) */
+	uint32_t name_len;
+	/** Length of data */
+	uint32_t data_len;
+} __attribute__ (( packed ));
+
+/** Simulated store */
+static struct {
+	/** Header */
+	struct efivars_sim_header header;
+	/** Store contents */
+	void *data;
+	/** Store image file name (or NULL) */
+	const char *file;
+	/** Simulated latency per record write */
+	unsigned long write_us;
+	/** Simulated latency per reclaim */
+	unsigned long reclaim_us;
+	/** Store has been initialised */
+	bool initialised;
+} efivars_sim;
+
+/**
+ * Get environment variable as unsigned integer
+ *
+ * @v name		Environment variable name
+ * @v value		Default value
+ * @ret value		Value
+ */
+static unsigned long efivars_sim_env ( const char *name,
+				       unsigned long value ) {
+	const char *text;
+
+	text = getenv ( name );
+	if ( text && *text )
+		value = strtoul ( text, NULL, 0 );
+	return value;
+}
+
+/**
+ * Calculate length of simulated store record
+ *
+ * @v record		Record
+ * @ret len		Length of record (including padding)
+ */
+static size_t efivars_sim_len ( const struct efivars_sim_record *record ) {
+	size_t len;
+
+	len = ( sizeof ( *record ) + record->name_len + record->data_len );
+	return ( ( len + 3 ) & ~( ( size_t ) 3 ) );
+}
+
+/**
+ * Report simulated store statistics
+ */
+static void efivars_sim_report ( void ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	const struct efivars_sim_record *record;
+	unsigned int valid = 0;
+	unsigned int deleted = 0;
+	size_t offset;
+
+	/* Count records */
+	for ( offset = 0 ; offset < header->used ;
+	      offset += efivars_sim_len ( record ) ) {
+		record = ( efivars_sim.data + offset );
+		if ( record->state == EFIVARS_SIM_VALID ) {
+			valid++;
+		} else {
+			deleted++;
+		}
+	}
+
+	/* Report statistics */
+	fprintf ( stderr, "efivars: %u valid, %u deleted records; "
+		  "%u/%u bytes used\n", valid, deleted, header->used,
+		  header->capacity );
+	fprintf ( stderr, "efivars: %llu writes, %llu deletes, %llu reclaims; "
+		  "%llu us simulated latency\n",
+		  ( ( unsigned long long ) header->writes ),
+		  ( ( unsigned long long ) header->deletes ),
+		  ( ( unsigned long long ) header->reclaims ),
+		  ( ( unsigned long long ) header->latency ) );
+}
+
+/**
+ * Initialise simulated store
+ *
+ * @ret ok		Success indicator
+ */
+static int efivars_sim_init ( void ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	const struct efivars_sim_record *record;
+	size_t offset;
+	FILE *fh;
+
+	/* Do nothing if already initialised */
+	if ( efivars_sim.initialised )
+		return 1;
+
+	/* Read configuration */
+	efivars_sim.file = getenv ( "EFIVARS_SIM_FILE" );
+	efivars_sim.write_us = efivars_sim_env ( "EFIVARS_SIM_WRITE_US",
+						 EFIVARS_SIM_WRITE_US );
+	efivars_sim.reclaim_us = efivars_sim_env ( "EFIVARS_SIM_RECLAIM_US",
+						   EFIVARS_SIM_RECLAIM_US );
+	memset ( header, 0, sizeof ( *header ) );
+	memcpy ( header->magic, EFIVARS_SIM_MAGIC, sizeof ( header->magic ) );
+	header->capacity = efivars_sim_env ( "EFIVARS_SIM_CAPACITY",
+					     EFIVARS_SIM_CAPACITY );
+
+	/* Read existing store image, if any */
+	fh = ( efivars_sim.file ? fopen ( efivars_sim.file, "rb" ) : NULL );
+	if ( fh ) {
+		if ( ( fread ( header, sizeof ( *header ), 1, fh ) != 1 ) ||
+		     ( memcmp ( header->magic, EFIVARS_SIM_MAGIC,
+				sizeof ( header->magic ) ) != 0 ) ||
+		     ( header->used > header->capacity ) ) {
+			errno = EINVAL;
+			goto err_header;
+		}
+	}
+
+	/* Allocate store */
+	efivars_sim.data = malloc ( header->capacity );
+	if ( ! efivars_sim.data )
+		goto err_alloc;
+
+	/* Read existing store contents, if any */
+	if ( fh ) {
+		if ( fread ( efivars_sim.data, 1, header->used,
+			     fh ) != header->used ) {
+			errno = EINVAL;
+			goto err_data;
+		}
+		fclose ( fh );
+		fh = NULL;
+	}
+
+	/* Validate records */
+	for ( offset = 0 ; offset < header->used ;
+	      offset += efivars_sim_len ( record ) ) {
+		record = ( efivars_sim.data + offset );
+		if ( ( ( header->used - offset ) < sizeof ( *record ) ) ||
+		     ( efivars_sim_len ( record ) >
+		       ( header->used - offset ) ) ||
+		     ( record->name_len < 1 ) ||
+		     ( ( ( char * ) ( record + 1 ) )
+		       [ record->name_len - 1 ] != '\0' ) ) {
+			errno = EINVAL;
+			goto err_record;
+		}
+	}
+
+	/* Report statistics on exit, if applicable */
+	if ( getenv ( "EFIVARS_SIM_REPORT" ) )
+		atexit ( efivars_sim_report );
+
+	efivars_sim.initialised = true;
+	return 1;
+
+ err_record:
+ err_data:
+	free ( efivars_sim.data );
+	efivars_sim.data = NULL;
+ err_alloc:
+ err_header:
+	if ( fh )
+		fclose ( fh );
+	return 0;
+}
+
+/**
+ * Write out simulated store image
+ *
+ * @ret ok		Success indicator
+ */
+static int efivars_sim_sync ( void ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	FILE *fh;
+	int ok;
+
+	/* Do nothing unless backed by a file */
+	if ( ! efivars_sim.file )
+		return 1;
+
+	/* Write image */
+	fh = fopen ( efivars_sim.file, "wb" );
+	if ( ! fh )
+		return 0;
+	ok = ( ( fwrite ( header, sizeof ( *header ), 1, fh ) == 1 ) &&
+	       ( fwrite ( efivars_sim.data, 1, header->used,
+			  fh ) == header->used ) );
+	if ( fclose ( fh ) != 0 )
+		ok = 0;
+	if ( ! ok )
+		errno = EIO;
+
+	return ok;
+}
+
+/**
+ * Find valid simulated store record
+ *
+ * @v name		Variable name
+ * @ret record		Record, or NULL if not found
+ */
+static struct efivars_sim_record * efivars_sim_find ( const char *name ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	struct efivars_sim_record *record;
+	size_t offset;
+
+	for ( offset = 0 ; offset < header->used ;
+	      offset += efivars_sim_len ( record ) ) {
+		record = ( efivars_sim.data + offset );
+		if ( ( record->state == EFIVARS_SIM_VALID ) &&
+		     ( strcmp ( ( ( void * ) ( record + 1 ) ), name ) == 0 ) )
+			return record;
+	}
+	return NULL;
+}
+
+/**
+ * Mark simulated store record as deleted
+ *
+ * @v record		Record
+ */
+static void efivars_sim_mark ( struct efivars_sim_record *record ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+
+	record->state &= EFIVARS_SIM_DELETED;
+	header->deletes++;
+	header->latency += efivars_sim.write_us;
+}
+
+/**
+ * Reclaim space occupied by deleted simulated store records
+ *
+ * @v keep		Valid record to be tracked (or NULL)
+ * @ret keep		Relocated tracked record (or NULL)
+ */
+static struct efivars_sim_record *
+efivars_sim_reclaim ( struct efivars_sim_record *keep ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	struct efivars_sim_record *record;
+	struct efivars_sim_record *kept = NULL;
+	size_t offset;
+	size_t used;
+	size_t len;
+
+	/* Move all valid records to start of store */
+	used = 0;
+	for ( offset = 0 ; offset < header->used ; offset += len ) {
+		record = ( efivars_sim.data + offset );
+		len = efivars_sim_len ( record );
+		if ( record->state != EFIVARS_SIM_VALID )
+			continue;
+		memmove ( ( efivars_sim.data + used ), record, len );
+		if ( record == keep )
+			kept = ( efivars_sim.data + used );
+		used += len;
+	}
+	header->used = used;
+
+	/* Record reclaim */
+	header->reclaims++;
+	header->latency += efivars_sim.reclaim_us;
+
+	return kept;
+}
+
+int efivars_read_guid ( const char *guid, const char *name, void **data,
+			size_t *len, uint32_t *attributes ) {
+	struct efivars_sim_record *record;
+
+	/* Only global variables are simulated */
+	if ( strcmp ( guid, EFIVARS_GLOBAL_GUID ) != 0 ) {
+		errno = ENOENT;
+		return 0;
+	}
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	/* Find record */
+	record = efivars_sim_find ( name );
+	if ( ! record ) {
+		errno = ENOENT;
+		return 0;
+	}
+
+	/* Copy data */
+	*data = malloc ( record->data_len ? record->data_len : 1 );
+	if ( ! *data )
+		return 0;
+	memcpy ( *data, ( ( ( void * ) ( record + 1 ) ) + record->name_len ),
+		 record->data_len );
+	*len = record->data_len;
+	*attributes = record->attributes;
+
+	return 1;
+}
+
+int efivars_writev ( const char *name, const struct efivars_iov *iov,
+		     unsigned int count, uint32_t attributes ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	struct efivars_sim_record *old;
+	struct efivars_sim_record *record;
+	struct efivars_sim_record new = {
+		.state = EFIVARS_SIM_VALID,
+		.attributes = attributes,
+		.name_len = ( strlen ( name ) + 1 /* NUL */ ),
+	};
+	size_t record_len;
+	size_t len;
+	unsigned int i;
+	void *tmp;
+
+	/* Calculate record length */
+	for ( len = 0, i = 0 ; i < count ; i++ )
+		len += iov[i].len;
+	new.data_len = len;
+	record_len = efivars_sim_len ( &new );
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	/* Treat zero-length writes as deletions */
+	if ( ! len )
+		return efivars_delete ( name );
+
+	/* Reclaim space, if necessary */
+	old = efivars_sim_find ( name );
+	if ( record_len > ( header->capacity - header->used ) )
+		old = efivars_sim_reclaim ( old );
+	if ( record_len > ( header->capacity - header->used ) ) {
+		errno = ENOSPC;
+		return 0;
+	}
+
+	/* Append new record */
+	record = ( efivars_sim.data + header->used );
+	memcpy ( record, &new, sizeof ( *record ) );
+	memcpy ( ( record + 1 ), name, new.name_len );
+	tmp = ( ( ( void * ) ( record + 1 ) ) + new.name_len );
+	for ( i = 0 ; i < count ; i++ ) {
+		memcpy ( tmp, iov[i].data, iov[i].len );
+		tmp += iov[i].len;
+	}
+	memset ( tmp, 0, ( record_len - sizeof ( *record ) -
+			   new.name_len - len ) );
+	header->used += record_len;
+	header->writes++;
+	header->latency += efivars_sim.write_us;
+
+	/* Mark old record as deleted */
+	if ( old )
+		efivars_sim_mark ( old );
+
+	/* Write out store image */
+	return efivars_sim_sync();
+}
+
+int efivars_delete ( const char *name ) {
+	struct efivars_sim_record *record;
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	/* Find record */
+	record = efivars_sim_find ( name );
+	if ( ! record ) {
+		errno = ENOENT;
+		return 0;
+	}
+
+	/* Mark record as deleted */
+	efivars_sim_mark ( record );
+
+	/* Write out store image */
+	return efivars_sim_sync();
+}
+
+int efivars_exists ( const char *name ) {
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	/* Find record */
+	return ( efivars_sim_find ( name ) != NULL );
+}
+
+int efivars_space ( size_t *space ) {
+	struct efivars_sim_header *header = &efivars_sim.header;
+	const struct efivars_sim_record *record;
+	size_t offset;
+	size_t used;
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	/* Count space used by valid records, since deleted records
+	 * may be reclaimed.
+	 */
+	used = 0;
+	for ( offset = 0 ; offset < header->used ;
+	      offset += efivars_sim_len ( record ) ) {
+		record = ( efivars_sim.data + offset );
+		if ( record->state == EFIVARS_SIM_VALID )
+			used += efivars_sim_len ( record );
+	}
+
+	*space = ( header->capacity - used );
+	return 1;
+}
+
+int efivars_capacity ( size_t *capacity ) {
+
+	/* Initialise store */
+	if ( ! efivars_sim_init() )
+		return 0;
+
+	*capacity = efivars_sim.header.capacity;
+	return 1;
+}
+
+size_t efivars_footprint ( const char *name, size_t len ) {
+	struct efivars_sim_record record = {
+		.name_len = ( strlen ( name ) + 1 /* NUL */ ),
+		.data_len = len,
+	};
+
+	return efivars_sim_len ( &record );
+}
+
+int efivars_watch ( void ) {
+
+	/* Changes made by other processes are not notified */
+	errno = ENOTSUP;
+	return -1;
+}
+
+int efivars_watch_drain ( int fd ) {
+	( void ) fd;
+	errno = ENOTSUP;
+	return 0;
+}
+
+#endif /* EFIVAR_SIMULATED */
@@ -11,10 +11,42 @@
 #define _EFIVARS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
-extern int efivars_read ( const char *name, void **data, size_t *len );
-extern int efivars_write ( const char *name, const void *data, size_t len );
+/** Default attributes for newly created variables
+ *
+ * This is EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS
+ * | EFI_VARIABLE_RUNTIME_ACCESS, defined numerically to avoid
+ * conflicting definitions between the EDK2 and libefivar headers.
+ */
+#define EFIVARS_DEFAULT_ATTRIBUTES 0x00000007UL
+
+/** Global variable GUID */
+#define EFIVARS_GLOBAL_GUID "8be4df61-93ca-11d2-aa0d-00e098032b8c"
+
+/** A fragment of variable data */
+struct efivars_iov {
+	/** Data */
+	const void *data;
+	/** Length of data */
+	size_t len;
+};
+
+extern int efivars_read ( const char *name, void **data, size_t *len,
+			  uint32_t *attributes );
+extern int efivars_read_guid ( const char *guid, const char *name,
+			       void **data, size_t *len,
+			       uint32_t *attributes );
+extern int efivars_write ( const char *name, const void *data, size_t len,
+			   uint32_t attributes );
+extern int efivars_writev ( const char *name, const struct efivars_iov *iov,
+			    unsigned int count, uint32_t attributes );
 extern int efivars_delete ( const char *name );
 extern int efivars_exists ( const char *name );
+extern int efivars_space ( size_t *space );
+extern int efivars_capacity ( size_t *capacity );
+extern size_t efivars_footprint ( const char *name, size_t len );
+extern int efivars_watch ( void );
+extern int efivars_watch_drain ( int fd );
 
 #endif /* _EFIVARS_H */
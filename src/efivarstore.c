@@ -0,0 +1,991 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI variable store formats
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <glib.h>
+#include <Uefi/UefiBaseType.h>
+#include <Pi/PiFirmwareVolume.h>
+
+#include "guid.h"
+#include "strconvert.h"
+#include "efivarstore.h"
+
+/** Open files without text-mode translation, where applicable */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/******************************************************************************
+ *
+ * Image files
+ *
+ ******************************************************************************
+ */
+
+/**
+ * Open image file
+ *
+ * @v stream		Variable store stream
+ * @v mode		Open mode
+ * @ret ok		Success indicator
+ */
+static int image_open ( struct var_stream *stream, const char *mode ) {
+
+	/* Use standard input or output, if applicable */
+	if ( strcmp ( stream->path, "-" ) == 0 ) {
+		stream->file = ( ( mode[0] == 'r' ) ? stdin : stdout );
+		return 1;
+	}
+
+	/* Open file */
+	stream->file = fopen ( stream->path, mode );
+	if ( ! stream->file )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Read from image file
+ *
+ * @v stream		Variable store stream
+ * @v buf		Buffer
+ * @v len		Length to read
+ * @ret ok		Success indicator
+ */
+static int image_read ( struct var_stream *stream, void *buf, size_t len ) {
+
+	/* Read data, treating a truncated file as malformed */
+	if ( fread ( buf, 1, len, stream->file ) != len ) {
+		if ( ! ferror ( stream->file ) )
+			errno = EINVAL;
+		return 0;
+	}
+	stream->offset += len;
+
+	return 1;
+}
+
+/**
+ * Write to image file
+ *
+ * @v stream		Variable store stream
+ * @v buf		Buffer
+ * @v len		Length to write
+ * @ret ok		Success indicator
+ */
+static int image_write ( struct var_stream *stream, const void *buf,
+			 size_t len ) {
+
+	/* Write data */
+	if ( fwrite ( buf, 1, len, stream->file ) != len )
+		return 0;
+	stream->offset += len;
+
+	return 1;
+}
+
+/**
+ * Skip over (or pad) image file to specified alignment or offset
+ *
+ * @v stream		Variable store stream
+ * @v offset		Offset
+ * @v fill		Padding byte (for writing), or negative to read
+ * @ret ok		Success indicator
+ *
+ * Image files are never seeked, so that standard input and output
+ * may be used.
+ */
+static int image_pad ( struct var_stream *stream, size_t offset, int fill ) {
+	uint8_t buf[512];
+	size_t len;
+
+	/* Fill buffer */
+	memset ( buf, fill, sizeof ( buf ) );
+
+	/* Skip or pad to offset */
+	while ( stream->offset < offset ) {
+		len = ( offset - stream->offset );
+		if ( len > sizeof ( buf ) )
+			len = sizeof ( buf );
+		if ( ! ( ( fill < 0 ) ? image_read ( stream, buf, len ) :
+			 image_write ( stream, buf, len ) ) )
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Close image file
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int image_close ( struct var_stream *stream ) {
+	FILE *file = stream->file;
+
+	/* Do nothing for standard input or output */
+	if ( ( file == stdin ) || ( file == stdout ) )
+		return ( fflush ( file ) == 0 );
+
+	/* Close file */
+	return ( fclose ( file ) == 0 );
+}
+
+/**
+ * Check validity of variable name
+ *
+ * @v var		Variable
+ * @ret ok		Success indicator
+ */
+static int var_name_valid ( struct var *var ) {
+	unsigned int chars = ( var->name_len / sizeof ( var->name[0] ) );
+	unsigned int i;
+
+	/* Check name is a nonempty NUL-terminated string */
+	if ( ( var->name_len % sizeof ( var->name[0] ) ) || ( chars < 2 ) )
+		goto err;
+	for ( i = 0 ; i < ( chars - 1 ) ; i++ ) {
+		if ( ! var->name[i] )
+			goto err;
+	}
+	if ( var->name[i] )
+		goto err;
+
+	return 1;
+
+ err:
+	errno = EINVAL;
+	return 0;
+}
+
+/******************************************************************************
+ *
+ * efivarfs directory trees
+ *
+ ******************************************************************************
+ */
+
+/**
+ * Open efivarfs directory for reading
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int efivarfs_open_read ( struct var_stream *stream ) {
+
+	/* Open directory */
+	stream->dir = opendir ( stream->path );
+	if ( ! stream->dir )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Read next variable from efivarfs directory
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable to fill in
+ * @ret rc		1 if a variable was read, 0 at end of store, or -1
+ */
+static int efivarfs_read ( struct var_stream *stream, struct var *var ) {
+	struct dirent *dirent;
+	char *path;
+	char *guid;
+	CHAR16 *name;
+	ssize_t len;
+	size_t name_len;
+	unsigned int i;
+	int fd;
+
+	/* Find next variable file (named <name>-<guid>) */
+	while ( 1 ) {
+		errno = 0;
+		dirent = readdir ( stream->dir );
+		if ( ! dirent )
+			return ( errno ? -1 : 0 );
+		name_len = strlen ( dirent->d_name );
+		if ( name_len < ( GUID_TEXT_LEN + 2 ) )
+			continue;
+		guid = ( dirent->d_name + name_len - GUID_TEXT_LEN );
+		if ( ( guid[-1] == '-' ) &&
+		     guid_from_text ( guid, &var->guid ) )
+			break;
+	}
+
+	/* Convert name */
+	guid[-1] = '\0';
+	name = utf8_to_efi ( dirent->d_name );
+	guid[-1] = '-';
+	if ( ! name )
+		return -1;
+	for ( i = 0 ; name[i] ; i++ ) {
+		if ( i >= ( VAR_NAME_MAX - 1 ) ) {
+			free ( name );
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		var->name[i] = name[i];
+	}
+	var->name[i] = 0;
+	var->name_len = ( ( i + 1 ) * sizeof ( var->name[0] ) );
+	free ( name );
+
+	/* Read attributes and data */
+	path = g_build_filename ( stream->path, dirent->d_name, NULL );
+	fd = open ( path, ( O_RDONLY | O_BINARY ) );
+	g_free ( path );
+	if ( fd < 0 )
+		return -1;
+	len = read ( fd, &var->value, sizeof ( var->value ) );
+	close ( fd );
+	if ( len < 0 )
+		return -1;
+	if ( len < ( ( ssize_t ) sizeof ( var->value.attributes ) ) ) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ( len == ( ( ssize_t ) sizeof ( var->value ) ) ) {
+		errno = EFBIG;
+		return -1;
+	}
+	var->len = ( len - sizeof ( var->value.attributes ) );
+
+	return 1;
+}
+
+/**
+ * Open efivarfs directory for writing
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int efivarfs_open_write ( struct var_stream *stream ) {
+
+	/* Create directory, if applicable */
+	if ( g_mkdir_with_parents ( stream->path, 0755 ) != 0 )
+		return 0;
+
+	/* Open directory */
+	return efivarfs_open_read ( stream );
+}
+
+/**
+ * Write variable to efivarfs directory
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable
+ * @ret ok		Success indicator
+ */
+static int efivarfs_write ( struct var_stream *stream,
+			    const struct var *var ) {
+	char filename[ VAR_NAME_MAX * 4 + 1 /* "-" */ + GUID_TEXT_LEN + 1 ];
+	size_t len = ( sizeof ( var->value.attributes ) + var->len );
+	char *name;
+	char *path;
+	int fd;
+
+	/* Construct file name */
+	name = efi_to_utf8 ( var->name );
+	if ( ! name )
+		goto err_name;
+	if ( strchr ( name, '/' ) ) {
+		errno = EINVAL;
+		goto err_slash;
+	}
+	snprintf ( filename, sizeof ( filename ), "%s-", name );
+	guid_to_text ( &var->guid, ( filename + strlen ( filename ) ) );
+
+	/* Write attributes and data as a single write */
+	path = g_build_filename ( stream->path, filename, NULL );
+	fd = open ( path, ( O_WRONLY | O_CREAT | O_TRUNC | O_BINARY ), 0644 );
+	g_free ( path );
+	if ( fd < 0 )
+		goto err_open;
+	if ( write ( fd, &var->value, len ) != ( ( ssize_t ) len ) )
+		goto err_write;
+	if ( close ( fd ) != 0 )
+		goto err_close;
+
+	free ( name );
+	return 1;
+
+ err_write:
+	close ( fd );
+ err_close:
+ err_open:
+ err_slash:
+	free ( name );
+ err_name:
+	return 0;
+}
+
+/**
+ * Finish writing efivarfs directory
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int efivarfs_finish ( struct var_stream *stream ) {
+
+	/* Close directory */
+	return ( closedir ( stream->dir ) == 0 );
+}
+
+/******************************************************************************
+ *
+ * EDK2 non-volatile variable store images
+ *
+ ******************************************************************************
+ */
+
+/** EDK2 non-volatile data firmware volume GUID */
+#define EDK2_NV_DATA_FV_GUID						\
+	{ 0xfff12b8d, 0x7696, 0x4c8b,					\
+	  { 0xa9, 0x85, 0x27, 0x47, 0x07, 0x5b, 0x4f, 0x50 } }
+
+/** EDK2 variable store signature GUID */
+#define EDK2_VARIABLE_GUID						\
+	{ 0xddcf3616, 0x3275, 0x4164,					\
+	  { 0x98, 0xb6, 0xfe, 0x85, 0x70, 0x7f, 0xfe, 0x7d } }
+
+/** EDK2 authenticated variable store signature GUID */
+#define EDK2_AUTH_VARIABLE_GUID						\
+	{ 0xaaf32c78, 0x947b, 0x439a,					\
+	  { 0xa1, 0x80, 0x2e, 0x14, 0x4e, 0xc3, 0x77, 0x92 } }
+
+/** EDK2 firmware volume attributes (as used by OVMF) */
+#define EDK2_FV_ATTRIBUTES 0x0004feff
+
+/** EDK2 firmware volume block size */
+#define EDK2_FV_BLOCK_SIZE 0x1000
+
+/** EDK2 variable store is formatted */
+#define EDK2_STORE_FORMATTED 0x5a
+
+/** EDK2 variable store is healthy */
+#define EDK2_STORE_HEALTHY 0xfe
+
+/** EDK2 variable header start marker */
+#define EDK2_VAR_START_ID 0x55aa
+
+/** EDK2 variable has been completely added */
+#define EDK2_VAR_ADDED 0x3f
+
+/** EDK2 variable header alignment */
+#define EDK2_VAR_ALIGN 4
+
+/** An EDK2 firmware volume header (with terminated block map) */
+struct edk2_fv_header {
+	/** Firmware volume header */
+	EFI_FIRMWARE_VOLUME_HEADER fv;
+	/** Block map terminator */
+	EFI_FV_BLOCK_MAP_ENTRY end;
+};
+
+/** An EDK2 variable store header
+ *
+ * The EDK2 definitions of the variable store structures live in
+ * MdeModulePkg, which is not part of this tree.
+ */
+struct edk2_store_header {
+	/** Signature */
+	EFI_GUID signature;
+	/** Size of variable store (including this header) */
+	uint32_t size;
+	/** Format */
+	uint8_t format;
+	/** State */
+	uint8_t state;
+	/** Reserved */
+	uint16_t reserved;
+	/** Reserved */
+	uint32_t reserved1;
+} __attribute__ (( packed ));
+
+/** An EDK2 variable header (common portion) */
+struct edk2_var_header {
+	/** Start marker */
+	uint16_t start;
+	/** State */
+	uint8_t state;
+	/** Reserved */
+	uint8_t reserved;
+	/** Attributes */
+	uint32_t attributes;
+} __attribute__ (( packed ));
+
+/** An EDK2 variable header (remaining portion) */
+struct edk2_var_info {
+	/** Name length (in bytes, including terminating NUL) */
+	uint32_t name_len;
+	/** Data length */
+	uint32_t len;
+	/** Vendor GUID */
+	EFI_GUID guid;
+} __attribute__ (( packed ));
+
+/** An EDK2 authenticated variable header (authentication portion) */
+struct edk2_var_auth {
+	/** Monotonic count */
+	uint64_t count;
+	/** Timestamp */
+	EFI_TIME time;
+	/** Public key index */
+	uint32_t key;
+} __attribute__ (( packed ));
+
+/** EDK2 authenticated variable store signature */
+static const EFI_GUID edk2_auth_guid = EDK2_AUTH_VARIABLE_GUID;
+
+/** EDK2 variable store signature */
+static const EFI_GUID edk2_guid = EDK2_VARIABLE_GUID;
+
+/**
+ * Calculate EDK2 firmware volume header checksum
+ *
+ * @v data		Firmware volume header (or portion thereof)
+ * @v len		Length of data
+ * @ret sum		Sum of all 16-bit words
+ */
+static uint16_t edk2_checksum ( const void *data, size_t len ) {
+	const uint16_t *word = data;
+	uint16_t sum = 0;
+	unsigned int i;
+
+	for ( i = 0 ; i < ( len / sizeof ( *word ) ) ; i++ )
+		sum += word[i];
+	return sum;
+}
+
+/**
+ * Open EDK2 image for reading
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int edk2_open_read ( struct var_stream *stream ) {
+	struct edk2_fv_header header;
+	struct edk2_store_header store;
+	uint16_t word;
+	uint16_t sum;
+
+	/* Open file */
+	if ( ! image_open ( stream, "rb" ) )
+		goto err_open;
+
+	/* Read and check firmware volume header */
+	if ( ! image_read ( stream, &header.fv, sizeof ( header.fv ) ) )
+		goto err_read;
+	if ( ( header.fv.Signature != EFI_FVH_SIGNATURE ) ||
+	     ( header.fv.HeaderLength < sizeof ( header.fv ) ) ||
+	     ( header.fv.HeaderLength % sizeof ( word ) ) ) {
+		errno = EINVAL;
+		goto err_header;
+	}
+
+	/* Read remainder of firmware volume header and check checksum */
+	sum = edk2_checksum ( &header.fv, sizeof ( header.fv ) );
+	while ( stream->offset < header.fv.HeaderLength ) {
+		if ( ! image_read ( stream, &word, sizeof ( word ) ) )
+			goto err_skip;
+		sum += word;
+	}
+	if ( sum != 0 ) {
+		errno = EINVAL;
+		goto err_checksum;
+	}
+
+	/* Read and check variable store header */
+	if ( ! image_read ( stream, &store, sizeof ( store ) ) )
+		goto err_read_store;
+	stream->authenticated = ( memcmp ( &store.signature, &edk2_auth_guid,
+					sizeof ( store.signature ) ) == 0 );
+	if ( ( ( ! stream->authenticated ) &&
+	       ( memcmp ( &store.signature, &edk2_guid,
+			  sizeof ( store.signature ) ) != 0 ) ) ||
+	     ( store.format != EDK2_STORE_FORMATTED ) ||
+	     ( store.state != EDK2_STORE_HEALTHY ) ||
+	     ( store.size < sizeof ( store ) ) ) {
+		errno = EINVAL;
+		goto err_store;
+	}
+	stream->size = ( header.fv.HeaderLength + store.size );
+
+	return 1;
+
+ err_store:
+ err_read_store:
+ err_checksum:
+ err_skip:
+ err_header:
+ err_read:
+	image_close ( stream );
+ err_open:
+	return 0;
+}
+
+/**
+ * Read next variable from EDK2 image
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable to fill in
+ * @ret rc		1 if a variable was read, 0 at end of store, or -1
+ *
+ * Variables that are deleted (or in transition to being deleted) are
+ * skipped.
+ */
+static int edk2_read ( struct var_stream *stream, struct var *var ) {
+	struct edk2_var_header header;
+	struct edk2_var_auth auth;
+	struct edk2_var_info info;
+	size_t offset;
+	size_t len;
+
+	do {
+		/* Skip to next variable header */
+		offset = ( ( stream->offset + EDK2_VAR_ALIGN - 1 ) &
+			   ~( EDK2_VAR_ALIGN - 1 ) );
+		len = ( sizeof ( header ) + sizeof ( info ) +
+			( stream->authenticated ? sizeof ( auth ) : 0 ) );
+		if ( ( offset + len ) > stream->size )
+			return 0;
+		if ( ! image_pad ( stream, offset, -1 ) )
+			return -1;
+
+		/* Read variable header */
+		if ( ! image_read ( stream, &header, sizeof ( header ) ) )
+			return -1;
+		if ( header.start != EDK2_VAR_START_ID )
+			return 0;
+		if ( stream->authenticated &&
+		     ( ! image_read ( stream, &auth, sizeof ( auth ) ) ) )
+			return -1;
+		if ( ! image_read ( stream, &info, sizeof ( info ) ) )
+			return -1;
+		if ( ( stream->offset + info.name_len + info.len ) >
+		     stream->size ) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		/* Skip variables that are not valid */
+		if ( header.state != EDK2_VAR_ADDED ) {
+			if ( ! image_pad ( stream, ( stream->offset +
+						     info.name_len +
+						     info.len ), -1 ) )
+				return -1;
+			continue;
+		}
+
+		/* Read name and data */
+		if ( ( info.name_len > sizeof ( var->name ) ) ||
+		     ( info.len > sizeof ( var->value.data ) ) ) {
+			errno = EFBIG;
+			return -1;
+		}
+		memcpy ( &var->guid, &info.guid, sizeof ( var->guid ) );
+		var->name_len = info.name_len;
+		var->value.attributes = header.attributes;
+		var->len = info.len;
+		if ( ! image_read ( stream, var->name, var->name_len ) )
+			return -1;
+		if ( ! image_read ( stream, var->value.data, var->len ) )
+			return -1;
+		if ( ! var_name_valid ( var ) )
+			return -1;
+
+		return 1;
+
+	} while ( 1 );
+}
+
+/**
+ * Open EDK2 image for writing
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ *
+ * An authenticated variable store is always generated, since this is
+ * required by any firmware supporting Secure Boot.
+ */
+static int edk2_open_write ( struct var_stream *stream ) {
+	static const EFI_GUID fs_guid = EDK2_NV_DATA_FV_GUID;
+	struct edk2_fv_header header;
+	struct edk2_store_header store;
+
+	/* Check image size */
+	if ( ( stream->size < ( sizeof ( header ) + sizeof ( store ) ) ) ||
+	     ( stream->size % EDK2_FV_BLOCK_SIZE ) ) {
+		errno = EINVAL;
+		goto err_size;
+	}
+
+	/* Open file */
+	if ( ! image_open ( stream, "wb" ) )
+		goto err_open;
+
+	/* Construct firmware volume header */
+	memset ( &header, 0, sizeof ( header ) );
+	memcpy ( &header.fv.FileSystemGuid, &fs_guid, sizeof ( fs_guid ) );
+	header.fv.FvLength = stream->size;
+	header.fv.Signature = EFI_FVH_SIGNATURE;
+	header.fv.Attributes = EDK2_FV_ATTRIBUTES;
+	header.fv.HeaderLength = sizeof ( header );
+	header.fv.Revision = EFI_FVH_REVISION;
+	header.fv.BlockMap[0].NumBlocks = ( stream->size /
+					    EDK2_FV_BLOCK_SIZE );
+	header.fv.BlockMap[0].Length = EDK2_FV_BLOCK_SIZE;
+	header.fv.Checksum = -edk2_checksum ( &header, sizeof ( header ) );
+
+	/* Construct variable store header */
+	memset ( &store, 0, sizeof ( store ) );
+	memcpy ( &store.signature, &edk2_auth_guid,
+		 sizeof ( store.signature ) );
+	store.size = ( stream->size - sizeof ( header ) );
+	store.format = EDK2_STORE_FORMATTED;
+	store.state = EDK2_STORE_HEALTHY;
+
+	/* Write headers */
+	if ( ! image_write ( stream, &header, sizeof ( header ) ) )
+		goto err_write;
+	if ( ! image_write ( stream, &store, sizeof ( store ) ) )
+		goto err_write;
+
+	return 1;
+
+ err_write:
+	image_close ( stream );
+ err_open:
+ err_size:
+	return 0;
+}
+
+/**
+ * Write variable to EDK2 image
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable
+ * @ret ok		Success indicator
+ */
+static int edk2_write ( struct var_stream *stream, const struct var *var ) {
+	struct edk2_var_header header;
+	struct edk2_var_auth auth;
+	struct edk2_var_info info;
+	size_t offset;
+
+	/* Check for space */
+	offset = ( ( stream->offset + EDK2_VAR_ALIGN - 1 ) &
+		   ~( EDK2_VAR_ALIGN - 1 ) );
+	if ( ( offset + sizeof ( header ) + sizeof ( auth ) +
+	       sizeof ( info ) + var->name_len + var->len ) > stream->size ) {
+		errno = ENOSPC;
+		return 0;
+	}
+
+	/* Construct variable header */
+	memset ( &header, 0, sizeof ( header ) );
+	header.start = EDK2_VAR_START_ID;
+	header.state = EDK2_VAR_ADDED;
+	header.attributes = var->value.attributes;
+	memset ( &auth, 0, sizeof ( auth ) );
+	info.name_len = var->name_len;
+	info.len = var->len;
+	memcpy ( &info.guid, &var->guid, sizeof ( info.guid ) );
+
+	/* Write variable */
+	if ( ! ( image_pad ( stream, offset, 0xff ) &&
+		 image_write ( stream, &header, sizeof ( header ) ) &&
+		 image_write ( stream, &auth, sizeof ( auth ) ) &&
+		 image_write ( stream, &info, sizeof ( info ) ) &&
+		 image_write ( stream, var->name, var->name_len ) &&
+		 image_write ( stream, var->value.data, var->len ) ) )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Finish writing EDK2 image
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int edk2_finish ( struct var_stream *stream ) {
+	int ok;
+
+	/* Pad remainder of variable store with erased flash */
+	ok = image_pad ( stream, stream->size, 0xff );
+
+	/* Close file */
+	if ( ! image_close ( stream ) )
+		ok = 0;
+
+	return ok;
+}
+
+/******************************************************************************
+ *
+ * Binary snapshots
+ *
+ ******************************************************************************
+ */
+
+/** Binary snapshot signature */
+#define SNAPSHOT_SIGNATURE "EFIVARS\x1a"
+
+/** Binary snapshot version */
+#define SNAPSHOT_VERSION 1
+
+/** A binary snapshot header */
+struct snapshot_header {
+	/** Signature */
+	char signature[8];
+	/** Version */
+	uint32_t version;
+	/** Reserved */
+	uint32_t reserved;
+} __attribute__ (( packed ));
+
+/** A binary snapshot variable record
+ *
+ * Each record is immediately followed by the name and data.  The
+ * snapshot is terminated by a record with a zero name length, so
+ * that a truncated snapshot can be detected.
+ */
+struct snapshot_record {
+	/** Vendor GUID */
+	EFI_GUID guid;
+	/** Attributes */
+	uint32_t attributes;
+	/** Name length (in bytes, including terminating NUL) */
+	uint32_t name_len;
+	/** Data length */
+	uint32_t len;
+} __attribute__ (( packed ));
+
+/**
+ * Open binary snapshot for reading
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int snapshot_open_read ( struct var_stream *stream ) {
+	struct snapshot_header header;
+
+	/* Open file */
+	if ( ! image_open ( stream, "rb" ) )
+		goto err_open;
+
+	/* Read and check header */
+	if ( ! image_read ( stream, &header, sizeof ( header ) ) )
+		goto err_read;
+	if ( ( memcmp ( header.signature, SNAPSHOT_SIGNATURE,
+			sizeof ( header.signature ) ) != 0 ) ||
+	     ( header.version != SNAPSHOT_VERSION ) ) {
+		errno = EINVAL;
+		goto err_header;
+	}
+
+	return 1;
+
+ err_header:
+ err_read:
+	image_close ( stream );
+ err_open:
+	return 0;
+}
+
+/**
+ * Read next variable from binary snapshot
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable to fill in
+ * @ret rc		1 if a variable was read, 0 at end of store, or -1
+ */
+static int snapshot_read ( struct var_stream *stream, struct var *var ) {
+	struct snapshot_record record;
+
+	/* Read record */
+	if ( ! image_read ( stream, &record, sizeof ( record ) ) )
+		return -1;
+	if ( ! record.name_len )
+		return 0;
+	if ( ( record.name_len > sizeof ( var->name ) ) ||
+	     ( record.len > sizeof ( var->value.data ) ) ) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	/* Read name and data */
+	memcpy ( &var->guid, &record.guid, sizeof ( var->guid ) );
+	var->name_len = record.name_len;
+	var->value.attributes = record.attributes;
+	var->len = record.len;
+	if ( ! image_read ( stream, var->name, var->name_len ) )
+		return -1;
+	if ( ! image_read ( stream, var->value.data, var->len ) )
+		return -1;
+	if ( ! var_name_valid ( var ) )
+		return -1;
+
+	return 1;
+}
+
+/**
+ * Open binary snapshot for writing
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int snapshot_open_write ( struct var_stream *stream ) {
+	struct snapshot_header header;
+
+	/* Open file */
+	if ( ! image_open ( stream, "wb" ) )
+		goto err_open;
+
+	/* Write header */
+	memset ( &header, 0, sizeof ( header ) );
+	memcpy ( header.signature, SNAPSHOT_SIGNATURE,
+		 sizeof ( header.signature ) );
+	header.version = SNAPSHOT_VERSION;
+	if ( ! image_write ( stream, &header, sizeof ( header ) ) )
+		goto err_write;
+
+	return 1;
+
+ err_write:
+	image_close ( stream );
+ err_open:
+	return 0;
+}
+
+/**
+ * Write variable to binary snapshot
+ *
+ * @v stream		Variable store stream
+ * @v var		Variable
+ * @ret ok		Success indicator
+ */
+static int snapshot_write ( struct var_stream *stream,
+			    const struct var *var ) {
+	struct snapshot_record record;
+
+	/* Construct record */
+	memcpy ( &record.guid, &var->guid, sizeof ( record.guid ) );
+	record.attributes = var->value.attributes;
+	record.name_len = var->name_len;
+	record.len = var->len;
+
+	/* Write record, name, and data */
+	if ( ! ( image_write ( stream, &record, sizeof ( record ) ) &&
+		 image_write ( stream, var->name, var->name_len ) &&
+		 image_write ( stream, var->value.data, var->len ) ) )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Finish writing binary snapshot
+ *
+ * @v stream		Variable store stream
+ * @ret ok		Success indicator
+ */
+static int snapshot_finish ( struct var_stream *stream ) {
+	struct snapshot_record end;
+	int ok;
+
+	/* Write terminating record */
+	memset ( &end, 0, sizeof ( end ) );
+	ok = image_write ( stream, &end, sizeof ( end ) );
+
+	/* Close file */
+	if ( ! image_close ( stream ) )
+		ok = 0;
+
+	return ok;
+}
+
+/******************************************************************************
+ *
+ * Conversion
+ *
+ ******************************************************************************
+ */
+
+/** Variable store formats */
+static const struct var_format formats[] = {
+	{
+		.name = "efivarfs",
+		.open_read = efivarfs_open_read,
+		.read = efivarfs_read,
+		.open_write = efivarfs_open_write,
+		.write = efivarfs_write,
+		.finish = efivarfs_finish,
+	},
+	{
+		.name = "edk2",
+		.open_read = edk2_open_read,
+		.read = edk2_read,
+		.open_write = edk2_open_write,
+		.write = edk2_write,
+		.finish = edk2_finish,
+	},
+	{
+		.name = "snapshot",
+		.open_read = snapshot_open_read,
+		.read = snapshot_read,
+		.open_write = snapshot_open_write,
+		.write = snapshot_write,
+		.finish = snapshot_finish,
+	},
+};
+
+/**
+ * Find variable store format
+ *
+ * @v name		Format name
+ * @ret format		Variable store format, or NULL if not found
+ */
+const struct var_format * var_format ( const char *name ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < ( sizeof ( formats ) / sizeof ( formats[0] ) ) ;
+	      i++ ) {
+		if ( strcmp ( formats[i].name, name ) == 0 )
+			return &formats[i];
+	}
+	return NULL;
+}
+
+/**
+ * Close variable store stream opened for reading
+ *
+ * @v stream		Variable store stream
+ */
+void var_close ( struct var_stream *stream ) {
+
+	/* Close directory or file, as applicable */
+	if ( stream->dir )
+		closedir ( stream->dir );
+	if ( stream->file )
+		image_close ( stream );
+}
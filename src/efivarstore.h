@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI variable store formats
+ *
+ */
+
+#ifndef _EFIVARSTORE_H
+#define _EFIVARSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <Uefi/UefiBaseType.h>
+
+/** Maximum length of a variable name (in characters, including NUL) */
+#define VAR_NAME_MAX 1024
+
+/** Maximum length of variable data */
+#define VAR_DATA_MAX 0x10000
+
+/** A variable read from or written to a variable store
+ *
+ * Exactly one variable is held in memory at any time, so that
+ * arbitrarily large variable stores may be processed within a fixed
+ * memory footprint.
+ */
+struct var {
+	/** Vendor GUID */
+	EFI_GUID guid;
+	/** Name length (in bytes, including terminating NUL) */
+	size_t name_len;
+	/** Name (NUL-terminated) */
+	CHAR16 name[VAR_NAME_MAX];
+	/** Data length */
+	size_t len;
+	/** Value
+	 *
+	 * The attributes immediately precede the data, matching the
+	 * layout of an efivarfs file.  This allows the value to be
+	 * written to efivarfs in the single write required by the
+	 * kernel.
+	 */
+	struct {
+		/** Attributes */
+		uint32_t attributes;
+		/** Data */
+		uint8_t data[VAR_DATA_MAX];
+	} __attribute__ (( packed )) value;
+};
+
+/** A variable store stream */
+struct var_stream {
+	/** Path (or "-" for standard input or output) */
+	const char *path;
+	/** File (for image formats) */
+	FILE *file;
+	/** Directory (for directory formats) */
+	DIR *dir;
+	/** Current offset within file */
+	size_t offset;
+	/** Length of variable store within file (or to be generated) */
+	size_t size;
+	/** Number of variables converted */
+	unsigned int count;
+	/** Variable store uses authenticated variable headers */
+	bool authenticated;
+};
+
+/** A variable store format */
+struct var_format {
+	/** Name */
+	const char *name;
+	/**
+	 * Open variable store for reading
+	 *
+	 * @v stream		Variable store stream
+	 * @ret ok		Success indicator
+	 */
+	int ( * open_read ) ( struct var_stream *stream );
+	/**
+	 * Read next variable
+	 *
+	 * @v stream		Variable store stream
+	 * @v var		Variable to fill in
+	 * @ret rc		1 if a variable was read, 0 at end of store,
+	 *			or -1 on error
+	 *
+	 * Only variables in the added state are read from an EDK2
+	 * image.  A variable that is present only in the
+	 * in-deleted-transition state (e.g. because firmware was
+	 * interrupted while replacing it) is dropped, even though
+	 * firmware would recover it on the next boot.
+	 */
+	int ( * read ) ( struct var_stream *stream, struct var *var );
+	/**
+	 * Open variable store for writing
+	 *
+	 * @v stream		Variable store stream
+	 * @ret ok		Success indicator
+	 */
+	int ( * open_write ) ( struct var_stream *stream );
+	/**
+	 * Write variable
+	 *
+	 * @v stream		Variable store stream
+	 * @v var		Variable
+	 * @ret ok		Success indicator
+	 */
+	int ( * write ) ( struct var_stream *stream, const struct var *var );
+	/**
+	 * Finish writing variable store
+	 *
+	 * @v stream		Variable store stream
+	 * @ret ok		Success indicator
+	 */
+	int ( * finish ) ( struct var_stream *stream );
+};
+
+extern const struct var_format * var_format ( const char *name );
+extern void var_close ( struct var_stream *stream );
+
+#endif /* _EFIVARSTORE_H */
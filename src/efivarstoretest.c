@@ -0,0 +1,477 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI variable store format self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <cmocka.h>
+
+#include "efivarstore.h"
+#include "efivarstoretest.h"
+
+/** Size of test EDK2 images */
+#define VARSTORE_TEST_SIZE 0x4000
+
+/** Offset of checksummed field within test EDK2 images */
+#define VARSTORE_TEST_ATTRIBUTES 0x2c
+
+/** EDK2 variable header start marker and added state */
+#define VARSTORE_TEST_ADDED "\xaa\x55\x3f"
+
+/** EDK2 variable in transition to being deleted */
+#define VARSTORE_TEST_IN_DELETED_TRANSITION 0x3e
+
+/** EDK2 variable that has been deleted */
+#define VARSTORE_TEST_DELETED 0x3c
+
+/** A test variable */
+struct varstore_test {
+	/** Name */
+	const char *name;
+	/** Attributes */
+	uint32_t attributes;
+	/** Data */
+	const char *data;
+};
+
+/** Test variables */
+static const struct varstore_test varstore_tests[] = {
+	{ "BootOrder", 0x7, "\x01\x00\x00\x00" },
+	{ "Boot0001", 0x7, "Boot entry" },
+	{ "Lang", 0x6, "eng" },
+};
+
+/** Number of test variables */
+#define VARSTORE_TESTS \
+	( sizeof ( varstore_tests ) / sizeof ( varstore_tests[0] ) )
+
+/** Test variable vendor GUID */
+static const EFI_GUID varstore_test_guid = {
+	0x8be4df61, 0x93ca, 0x11d2,
+	{ 0xaa, 0x0d, 0x00, 0xe0, 0x98, 0x03, 0x2b, 0x8c }
+};
+
+/** Variable buffer (too large for the stack) */
+static struct var varstore_var;
+
+/**
+ * Fill in test variable
+ *
+ * @v test		Test variable
+ * @v var		Variable to fill in
+ */
+static void varstore_fill ( const struct varstore_test *test,
+			    struct var *var ) {
+	unsigned int i;
+
+	memset ( var, 0, sizeof ( *var ) );
+	memcpy ( &var->guid, &varstore_test_guid, sizeof ( var->guid ) );
+	for ( i = 0 ; test->name[i] ; i++ )
+		var->name[i] = test->name[i];
+	var->name_len = ( ( i + 1 ) * sizeof ( var->name[0] ) );
+	var->value.attributes = test->attributes;
+	var->len = strlen ( test->data );
+	memcpy ( var->value.data, test->data, var->len );
+}
+
+/**
+ * Check if variable matches test variable name
+ *
+ * @v test		Test variable
+ * @v var		Variable
+ * @ret match		Variable name matches
+ */
+static bool varstore_match ( const struct varstore_test *test,
+			     const struct var *var ) {
+	size_t len = strlen ( test->name );
+	unsigned int i;
+
+	if ( var->name_len != ( ( len + 1 ) * sizeof ( var->name[0] ) ) )
+		return false;
+	for ( i = 0 ; i < len ; i++ ) {
+		if ( var->name[i] != test->name[i] )
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Write test variable store
+ *
+ * @v format		Variable store format name
+ * @v path		Path
+ */
+static void varstore_write ( const char *format, const char *path ) {
+	const struct var_format *fmt = var_format ( format );
+	struct var_stream stream;
+	unsigned int i;
+
+	assert_non_null ( fmt );
+	memset ( &stream, 0, sizeof ( stream ) );
+	stream.path = path;
+	stream.size = VARSTORE_TEST_SIZE;
+	assert_true ( fmt->open_write ( &stream ) );
+	for ( i = 0 ; i < VARSTORE_TESTS ; i++ ) {
+		varstore_fill ( &varstore_tests[i], &varstore_var );
+		assert_true ( fmt->write ( &stream, &varstore_var ) );
+	}
+	assert_true ( fmt->finish ( &stream ) );
+}
+
+/**
+ * Check test variable store contents
+ *
+ * @v format		Variable store format name
+ * @v path		Path
+ * @v present		Bitmask of test variables expected to be present
+ */
+static void assert_varstore ( const char *format, const char *path,
+			      unsigned int present ) {
+	const struct var_format *fmt = var_format ( format );
+	const struct varstore_test *test;
+	struct var_stream stream;
+	unsigned int found = 0;
+	unsigned int i;
+	int rc;
+
+	assert_non_null ( fmt );
+	memset ( &stream, 0, sizeof ( stream ) );
+	stream.path = path;
+	assert_true ( fmt->open_read ( &stream ) );
+	while ( ( rc = fmt->read ( &stream, &varstore_var ) ) > 0 ) {
+
+		/* Identify variable (in any order, for directories) */
+		for ( i = 0 ; i < VARSTORE_TESTS ; i++ ) {
+			test = &varstore_tests[i];
+			if ( varstore_match ( test, &varstore_var ) )
+				break;
+		}
+		assert_in_range ( i, 0, ( VARSTORE_TESTS - 1 ) );
+		assert_false ( found & ( 1 << i ) );
+		found |= ( 1 << i );
+
+		/* Check variable */
+		assert_memory_equal ( &varstore_var.guid, &varstore_test_guid,
+				      sizeof ( varstore_var.guid ) );
+		assert_int_equal ( varstore_var.value.attributes,
+				   test->attributes );
+		assert_int_equal ( varstore_var.len, strlen ( test->data ) );
+		assert_memory_equal ( varstore_var.value.data, test->data,
+				      varstore_var.len );
+	}
+	assert_int_equal ( rc, 0 );
+	assert_int_equal ( found, present );
+	var_close ( &stream );
+}
+
+/**
+ * Convert variable store
+ *
+ * @v from		Input variable store format name
+ * @v from_path		Input path
+ * @v to		Output variable store format name
+ * @v to_path		Output path
+ */
+static void varstore_convert ( const char *from, const char *from_path,
+			       const char *to, const char *to_path ) {
+	const struct var_format *in = var_format ( from );
+	const struct var_format *out = var_format ( to );
+	struct var_stream input;
+	struct var_stream output;
+	int rc;
+
+	assert_non_null ( in );
+	assert_non_null ( out );
+	memset ( &input, 0, sizeof ( input ) );
+	input.path = from_path;
+	memset ( &output, 0, sizeof ( output ) );
+	output.path = to_path;
+	output.size = VARSTORE_TEST_SIZE;
+	assert_true ( in->open_read ( &input ) );
+	assert_true ( out->open_write ( &output ) );
+	while ( ( rc = in->read ( &input, &varstore_var ) ) > 0 )
+		assert_true ( out->write ( &output, &varstore_var ) );
+	assert_int_equal ( rc, 0 );
+	assert_true ( out->finish ( &output ) );
+	var_close ( &input );
+}
+
+/**
+ * Remove test variable store
+ *
+ * @v path		Path to image file or directory
+ */
+static void varstore_remove ( const char *path ) {
+	const gchar *name;
+	gchar *file;
+	GDir *dir;
+
+	/* Remove directory contents, if applicable */
+	dir = g_dir_open ( path, 0, NULL );
+	if ( dir ) {
+		while ( ( name = g_dir_read_name ( dir ) ) ) {
+			file = g_build_filename ( path, name, NULL );
+			assert_int_equal ( g_unlink ( file ), 0 );
+			g_free ( file );
+		}
+		g_dir_close ( dir );
+		assert_int_equal ( g_rmdir ( path ), 0 );
+	} else {
+		assert_int_equal ( g_unlink ( path ), 0 );
+	}
+}
+
+/**
+ * Check that reading variable store fails
+ *
+ * @v format		Variable store format name
+ * @v path		Path
+ * @v error		Expected error
+ */
+static void assert_varstore_bad ( const char *format, const char *path,
+				  int error ) {
+	const struct var_format *fmt = var_format ( format );
+	struct var_stream stream;
+	int rc;
+
+	assert_non_null ( fmt );
+	memset ( &stream, 0, sizeof ( stream ) );
+	stream.path = path;
+	if ( ! fmt->open_read ( &stream ) ) {
+		assert_int_equal ( errno, error );
+		return;
+	}
+	do {
+		rc = fmt->read ( &stream, &varstore_var );
+	} while ( rc > 0 );
+	assert_int_equal ( rc, -1 );
+	assert_int_equal ( errno, error );
+	var_close ( &stream );
+}
+
+/**
+ * Rewrite image file with modified contents
+ *
+ * @v path		Path
+ * @v data		Original contents
+ * @v len		Length of contents to write
+ */
+static void varstore_rewrite ( const char *path, const gchar *data,
+			       gsize len ) {
+
+	assert_true ( g_file_set_contents ( path, data, len, NULL ) );
+}
+
+/**
+ * Find EDK2 variable header
+ *
+ * @v data		Image contents
+ * @v len		Length of image
+ * @v index		Variable index
+ * @ret offset		Offset of variable header
+ */
+static size_t varstore_find ( const gchar *data, gsize len,
+			      unsigned int index ) {
+	const char *marker = VARSTORE_TEST_ADDED;
+	size_t marker_len = strlen ( marker );
+	size_t offset;
+
+	for ( offset = 0 ; ( offset + marker_len ) <= len ; offset += 4 ) {
+		if ( memcmp ( ( data + offset ), marker, marker_len ) != 0 )
+			continue;
+		if ( ! index-- )
+			return offset;
+	}
+	fail();
+	return 0;
+}
+
+/** Test variable store round trips */
+void test_varstoreroundtrip ( void **state ) {
+	static const char *formats[] = { "efivarfs", "edk2", "snapshot" };
+	unsigned int all = ( ( 1 << VARSTORE_TESTS ) - 1 );
+	const struct var_format *edk2 = var_format ( "edk2" );
+	struct var_stream stream;
+	gchar *dir;
+	gchar *path;
+	gchar *copy;
+	unsigned int i;
+	unsigned int j;
+
+	( void ) state;
+	dir = g_dir_make_tmp ( "efikittest.XXXXXX", NULL );
+	assert_non_null ( dir );
+
+	/* Check that unknown formats are not found */
+	assert_null ( var_format ( "unknown" ) );
+
+	/* Check each format, and conversion to each other format */
+	for ( i = 0 ; i < ( sizeof ( formats ) / sizeof ( formats[0] ) ) ;
+	      i++ ) {
+		path = g_build_filename ( dir, formats[i], NULL );
+		varstore_write ( formats[i], path );
+		assert_varstore ( formats[i], path, all );
+		for ( j = 0 ; j < ( sizeof ( formats ) /
+				    sizeof ( formats[0] ) ) ; j++ ) {
+			copy = g_build_filename ( dir, "copy", NULL );
+			varstore_convert ( formats[i], path, formats[j],
+					   copy );
+			assert_varstore ( formats[j], copy, all );
+			varstore_remove ( copy );
+			g_free ( copy );
+		}
+		varstore_remove ( path );
+		g_free ( path );
+	}
+
+	/* Check that misaligned EDK2 image sizes are rejected */
+	path = g_build_filename ( dir, "edk2", NULL );
+	memset ( &stream, 0, sizeof ( stream ) );
+	stream.path = path;
+	stream.size = ( VARSTORE_TEST_SIZE + 1 );
+	assert_false ( edk2->open_write ( &stream ) );
+	assert_int_equal ( errno, EINVAL );
+	g_free ( path );
+
+	g_rmdir ( dir );
+	g_free ( dir );
+}
+
+/** Test corrupt EDK2 images */
+void test_varstoreedk2 ( void **state ) {
+	unsigned int all = ( ( 1 << VARSTORE_TESTS ) - 1 );
+	gchar *dir;
+	gchar *path;
+	gchar *data;
+	gsize len;
+	size_t offset;
+
+	( void ) state;
+	dir = g_dir_make_tmp ( "efikittest.XXXXXX", NULL );
+	assert_non_null ( dir );
+	path = g_build_filename ( dir, "edk2", NULL );
+	varstore_write ( "edk2", path );
+	assert_true ( g_file_get_contents ( path, &data, &len, NULL ) );
+	assert_int_equal ( len, VARSTORE_TEST_SIZE );
+
+	/* Check that truncated images are rejected */
+	varstore_rewrite ( path, data, 0 );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	varstore_rewrite ( path, data, VARSTORE_TEST_ATTRIBUTES );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	offset = varstore_find ( data, len, 0 );
+	varstore_rewrite ( path, data, offset );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	offset = varstore_find ( data, len, 1 );
+	varstore_rewrite ( path, data, ( offset + 8 ) );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+
+	/* Check that a bad firmware volume header checksum is rejected */
+	data[VARSTORE_TEST_ATTRIBUTES] ^= 0x01;
+	varstore_rewrite ( path, data, len );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	data[VARSTORE_TEST_ATTRIBUTES] ^= 0x01;
+
+	/* Check that a bad firmware volume signature is rejected */
+	data[0x28] ^= 0x01;
+	varstore_rewrite ( path, data, len );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	data[0x28] ^= 0x01;
+	varstore_rewrite ( path, data, len );
+	assert_varstore ( "edk2", path, all );
+
+	/* Check that a variable overrunning the store is rejected */
+	offset = varstore_find ( data, len, 2 );
+	data[ offset + 8 + 28 + 4 + 1 ] = 0x7f;
+	varstore_rewrite ( path, data, len );
+	assert_varstore_bad ( "edk2", path, EINVAL );
+	data[ offset + 8 + 28 + 4 + 1 ] = 0x00;
+
+	/* Check that deleted variables are skipped */
+	offset = varstore_find ( data, len, 0 );
+	data[ offset + 2 ] = VARSTORE_TEST_DELETED;
+	varstore_rewrite ( path, data, len );
+	assert_varstore ( "edk2", path, ( all & ~( 1 << 0 ) ) );
+
+	/* Check that variables in transition to being deleted are
+	 * skipped, even with no replacement variable present.
+	 */
+	offset = varstore_find ( data, len, 0 );
+	data[ offset + 2 ] = VARSTORE_TEST_IN_DELETED_TRANSITION;
+	varstore_rewrite ( path, data, len );
+	assert_varstore ( "edk2", path, ( 1 << 2 ) );
+
+	g_free ( data );
+	g_unlink ( path );
+	g_free ( path );
+	g_rmdir ( dir );
+	g_free ( dir );
+}
+
+/** Test corrupt snapshots and efivarfs trees */
+void test_varstorecorrupt ( void **state ) {
+	unsigned int all = ( ( 1 << VARSTORE_TESTS ) - 1 );
+	gchar *dir;
+	gchar *path;
+	gchar *data;
+	gsize len;
+	size_t offset;
+
+	( void ) state;
+	dir = g_dir_make_tmp ( "efikittest.XXXXXX", NULL );
+	assert_non_null ( dir );
+
+	/* Check that truncated snapshots are rejected */
+	path = g_build_filename ( dir, "snapshot", NULL );
+	varstore_write ( "snapshot", path );
+	assert_true ( g_file_get_contents ( path, &data, &len, NULL ) );
+	varstore_rewrite ( path, data, 8 );
+	assert_varstore_bad ( "snapshot", path, EINVAL );
+	varstore_rewrite ( path, data, ( len - 1 ) );
+	assert_varstore_bad ( "snapshot", path, EINVAL );
+	varstore_rewrite ( path, data, ( len - 20 ) );
+	assert_varstore_bad ( "snapshot", path, EINVAL );
+
+	/* Check that an unknown snapshot version is rejected */
+	data[8] ^= 0x80;
+	varstore_rewrite ( path, data, len );
+	assert_varstore_bad ( "snapshot", path, EINVAL );
+	data[8] ^= 0x80;
+
+	/* Check that an unterminated variable name is rejected */
+	offset = ( 16 /* header */ + 28 /* record */ +
+		   ( strlen ( varstore_tests[0].name ) * 2 ) );
+	data[offset] = 'X';
+	varstore_rewrite ( path, data, len );
+	assert_varstore_bad ( "snapshot", path, EINVAL );
+	data[offset] = '\0';
+	varstore_rewrite ( path, data, len );
+	assert_varstore ( "snapshot", path, all );
+	g_free ( data );
+	g_unlink ( path );
+	g_free ( path );
+
+	/* Check that efivarfs files without attributes are rejected */
+	path = g_build_filename ( dir, "Lang-8be4df61-93ca-11d2-aa0d-"
+				  "00e098032b8c", NULL );
+	varstore_rewrite ( path, "\x06\x00", 2 );
+	assert_varstore_bad ( "efivarfs", dir, EINVAL );
+	g_unlink ( path );
+	g_free ( path );
+
+	g_rmdir ( dir );
+	g_free ( dir );
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI variable store format self-tests
+ *
+ */
+
+#ifndef _EFIVARSTORETEST_H
+#define _EFIVARSTORETEST_H
+
+extern void test_varstoreroundtrip ( void **state );
+extern void test_varstoreedk2 ( void **state );
+extern void test_varstorecorrupt ( void **state );
+
+#endif /* _EFIVARSTORETEST_H */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * GUID textual representations
+ *
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <Uefi/UefiBaseType.h>
+
+#include "guid.h"
+
+/** Hexadecimal digit flag */
+#define GUID_DIGIT 0x10
+
+/** Hexadecimal digit values (zero for non-hexadecimal characters) */
+static const uint8_t guid_digit_values[256] = {
+	[ '0' ] = ( GUID_DIGIT | 0x0 ), [ '1' ] = ( GUID_DIGIT | 0x1 ),
+	[ '2' ] = ( GUID_DIGIT | 0x2 ), [ '3' ] = ( GUID_DIGIT | 0x3 ),
+	[ '4' ] = ( GUID_DIGIT | 0x4 ), [ '5' ] = ( GUID_DIGIT | 0x5 ),
+	[ '6' ] = ( GUID_DIGIT | 0x6 ), [ '7' ] = ( GUID_DIGIT | 0x7 ),
+	[ '8' ] = ( GUID_DIGIT | 0x8 ), [ '9' ] = ( GUID_DIGIT | 0x9 ),
+	[ 'a' ] = ( GUID_DIGIT | 0xa ), [ 'b' ] = ( GUID_DIGIT | 0xb ),
+	[ 'c' ] = ( GUID_DIGIT | 0xc ), [ 'd' ] = ( GUID_DIGIT | 0xd ),
+	[ 'e' ] = ( GUID_DIGIT | 0xe ), [ 'f' ] = ( GUID_DIGIT | 0xf ),
+	[ 'A' ] = ( GUID_DIGIT | 0xa ), [ 'B' ] = ( GUID_DIGIT | 0xb ),
+	[ 'C' ] = ( GUID_DIGIT | 0xc ), [ 'D' ] = ( GUID_DIGIT | 0xd ),
+	[ 'E' ] = ( GUID_DIGIT | 0xe ), [ 'F' ] = ( GUID_DIGIT | 0xf ),
+};
+
+/** Hexadecimal digits */
+static const char guid_digits[16] = "0123456789abcdef";
+
+/** Byte offsets within an EFI_GUID, in textual representation order
+ *
+ * The first three fields are stored in little-endian byte order but
+ * written most significant byte first.
+ */
+static const uint8_t guid_offsets[16] = {
+	3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+/** Bitmask of byte positions preceded by a hyphen */
+#define GUID_HYPHENS ( ( 1 << 4 ) | ( 1 << 6 ) | ( 1 << 8 ) | ( 1 << 10 ) )
+
+/**
+ * Construct GUID textual representation
+ *
+ * @v guid		GUID
+ * @v text		Buffer of at least GUID_TEXT_LEN + 1 bytes
+ *
+ * The textual representation is of the canonical form
+ * "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx", using lowercase
+ * hexadecimal digits.  Each byte is converted by table lookup, rather
+ * than via a general-purpose formatted print.
+ */
+void guid_to_text ( const EFI_GUID *guid, char *text ) {
+	const uint8_t *bytes = ( ( const uint8_t * ) guid );
+	uint8_t byte;
+	unsigned int i;
+
+	for ( i = 0 ; i < sizeof ( guid_offsets ) ; i++ ) {
+		if ( GUID_HYPHENS & ( 1 << i ) )
+			*(text++) = '-';
+		byte = bytes[ guid_offsets[i] ];
+		*(text++) = guid_digits[ byte >> 4 ];
+		*(text++) = guid_digits[ byte & 0x0f ];
+	}
+	*text = '\0';
+}
+
+/**
+ * Parse GUID textual representation
+ *
+ * @v text		Textual representation
+ * @v guid		GUID to fill in
+ * @ret end		End of textual representation, or NULL on error
+ *
+ * The textual representation must be of the canonical form
+ * "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx", using hexadecimal digits of
+ * either case.  Any characters following the textual representation
+ * (e.g. a closing brace) are left for the caller to handle.
+ */
+const char * guid_from_text ( const char *text, EFI_GUID *guid ) {
+	uint8_t *bytes = ( ( uint8_t * ) guid );
+	uint8_t high;
+	uint8_t low;
+	unsigned int i;
+
+	for ( i = 0 ; i < sizeof ( guid_offsets ) ; i++ ) {
+		if ( ( GUID_HYPHENS & ( 1 << i ) ) && ( *(text++) != '-' ) )
+			goto err_syntax;
+		high = guid_digit_values[ ( uint8_t ) *(text++) ];
+		if ( ! ( high & GUID_DIGIT ) )
+			goto err_syntax;
+		low = guid_digit_values[ ( uint8_t ) *(text++) ];
+		if ( ! ( low & GUID_DIGIT ) )
+			goto err_syntax;
+		bytes[ guid_offsets[i] ] = ( ( ( high & 0x0f ) << 4 ) |
+					   ( low & 0x0f ) );
+	}
+
+	return text;
+
+ err_syntax:
+	errno = EINVAL;
+	return NULL;
+}
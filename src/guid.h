@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * GUID textual representations
+ *
+ */
+
+#ifndef _GUID_H
+#define _GUID_H
+
+#include <Uefi/UefiBaseType.h>
+
+/** Length of GUID textual representation (excluding terminating NUL) */
+#define GUID_TEXT_LEN 36
+
+extern void guid_to_text ( const EFI_GUID *guid, char *text );
+extern const char * guid_from_text ( const char *text, EFI_GUID *guid );
+
+#endif /* _GUID_H */
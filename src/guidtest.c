@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * GUID textual representation self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <Uefi/UefiBaseType.h>
+
+#include "guid.h"
+#include "guidtest.h"
+
+/** EFI global variable GUID */
+#define GLOBAL_GUID							\
+	{ 0x8be4df61, 0x93ca, 0x11d2,					\
+	  { 0xaa, 0x0d, 0x00, 0xe0, 0x98, 0x03, 0x2b, 0x8c } }
+
+/** Test GUID textual representations */
+void test_guid ( void **state ) {
+	static const EFI_GUID global = GLOBAL_GUID;
+	char text[ GUID_TEXT_LEN + 1 ];
+	EFI_GUID guid;
+	const char *end;
+
+	( void ) state;
+	guid_to_text ( &global, text );
+	assert_string_equal ( text, "8be4df61-93ca-11d2-aa0d-00e098032b8c" );
+	memset ( &guid, 0, sizeof ( guid ) );
+	end = guid_from_text ( text, &guid );
+	assert_ptr_equal ( end, &text[GUID_TEXT_LEN] );
+	assert_memory_equal ( &guid, &global, sizeof ( guid ) );
+	end = guid_from_text ( "8BE4DF61-93CA-11D2-AA0D-00E098032B8C}",
+			       &guid );
+	assert_non_null ( end );
+	assert_string_equal ( end, "}" );
+	assert_memory_equal ( &guid, &global, sizeof ( guid ) );
+	assert_null ( guid_from_text ( "8be4df61-93ca-11d2-aa0d-00e098032b8",
+				       &guid ) );
+	assert_null ( guid_from_text ( "8be4df6193ca-11d2-aa0d-00e098032b8c",
+				       &guid ) );
+	assert_null ( guid_from_text ( "8be4df61-93ca-11d2-aa0d-00e098032g8c",
+				       &guid ) );
+	assert_null ( guid_from_text ( "", &guid ) );
+}
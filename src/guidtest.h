@@ -0,0 +1,15 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * GUID textual representation self-tests
+ *
+ */
+
+#ifndef _GUIDTEST_H
+#define _GUIDTEST_H
+
+extern void test_guid ( void **state );
+
+#endif /* _GUIDTEST_H */
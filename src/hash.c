@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * Open-addressed hash tables
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "hash.h"
+
+/**
+ * Accumulate FNV-1a hash
+ *
+ * @v hash		Hash value so far (or HASH_FNV_INIT)
+ * @v data		Data
+ * @v len		Length of data
+ * @ret hash		Hash value
+ *
+ * FNV-1a is more than adequate for the short keys used within this
+ * library, and may be accumulated over keys held in several pieces.
+ */
+unsigned int hash_fnv ( unsigned int hash, const void *data, size_t len ) {
+	const uint8_t *byte;
+
+	for ( byte = data ; len-- ; byte++ )
+		hash = ( ( hash ^ *byte ) * 16777619U );
+	return hash;
+}
+
+/**
+ * Find hash table slot within slot array
+ *
+ * @v slots		Slots
+ * @v mask		Hash table size mask
+ * @v hash		Key hash
+ * @v key		Key
+ * @v same		Key comparison method (or NULL to find an empty slot)
+ * @ret slot		Hash table slot (empty if key is not present)
+ */
+static struct hash_slot * hash_probe ( struct hash_slot *slots,
+				       unsigned int mask, unsigned int hash,
+				       const void *key, hash_same_t same ) {
+	struct hash_slot *slot;
+	unsigned int index;
+
+	/* Probe linearly from hashed position */
+	for ( index = hash ; ; index++ ) {
+		slot = &slots[ index & mask ];
+		if ( ( ! slot->key ) ||
+		     ( same && ( slot->hash == hash ) &&
+		       same ( slot->key, key ) ) )
+			return slot;
+	}
+}
+
+/**
+ * Initialise hash table
+ *
+ * @v table		Hash table
+ * @v count		Number of entries to accommodate without growing
+ * @ret ok		Success indicator
+ */
+int hash_init ( struct hash_table *table, unsigned int count ) {
+	unsigned int size;
+
+	/* Size table to remain no more than half full */
+	for ( size = 1 ; size < ( 2 * count ) ; size <<= 1 ) {}
+	table->count = 0;
+	table->mask = ( size - 1 );
+	table->slots = calloc ( size, sizeof ( table->slots[0] ) );
+	if ( ! table->slots )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Ensure hash table has space for an additional entry
+ *
+ * @v table		Hash table
+ * @ret ok		Success indicator
+ *
+ * The hash table is doubled in size whenever adding an entry would
+ * leave it more than half full.  Any previously found slots are
+ * invalidated.
+ */
+int hash_reserve ( struct hash_table *table ) {
+	struct hash_slot *slots;
+	struct hash_slot *old;
+	struct hash_slot *slot;
+	unsigned int mask;
+	unsigned int i;
+
+	/* Do nothing unless table would become more than half full */
+	if ( ( ( table->count + 1 ) * 2 ) <= ( table->mask + 1 ) )
+		return 1;
+
+	/* Allocate new slots */
+	mask = ( ( ( table->mask + 1 ) * 2 ) - 1 );
+	slots = calloc ( ( mask + 1 ), sizeof ( slots[0] ) );
+	if ( ! slots )
+		return 0;
+
+	/* Rehash occupied slots */
+	for ( i = 0 ; i <= table->mask ; i++ ) {
+		old = &table->slots[i];
+		if ( ! old->key )
+			continue;
+		slot = hash_probe ( slots, mask, old->hash, NULL, NULL );
+		*slot = *old;
+	}
+
+	/* Replace slots */
+	free ( table->slots );
+	table->slots = slots;
+	table->mask = mask;
+	return 1;
+}
+
+/**
+ * Find hash table slot
+ *
+ * @v table		Hash table
+ * @v hash		Key hash
+ * @v key		Key
+ * @v same		Key comparison method
+ * @ret slot		Hash table slot (empty if key is not present)
+ */
+struct hash_slot * hash_find ( const struct hash_table *table,
+			       unsigned int hash, const void *key,
+			       hash_same_t same ) {
+
+	return hash_probe ( table->slots, table->mask, hash, key, same );
+}
+
+/**
+ * Fill in hash table slot
+ *
+ * @v table		Hash table
+ * @v slot		Slot found via hash_find()
+ * @v key		Key
+ * @v value		Value
+ * @v hash		Key hash
+ *
+ * The slot may be empty or may already hold the same key, in which
+ * case the key and value are replaced.
+ */
+void hash_set ( struct hash_table *table, struct hash_slot *slot,
+		const void *key, void *value, unsigned int hash ) {
+
+	if ( ! slot->key )
+		table->count++;
+	slot->key = key;
+	slot->value = value;
+	slot->hash = hash;
+}
+
+/**
+ * Free hash table
+ *
+ * @v table		Hash table
+ *
+ * Keys and values are owned by the caller and are not freed.
+ */
+void hash_free ( struct hash_table *table ) {
+
+	free ( table->slots );
+	table->slots = NULL;
+}
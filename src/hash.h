@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * Open-addressed hash tables
+ *
+ */
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Initial FNV-1a hash value */
+#define HASH_FNV_INIT 2166136261U
+
+/** A hash table slot */
+struct hash_slot {
+	/** Key (or NULL if empty) */
+	const void *key;
+	/** Value */
+	void *value;
+	/** Key hash */
+	unsigned int hash;
+};
+
+/** A hash table using linear probing */
+struct hash_table {
+	/** Number of occupied slots */
+	unsigned int count;
+	/** Hash table size mask */
+	unsigned int mask;
+	/** Slots */
+	struct hash_slot *slots;
+};
+
+/**
+ * Check if keys are the same
+ *
+ * @v key		Key held in hash table
+ * @v other		Key being looked up
+ * @ret same		Keys are the same
+ */
+typedef bool ( * hash_same_t ) ( const void *key, const void *other );
+
+extern unsigned int hash_fnv ( unsigned int hash, const void *data,
+			       size_t len );
+extern int hash_init ( struct hash_table *table, unsigned int count );
+extern int hash_reserve ( struct hash_table *table );
+extern struct hash_slot * hash_find ( const struct hash_table *table,
+				      unsigned int hash, const void *key,
+				      hash_same_t same );
+extern void hash_set ( struct hash_table *table, struct hash_slot *slot,
+		       const void *key, void *value, unsigned int hash );
+extern void hash_free ( struct hash_table *table );
+
+#endif /* _HASH_H */
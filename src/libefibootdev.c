@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -33,6 +34,9 @@ static const char *efiboot_type_names[] = {
 #define EFIBOOT_NAME_LEN \
 	( 7 /* "SysPrep" */ + 5 /* "Order" */ + 1 /* NUL */ )
 
+/** Boot next variable name */
+#define EFIBOOT_NEXT_NAME "BootNext"
+
 /** An EFI boot entry device path */
 struct efi_boot_entry_path {
 	/** Device path protocol */
@@ -53,18 +57,76 @@ struct efi_boot_entry {
 	uint32_t attributes;
 	/** Description (as UTF8 string) */
 	char *description;
+	/** Description reference count (or NULL if not shared) */
+	unsigned int *description_refs;
 	/** Device paths */
 	struct efi_boot_entry_path *paths;
+	/** Device paths reference count (or NULL if not shared) */
+	unsigned int *paths_refs;
 	/** Number of device paths */
 	unsigned int count;
 	/** Optional data */
 	void *data;
+	/** Optional data reference count (or NULL if not shared) */
+	unsigned int *data_refs;
 	/** Length of optional data */
 	size_t len;
+	/** Cached optional data textual representation (as UTF8 string) */
+	char *text;
+	/** Variable attributes */
+	uint32_t var_attributes;
 	/** Variable name */
 	char name[EFIBOOT_NAME_LEN];
 };
 
+/**
+ * Share storage with a cloned EFI boot entry
+ *
+ * @v refs		Reference count pointer
+ * @ret ok		Success indicator
+ *
+ * The caller must copy both the storage pointer and the updated
+ * reference count pointer into the clone.
+ */
+static int efiboot_share ( unsigned int **refs ) {
+
+	/* Allocate reference count, if not already shared */
+	if ( ! *refs ) {
+		*refs = malloc ( sizeof ( **refs ) );
+		if ( ! *refs )
+			return 0;
+		**refs = 1;
+	}
+
+	/* Add reference */
+	(**refs)++;
+
+	return 1;
+}
+
+/**
+ * Drop reference to shared storage
+ *
+ * @v refs		Reference count pointer
+ * @ret last		Storage is no longer referenced and should be freed
+ *
+ * After this call the entry no longer shares the storage, and the
+ * reference count pointer is cleared.
+ */
+static bool efiboot_unshare ( unsigned int **refs ) {
+	bool last = true;
+
+	/* Drop reference, if shared */
+	if ( *refs ) {
+		last = ( --(**refs) == 0 );
+		if ( last )
+			free ( *refs );
+		*refs = NULL;
+	}
+
+	return last;
+}
+
 /**
  * Free EFI boot entry cached device path textual representations
  *
@@ -79,6 +141,21 @@ static void efiboot_free_text ( struct efi_boot_entry *entry ) {
 	}
 }
 
+/**
+ * Free EFI boot entry cached optional data textual representation
+ *
+ * @v entry		EFI boot entry
+ */
+static void efiboot_free_data_text ( struct efi_boot_entry *entry ) {
+
+	/* Free text only if it does not point into the optional data */
+	if ( ( ( void * ) entry->text < entry->data ) ||
+	     ( ( void * ) entry->text >= ( entry->data + entry->len ) ) ) {
+		free ( entry->text );
+	}
+	entry->text = NULL;
+}
+
 /**
  * Free EFI boot entry
  *
@@ -86,10 +163,15 @@ static void efiboot_free_text ( struct efi_boot_entry *entry ) {
  */
 void efiboot_free ( struct efi_boot_entry *entry ) {
 
-	efiboot_free_text ( entry );
-	free ( entry->data );
-	free ( entry->paths );
-	free ( entry->description );
+	efiboot_free_data_text ( entry );
+	if ( efiboot_unshare ( &entry->data_refs ) )
+		free ( entry->data );
+	if ( efiboot_unshare ( &entry->paths_refs ) ) {
+		efiboot_free_text ( entry );
+		free ( entry->paths );
+	}
+	if ( efiboot_unshare ( &entry->description_refs ) )
+		free ( entry->description );
 	free ( entry );
 }
 
@@ -160,6 +242,7 @@ struct efi_boot_entry * efiboot_from_option ( const EFI_LOAD_OPTION *option,
 	entry->type = EFIBOOT_TYPE_BOOT;
 	entry->index = EFIBOOT_INDEX_AUTO;
 	entry->attributes = option->Attributes;
+	entry->var_attributes = EFIVARS_DEFAULT_ATTRIBUTES;
 
 	/* Populate description */
 	desc = ( ( ( void * ) option ) + sizeof ( *option ) );
@@ -506,8 +589,9 @@ int efiboot_set_description ( struct efi_boot_entry *entry,
 	if ( ! tmp )
 		return 0;
 
-	/* Free old description */
-	free ( entry->description );
+	/* Free old description, if no longer shared */
+	if ( efiboot_unshare ( &entry->description_refs ) )
+		free ( entry->description );
 
 	/* Update description */
 	entry->description = tmp;
@@ -576,6 +660,45 @@ const char * efiboot_path_text ( const struct efi_boot_entry *entry,
 	return path->text;
 }
 
+/**
+ * Adopt block of device paths
+ *
+ * @v entry		EFI boot entry
+ * @v block		Block of device paths
+ * @v count		Number of device paths (must be at least 1)
+ *
+ * The block must have been allocated using malloc(), with space for
+ * @c count path descriptors followed by the device paths themselves.
+ * Ownership of the block passes to the boot entry.
+ */
+static void efiboot_adopt_paths ( struct efi_boot_entry *entry, void *block,
+				  unsigned int count ) {
+	struct efi_boot_entry_path *paths = block;
+	EFI_DEVICE_PATH_PROTOCOL *path;
+	unsigned int i;
+
+	/* Populate path descriptors */
+	path = ( block + ( count * sizeof ( paths[0] ) ) );
+	for ( i = 0 ; i < count ; i++ ) {
+		paths[i].path = path;
+		paths[i].text = NULL;
+		path = ( ( ( void * ) path ) + efidp_len ( path ) );
+	}
+
+	/* Free old device paths, if no longer shared */
+	if ( efiboot_unshare ( &entry->paths_refs ) ) {
+		efiboot_free_text ( entry );
+		free ( entry->paths );
+	}
+
+	/* Update device paths */
+	entry->paths = paths;
+	entry->count = count;
+
+	/* Mark as modified */
+	entry->modified = true;
+}
+
 /**
  * Set device paths
  *
@@ -587,7 +710,7 @@ const char * efiboot_path_text ( const struct efi_boot_entry *entry,
 int efiboot_set_paths ( struct efi_boot_entry *entry,
 			EFI_DEVICE_PATH_PROTOCOL **paths, unsigned int count ) {
 	struct efi_boot_entry_path *tmp;
-	EFI_DEVICE_PATH_PROTOCOL *path;
+	void *path;
 	size_t len;
 	unsigned int i;
 
@@ -606,25 +729,226 @@ int efiboot_set_paths ( struct efi_boot_entry *entry,
 		return 0;
 	path = ( ( ( void * ) tmp ) + ( count * sizeof ( tmp[0] ) ) );
 	for ( i = 0 ; i < count ; i++ ) {
-		tmp[i].path = path;
-		tmp[i].text = NULL;
 		len = efidp_len ( paths[i] );
 		memcpy ( path, paths[i], len );
-		path = ( ( ( void * ) path ) + len );
+		path += len;
 	}
 
-	/* Free old device paths */
-	efiboot_free_text ( entry );
-	free ( entry->paths );
-
 	/* Update device paths */
-	entry->paths = tmp;
+	efiboot_adopt_paths ( entry, tmp, count );
+
+	return 1;
+}
+
+/**
+ * Ensure device paths are not shared with any clone
+ *
+ * @v entry		EFI boot entry
+ * @ret ok		Success indicator
+ *
+ * The cached textual representations are copied along with the
+ * device paths, since the paths themselves are unchanged.
+ */
+static int efiboot_own_paths ( struct efi_boot_entry *entry ) {
+	struct efi_boot_entry_path *paths;
+	const char *text;
+	void *base;
+	size_t len;
+	unsigned int i;
+
+	/* Do nothing unless shared with another entry */
+	if ( ! entry->paths_refs )
+		return 1;
+	if ( *entry->paths_refs == 1 ) {
+		efiboot_unshare ( &entry->paths_refs );
+		return 1;
+	}
+
+	/* Copy block */
+	len = ( entry->count * sizeof ( entry->paths[0] ) );
+	for ( i = 0 ; i < entry->count ; i++ )
+		len += efidp_len ( entry->paths[i].path );
+	paths = malloc ( len );
+	if ( ! paths )
+		return 0;
+	memcpy ( paths, entry->paths, len );
+
+	/* Update path descriptors to refer to the copy */
+	base = entry->paths;
+	for ( i = 0 ; i < entry->count ; i++ ) {
+		paths[i].path = ( ( ( void * ) paths ) +
+				  ( ( ( void * ) entry->paths[i].path ) -
+				    base ) );
+		text = entry->paths[i].text;
+		paths[i].text = ( text ? strdup ( text ) : NULL );
+	}
+
+	/* Drop reference to shared block */
+	efiboot_unshare ( &entry->paths_refs );
+	entry->paths = paths;
+
+	return 1;
+}
+
+/**
+ * Splice device path list
+ *
+ * @v entry		EFI boot entry
+ * @v index		Index of first path to remove
+ * @v remove		Number of paths to remove
+ * @v path		Device path to insert at index (or NULL)
+ * @ret ok		Success indicator
+ *
+ * The device paths are edited in place within the existing block, and
+ * the cached textual representations of all paths other than those
+ * removed are retained.
+ */
+static int efiboot_splice_paths ( struct efi_boot_entry *entry,
+				  unsigned int index, unsigned int remove,
+				  const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	struct efi_boot_entry_path *paths;
+	EFI_DEVICE_PATH_PROTOCOL *copy = NULL;
+	EFI_DEVICE_PATH_PROTOCOL *tmp;
+	unsigned int insert = ( path ? 1 : 0 );
+	unsigned int count;
+	unsigned int i;
+	size_t old_hdrlen;
+	size_t new_hdrlen;
+	size_t beforelen;
+	size_t removelen;
+	size_t insertlen;
+	size_t afterlen;
+	size_t old_len;
+	size_t new_len;
+	void *base;
+
+	/* Sanity checks */
+	if ( ( index > entry->count ) ||
+	     ( remove > ( entry->count - index ) ) ) {
+		errno = EINVAL;
+		goto err_sanity;
+	}
+	count = ( entry->count - remove + insert );
+	if ( count < 1 ) {
+		errno = EINVAL;
+		goto err_sanity;
+	}
+
+	/* Take a private copy of the block, if shared */
+	if ( ! efiboot_own_paths ( entry ) )
+		goto err_own;
+
+	/* Calculate lengths of each region */
+	beforelen = 0;
+	for ( i = 0 ; i < index ; i++ )
+		beforelen += efidp_len ( entry->paths[i].path );
+	removelen = 0;
+	for ( ; i < ( index + remove ) ; i++ )
+		removelen += efidp_len ( entry->paths[i].path );
+	afterlen = 0;
+	for ( ; i < entry->count ; i++ )
+		afterlen += efidp_len ( entry->paths[i].path );
+	insertlen = ( path ? efidp_len ( path ) : 0 );
+	old_hdrlen = ( entry->count * sizeof ( entry->paths[0] ) );
+	new_hdrlen = ( count * sizeof ( entry->paths[0] ) );
+	old_len = ( old_hdrlen + beforelen + removelen + afterlen );
+	new_len = ( new_hdrlen + beforelen + insertlen + afterlen );
+
+	/* Copy new path if it lies within the block being edited */
+	base = entry->paths;
+	if ( ( ( void * ) path >= base ) &&
+	     ( ( void * ) path < ( base + old_len ) ) ) {
+		copy = malloc ( insertlen );
+		if ( ! copy )
+			goto err_copy;
+		memcpy ( copy, path, insertlen );
+		path = copy;
+	}
+
+	/* Grow block, if applicable */
+	if ( new_len > old_len ) {
+		base = realloc ( entry->paths, new_len );
+		if ( ! base )
+			goto err_realloc;
+		entry->paths = base;
+	}
+	paths = base;
+
+	/* Free cached textual representations of removed paths */
+	for ( i = index ; i < ( index + remove ) ; i++ )
+		free ( paths[i].text );
+
+	/* Shrink path list header, if applicable */
+	if ( count < entry->count ) {
+		memmove ( &paths[ index + insert ], &paths[ index + remove ],
+			  ( ( entry->count - index - remove ) *
+			    sizeof ( paths[0] ) ) );
+	}
+
+	/* Move device paths following the spliced region, then those
+	 * preceding it (or vice versa), so that neither overwrites
+	 * the other.
+	 */
+	if ( ( new_hdrlen + insertlen ) >= ( old_hdrlen + removelen ) ) {
+		memmove ( ( base + new_hdrlen + beforelen + insertlen ),
+			  ( base + old_hdrlen + beforelen + removelen ),
+			  afterlen );
+		memmove ( ( base + new_hdrlen ), ( base + old_hdrlen ),
+			  beforelen );
+	} else {
+		memmove ( ( base + new_hdrlen ), ( base + old_hdrlen ),
+			  beforelen );
+		memmove ( ( base + new_hdrlen + beforelen + insertlen ),
+			  ( base + old_hdrlen + beforelen + removelen ),
+			  afterlen );
+	}
+
+	/* Copy in new path, if applicable */
+	if ( path ) {
+		memcpy ( ( base + new_hdrlen + beforelen ), path,
+			 insertlen );
+	}
+
+	/* Grow path list header, if applicable */
+	if ( count > entry->count ) {
+		memmove ( &paths[ index + insert ], &paths[ index + remove ],
+			  ( ( entry->count - index - remove ) *
+			    sizeof ( paths[0] ) ) );
+	}
+	if ( path )
+		paths[index].text = NULL;
+
+	/* Shrink block, if applicable */
+	if ( new_len < old_len ) {
+		base = realloc ( entry->paths, new_len );
+		if ( base )
+			entry->paths = base;
+		paths = entry->paths;
+		base = entry->paths;
+	}
+
+	/* Update device path pointers */
+	tmp = ( base + new_hdrlen );
+	for ( i = 0 ; i < count ; i++ ) {
+		paths[i].path = tmp;
+		tmp = ( ( ( void * ) tmp ) + efidp_len ( tmp ) );
+	}
 	entry->count = count;
 
+	/* Free copy of new path, if applicable */
+	free ( copy );
+
 	/* Mark as modified */
 	entry->modified = true;
 
 	return 1;
+
+ err_realloc:
+	free ( copy );
+ err_copy:
+ err_own:
+ err_sanity:
+	return 0;
 }
 
 /**
@@ -637,34 +961,61 @@ int efiboot_set_paths ( struct efi_boot_entry *entry,
  */
 int efiboot_set_path ( struct efi_boot_entry *entry, unsigned int index,
 		       const EFI_DEVICE_PATH_PROTOCOL *path ) {
-	EFI_DEVICE_PATH_PROTOCOL **paths;
-	unsigned int i;
 
 	/* Sanity check */
 	if ( index >= entry->count ) {
 		errno = EINVAL;
-		goto err_count;
+		return 0;
 	}
 
-	/* Construct updated list of device paths */
-	paths = malloc ( entry->count * sizeof ( paths[0] ) );
-	if ( ! paths )
-		goto err_alloc;
-	for ( i = 0 ; i < entry->count ; i++ )
-		paths[i] = entry->paths[i].path;
-	paths[index] = ( ( EFI_DEVICE_PATH_PROTOCOL * ) path );
+	/* Replace device path */
+	return efiboot_splice_paths ( entry, index, 1, path );
+}
 
-	/* Set device paths */
-	if ( ! efiboot_set_paths ( entry, paths, entry->count ) )
-		goto err_set_paths;
+/**
+ * Insert device path
+ *
+ * @v entry		EFI boot entry
+ * @v index		Path index (at most the current number of paths)
+ * @v path		Device path
+ * @ret ok		Success indicator
+ */
+int efiboot_insert_path ( struct efi_boot_entry *entry, unsigned int index,
+			  const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	return efiboot_splice_paths ( entry, index, 0, path );
+}
 
-	return 1;
+/**
+ * Append device path
+ *
+ * @v entry		EFI boot entry
+ * @v path		Device path
+ * @ret ok		Success indicator
+ */
+int efiboot_append_path ( struct efi_boot_entry *entry,
+			  const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	return efiboot_splice_paths ( entry, entry->count, 0, path );
+}
 
- err_set_paths:
-	free ( paths );
- err_alloc:
- err_count:
-	return 0;
+/**
+ * Remove device path
+ *
+ * @v entry		EFI boot entry
+ * @v index		Path index
+ * @ret ok		Success indicator
+ *
+ * The final remaining device path cannot be removed.
+ */
+int efiboot_remove_path ( struct efi_boot_entry *entry, unsigned int index ) {
+
+	/* Sanity check */
+	if ( index >= entry->count ) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Remove device path */
+	return efiboot_splice_paths ( entry, index, 1, NULL );
 }
 
 /**
@@ -677,39 +1028,20 @@ int efiboot_set_path ( struct efi_boot_entry *entry, unsigned int index,
  */
 int efiboot_set_paths_text ( struct efi_boot_entry *entry, const char **texts,
 			     unsigned int count ) {
-	EFI_DEVICE_PATH_PROTOCOL **paths;
-	int i;
-
-	/* Allocate path list */
-	paths = malloc ( count * sizeof ( paths[0] ) );
-	if ( ! paths )
-		goto err_alloc;
-
-	/* Construct path list */
-	for ( i = 0 ; i < ( ( int ) count ) ; i++ ) {
-		paths[i] = efidp_from_text ( texts[i], false );
-		if ( ! paths[i] )
-			goto err_from_text;
-	}
+	void *block;
+	size_t len;
 
-	/* Set paths */
-	if ( ! efiboot_set_paths ( entry, paths, count ) )
-		goto err_set_paths;
+	/* Convert all paths directly into a single block */
+	block = efidp_from_texts ( texts, count, false,
+				   ( count * sizeof ( entry->paths[0] ) ),
+				   &len );
+	if ( ! block )
+		return 0;
 
-	/* Free paths */
-	for ( i = 0 ; i < ( ( int ) count ) ; i++ )
-		free ( paths[i] );
-	free ( paths );
+	/* Update device paths */
+	efiboot_adopt_paths ( entry, block, count );
 
 	return 1;
-
- err_set_paths:
- err_from_text:
-	for ( i-- ; i >= 0 ; i-- )
-		free ( paths[i] );
-	free ( paths );
- err_alloc:
-	return 0;
 }
 
 /**
@@ -786,11 +1118,38 @@ int efiboot_set_data ( struct efi_boot_entry *entry, const void *data,
 		tmp = NULL;
 	}
 
-	/* Free old optional data */
-	free ( entry->data );
+	/* Update optional data */
+	return efiboot_take_data ( entry, tmp, len );
+}
+
+/**
+ * Set optional data without copying
+ *
+ * @v entry		EFI boot entry
+ * @v data		Optional data (NULL to clear optional data)
+ * @v len		Length of optional data (0 to clear optional data)
+ * @ret ok		Success indicator
+ *
+ * The optional data must have been allocated using malloc().
+ * Ownership of the optional data passes to the boot entry, and the
+ * caller must not subsequently access or free it.
+ */
+int efiboot_take_data ( struct efi_boot_entry *entry, void *data,
+			size_t len ) {
+
+	/* Discard zero-length data */
+	if ( ! len ) {
+		free ( data );
+		data = NULL;
+	}
+
+	/* Free old optional data, if no longer shared */
+	efiboot_free_data_text ( entry );
+	if ( efiboot_unshare ( &entry->data_refs ) )
+		free ( entry->data );
 
 	/* Update optional data */
-	entry->data = tmp;
+	entry->data = data;
 	entry->len = len;
 
 	/* Mark as modified */
@@ -809,64 +1168,426 @@ void efiboot_clear_data ( struct efi_boot_entry *entry ) {
 }
 
 /**
- * Create new EFI boot entry
+ * Check for UCS-2 text optional data
  *
- * @ret entry		EFI boot entry, or NULL on error
+ * @v data		Optional data
+ * @v len		Length of optional data
+ * @ret is_text		Optional data is UCS-2 text
  */
-struct efi_boot_entry * efiboot_new ( void ) {
-	struct efi_boot_entry *entry;
-	static EFI_DEVICE_PATH_PROTOCOL path = EFIDP_END;
-	static EFI_DEVICE_PATH_PROTOCOL *paths[] = { &path };
+static bool efiboot_data_is_ucs2 ( const void *data, size_t len ) {
+	const uint8_t *bytes = data;
+	unsigned int count;
+	unsigned int i;
+	CHAR16 c;
 
-	/* Allocate entry */
-	entry = malloc ( sizeof ( *entry ) );
-	if ( ! entry )
-		goto err_alloc;
-	memset ( entry, 0, sizeof ( *entry ) );
-	entry->modified = true;
-	entry->type = EFIBOOT_TYPE_BOOT;
-	entry->index = EFIBOOT_INDEX_AUTO;
-	entry->attributes = LOAD_OPTION_ACTIVE;
+	/* Require an even length */
+	if ( len & 1 )
+		return false;
+	count = ( len / sizeof ( c ) );
 
-	/* Set description */
-	if ( ! efiboot_set_description ( entry, "Unknown" ) )
-		goto err_description;
+	/* Allow any number of trailing NULs */
+	while ( count && ( ! ( bytes[ 2 * count - 2 ] |
+			       bytes[ 2 * count - 1 ] ) ) ) {
+		count--;
+	}
+	if ( ! count )
+		return false;
 
-	/* Set device paths */
-	if ( ! efiboot_set_paths ( entry, paths, 1 ) )
-		goto err_paths;
+	/* Require the first character to be printable ASCII, to avoid
+	 * misidentifying arbitrary binary data as UCS-2 text.
+	 */
+	if ( ( bytes[0] < 0x20 ) || ( bytes[0] >= 0x7f ) || bytes[1] )
+		return false;
 
-	return entry;
+	/* Require printable characters */
+	for ( i = 0 ; i < count ; i++ ) {
+		c = ( bytes[ 2 * i ] | ( bytes[ 2 * i + 1 ] << 8 ) );
+		if ( ( ( c < 0x20 ) && ( c != '\t' ) && ( c != '\n' ) ) ||
+		     ( c == 0x7f ) || ( ( c >= 0xd800 ) && ( c <= 0xdfff ) ) ) {
+			return false;
+		}
+	}
 
- err_paths:
- err_description:
-	efiboot_free ( entry );
- err_alloc:
-	return NULL;
+	return true;
 }
 
 /**
- * Automatically assign EFI variable index
+ * Check for ASCII text optional data
  *
- * @v entry		EFI boot entry
- * @ret ok		Success indicator
+ * @v data		Optional data
+ * @v len		Length of optional data
+ * @ret is_text		Optional data is ASCII text
  */
-static int efiboot_autoindex ( struct efi_boot_entry *entry ) {
-	char name[EFIBOOT_NAME_LEN];
-	unsigned int index;
+static bool efiboot_data_is_ascii ( const void *data, size_t len ) {
+	const uint8_t *bytes = data;
+	size_t i;
+
+	/* Allow a single trailing NUL */
+	if ( len && ( ! bytes[ len - 1 ] ) )
+		len--;
+	if ( ! len )
+		return false;
+
+	/* Require printable characters */
+	for ( i = 0 ; i < len ; i++ ) {
+		if ( ( ( bytes[i] < 0x20 ) && ( bytes[i] != '\t' ) &&
+		       ( bytes[i] != '\n' ) ) || ( bytes[i] >= 0x7f ) ) {
+			return false;
+		}
+	}
 
-	/* Find an unused index */
-	for ( index = 0 ; index <= EFIBOOT_INDEX_MAX ; index++ ) {
+	return true;
+}
 
-		/* Skip if already in use */
-		if ( ! efiboot_index_name ( entry->type, index, name ) )
-			continue;
-		if ( efivars_exists ( name ) )
-			continue;
+/**
+ * Locate text spanning entire optional data
+ *
+ * @v data		Optional data
+ * @v len		Length of optional data
+ * @v textlen		Maximum length of text to fill in
+ * @ret text		Text (not necessarily NUL-terminated)
+ */
+static const void * efiboot_all_text ( const void *data, size_t len,
+				       size_t *textlen ) {
+	*textlen = len;
+	return data;
+}
 
-		/* Record selected index */
-		if ( ! efiboot_set_index ( entry, index ) )
-			return 0;
+/**
+ * Locate text within Windows Boot Manager optional data
+ *
+ * @v data		Optional data
+ * @v len		Length of optional data
+ * @v textlen		Maximum length of text to fill in
+ * @ret text		Text (not necessarily NUL-terminated), or NULL
+ *
+ * The Windows Boot Manager optional data comprises the ASCII
+ * signature "WINDOWS", a small binary header, and a UCS-2 string of
+ * the form "BCDOBJECT={guid}" identifying the boot configuration
+ * data object to be used.
+ */
+static const void * efiboot_windows_text ( const void *data, size_t len,
+					   size_t *textlen ) {
+	static const CHAR16 bcdobject[] = {
+		'B', 'C', 'D', 'O', 'B', 'J', 'E', 'C', 'T', '='
+	};
+	size_t offset;
+
+	/* Search for BCD object string */
+	for ( offset = 0 ; ( offset + sizeof ( bcdobject ) ) <= len ;
+	      offset += sizeof ( bcdobject[0] ) ) {
+		if ( memcmp ( ( data + offset ), bcdobject,
+			      sizeof ( bcdobject ) ) == 0 ) {
+			*textlen = ( len - offset );
+			return ( data + offset );
+		}
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+/** Optional data decoders
+ *
+ * Decoders are tried in order.  The prefix (if any) provides a cheap
+ * first-pass identification, and the validation method (if any)
+ * confirms the match.  ASCII text is tried before UCS-2 text, since
+ * any UCS-2 text longer than a single character will contain NULs
+ * that cannot appear within ASCII text.
+ */
+static const struct efi_boot_data_decoder {
+	/** Format */
+	enum efi_boot_data_format format;
+	/** Required prefix (or NULL) */
+	const void *prefix;
+	/** Length of required prefix */
+	size_t prefix_len;
+	/**
+	 * Validate optional data (or NULL)
+	 *
+	 * @v data		Optional data
+	 * @v len		Length of optional data
+	 * @ret valid		Optional data is valid
+	 */
+	bool ( * valid ) ( const void *data, size_t len );
+	/**
+	 * Locate text within optional data (or NULL)
+	 *
+	 * @v data		Optional data
+	 * @v len		Length of optional data
+	 * @v textlen		Maximum length of text to fill in
+	 * @ret text		Text (not necessarily NUL-terminated), or NULL
+	 */
+	const void * ( * text ) ( const void *data, size_t len,
+				  size_t *textlen );
+	/** Text is UCS-2 (rather than ASCII) */
+	bool ucs2;
+} efiboot_data_decoders[] = {
+	{
+		.format = EFIBOOT_DATA_WINDOWS,
+		.prefix = "WINDOWS",
+		.prefix_len = sizeof ( "WINDOWS" ),
+		.text = efiboot_windows_text,
+		.ucs2 = true,
+	},
+	{
+		.format = EFIBOOT_DATA_ASCII,
+		.valid = efiboot_data_is_ascii,
+		.text = efiboot_all_text,
+	},
+	{
+		.format = EFIBOOT_DATA_UCS2,
+		.valid = efiboot_data_is_ucs2,
+		.text = efiboot_all_text,
+		.ucs2 = true,
+	},
+	{
+		.format = EFIBOOT_DATA_BINARY,
+	},
+};
+
+/** Optional data format names */
+static const char *efiboot_data_format_names[] = {
+	[EFIBOOT_DATA_NONE] = "none",
+	[EFIBOOT_DATA_BINARY] = "binary",
+	[EFIBOOT_DATA_UCS2] = "ucs2",
+	[EFIBOOT_DATA_ASCII] = "ascii",
+	[EFIBOOT_DATA_WINDOWS] = "windows",
+};
+
+/**
+ * Find optional data decoder
+ *
+ * @v entry		EFI boot entry
+ * @ret decoder		Optional data decoder, or NULL if there is no data
+ */
+static const struct efi_boot_data_decoder *
+efiboot_data_decoder ( const struct efi_boot_entry *entry ) {
+	const struct efi_boot_data_decoder *decoder;
+	unsigned int i;
+
+	/* Do nothing if there is no optional data */
+	if ( ! entry->len )
+		return NULL;
+
+	/* Find first matching decoder */
+	for ( i = 0 ; i < ( sizeof ( efiboot_data_decoders ) /
+			    sizeof ( efiboot_data_decoders[0] ) ) ; i++ ) {
+		decoder = &efiboot_data_decoders[i];
+		if ( decoder->prefix &&
+		     ( ( entry->len < decoder->prefix_len ) ||
+		       ( memcmp ( entry->data, decoder->prefix,
+				  decoder->prefix_len ) != 0 ) ) ) {
+			continue;
+		}
+		if ( decoder->valid &&
+		     ( ! decoder->valid ( entry->data, entry->len ) ) ) {
+			continue;
+		}
+		return decoder;
+	}
+
+	return NULL;
+}
+
+/**
+ * Get optional data format
+ *
+ * @v entry		EFI boot entry
+ * @ret format		Optional data format
+ */
+enum efi_boot_data_format
+efiboot_data_format ( const struct efi_boot_entry *entry ) {
+	const struct efi_boot_data_decoder *decoder;
+
+	/* Identify format */
+	decoder = efiboot_data_decoder ( entry );
+	return ( decoder ? decoder->format : EFIBOOT_DATA_NONE );
+}
+
+/**
+ * Get optional data format name
+ *
+ * @v format		Optional data format
+ * @ret name		Format name, or NULL on error
+ */
+const char * efiboot_data_format_name ( enum efi_boot_data_format format ) {
+
+	/* Sanity check */
+	if ( format > EFIBOOT_DATA_MAX ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return efiboot_data_format_names[format];
+}
+
+/**
+ * Get optional data textual representation
+ *
+ * @v entry		EFI boot entry
+ * @ret text		Optional data text (as UTF8 string), or NULL on error
+ *
+ * Text is available only for optional data in a recognised textual
+ * format, such as a UCS-2 kernel command line or shim second-stage
+ * loader arguments.  NUL-terminated ASCII text is returned directly
+ * without copying; other text is converted on first use and cached.
+ */
+const char * efiboot_data_text ( const struct efi_boot_entry *entry ) {
+	struct efi_boot_entry *cache = ( ( struct efi_boot_entry * ) entry );
+	const struct efi_boot_data_decoder *decoder;
+	const void *text;
+	size_t len;
+
+	/* Use cached representation, if available */
+	if ( entry->text )
+		return entry->text;
+
+	/* Identify format */
+	decoder = efiboot_data_decoder ( entry );
+	if ( ! ( decoder && decoder->text ) ) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	/* Locate text */
+	text = decoder->text ( entry->data, entry->len, &len );
+	if ( ! text )
+		return NULL;
+
+	/* Create cached representation */
+	if ( decoder->ucs2 ) {
+		cache->text = efin_to_utf8 ( text, len );
+	} else if ( memchr ( text, '\0', len ) ) {
+		cache->text = ( ( char * ) text );
+	} else {
+		cache->text = strndup ( text, len );
+	}
+
+	return entry->text;
+}
+
+/**
+ * Create new EFI boot entry
+ *
+ * @ret entry		EFI boot entry, or NULL on error
+ */
+struct efi_boot_entry * efiboot_new ( void ) {
+	struct efi_boot_entry *entry;
+	static EFI_DEVICE_PATH_PROTOCOL path = EFIDP_END;
+	static EFI_DEVICE_PATH_PROTOCOL *paths[] = { &path };
+
+	/* Allocate entry */
+	entry = malloc ( sizeof ( *entry ) );
+	if ( ! entry )
+		goto err_alloc;
+	memset ( entry, 0, sizeof ( *entry ) );
+	entry->modified = true;
+	entry->type = EFIBOOT_TYPE_BOOT;
+	entry->index = EFIBOOT_INDEX_AUTO;
+	entry->attributes = LOAD_OPTION_ACTIVE;
+	entry->var_attributes = EFIVARS_DEFAULT_ATTRIBUTES;
+
+	/* Set description */
+	if ( ! efiboot_set_description ( entry, "Unknown" ) )
+		goto err_description;
+
+	/* Set device paths */
+	if ( ! efiboot_set_paths ( entry, paths, 1 ) )
+		goto err_paths;
+
+	return entry;
+
+ err_paths:
+ err_description:
+	efiboot_free ( entry );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Clone EFI boot entry
+ *
+ * @v orig		Original EFI boot entry
+ * @ret entry		EFI boot entry, or NULL on error
+ *
+ * The clone shares the description, device paths and optional data
+ * with the original entry, and a private copy is made only when the
+ * clone (or the original) is modified.  The clone has the same type
+ * as the original entry but will be assigned a new index when saved.
+ */
+struct efi_boot_entry * efiboot_clone ( struct efi_boot_entry *orig ) {
+	struct efi_boot_entry *entry;
+
+	/* Allocate entry */
+	entry = malloc ( sizeof ( *entry ) );
+	if ( ! entry )
+		goto err_alloc;
+	memset ( entry, 0, sizeof ( *entry ) );
+	entry->attributes = orig->attributes;
+	entry->var_attributes = orig->var_attributes;
+
+	/* Share description */
+	if ( ! efiboot_share ( &orig->description_refs ) )
+		goto err_description;
+	entry->description = orig->description;
+	entry->description_refs = orig->description_refs;
+
+	/* Share device paths */
+	if ( ! efiboot_share ( &orig->paths_refs ) )
+		goto err_paths;
+	entry->paths = orig->paths;
+	entry->paths_refs = orig->paths_refs;
+	entry->count = orig->count;
+
+	/* Share optional data */
+	if ( orig->data ) {
+		if ( ! efiboot_share ( &orig->data_refs ) )
+			goto err_data;
+		entry->data = orig->data;
+		entry->data_refs = orig->data_refs;
+		entry->len = orig->len;
+	}
+
+	/* Set type and automatic index */
+	if ( ! efiboot_set_type_index ( entry, orig->type,
+					EFIBOOT_INDEX_AUTO ) ) {
+		goto err_type_index;
+	}
+
+	return entry;
+
+ err_type_index:
+ err_data:
+ err_paths:
+ err_description:
+	efiboot_free ( entry );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Automatically assign EFI variable index
+ *
+ * @v entry		EFI boot entry
+ * @ret ok		Success indicator
+ */
+static int efiboot_autoindex ( struct efi_boot_entry *entry ) {
+	char name[EFIBOOT_NAME_LEN];
+	unsigned int index;
+
+	/* Find an unused index */
+	for ( index = 0 ; index <= EFIBOOT_INDEX_MAX ; index++ ) {
+
+		/* Skip if already in use */
+		if ( ! efiboot_index_name ( entry->type, index, name ) )
+			continue;
+		if ( efivars_exists ( name ) )
+			continue;
+
+		/* Record selected index */
+		if ( ! efiboot_set_index ( entry, index ) )
+			return 0;
 
 		return 1;
 	}
@@ -875,6 +1596,90 @@ static int efiboot_autoindex ( struct efi_boot_entry *entry ) {
 	return 0;
 }
 
+/**
+ * Compare EFI variable data against data fragments
+ *
+ * @v data		Data
+ * @v len		Length of data
+ * @v iov		Data fragments
+ * @v count		Number of data fragments
+ * @ret same		Data is identical
+ */
+static bool efiboot_same ( const void *data, size_t len,
+			   const struct efivars_iov *iov, unsigned int count ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( ( iov[i].len > len ) ||
+		     ( memcmp ( data, iov[i].data, iov[i].len ) != 0 ) )
+			return false;
+		data += iov[i].len;
+		len -= iov[i].len;
+	}
+	return ( len == 0 );
+}
+
+/**
+ * Write EFI variable from data fragments, if changed
+ *
+ * @v name		Variable name
+ * @v iov		Data fragments
+ * @v count		Number of data fragments
+ * @v attributes	Variable attributes (or 0 to preserve existing)
+ * @ret ok		Success indicator
+ *
+ * Writes to the firmware variable store are expensive, and some
+ * firmware implements a change of attributes by deleting and
+ * recreating the variable.  The write is skipped if the variable
+ * already exists with identical content and attributes.
+ *
+ * If @c attributes is zero, then the attributes of any existing
+ * variable will be preserved, and a new variable will be created
+ * with the default attributes.
+ */
+static int efiboot_writev ( const char *name, const struct efivars_iov *iov,
+			    unsigned int count, uint32_t attributes ) {
+	uint32_t old_attributes;
+	void *old_data;
+	size_t old_len;
+	bool unchanged;
+
+	/* Compare against existing variable, if any */
+	if ( efivars_read ( name, &old_data, &old_len, &old_attributes ) ) {
+		if ( ! attributes )
+			attributes = old_attributes;
+		unchanged = ( ( attributes == old_attributes ) &&
+			      efiboot_same ( old_data, old_len, iov, count ) );
+		free ( old_data );
+		if ( unchanged )
+			return 1;
+	} else if ( ! attributes ) {
+		attributes = EFIVARS_DEFAULT_ATTRIBUTES;
+	}
+
+	/* Write variable */
+	return efivars_writev ( name, iov, count, attributes );
+}
+
+/**
+ * Write EFI variable, if changed
+ *
+ * @v name		Variable name
+ * @v data		Data
+ * @v len		Length of data
+ * @v attributes	Variable attributes (or 0 to preserve existing)
+ * @ret ok		Success indicator
+ */
+static int efiboot_write ( const char *name, const void *data, size_t len,
+			   uint32_t attributes ) {
+	struct efivars_iov iov = {
+		.data = data,
+		.len = len,
+	};
+
+	return efiboot_writev ( name, &iov, 1, attributes );
+}
+
 /**
  * Load boot entry from EFI variable
  *
@@ -890,6 +1695,7 @@ struct efi_boot_entry * efiboot_load ( enum efi_boot_option_type type,
 				       unsigned int index ) {
 	struct efi_boot_entry *entry;
 	char name[EFIBOOT_NAME_LEN];
+	uint32_t attributes;
 	void *data;
 	size_t len;
 
@@ -898,7 +1704,7 @@ struct efi_boot_entry * efiboot_load ( enum efi_boot_option_type type,
 		goto err_name;
 
 	/* Read variable data */
-	if ( ! efivars_read ( name, &data, &len ) )
+	if ( ! efivars_read ( name, &data, &len, &attributes ) )
 		goto err_read;
 
 	/* Parse boot entry */
@@ -906,9 +1712,10 @@ struct efi_boot_entry * efiboot_load ( enum efi_boot_option_type type,
 	if ( ! entry )
 		goto err_from_option;
 
-	/* Record type, index, and variable name */
+	/* Record type, index, variable name, and variable attributes */
 	entry->type = type;
 	entry->index = index;
+	entry->var_attributes = attributes;
 	memcpy ( entry->name, name, sizeof ( entry->name ) );
 
 	/* Free variable data */
@@ -924,80 +1731,241 @@ struct efi_boot_entry * efiboot_load ( enum efi_boot_option_type type,
 }
 
 /**
- * Save boot entry to EFI variable
+ * Calculate length of EFI load option
  *
  * @v entry		EFI boot entry
+ * @v len		Length of EFI load option to fill in
  * @ret ok		Success indicator
- *
- * If the boot entry index is @c EFIBOOT_INDEX_AUTO then it will be
- * updated to reflect the automatically selected index.
  */
-int efiboot_save ( struct efi_boot_entry *entry ) {
-	EFI_LOAD_OPTION *option;
-	size_t len;
-
-	/* Skip saving if entry is unmodified */
-	if ( ! entry->modified )
-		return 1;
-
-	/* Select index, if applicable */
-	if ( entry->index == EFIBOOT_INDEX_AUTO ) {
-		if ( ! efiboot_autoindex ( entry ) )
-			goto err_autoindex;
-	}
-
-	/* Construct load option */
-	option = efiboot_to_option ( entry, &len );
-	if ( ! option )
-		goto err_to_option;
+static int efiboot_option_len ( const struct efi_boot_entry *entry,
+				size_t *len ) {
+	CHAR16 *desc;
+	unsigned int i;
 
-	/* Write variable data */
-	if ( ! efivars_write ( efiboot_name ( entry ), option, len ) )
-		goto err_write;
+	/* Convert description to EFI string */
+	desc = utf8_to_efi ( entry->description );
+	if ( ! desc )
+		return 0;
 
-	/* Free load option */
-	free ( option );
+	/* Calculate length */
+	*len = ( sizeof ( EFI_LOAD_OPTION ) + StrSize ( desc ) + entry->len );
+	for ( i = 0 ; i < entry->count ; i++ )
+		*len += efidp_len ( entry->paths[i].path );
 
-	/* Clear modification flag */
-	entry->modified = false;
+	/* Free EFI string */
+	free ( desc );
 
 	return 1;
-
- err_write:
-	free ( option );
- err_to_option:
- err_autoindex:
-	return 0;
 }
 
 /**
- * Delete boot entry EFI variable
+ * Fit boot entry within variable size budget
  *
  * @v entry		EFI boot entry
+ * @v max_len		Maximum variable length (or zero for no limit)
+ * @v fallbacks		Applied fallbacks to fill in
  * @ret ok		Success indicator
+ *
+ * Firmware will reject an attempt to save a load option that exceeds
+ * its maximum variable size.  If the load option would exceed the
+ * budget, then each device path is first shortened to a short-form
+ * partition path.  If the load option still exceeds the budget, then
+ * textual optional data (e.g. a kernel command line) is trimmed,
+ * retaining its NUL terminator.  Binary optional data is never
+ * trimmed.  If the load option cannot be made to fit, then errno is
+ * set to E2BIG.
+ *
+ * Unmodified entries are left untouched, since they have already
+ * been accepted by the firmware.
  */
-int efiboot_del ( struct efi_boot_entry *entry ) {
+int efiboot_fit ( struct efi_boot_entry *entry, size_t max_len,
+		  unsigned int *fallbacks ) {
+	const EFI_DEVICE_PATH_PROTOCOL *path;
+	const EFI_DEVICE_PATH_PROTOCOL *shortened;
+	size_t unit;
+	size_t len;
+	unsigned int i;
+	void *data;
 
-	/* Do nothing if there is no corresponding variable */
-	if ( entry->index == EFIBOOT_INDEX_AUTO )
+	/* Do nothing unless entry exceeds budget */
+	*fallbacks = 0;
+	if ( ( ! entry->modified ) || ( ! max_len ) )
+		return 1;
+	if ( ! efiboot_option_len ( entry, &len ) )
+		return 0;
+	if ( len <= max_len )
 		return 1;
 
-	/* Delete variable */
-	if ( ! efivars_delete ( efiboot_name ( entry ) ) )
+	/* Shorten device paths */
+	for ( i = 0 ; i < entry->count ; i++ ) {
+		path = entry->paths[i].path;
+		shortened = efidp_shorten ( path );
+		if ( shortened == path )
+			continue;
+		if ( ! efiboot_set_path ( entry, i, shortened ) )
+			return 0;
+		*fallbacks |= EFIBOOT_FIT_SHORT_PATHS;
+	}
+	if ( ! efiboot_option_len ( entry, &len ) )
 		return 0;
+	if ( len <= max_len )
+		return 1;
 
-	/* Clear index */
-	if ( ! efiboot_set_index ( entry, EFIBOOT_INDEX_AUTO ) )
+	/* Identify textual optional data character size */
+	switch ( efiboot_data_format ( entry ) ) {
+	case EFIBOOT_DATA_UCS2:
+		unit = sizeof ( CHAR16 );
+		break;
+	case EFIBOOT_DATA_ASCII:
+		unit = sizeof ( char );
+		break;
+	default:
+		unit = 0;
+		break;
+	}
+
+	/* Trim optional data, retaining a terminating NUL */
+	if ( ( ! unit ) || ( ( len - max_len + unit ) > entry->len ) ) {
+		errno = E2BIG;
+		return 0;
+	}
+	len = ( ( entry->len - ( len - max_len ) ) & ~( unit - 1 ) );
+	data = malloc ( len );
+	if ( ! data )
 		return 0;
+	memcpy ( data, entry->data, ( len - unit ) );
+	memset ( ( data + len - unit ), 0, unit );
+	if ( ! efiboot_take_data ( entry, data, len ) )
+		return 0;
+	*fallbacks |= EFIBOOT_FIT_TRIM_DATA;
 
 	return 1;
 }
 
 /**
- * Free EFI boot entry list
+ * Construct data fragments for boot entry EFI variable
  *
- * @v entries		List of boot entries
- */
+ * @v entry		EFI boot entry
+ * @v option		EFI load option header to fill in
+ * @v desc		Description (as EFI string)
+ * @v iov		Data fragments to fill in (at least four)
+ * @ret count		Number of data fragments
+ *
+ * The fragments refer directly to the entry's own storage.  The
+ * device paths are always stored contiguously following the path
+ * descriptors, and so form a single fragment.
+ */
+static unsigned int efiboot_iov ( const struct efi_boot_entry *entry,
+				  EFI_LOAD_OPTION *option, const CHAR16 *desc,
+				  struct efivars_iov *iov ) {
+	size_t pathslen;
+	unsigned int count;
+	unsigned int i;
+
+	/* Construct load option header */
+	pathslen = 0;
+	for ( i = 0 ; i < entry->count ; i++ )
+		pathslen += efidp_len ( entry->paths[i].path );
+	option->Attributes = entry->attributes;
+	option->FilePathListLength = pathslen;
+
+	/* Construct fragments */
+	iov[0].data = option;
+	iov[0].len = sizeof ( *option );
+	iov[1].data = desc;
+	iov[1].len = StrSize ( desc );
+	iov[2].data = entry->paths[0].path;
+	iov[2].len = pathslen;
+	count = 3;
+	if ( entry->len ) {
+		iov[count].data = entry->data;
+		iov[count].len = entry->len;
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * Save boot entry to EFI variable
+ *
+ * @v entry		EFI boot entry
+ * @ret ok		Success indicator
+ *
+ * If the boot entry index is @c EFIBOOT_INDEX_AUTO then it will be
+ * updated to reflect the automatically selected index.
+ */
+int efiboot_save ( struct efi_boot_entry *entry ) {
+	EFI_LOAD_OPTION option;
+	struct efivars_iov iov[4];
+	CHAR16 *desc;
+	unsigned int count;
+
+	/* Skip saving if entry is unmodified */
+	if ( ! entry->modified )
+		return 1;
+
+	/* Select index, if applicable */
+	if ( entry->index == EFIBOOT_INDEX_AUTO ) {
+		if ( ! efiboot_autoindex ( entry ) )
+			goto err_autoindex;
+	}
+
+	/* Convert description to EFI string */
+	desc = utf8_to_efi ( entry->description );
+	if ( ! desc )
+		goto err_desc;
+
+	/* Write variable data directly from the entry's own storage */
+	count = efiboot_iov ( entry, &option, desc, iov );
+	if ( ! efiboot_writev ( efiboot_name ( entry ), iov, count,
+				entry->var_attributes ) ) {
+		goto err_write;
+	}
+
+	/* Free EFI string */
+	free ( desc );
+
+	/* Clear modification flag */
+	entry->modified = false;
+
+	return 1;
+
+ err_write:
+	free ( desc );
+ err_desc:
+ err_autoindex:
+	return 0;
+}
+
+/**
+ * Delete boot entry EFI variable
+ *
+ * @v entry		EFI boot entry
+ * @ret ok		Success indicator
+ */
+int efiboot_del ( struct efi_boot_entry *entry ) {
+
+	/* Do nothing if there is no corresponding variable */
+	if ( entry->index == EFIBOOT_INDEX_AUTO )
+		return 1;
+
+	/* Delete variable */
+	if ( ! efivars_delete ( efiboot_name ( entry ) ) )
+		return 0;
+
+	/* Clear index */
+	if ( ! efiboot_set_index ( entry, EFIBOOT_INDEX_AUTO ) )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Free EFI boot entry list
+ *
+ * @v entries		List of boot entries
+ */
 void efiboot_free_all ( struct efi_boot_entry **entries ) {
 	struct efi_boot_entry **tmp;
 
@@ -1007,22 +1975,23 @@ void efiboot_free_all ( struct efi_boot_entry **entries ) {
 }
 
 /**
- * Load EFI boot entry list from EFI variables
+ * Load EFI boot order from EFI variable
  *
  * @v type		Load option type
- * @ret entries		List of boot entries (NULL terminated), or NULL on error
+ * @v count		Number of boot order entries to fill in
+ * @ret order		Boot order (list of indices), or NULL on error
  *
- * The list of boot entries is dynamically allocated and must
- * eventually be freed by the caller using efiboot_free_all().
+ * A missing order variable is treated as an empty list.  The list of
+ * indices is allocated using malloc() and must eventually be freed by
+ * the caller.
  */
-struct efi_boot_entry ** efiboot_load_all ( enum efi_boot_option_type type ) {
-	struct efi_boot_entry **entries;
+uint16_t * efiboot_load_order ( enum efi_boot_option_type type,
+				unsigned int *count ) {
 	char name[EFIBOOT_NAME_LEN];
+	uint32_t attributes;
+	uint16_t *order;
 	void *data;
 	size_t len;
-	uint16_t *index;
-	int count;
-	int i;
 
 	/* Construct order variable name */
 	if ( ! efiboot_order_name ( type, name ) )
@@ -1033,28 +2002,407 @@ struct efi_boot_entry ** efiboot_load_all ( enum efi_boot_option_type type ) {
 	 * Zero-length variables are not supported.  Treat a missing
 	 * order variable as equivalent to an empty list.
 	 */
-	if ( ! efivars_read ( name, &data, &len ) ) {
+	if ( ! efivars_read ( name, &data, &len, &attributes ) ) {
 		if ( errno != ENOENT )
 			goto err_read;
 		data = NULL;
 		len = 0;
 	}
+	*count = ( len / sizeof ( order[0] ) );
+
+	/* Return variable data directly, if non-empty */
+	if ( *count )
+		return data;
+
+	/* Otherwise, allocate an empty list */
+	free ( data );
+	order = malloc ( sizeof ( order[0] ) );
+	if ( ! order )
+		goto err_alloc;
+
+	return order;
+
+ err_alloc:
+ err_read:
+ err_name:
+	return NULL;
+}
+
+/**
+ * Save EFI boot order to EFI variable
+ *
+ * @v type		Load option type
+ * @v order		Boot order (list of indices)
+ * @v count		Number of boot order entries
+ * @ret ok		Success indicator
+ *
+ * The variable is left untouched if the boot order is unchanged.
+ */
+int efiboot_save_order ( enum efi_boot_option_type type,
+			 const uint16_t *order, unsigned int count ) {
+	char name[EFIBOOT_NAME_LEN];
+
+	/* Construct order variable name */
+	if ( ! efiboot_order_name ( type, name ) )
+		return 0;
+
+	/* Save order variable, preserving any existing attributes */
+	return efiboot_write ( name, order, ( count * sizeof ( order[0] ) ),
+			       0 );
+}
+
+/**
+ * Load EFI boot next index from EFI variable
+ *
+ * @v index		Boot entry index to fill in
+ * @ret ok		Success indicator
+ *
+ * A missing BootNext variable is reported as an error with errno set
+ * to ENOENT.
+ */
+int efiboot_load_next ( unsigned int *index ) {
+	uint32_t attributes;
+	uint16_t *next;
+	size_t len;
+
+	/* Read BootNext variable */
+	if ( ! efivars_read ( EFIBOOT_NEXT_NAME, ( ( void ** ) &next ), &len,
+			      &attributes ) )
+		goto err_read;
+	if ( len != sizeof ( *next ) ) {
+		errno = EINVAL;
+		goto err_len;
+	}
+	*index = *next;
+
+	/* Free variable data */
+	free ( next );
+
+	return 1;
+
+ err_len:
+	free ( next );
+ err_read:
+	return 0;
+}
+
+/**
+ * Get remaining EFI variable store space
+ *
+ * @v space		Remaining space to fill in
+ * @ret ok		Success indicator
+ *
+ * If the remaining space cannot be determined (e.g. because the
+ * kernel or firmware does not report it), then errno is set to
+ * ENOTSUP.  The remaining space may be used as the starting point
+ * for a pre-flight check of a batch of changes using
+ * efiboot_plan_save(), efiboot_plan_del(), and efiboot_plan_order().
+ */
+int efiboot_space ( size_t *space ) {
+
+	return efivars_space ( space );
+}
+
+/**
+ * Get total EFI variable store capacity
+ *
+ * @v capacity		Total capacity to fill in
+ * @ret ok		Success indicator
+ *
+ * If the capacity cannot be determined, then errno is set to ENOTSUP.
+ */
+int efiboot_capacity ( size_t *capacity ) {
+
+	return efivars_capacity ( capacity );
+}
+
+/**
+ * Charge variable store space
+ *
+ * @v need		Space required by new variable
+ * @v release		Space released by old variable
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ *
+ * A firmware variable store will generally write the new variable
+ * before discarding the old, and so the space occupied by the old
+ * variable is released only once the new variable has been charged.
+ */
+static int efiboot_plan ( size_t need, size_t release, size_t *space ) {
+
+	if ( need > *space ) {
+		errno = ENOSPC;
+		return 0;
+	}
+	*space = ( *space - need + release );
+	return 1;
+}
+
+/**
+ * Charge variable store space for writing EFI variable, if changed
+ *
+ * @v name		Variable name
+ * @v iov		Data fragments
+ * @v count		Number of data fragments
+ * @v attributes	Variable attributes (or 0 to preserve existing)
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ *
+ * Nothing is charged for a write that would be skipped by
+ * efiboot_writev().
+ */
+static int efiboot_plan_writev ( const char *name,
+				 const struct efivars_iov *iov,
+				 unsigned int count, uint32_t attributes,
+				 size_t *space ) {
+	uint32_t old_attributes;
+	void *old_data;
+	size_t old_len;
+	size_t len;
+	bool unchanged;
+	unsigned int i;
+
+	/* Calculate length */
+	for ( len = 0, i = 0 ; i < count ; i++ )
+		len += iov[i].len;
+
+	/* Compare against existing variable, if any */
+	if ( ! efivars_read ( name, &old_data, &old_len, &old_attributes ) ) {
+		if ( errno != ENOENT )
+			return 0;
+		return efiboot_plan ( efivars_footprint ( name, len ), 0,
+				      space );
+	}
+	unchanged = ( ( ( ! attributes ) || ( attributes == old_attributes ) )
+		      && efiboot_same ( old_data, old_len, iov, count ) );
+	free ( old_data );
+	if ( unchanged )
+		return 1;
+
+	return efiboot_plan ( efivars_footprint ( name, len ),
+			      efivars_footprint ( name, old_len ), space );
+}
+
+/**
+ * Charge variable store space for saving boot entry
+ *
+ * @v entry		EFI boot entry
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ *
+ * The remaining space is reduced by the space that efiboot_save()
+ * would consume.  If there is insufficient space, then errno is set
+ * to ENOSPC.
+ */
+int efiboot_plan_save ( const struct efi_boot_entry *entry, size_t *space ) {
+	EFI_LOAD_OPTION option;
+	struct efivars_iov iov[4];
+	char name[EFIBOOT_NAME_LEN];
+	CHAR16 *desc;
+	unsigned int count;
+	size_t len;
+	unsigned int i;
+	int ok;
+
+	/* Nothing will be written if entry is unmodified */
+	if ( ! entry->modified )
+		return 1;
+
+	/* Convert description to EFI string */
+	desc = utf8_to_efi ( entry->description );
+	if ( ! desc )
+		return 0;
+	count = efiboot_iov ( entry, &option, desc, iov );
+
+	/* Charge new variable, or changes to existing variable.  All
+	 * automatically selected indices produce names of the same
+	 * length, and so any index may be used to calculate the
+	 * space required by a new variable.
+	 */
+	if ( entry->index == EFIBOOT_INDEX_AUTO ) {
+		for ( len = 0, i = 0 ; i < count ; i++ )
+			len += iov[i].len;
+		ok = ( efiboot_index_name ( entry->type, 0, name ) &&
+		       efiboot_plan ( efivars_footprint ( name, len ), 0,
+				      space ) );
+	} else {
+		ok = efiboot_plan_writev ( efiboot_name ( entry ), iov, count,
+					   entry->var_attributes, space );
+	}
+
+	/* Free EFI string */
+	free ( desc );
+
+	return ok;
+}
+
+/**
+ * Release variable store space for deleting boot entry
+ *
+ * @v entry		EFI boot entry
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ */
+int efiboot_plan_del ( const struct efi_boot_entry *entry, size_t *space ) {
+	uint32_t attributes;
+	void *data;
+	size_t len;
+
+	/* Do nothing if there is no corresponding variable */
+	if ( entry->index == EFIBOOT_INDEX_AUTO )
+		return 1;
+
+	/* Release space occupied by existing variable, if any */
+	if ( ! efivars_read ( efiboot_name ( entry ), &data, &len,
+			      &attributes ) ) {
+		return ( errno == ENOENT );
+	}
+	free ( data );
+	*space += efivars_footprint ( efiboot_name ( entry ), len );
+
+	return 1;
+}
+
+/**
+ * Charge variable store space for saving EFI boot order
+ *
+ * @v type		Load option type
+ * @v order		Boot order (list of indices)
+ * @v count		Number of boot order entries
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ */
+int efiboot_plan_order ( enum efi_boot_option_type type,
+			 const uint16_t *order, unsigned int count,
+			 size_t *space ) {
+	char name[EFIBOOT_NAME_LEN];
+	struct efivars_iov iov = {
+		.data = order,
+		.len = ( count * sizeof ( order[0] ) ),
+	};
+
+	/* Construct order variable name */
+	if ( ! efiboot_order_name ( type, name ) )
+		return 0;
+
+	/* Charge order variable */
+	return efiboot_plan_writev ( name, &iov, 1, 0, space );
+}
+
+/**
+ * Restore intended EFI boot order
+ *
+ * @v order		Current boot order (list of indices)
+ * @v count		Number of current boot order entries
+ * @v intended		Intended boot order (list of indices)
+ * @v intended_count	Number of intended boot order entries
+ * @v restored		Restored boot order to fill in
+ * @ret restored_count	Number of restored boot order entries
+ *
+ * Firmware may reorder the boot order or insert newly detected
+ * devices at the start.  The restored boot order consists of the
+ * intended boot order, followed by any other entries from the
+ * current boot order in their existing relative order.  Intended
+ * entries missing from the current boot order are reinstated; the
+ * caller should omit any intended entries that no longer exist.
+ *
+ * The restored boot order must have space for @c count plus
+ * @c intended_count entries.
+ */
+unsigned int efiboot_order_restore ( const uint16_t *order,
+				     unsigned int count,
+				     const uint16_t *intended,
+				     unsigned int intended_count,
+				     uint16_t *restored ) {
+	unsigned int restored_count;
+	unsigned int i;
+	unsigned int j;
+
+	/* Start with intended boot order */
+	memcpy ( restored, intended, ( intended_count * sizeof ( order[0] ) ) );
+	restored_count = intended_count;
+
+	/* Append any other entries */
+	for ( i = 0 ; i < count ; i++ ) {
+		for ( j = 0 ; j < intended_count ; j++ ) {
+			if ( intended[j] == order[i] )
+				break;
+		}
+		if ( j == intended_count )
+			restored[restored_count++] = order[i];
+	}
+
+	return restored_count;
+}
+
+/**
+ * Watch for changes to EFI variables
+ *
+ * @ret fd		File descriptor, or negative error
+ *
+ * The file descriptor becomes readable whenever any EFI variable
+ * may have changed, and must then be drained using
+ * efiboot_watch_drain().  Notifications are best-effort: a change
+ * made by firmware is generally not notified until the next boot.
+ * If change notifications are not supported, then errno is set to
+ * ENOTSUP.
+ */
+int efiboot_watch ( void ) {
+
+	return efivars_watch();
+}
+
+/**
+ * Drain EFI variable change notifications
+ *
+ * @v fd		File descriptor
+ * @ret ok		Success indicator
+ */
+int efiboot_watch_drain ( int fd ) {
+
+	return efivars_watch_drain ( fd );
+}
+
+/**
+ * Load EFI boot entry list from EFI variables
+ *
+ * @v type		Load option type
+ * @ret entries		List of boot entries (NULL terminated), or NULL on error
+ *
+ * The list of boot entries is dynamically allocated and must
+ * eventually be freed by the caller using efiboot_free_all().
+ *
+ * As with efiboot_iter_next(), boot order entries for which no boot
+ * entry exists are skipped.
+ */
+struct efi_boot_entry ** efiboot_load_all ( enum efi_boot_option_type type ) {
+	struct efi_boot_entry **entries;
+	uint16_t *order;
+	unsigned int count;
+	unsigned int pos;
+	int i;
+
+	/* Read order variable */
+	order = efiboot_load_order ( type, &count );
+	if ( ! order )
+		goto err_order;
 
 	/* Allocate list of entries */
-	index = data;
-	count = ( len / sizeof ( index[0] ) );
 	entries = malloc ( ( count + 1 /* NULL */ ) * sizeof ( entries[0] ) );
 	if ( ! entries )
 		goto err_alloc;
-	for ( i = 0 ; i < count ; i++ ) {
-		entries[i] = efiboot_load ( type, index[i] );
-		if ( ! entries[i] )
+	for ( i = 0, pos = 0 ; pos < count ; pos++ ) {
+		entries[i] = efiboot_load ( type, order[pos] );
+		if ( entries[i] ) {
+			i++;
+		} else if ( errno != ENOENT ) {
 			goto err_load;
+		}
 	}
-	entries[count] = NULL;
+	entries[i] = NULL;
 
 	/* Free order variable */
-	free ( data );
+	free ( order );
 
 	return entries;
 
@@ -1063,12 +2411,121 @@ struct efi_boot_entry ** efiboot_load_all ( enum efi_boot_option_type type ) {
 		efiboot_free ( entries[i] );
 	free ( entries );
  err_alloc:
-	free ( data );
- err_read:
- err_name:
+	free ( order );
+ err_order:
+	return NULL;
+}
+
+/** A boot entry iterator */
+struct efi_boot_iter {
+	/** Load option type */
+	enum efi_boot_option_type type;
+	/** Boot order */
+	uint16_t *order;
+	/** Number of boot order entries */
+	unsigned int count;
+	/** Next boot order position */
+	unsigned int pos;
+	/** Most recently returned boot entry (or NULL) */
+	struct efi_boot_entry *entry;
+};
+
+/**
+ * Open boot entry iterator
+ *
+ * @v type		Load option type
+ * @ret iter		Boot entry iterator, or NULL on error
+ *
+ * The iterator must eventually be closed by the caller using
+ * efiboot_iter_close().
+ */
+struct efi_boot_iter * efiboot_iter_open ( enum efi_boot_option_type type ) {
+	struct efi_boot_iter *iter;
+
+	/* Allocate and initialise iterator */
+	iter = calloc ( 1, sizeof ( *iter ) );
+	if ( ! iter )
+		goto err_alloc;
+	iter->type = type;
+
+	/* Read order variable */
+	iter->order = efiboot_load_order ( type, &iter->count );
+	if ( ! iter->order )
+		goto err_order;
+
+	return iter;
+
+ err_order:
+	free ( iter );
+ err_alloc:
 	return NULL;
 }
 
+/**
+ * Get next boot entry from iterator
+ *
+ * @v iter		Boot entry iterator
+ * @v entry		Boot entry to fill in (or NULL at end of boot order)
+ * @v pos		Boot order position to fill in
+ * @ret ok		Success indicator
+ *
+ * Boot entries are loaded one at a time in boot order, with the
+ * previously returned boot entry being freed before the next is
+ * loaded.  The boot entry remains owned by the iterator, and is
+ * valid only until the next call to efiboot_iter_next() or
+ * efiboot_iter_close().  Use efiboot_clone() to retain a boot entry
+ * beyond this point.
+ *
+ * As with firmware, boot order entries for which no boot entry
+ * exists are skipped.  The boot order position is therefore not
+ * necessarily the number of boot entries previously returned.  If a
+ * boot entry cannot be loaded for any other reason, then the
+ * iterator still advances past it (and the boot order position is
+ * still filled in), so that the caller may choose to report the
+ * failure and continue with the next boot entry.
+ */
+int efiboot_iter_next ( struct efi_boot_iter *iter,
+			struct efi_boot_entry **entry, unsigned int *pos ) {
+	unsigned int index;
+
+	/* Free previous entry, if any */
+	if ( iter->entry ) {
+		efiboot_free ( iter->entry );
+		iter->entry = NULL;
+	}
+
+	/* Load next existing entry, if any */
+	while ( iter->pos < iter->count ) {
+		*pos = iter->pos;
+		index = iter->order[ iter->pos++ ];
+		iter->entry = efiboot_load ( iter->type, index );
+		if ( iter->entry )
+			break;
+		if ( errno != ENOENT )
+			return 0;
+	}
+
+	*entry = iter->entry;
+	return 1;
+}
+
+/**
+ * Close boot entry iterator
+ *
+ * @v iter		Boot entry iterator (or NULL)
+ */
+void efiboot_iter_close ( struct efi_boot_iter *iter ) {
+
+	/* Do nothing if no iterator */
+	if ( ! iter )
+		return;
+
+	if ( iter->entry )
+		efiboot_free ( iter->entry );
+	free ( iter->order );
+	free ( iter );
+}
+
 /**
  * Save EFI boot entry list to EFI variables
  *
@@ -1081,53 +2538,600 @@ struct efi_boot_entry ** efiboot_load_all ( enum efi_boot_option_type type ) {
  */
 int efiboot_save_all ( enum efi_boot_option_type type,
 		       struct efi_boot_entry **entries ) {
-	char name[EFIBOOT_NAME_LEN];
-	uint16_t *index;
-	size_t len;
+	uint16_t *order;
 	unsigned int count;
 	unsigned int i;
-
-	/* Construct order variable name */
-	if ( ! efiboot_order_name ( type, name ) )
-		goto err_name;
+	size_t space;
 
 	/* Count number of entries */
 	for ( count = 0 ; entries[count] ; count++ ) {}
 
-	/* Save each individual entry */
+	/* Check entry types */
 	for ( i = 0 ; i < count ; i++ ) {
 		if ( entries[i]->type != type ) {
 			errno = EINVAL;
 			goto err_type;
 		}
-		if ( ! efiboot_save ( entries[i] ) )
-			goto err_save;
 	}
 
 	/* Allocate order variable */
-	len = ( count * sizeof ( index[0] ) );
-	index = malloc ( len );
-	if ( ! index )
+	order = malloc ( ( count + 1 /* avoid zero-length */ ) *
+			 sizeof ( order[0] ) );
+	if ( ! order )
 		goto err_alloc;
 
+	/* Check that all variables will fit within the variable
+	 * store before writing anything, where the remaining space is
+	 * known.  Automatically selected indices are not yet known,
+	 * but do not affect the length of the order variable.
+	 */
+	if ( efiboot_space ( &space ) ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( ! efiboot_plan_save ( entries[i], &space ) )
+				goto err_space;
+			order[i] = entries[i]->index;
+		}
+		if ( ! efiboot_plan_order ( type, order, count, &space ) )
+			goto err_space;
+	} else if ( errno != ENOTSUP ) {
+		goto err_space;
+	}
+
+	/* Save each individual entry */
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( ! efiboot_save ( entries[i] ) )
+			goto err_save;
+	}
+
 	/* Construct order variable */
 	for ( i = 0 ; i < count ; i++ )
-		index[i] = entries[i]->index;
+		order[i] = entries[i]->index;
 
 	/* Save order variable */
-	if ( ! efivars_write ( name, index, len ) )
+	if ( ! efiboot_save_order ( type, order, count ) )
 		goto err_write;
 
 	/* Free order variable */
-	free ( index );
+	free ( order );
 
 	return 1;
 
  err_write:
-	free ( index );
- err_alloc:
  err_save:
+ err_space:
+	free ( order );
+ err_alloc:
  err_type:
+	return 0;
+}
+
+/**
+ * Copy load option to new index
+ *
+ * @v type		Load option type
+ * @v from		Original index
+ * @v to		New index
+ * @ret ok		Success indicator
+ *
+ * The variable attributes are preserved.  A nonexistent original
+ * option is reported as an error with errno set to ENOENT.
+ */
+static int efiboot_copy_index ( enum efi_boot_option_type type,
+				unsigned int from, unsigned int to ) {
+	char name[EFIBOOT_NAME_LEN];
+	uint32_t attributes;
+	size_t len;
+	void *data;
+	int ok;
+
+	/* Read original option */
+	if ( ! efiboot_index_name ( type, from, name ) )
+		return 0;
+	if ( ! efivars_read ( name, &data, &len, &attributes ) )
+		return 0;
+
+	/* Write option to new index */
+	ok = ( efiboot_index_name ( type, to, name ) &&
+	       efiboot_write ( name, data, len, attributes ) );
+	free ( data );
+
+	return ok;
+}
+
+/**
+ * Charge variable store space for copying load option to new index
+ *
+ * @v type		Load option type
+ * @v from		Original index
+ * @v to		New index
+ * @v release		Original is deleted immediately after copying
+ * @v space		Remaining space to update
+ * @ret ok		Success indicator
+ */
+static int efiboot_plan_copy ( enum efi_boot_option_type type,
+			       unsigned int from, unsigned int to,
+			       bool release, size_t *space ) {
+	char name[EFIBOOT_NAME_LEN];
+	uint32_t attributes;
+	size_t released;
+	size_t len;
+	void *data;
+
+	/* Read original option */
+	if ( ! efiboot_index_name ( type, from, name ) )
+		return 0;
+	if ( ! efivars_read ( name, &data, &len, &attributes ) )
+		return 0;
+	free ( data );
+	released = ( release ? efivars_footprint ( name, len ) : 0 );
+
+	/* Charge new variable */
+	if ( ! efiboot_index_name ( type, to, name ) )
+		return 0;
+	return efiboot_plan ( efivars_footprint ( name, len ), released,
+			      space );
+}
+
+/**
+ * Compact load option indices
+ *
+ * @v type		Load option type
+ * @ret ok		Success indicator
+ *
+ * Duplicate entries are first removed from the order variable, with
+ * only the first occurrence of each index being retained.  Load
+ * options listed in the order variable are then renumbered into the
+ * lowest available indices.  Options already within the range
+ * 0..n-1 (where n is the number of distinct order variable entries)
+ * are left untouched, so that only options with higher indices are
+ * rewritten.
+ *
+ * Existing options not listed in the order variable but lying within
+ * the range 0..n-1 are first moved to the lowest unused indices above
+ * that range, so that the listed options always end up occupying
+ * exactly 0..n-1.  Unlisted options above the range are left
+ * untouched.  Order variable entries without a corresponding option
+ * are left in place.
+ *
+ * The relocated options are written first, followed by the updated
+ * order variable, and only then are the original variables deleted.
+ * An interrupted compaction will therefore never leave the order
+ * variable referring to a nonexistent option.  Where the remaining
+ * variable store space is known, nothing is written unless all of
+ * the relocated options and the order variable will fit.
+ */
+int efiboot_compact ( enum efi_boot_option_type type ) {
+	char name[EFIBOOT_NAME_LEN];
+	uint16_t *order;
+	uint16_t *new_order;
+	uint16_t *orphans;
+	uint16_t *new_orphans;
+	uint8_t *used;
+	unsigned int count;
+	unsigned int unique;
+	unsigned int orphan_count;
+	unsigned int slot;
+	unsigned int i;
+	size_t space;
+	bool changed;
+
+	/* Read order variable */
+	order = efiboot_load_order ( type, &count );
+	if ( ! order )
+		goto err_load_order;
+	used = calloc ( ( EFIBOOT_INDEX_MAX + 1 ), sizeof ( used[0] ) );
+	if ( ! used )
+		goto err_used;
+
+	/* Remove duplicate order entries, recording listed indices */
+	for ( i = 0, unique = 0 ; i < count ; i++ ) {
+		if ( used[ order[i] ] )
+			continue;
+		used[ order[i] ] = 1;
+		order[unique++] = order[i];
+	}
+	changed = ( unique != count );
+	count = unique;
+	new_order = malloc ( ( count + 1 /* avoid zero-length */ ) *
+			     sizeof ( new_order[0] ) );
+	if ( ! new_order )
+		goto err_new_order;
+	memcpy ( new_order, order, ( count * sizeof ( new_order[0] ) ) );
+	orphans = malloc ( ( count + 1 /* avoid zero-length */ ) *
+			   ( sizeof ( orphans[0] ) +
+			     sizeof ( new_orphans[0] ) ) );
+	if ( ! orphans )
+		goto err_orphans;
+	new_orphans = ( orphans + count + 1 );
+
+	/* Identify unlisted options within the target range, and
+	 * select the lowest unused indices above the range.
+	 */
+	orphan_count = 0;
+	for ( slot = 0, i = count ; slot < count ; slot++ ) {
+		if ( used[slot] )
+			continue;
+		if ( ! efiboot_index_name ( type, slot, name ) )
+			goto err_name;
+		if ( ! efivars_exists ( name ) )
+			continue;
+		for ( ; i <= EFIBOOT_INDEX_MAX ; i++ ) {
+			if ( used[i] )
+				continue;
+			if ( ! efiboot_index_name ( type, i, name ) )
+				goto err_name;
+			if ( ! efivars_exists ( name ) )
+				break;
+		}
+		if ( i > EFIBOOT_INDEX_MAX ) {
+			errno = ENOSPC;
+			goto err_space;
+		}
+		orphans[orphan_count] = slot;
+		new_orphans[orphan_count++] = i++;
+	}
+
+	/* Select new indices for listed options outside the target
+	 * range (ignoring nonexistent options).  Every index within
+	 * the range that is not already listed will be free once the
+	 * unlisted options have been moved.
+	 */
+	for ( i = 0, slot = 0 ; i < count ; i++ ) {
+		if ( order[i] < count )
+			continue;
+		if ( ! efiboot_index_name ( type, order[i], name ) )
+			goto err_name;
+		if ( ! efivars_exists ( name ) )
+			continue;
+		while ( used[slot] )
+			slot++;
+		used[slot] = 1;
+		new_order[i] = slot;
+		changed = true;
+	}
+
+	/* Check that all relocated options and the order variable
+	 * will fit within the variable store before writing anything,
+	 * where the remaining space is known.
+	 */
+	if ( efiboot_space ( &space ) ) {
+		for ( i = 0 ; i < orphan_count ; i++ ) {
+			if ( ! efiboot_plan_copy ( type, orphans[i],
+						   new_orphans[i], true,
+						   &space ) )
+				goto err_space;
+		}
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( new_order[i] == order[i] )
+				continue;
+			if ( ! efiboot_plan_copy ( type, order[i],
+						   new_order[i], false,
+						   &space ) )
+				goto err_space;
+		}
+		if ( changed && ( ! efiboot_plan_order ( type, new_order,
+							 count, &space ) ) )
+			goto err_space;
+	} else if ( errno != ENOTSUP ) {
+		goto err_space;
+	}
+
+	/* Move unlisted options out of the target range.  Each copy
+	 * is written before the original is deleted, so that an
+	 * interrupted move can leave at most a harmless duplicate.
+	 */
+	for ( i = 0 ; i < orphan_count ; i++ ) {
+		if ( ! efiboot_copy_index ( type, orphans[i],
+					    new_orphans[i] ) ) {
+			goto err_orphan;
+		}
+		if ( ( ! efiboot_index_name ( type, orphans[i], name ) ) ||
+		     ( ! efivars_delete ( name ) ) )
+			goto err_orphan;
+	}
+
+	/* Copy listed options to new indices */
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( new_order[i] == order[i] )
+			continue;
+		if ( ! efiboot_copy_index ( type, order[i], new_order[i] ) )
+			goto err_copy;
+	}
+
+	/* Update order variable */
+	if ( changed && ( ! efiboot_save_order ( type, new_order, count ) ) )
+		goto err_save_order;
+
+	/* Delete original options */
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( new_order[i] == order[i] )
+			continue;
+		if ( ( ! efiboot_index_name ( type, order[i], name ) ) ||
+		     ( ! efivars_delete ( name ) ) )
+			goto err_delete;
+	}
+
+	/* Free temporary storage */
+	free ( orphans );
+	free ( new_order );
+	free ( used );
+	free ( order );
+
+	return 1;
+
+ err_save_order:
+ err_copy:
+	/* Delete any options already written to new indices */
+	while ( i-- ) {
+		if ( new_order[i] == order[i] )
+			continue;
+		if ( efiboot_index_name ( type, new_order[i], name ) )
+			efivars_delete ( name );
+	}
+ err_orphan:
+ err_space:
  err_name:
+ err_delete:
+	free ( orphans );
+ err_orphans:
+	free ( new_order );
+ err_new_order:
+	free ( used );
+ err_used:
+	free ( order );
+ err_load_order:
 	return 0;
 }
+
+/** A published snapshot of boot entries */
+struct efi_boot_snapshot {
+	/** Reference count */
+	atomic_uint refs;
+	/** Boot entries (NULL-terminated) */
+	struct efi_boot_entry **entries;
+	/** Number of boot entries */
+	unsigned int count;
+};
+
+/** A boot entry snapshot publication point */
+struct efi_boot_publisher {
+	/** Currently published snapshot (or NULL) */
+	struct efi_boot_snapshot * _Atomic current;
+	/** Reader epoch */
+	atomic_ulong epoch;
+	/** Number of readers currently pinning within each epoch parity */
+	atomic_uint readers[2];
+	/** Writer lock */
+	atomic_flag writer;
+};
+
+/**
+ * Create boot entry snapshot from list of boot entries
+ *
+ * @v entries		Boot entries (NULL-terminated)
+ * @ret snapshot	Boot entry snapshot, or NULL on error
+ *
+ * Ownership of the list and of all boot entries passes to the
+ * snapshot (even on failure).  The entries must not subsequently be
+ * modified, and are read-only for the lifetime of the snapshot.
+ *
+ * All cached textual representations are created in advance, so
+ * that the entries may be accessed concurrently from multiple
+ * threads without any further modification.
+ */
+struct efi_boot_snapshot *
+efiboot_snapshot_take ( struct efi_boot_entry **entries ) {
+	struct efi_boot_snapshot *snapshot;
+	struct efi_boot_entry *entry;
+	unsigned int count;
+	unsigned int i;
+
+	/* Create cached textual representations */
+	for ( count = 0 ; ( entry = entries[count] ) ; count++ ) {
+		for ( i = 0 ; i < entry->count ; i++ ) {
+			if ( ! efiboot_path_text ( entry, i ) )
+				goto err_text;
+		}
+		errno = 0;
+		if ( ( ! efiboot_data_text ( entry ) ) && ( errno == ENOMEM ) )
+			goto err_text;
+	}
+
+	/* Allocate and initialise snapshot */
+	snapshot = malloc ( sizeof ( *snapshot ) );
+	if ( ! snapshot )
+		goto err_alloc;
+	atomic_init ( &snapshot->refs, 1 );
+	snapshot->entries = entries;
+	snapshot->count = count;
+
+	return snapshot;
+
+ err_alloc:
+ err_text:
+	efiboot_free_all ( entries );
+	return NULL;
+}
+
+/**
+ * Load boot entry snapshot
+ *
+ * @v type		Load option type
+ * @ret snapshot	Boot entry snapshot, or NULL on error
+ */
+struct efi_boot_snapshot * efiboot_snapshot ( enum efi_boot_option_type type ) {
+	struct efi_boot_entry **entries;
+
+	/* Load all boot entries */
+	entries = efiboot_load_all ( type );
+	if ( ! entries )
+		return NULL;
+
+	/* Create snapshot */
+	return efiboot_snapshot_take ( entries );
+}
+
+/**
+ * Get number of boot entries in snapshot
+ *
+ * @v snapshot		Boot entry snapshot
+ * @ret count		Number of boot entries
+ */
+unsigned int
+efiboot_snapshot_count ( const struct efi_boot_snapshot *snapshot ) {
+	return snapshot->count;
+}
+
+/**
+ * Get boot entry from snapshot
+ *
+ * @v snapshot		Boot entry snapshot
+ * @v index		Boot order position
+ * @ret entry		Boot entry (or NULL on index overflow)
+ */
+const struct efi_boot_entry *
+efiboot_snapshot_entry ( const struct efi_boot_snapshot *snapshot,
+			 unsigned int index ) {
+
+	/* Sanity check */
+	if ( index >= snapshot->count ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return snapshot->entries[index];
+}
+
+/**
+ * Drop reference to boot entry snapshot
+ *
+ * @v snapshot		Boot entry snapshot (or NULL)
+ */
+void efiboot_snapshot_put ( struct efi_boot_snapshot *snapshot ) {
+
+	/* Do nothing if no snapshot */
+	if ( ! snapshot )
+		return;
+
+	/* Free snapshot when the last reference is dropped */
+	if ( atomic_fetch_sub ( &snapshot->refs, 1 ) == 1 ) {
+		efiboot_free_all ( snapshot->entries );
+		free ( snapshot );
+	}
+}
+
+/**
+ * Create boot entry snapshot publication point
+ *
+ * @ret publisher	Publication point, or NULL on error
+ */
+struct efi_boot_publisher * efiboot_publisher_new ( void ) {
+	struct efi_boot_publisher *publisher;
+
+	/* Allocate and initialise publication point */
+	publisher = malloc ( sizeof ( *publisher ) );
+	if ( ! publisher )
+		return NULL;
+	atomic_init ( &publisher->current, NULL );
+	atomic_init ( &publisher->epoch, 0 );
+	atomic_init ( &publisher->readers[0], 0 );
+	atomic_init ( &publisher->readers[1], 0 );
+	atomic_flag_clear ( &publisher->writer );
+
+	return publisher;
+}
+
+/**
+ * Free boot entry snapshot publication point
+ *
+ * @v publisher		Publication point
+ *
+ * The caller must ensure that no other thread is still using the
+ * publication point.  Snapshots already pinned by readers remain
+ * valid until their references are dropped.
+ */
+void efiboot_publisher_free ( struct efi_boot_publisher *publisher ) {
+
+	efiboot_snapshot_put ( atomic_load ( &publisher->current ) );
+	free ( publisher );
+}
+
+/**
+ * Pin currently published boot entry snapshot
+ *
+ * @v publisher		Publication point
+ * @ret snapshot	Boot entry snapshot (or NULL if none published)
+ *
+ * The reader takes a reference to the currently published snapshot
+ * without acquiring any lock, and must eventually drop it using
+ * efiboot_snapshot_put().  The snapshot remains unchanged and valid
+ * for as long as the reference is held, regardless of any subsequent
+ * publication.
+ */
+struct efi_boot_snapshot *
+efiboot_pin ( struct efi_boot_publisher *publisher ) {
+	struct efi_boot_snapshot *snapshot;
+	unsigned long epoch;
+	atomic_uint *readers;
+
+	/* Register as a reader within the current epoch */
+	do {
+		epoch = atomic_load ( &publisher->epoch );
+		readers = &publisher->readers[ epoch & 1 ];
+		atomic_fetch_add ( readers, 1 );
+		if ( atomic_load ( &publisher->epoch ) == epoch )
+			break;
+		atomic_fetch_sub ( readers, 1 );
+	} while ( 1 );
+
+	/* Take reference to current snapshot.  The writer cannot
+	 * drop its own reference to this snapshot until all readers
+	 * within this epoch have finished.
+	 */
+	snapshot = atomic_load ( &publisher->current );
+	if ( snapshot )
+		atomic_fetch_add ( &snapshot->refs, 1 );
+
+	/* Deregister as a reader */
+	atomic_fetch_sub ( readers, 1 );
+
+	return snapshot;
+}
+
+/**
+ * Publish boot entry snapshot
+ *
+ * @v publisher		Publication point
+ * @v snapshot		Boot entry snapshot (or NULL)
+ *
+ * The new snapshot atomically replaces the currently published
+ * snapshot.  Ownership of the caller's reference passes to the
+ * publication point.  The previous snapshot is freed once all readers
+ * that pinned it have dropped their references.
+ *
+ * Concurrent writers are serialised, but readers are never blocked.
+ */
+void efiboot_publish ( struct efi_boot_publisher *publisher,
+		       struct efi_boot_snapshot *snapshot ) {
+	struct efi_boot_snapshot *old;
+	unsigned long epoch;
+
+	/* Serialise writers */
+	while ( atomic_flag_test_and_set ( &publisher->writer ) ) {}
+
+	/* Replace published snapshot */
+	old = atomic_exchange ( &publisher->current, snapshot );
+
+	/* Start a new epoch, and wait for any readers from the old
+	 * epoch (which may have loaded the old snapshot pointer but
+	 * not yet taken a reference) to finish.
+	 */
+	epoch = atomic_fetch_add ( &publisher->epoch, 1 );
+	while ( atomic_load ( &publisher->readers[ epoch & 1 ] ) ) {}
+
+	/* Release writer lock */
+	atomic_flag_clear ( &publisher->writer );
+
+	/* Drop reference to old snapshot */
+	efiboot_snapshot_put ( old );
+}
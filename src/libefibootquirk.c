@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI platform quirks
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <efibootdev.h>
+
+/** SMBIOS identification directory (relative to filesystem root) */
+#define EFIBOOT_QUIRK_DMI_PATH "/sys/class/dmi/id/"
+
+/** Maximum length of an SMBIOS identification string */
+#define EFIBOOT_QUIRK_DMI_LEN 128
+
+/** Variable overhead counted against the maximum variable size
+ *
+ * This is the EDK2 authenticated variable header plus the longest
+ * load option variable name (as a NUL-terminated UCS-2 string).
+ */
+#define EFIBOOT_QUIRK_OVERHEAD ( 60 + ( 2 * sizeof ( "SysPrep0000" ) ) )
+
+/** A set of platform quirks */
+struct efi_boot_quirk {
+	/** Platform name */
+	const char *name;
+	/** SMBIOS system vendor (or NULL to match any vendor) */
+	const char *vendor;
+	/** SMBIOS product name prefix (or NULL to match any product) */
+	const char *product;
+	/** Maximum variable store capacity (or zero to match any
+	 * capacity, including an unknown capacity)
+	 */
+	size_t max_capacity;
+	/** Maximum variable size (or zero for no known limit) */
+	size_t max_size;
+};
+
+/** Platform quirks
+ *
+ * Entries are matched in order, and the final entry matches any
+ * platform.
+ */
+static const struct efi_boot_quirk efiboot_quirks[] = {
+	/* OVMF built for the 1MB and 2MB flash image sizes has a
+	 * 0xe000-byte variable store and PcdMaxVariableSize=0x2000.
+	 */
+	{
+		.name = "QEMU",
+		.vendor = "QEMU",
+		.max_capacity = 0xe000,
+		.max_size = 0x2000,
+	},
+	/* OVMF built for the 4MB flash image size has a 0x40000-byte
+	 * variable store and PcdMaxVariableSize=0x8400.
+	 */
+	{
+		.name = "QEMU",
+		.vendor = "QEMU",
+		.max_capacity = 0x40000,
+		.max_size = 0x8400,
+	},
+	/* Other firmware (or a variable store of unknown size) cannot
+	 * be budgeted.
+	 */
+	{
+		.name = "QEMU",
+		.vendor = "QEMU",
+	},
+	/* Unknown platforms are not budgeted */
+	{
+		.name = "default",
+	},
+};
+
+/**
+ * Read SMBIOS identification string
+ *
+ * @v root		Filesystem root (e.g. "" for the running system)
+ * @v field		Field name (e.g. "sys_vendor")
+ * @v buf		Buffer to fill in
+ * @v len		Length of buffer
+ * @ret ok		Success indicator
+ *
+ * Any trailing whitespace (including the newline appended by sysfs)
+ * is removed.
+ */
+static int efiboot_quirk_dmi ( const char *root, const char *field,
+			       char *buf, size_t len ) {
+	char *path;
+	FILE *fh;
+	size_t i;
+	int ok = 0;
+
+	/* Construct path */
+	path = malloc ( strlen ( root ) + sizeof ( EFIBOOT_QUIRK_DMI_PATH ) +
+			strlen ( field ) );
+	if ( ! path )
+		goto err_alloc;
+	sprintf ( path, "%s" EFIBOOT_QUIRK_DMI_PATH "%s", root, field );
+
+	/* Read first line */
+	fh = fopen ( path, "r" );
+	if ( ! fh )
+		goto err_open;
+	if ( ! fgets ( buf, len, fh ) )
+		goto err_read;
+
+	/* Strip trailing whitespace */
+	for ( i = strlen ( buf ) ; i && ( buf[ i - 1 ] <= ' ' ) ; i-- )
+		buf[ i - 1 ] = '\0';
+
+	/* Success */
+	ok = 1;
+
+ err_read:
+	fclose ( fh );
+ err_open:
+	free ( path );
+ err_alloc:
+	return ok;
+}
+
+/**
+ * Identify platform quirks
+ *
+ * @v root		Filesystem root (e.g. "" for the running system)
+ * @v capacity		Variable store capacity (or zero if unknown)
+ * @ret quirk		Platform quirks
+ *
+ * The platform is identified by the SMBIOS system vendor and product
+ * name as exposed via sysfs.  A platform that cannot be identified
+ * (e.g. because SMBIOS information is unavailable) is given the
+ * default quirks.  The filesystem root allows the identification to
+ * be tested against a fixture directory tree.
+ *
+ * The same platform may be built with different variable size
+ * limits, and so the variable store capacity (as reported by
+ * efiboot_capacity()) is used to distinguish between builds.  No
+ * limit is applied if the capacity is unknown.
+ */
+const struct efi_boot_quirk * efiboot_quirk ( const char *root,
+					      size_t capacity ) {
+	const struct efi_boot_quirk *quirk;
+	char vendor[EFIBOOT_QUIRK_DMI_LEN];
+	char product[EFIBOOT_QUIRK_DMI_LEN];
+
+	/* Read SMBIOS identification, if available */
+	if ( ! efiboot_quirk_dmi ( root, "sys_vendor", vendor,
+				   sizeof ( vendor ) ) )
+		vendor[0] = '\0';
+	if ( ! efiboot_quirk_dmi ( root, "product_name", product,
+				   sizeof ( product ) ) )
+		product[0] = '\0';
+
+	/* Find first matching entry */
+	for ( quirk = efiboot_quirks ; ; quirk++ ) {
+		if ( quirk->vendor &&
+		     ( strcmp ( quirk->vendor, vendor ) != 0 ) )
+			continue;
+		if ( quirk->product &&
+		     ( strncmp ( quirk->product, product,
+				 strlen ( quirk->product ) ) != 0 ) )
+			continue;
+		if ( quirk->max_capacity &&
+		     ( ( ! capacity ) || ( capacity > quirk->max_capacity ) ) )
+			continue;
+		return quirk;
+	}
+}
+
+/**
+ * Get platform name
+ *
+ * @v quirk		Platform quirks
+ * @ret name		Platform name
+ */
+const char * efiboot_quirk_name ( const struct efi_boot_quirk *quirk ) {
+	return quirk->name;
+}
+
+/**
+ * Get maximum load option length
+ *
+ * @v quirk		Platform quirks
+ * @ret max_len		Maximum load option length (or zero for no limit)
+ *
+ * The maximum variable size enforced by firmware includes the
+ * variable header and name, which are deducted to give the maximum
+ * length of the load option itself.
+ */
+size_t efiboot_quirk_max_len ( const struct efi_boot_quirk *quirk ) {
+
+	if ( ! quirk->max_size )
+		return 0;
+	return ( quirk->max_size - EFIBOOT_QUIRK_OVERHEAD );
+}
@@ -0,0 +1,711 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI boot resolution simulator
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <Uefi/UefiBaseType.h>
+#include <Uefi/UefiSpec.h>
+#include <Protocol/DevicePath.h>
+#include <efibootdev.h>
+
+#include "strconvert.h"
+#include "hash.h"
+
+/** Removable media boot file name
+ *
+ * This is the file loaded by firmware from a partition identified by
+ * a device path that does not include a file path.  The name is not
+ * known for all architectures, in which case such a partition is
+ * assumed to contain a bootable file.
+ */
+#if defined(__i386__)
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTIA32.EFI"
+#elif defined(__x86_64__)
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTX64.EFI"
+#elif defined(__arm__)
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTARM.EFI"
+#elif defined(__aarch64__)
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTAA64.EFI"
+#elif defined(__riscv) && ( __riscv_xlen == 64 )
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTRISCV64.EFI"
+#elif defined(__loongarch64)
+#define EFIBOOT_REMOVABLE_FILE "\\EFI\\BOOT\\BOOTLOONGARCH64.EFI"
+#endif
+
+/** Ethernet MAC address length */
+#define EFIBOOT_MAC_LEN 6
+
+/** Hardware inventory key types */
+enum efi_boot_inventory_type {
+	/** Partition (keyed by signature) */
+	EFIBOOT_INVENTORY_PARTITION = 1,
+	/** File (keyed by partition signature and path) */
+	EFIBOOT_INVENTORY_FILE,
+	/** File on any partition (keyed by path) */
+	EFIBOOT_INVENTORY_ANY_FILE,
+	/** Partition with known files (keyed by signature) */
+	EFIBOOT_INVENTORY_SCANNED,
+	/** Network interface (keyed by MAC address) */
+	EFIBOOT_INVENTORY_NIC,
+};
+
+/** A hardware inventory */
+struct efi_boot_inventory {
+	/** Hash table of keys */
+	struct hash_table table;
+};
+
+/** Initial hash table capacity */
+#define EFIBOOT_INVENTORY_MIN_COUNT 32
+
+/** Boot resolution verdict names */
+static const char *efiboot_verdict_names[] = {
+	[EFIBOOT_VERDICT_BOOT] = "boot",
+	[EFIBOOT_VERDICT_INACTIVE] = "inactive",
+	[EFIBOOT_VERDICT_NOT_BOOTABLE] = "not a boot option",
+	[EFIBOOT_VERDICT_NO_DEVICE] = "device missing",
+	[EFIBOOT_VERDICT_NO_FILE] = "file missing",
+	[EFIBOOT_VERDICT_UNREACHED] = "not reached",
+};
+
+/**
+ * Normalise file path
+ *
+ * @v path		File path (as UTF-8 string)
+ * @ret normal		Normalised file path, or NULL on error
+ *
+ * The EFI system partition uses a case-insensitive FAT filesystem.
+ * File paths are normalised to upper case (for ASCII characters),
+ * with a single leading backslash and with forward slashes converted
+ * to backslashes, so that paths may be compared directly.  The
+ * normalised path is allocated using malloc() and must eventually be
+ * freed by the caller.
+ */
+static char * efiboot_inventory_path ( const char *path ) {
+	char *normal;
+	char *out;
+	char c;
+
+	/* Allocate normalised path */
+	normal = malloc ( 1 /* leading separator */ + strlen ( path ) +
+			  1 /* NUL */ );
+	if ( ! normal )
+		return NULL;
+
+	/* Construct normalised path, collapsing repeated separators */
+	out = normal;
+	*(out++) = '\\';
+	for ( ; ( c = *path ) ; path++ ) {
+		if ( c == '/' )
+			c = '\\';
+		if ( ( c >= 'a' ) && ( c <= 'z' ) )
+			c -= ( 'a' - 'A' );
+		if ( ( c == '\\' ) && ( out[-1] == '\\' ) )
+			continue;
+		*(out++) = c;
+	}
+	*out = '\0';
+
+	return normal;
+}
+
+/**
+ * Construct hardware inventory key
+ *
+ * @v type		Key type
+ * @v id		Identifier (e.g. partition signature), or NULL
+ * @v id_len		Length of identifier
+ * @v path		Normalised file path, or NULL
+ * @v hash		Key hash to fill in
+ * @ret key		Key, or NULL on error
+ *
+ * The key comprises the type, the identifier length, the identifier
+ * and the NUL-terminated file path, and so is self-delimiting.  The
+ * key is allocated using malloc() and must eventually be freed by the
+ * caller.
+ */
+static uint8_t * efiboot_inventory_key ( enum efi_boot_inventory_type type,
+					 const void *id, size_t id_len,
+					 const char *path,
+					 unsigned int *hash ) {
+	size_t path_len = ( path ? strlen ( path ) : 0 );
+	uint8_t *key;
+	uint8_t *data;
+	size_t len;
+
+	/* Sanity check */
+	if ( id_len > 0xff ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Allocate key */
+	len = ( 1 /* type */ + 1 /* id_len */ + id_len + path_len +
+		1 /* NUL */ );
+	key = malloc ( len );
+	if ( ! key )
+		return NULL;
+
+	/* Construct key */
+	data = key;
+	*(data++) = type;
+	*(data++) = id_len;
+	if ( id_len )
+		memcpy ( data, id, id_len );
+	data += id_len;
+	if ( path_len )
+		memcpy ( data, path, path_len );
+	data[path_len] = '\0';
+
+	/* Calculate hash */
+	*hash = hash_fnv ( HASH_FNV_INIT, key, len );
+
+	return key;
+}
+
+/**
+ * Check if hardware inventory keys are the same
+ *
+ * @v key		Key held in inventory
+ * @v other		Key being looked up
+ * @ret same		Keys are the same
+ */
+static bool efiboot_inventory_same ( const void *key, const void *other ) {
+	const uint8_t *data = key;
+	const uint8_t *other_data = other;
+	size_t len;
+
+	/* Compare type and identifier length */
+	if ( memcmp ( data, other_data, 2 ) != 0 )
+		return false;
+
+	/* Compare identifier and file path */
+	len = ( 2 + data[1] );
+	return ( ( memcmp ( data, other_data, len ) == 0 ) &&
+		 ( strcmp ( ( ( const char * ) data ) + len,
+			    ( ( const char * ) other_data ) + len ) == 0 ) );
+}
+
+/**
+ * Create hardware inventory
+ *
+ * @ret inventory	Hardware inventory, or NULL on error
+ */
+struct efi_boot_inventory * efiboot_inventory_new ( void ) {
+	struct efi_boot_inventory *inventory;
+
+	/* Allocate and initialise inventory */
+	inventory = calloc ( 1, sizeof ( *inventory ) );
+	if ( ! inventory )
+		goto err_alloc;
+	if ( ! hash_init ( &inventory->table, EFIBOOT_INVENTORY_MIN_COUNT ) )
+		goto err_table;
+
+	return inventory;
+
+ err_table:
+	free ( inventory );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Add key to hardware inventory
+ *
+ * @v inventory		Hardware inventory
+ * @v type		Key type
+ * @v id		Identifier, or NULL
+ * @v id_len		Length of identifier
+ * @v path		Normalised file path, or NULL
+ * @ret ok		Success indicator
+ */
+static int efiboot_inventory_add ( struct efi_boot_inventory *inventory,
+				   enum efi_boot_inventory_type type,
+				   const void *id, size_t id_len,
+				   const char *path ) {
+	struct hash_slot *slot;
+	unsigned int hash;
+	uint8_t *key;
+
+	/* Grow hash table if necessary */
+	if ( ! hash_reserve ( &inventory->table ) )
+		return 0;
+
+	/* Construct key */
+	key = efiboot_inventory_key ( type, id, id_len, path, &hash );
+	if ( ! key )
+		return 0;
+
+	/* Add key, if not already present */
+	slot = hash_find ( &inventory->table, hash, key,
+			   efiboot_inventory_same );
+	if ( slot->key ) {
+		free ( key );
+		return 1;
+	}
+	hash_set ( &inventory->table, slot, key, NULL, hash );
+
+	return 1;
+}
+
+/**
+ * Check for key in hardware inventory
+ *
+ * @v inventory		Hardware inventory
+ * @v type		Key type
+ * @v id		Identifier, or NULL
+ * @v id_len		Length of identifier
+ * @v path		Normalised file path, or NULL
+ * @ret present		Key is present (or negative on error)
+ */
+static int efiboot_inventory_has ( const struct efi_boot_inventory *inventory,
+				   enum efi_boot_inventory_type type,
+				   const void *id, size_t id_len,
+				   const char *path ) {
+	struct hash_slot *slot;
+	unsigned int hash;
+	uint8_t *key;
+
+	/* Construct key */
+	key = efiboot_inventory_key ( type, id, id_len, path, &hash );
+	if ( ! key )
+		return -1;
+
+	/* Find key */
+	slot = hash_find ( &inventory->table, hash, key,
+			   efiboot_inventory_same );
+	free ( key );
+
+	return ( slot->key != NULL );
+}
+
+/**
+ * Add partition to hardware inventory
+ *
+ * @v inventory		Hardware inventory
+ * @v signature		Partition signature
+ * @v len		Length of partition signature
+ * @ret ok		Success indicator
+ *
+ * The signature is as recorded in a hard drive device path node:
+ * the 16-byte partition GUID for a GPT partition, or the 4-byte
+ * disk signature for an MBR partition.
+ */
+int efiboot_inventory_add_partition ( struct efi_boot_inventory *inventory,
+				      const void *signature, size_t len ) {
+
+	return efiboot_inventory_add ( inventory, EFIBOOT_INVENTORY_PARTITION,
+				       signature, len, NULL );
+}
+
+/**
+ * Add file to hardware inventory
+ *
+ * @v inventory		Hardware inventory
+ * @v signature		Partition signature
+ * @v len		Length of partition signature
+ * @v path		File path within partition (as UTF-8 string)
+ * @ret ok		Success indicator
+ *
+ * The file path may use either forward slashes or backslashes as
+ * separators, and is matched case-insensitively.  Files are checked
+ * only on partitions for which at least one file has been added.
+ */
+int efiboot_inventory_add_file ( struct efi_boot_inventory *inventory,
+				 const void *signature, size_t len,
+				 const char *path ) {
+	char *normal;
+	int ok = 0;
+
+	/* Normalise path */
+	normal = efiboot_inventory_path ( path );
+	if ( ! normal )
+		goto err_path;
+
+	/* Add file, both on this partition and on any partition */
+	if ( ! efiboot_inventory_add ( inventory, EFIBOOT_INVENTORY_FILE,
+				       signature, len, normal ) )
+		goto err_file;
+	if ( ! efiboot_inventory_add ( inventory, EFIBOOT_INVENTORY_ANY_FILE,
+				       NULL, 0, normal ) )
+		goto err_any_file;
+
+	/* Record partition as having known files */
+	if ( ! efiboot_inventory_add ( inventory, EFIBOOT_INVENTORY_SCANNED,
+				       signature, len, NULL ) )
+		goto err_scanned;
+
+	/* Success */
+	ok = 1;
+
+ err_scanned:
+ err_any_file:
+ err_file:
+	free ( normal );
+ err_path:
+	return ok;
+}
+
+/**
+ * Add network interface to hardware inventory
+ *
+ * @v inventory		Hardware inventory
+ * @v mac		Ethernet MAC address
+ * @ret ok		Success indicator
+ */
+int efiboot_inventory_add_nic ( struct efi_boot_inventory *inventory,
+				const uint8_t *mac ) {
+
+	return efiboot_inventory_add ( inventory, EFIBOOT_INVENTORY_NIC,
+				       mac, EFIBOOT_MAC_LEN, NULL );
+}
+
+/**
+ * Free hardware inventory
+ *
+ * @v inventory		Hardware inventory (or NULL)
+ */
+void efiboot_inventory_free ( struct efi_boot_inventory *inventory ) {
+	unsigned int i;
+
+	/* Do nothing if no inventory */
+	if ( ! inventory )
+		return;
+
+	for ( i = 0 ; i <= inventory->table.mask ; i++ )
+		free ( ( void * ) inventory->table.slots[i].key );
+	hash_free ( &inventory->table );
+	free ( inventory );
+}
+
+/**
+ * Append file path node to file name
+ *
+ * @v name		File name (or NULL)
+ * @v node		File path node
+ * @ret name		Extended file name, or NULL on error
+ *
+ * The original file name is freed (even on error).
+ */
+static char * efiboot_resolve_append ( char *name,
+				       const FILEPATH_DEVICE_PATH *node ) {
+	size_t len = ( ( node->Header.Length[0] |
+			 ( node->Header.Length[1] << 8 ) ) -
+		       sizeof ( node->Header ) );
+	size_t name_len = ( name ? strlen ( name ) : 0 );
+	char *component;
+	char *tmp;
+
+	/* Convert file path node */
+	component = efin_to_utf8 ( node->PathName, len );
+	if ( ! component )
+		goto err_component;
+
+	/* Append component, with separator */
+	tmp = realloc ( name, ( name_len + 1 /* separator */ +
+				strlen ( component ) + 1 /* NUL */ ) );
+	if ( ! tmp )
+		goto err_realloc;
+	name = tmp;
+	name[name_len] = '\\';
+	strcpy ( &name[ name_len + 1 ], component );
+
+	free ( component );
+	return name;
+
+ err_realloc:
+	free ( component );
+ err_component:
+	free ( name );
+	return NULL;
+}
+
+/**
+ * Predict firmware handling of device path
+ *
+ * @v inventory		Hardware inventory
+ * @v path		Device path
+ * @v verified		Verdict was verified against the hardware inventory
+ * @ret verdict		Boot resolution verdict (or negative on error)
+ *
+ * A hard drive node requires the partition to be present, and a MAC
+ * address node requires the network interface to be present.  The
+ * file path (or the removable media boot file, if there is no file
+ * path) must then be present on the partition, or on any partition
+ * for a short-form file path.  Files on partitions with no known
+ * files, network boot files, and device path nodes that cannot be
+ * checked against the hardware inventory (e.g. firmware volume
+ * files), are assumed to be present.  A verdict that relies on any
+ * such assumption is reported as unverified.
+ */
+static int efiboot_resolve_path ( const struct efi_boot_inventory *inventory,
+				  const EFI_DEVICE_PATH_PROTOCOL *path,
+				  bool *verified ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	const HARDDRIVE_DEVICE_PATH *hd = NULL;
+	const MAC_ADDR_DEVICE_PATH *mac = NULL;
+	const void *signature = NULL;
+	size_t signature_len = 0;
+	char *name = NULL;
+	char *normal;
+	size_t len;
+	int present;
+	int verdict;
+
+	/* Scan device path */
+	*verified = true;
+	for ( node = path ;
+	      node->Type != END_DEVICE_PATH_TYPE ;
+	      node = ( ( ( const void * ) node ) + len ) ) {
+		len = ( node->Length[0] | ( node->Length[1] << 8 ) );
+		if ( ( node->Type == MEDIA_DEVICE_PATH ) &&
+		     ( node->SubType == MEDIA_HARDDRIVE_DP ) &&
+		     ( len >= sizeof ( *hd ) ) ) {
+			hd = ( ( const void * ) node );
+		} else if ( ( node->Type == MESSAGING_DEVICE_PATH ) &&
+			    ( node->SubType == MSG_MAC_ADDR_DP ) &&
+			    ( len >= sizeof ( *mac ) ) ) {
+			mac = ( ( const void * ) node );
+		} else if ( ( node->Type == MEDIA_DEVICE_PATH ) &&
+			    ( node->SubType == MEDIA_FILEPATH_DP ) ) {
+			name = efiboot_resolve_append ( name,
+							( ( const void * )
+							  node ) );
+			if ( ! name )
+				goto err;
+		} else {
+			*verified = false;
+		}
+	}
+
+	/* Check for presence of partition, if applicable */
+	if ( hd && ( hd->SignatureType == SIGNATURE_TYPE_MBR ) )
+		signature_len = sizeof ( uint32_t );
+	if ( hd && ( hd->SignatureType == SIGNATURE_TYPE_GUID ) )
+		signature_len = sizeof ( hd->Signature );
+	if ( hd && ( ! signature_len ) )
+		*verified = false;
+	if ( signature_len ) {
+		signature = hd->Signature;
+		present = efiboot_inventory_has ( inventory,
+						  EFIBOOT_INVENTORY_PARTITION,
+						  signature, signature_len,
+						  NULL );
+		if ( present < 0 )
+			goto err;
+		if ( ! present ) {
+			verdict = EFIBOOT_VERDICT_NO_DEVICE;
+			goto done;
+		}
+	}
+
+	/* Check for presence of network interface, if applicable.  The
+	 * boot file for a network boot cannot be checked in advance.
+	 */
+	if ( mac && ( mac->IfType > 1 /* Ethernet */ ) )
+		*verified = false;
+	if ( mac && ( mac->IfType <= 1 /* Ethernet */ ) ) {
+		present = efiboot_inventory_has ( inventory,
+						  EFIBOOT_INVENTORY_NIC,
+						  &mac->MacAddress,
+						  EFIBOOT_MAC_LEN, NULL );
+		if ( present < 0 )
+			goto err;
+		if ( ! present ) {
+			verdict = EFIBOOT_VERDICT_NO_DEVICE;
+			goto done;
+		}
+	}
+	if ( mac ) {
+		*verified = false;
+		verdict = EFIBOOT_VERDICT_BOOT;
+		goto done;
+	}
+
+	/* Assume success if the partition has no known files */
+	if ( signature ) {
+		present = efiboot_inventory_has ( inventory,
+						  EFIBOOT_INVENTORY_SCANNED,
+						  signature, signature_len,
+						  NULL );
+		if ( present < 0 )
+			goto err;
+		if ( ! present ) {
+			*verified = false;
+			verdict = EFIBOOT_VERDICT_BOOT;
+			goto done;
+		}
+	}
+
+	/* Use removable media boot file if no file path is present
+	 * (and the file name is known for this architecture).
+	 */
+	if ( ( ! name ) && hd && efiboot_removable_file() ) {
+		name = strdup ( efiboot_removable_file() );
+		if ( ! name )
+			goto err;
+	}
+
+	/* Assume success if there is nothing further to check */
+	if ( ! name ) {
+		*verified = false;
+		verdict = EFIBOOT_VERDICT_BOOT;
+		goto done;
+	}
+
+	/* Check for presence of file */
+	normal = efiboot_inventory_path ( name );
+	if ( ! normal )
+		goto err;
+	if ( signature ) {
+		present = efiboot_inventory_has ( inventory,
+						  EFIBOOT_INVENTORY_FILE,
+						  signature, signature_len,
+						  normal );
+	} else {
+		present = efiboot_inventory_has ( inventory,
+						  EFIBOOT_INVENTORY_ANY_FILE,
+						  NULL, 0, normal );
+	}
+	free ( normal );
+	if ( present < 0 )
+		goto err;
+	verdict = ( present ? EFIBOOT_VERDICT_BOOT : EFIBOOT_VERDICT_NO_FILE );
+
+ done:
+	free ( name );
+	return verdict;
+
+ err:
+	free ( name );
+	return -1;
+}
+
+/**
+ * Predict firmware handling of boot entry
+ *
+ * @v inventory		Hardware inventory
+ * @v entry		EFI boot entry
+ * @v next		Entry is selected by BootNext
+ * @ret verdict		Boot resolution verdict (or negative on error)
+ *
+ * The prediction follows the behaviour of the EDK2 boot manager.  An
+ * entry in the boot order is skipped if it is inactive or is not in
+ * the boot category, whereas an entry selected by BootNext is
+ * attempted regardless of its attributes.  Only the first device
+ * path is used for booting.
+ */
+int efiboot_resolve ( const struct efi_boot_inventory *inventory,
+		      const struct efi_boot_entry *entry, bool next ) {
+	uint32_t attributes = efiboot_attributes ( entry );
+	bool verified;
+
+	/* Check attributes, unless selected by BootNext */
+	if ( ! next ) {
+		if ( ! ( attributes & LOAD_OPTION_ACTIVE ) )
+			return EFIBOOT_VERDICT_INACTIVE;
+		if ( ( attributes & LOAD_OPTION_CATEGORY ) !=
+		     LOAD_OPTION_CATEGORY_BOOT )
+			return EFIBOOT_VERDICT_NOT_BOOTABLE;
+	}
+
+	/* Resolve first device path */
+	return efiboot_resolve_path ( inventory, efiboot_path ( entry, 0 ),
+				      &verified );
+}
+
+/**
+ * Move first available device path to front of boot entry
+ *
+ * @v inventory		Hardware inventory
+ * @v entry		EFI boot entry
+ * @v reordered		Device paths were reordered
+ * @ret ok		Success indicator
+ *
+ * Firmware attempts only the first device path, and may spend a
+ * long time timing out on a device that is absent (such as a
+ * removed network interface).  The first device path that is
+ * predicted to boot is moved to the front, with the remaining device
+ * paths retaining their relative order.  The entry is left unchanged
+ * if the first device path is already available, if no device path
+ * is available, or if the prediction for the first available device
+ * path was not fully verified against the hardware inventory.
+ */
+int efiboot_reorder_paths ( const struct efi_boot_inventory *inventory,
+			    struct efi_boot_entry *entry, bool *reordered ) {
+	unsigned int count = efiboot_path_count ( entry );
+	unsigned int i;
+	bool verified = false;
+	int verdict;
+
+	/* Find first available device path */
+	*reordered = false;
+	for ( i = 0 ; i < count ; i++ ) {
+		verdict = efiboot_resolve_path ( inventory,
+						 efiboot_path ( entry, i ),
+						 &verified );
+		if ( verdict < 0 )
+			return 0;
+		if ( verdict == EFIBOOT_VERDICT_BOOT )
+			break;
+	}
+
+	/* Do nothing unless a later device path is known to be
+	 * available.
+	 */
+	if ( ( i == 0 ) || ( i == count ) || ( ! verified ) )
+		return 1;
+
+	/* Move available device path to front.  The paths are edited
+	 * in place, retaining the cached textual representations of
+	 * all other paths.
+	 */
+	if ( ! efiboot_insert_path ( entry, 0, efiboot_path ( entry, i ) ) )
+		return 0;
+	if ( ! efiboot_remove_path ( entry, ( i + 1 ) ) ) {
+		efiboot_remove_path ( entry, 0 );
+		return 0;
+	}
+	*reordered = true;
+	return 1;
+}
+
+/**
+ * Get removable media boot file name
+ *
+ * @ret name		File name, or NULL if not known for this architecture
+ */
+const char * efiboot_removable_file ( void ) {
+
+#ifdef EFIBOOT_REMOVABLE_FILE
+	return EFIBOOT_REMOVABLE_FILE;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Get boot resolution verdict name
+ *
+ * @v verdict		Boot resolution verdict
+ * @ret name		Verdict name, or NULL if not recognised
+ */
+const char * efiboot_verdict_name ( enum efi_boot_verdict verdict ) {
+
+	/* Look up verdict name */
+	if ( verdict >= ( sizeof ( efiboot_verdict_names ) /
+			  sizeof ( efiboot_verdict_names[0] ) ) ) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return efiboot_verdict_names[verdict];
+}
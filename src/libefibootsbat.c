@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * Secure Boot Advanced Targeting (SBAT) policy evaluation
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <Uefi/UefiBaseType.h>
+#include <IndustryStandard/PeImage.h>
+#include <efibootdev.h>
+
+#include "efivars.h"
+#include "hash.h"
+
+/** Shim vendor GUID (owning the SBAT level variables) */
+#define EFIBOOT_SBAT_GUID "605dab50-e046-4300-abb6-3dd810dd8b23"
+
+/** Runtime-accessible copy of the SBAT level variable
+ *
+ * The SbatLevel variable itself is accessible only to boot services,
+ * and shim publishes a runtime-accessible copy.
+ */
+#define EFIBOOT_SBAT_LEVEL "SbatLevelRT"
+
+/** PE section name containing SBAT metadata */
+#define EFIBOOT_SBAT_SECTION ".sbat"
+
+/** An SBAT component entry */
+struct efi_boot_sbat_entry {
+	/** Component name */
+	const char *name;
+	/** Component generation */
+	unsigned long generation;
+};
+
+/** An SBAT component table */
+struct efi_boot_sbat {
+	/** Copy of CSV text (with fields terminated in place) */
+	char *text;
+	/** Number of entries */
+	unsigned int count;
+	/** Entries (in order of appearance) */
+	struct efi_boot_sbat_entry *entries;
+	/** Hash table of entries, indexed by component name */
+	struct hash_table table;
+};
+
+/**
+ * Calculate component name hash
+ *
+ * @v name		Component name
+ * @ret hash		Hash value
+ */
+static unsigned int efiboot_sbat_hash ( const char *name ) {
+
+	return hash_fnv ( HASH_FNV_INIT, name, strlen ( name ) );
+}
+
+/**
+ * Check if component names are the same
+ *
+ * @v key		Component name held in hash table
+ * @v other		Component name being looked up
+ * @ret same		Component names are the same
+ */
+static bool efiboot_sbat_same ( const void *key, const void *other ) {
+
+	return ( strcmp ( key, other ) == 0 );
+}
+
+/**
+ * Find hash table slot for component name
+ *
+ * @v sbat		SBAT component table
+ * @v name		Component name
+ * @ret slot		Hash table slot (empty if name is not present)
+ */
+static struct hash_slot *
+efiboot_sbat_slot ( const struct efi_boot_sbat *sbat, const char *name ) {
+
+	return hash_find ( &sbat->table, efiboot_sbat_hash ( name ), name,
+			   efiboot_sbat_same );
+}
+
+/**
+ * Parse SBAT CSV line
+ *
+ * @v line		Line (will be modified in place)
+ * @v entry		Entry to fill in
+ * @ret ok		Success indicator
+ *
+ * Each line has the form "component,generation[,...]".  Any fields
+ * beyond the generation (e.g. vendor information) are ignored.
+ */
+static int efiboot_sbat_parse_line ( char *line,
+				     struct efi_boot_sbat_entry *entry ) {
+	char *generation;
+	char *end;
+
+	/* Split out component name */
+	generation = strchr ( line, ',' );
+	if ( ( ! generation ) || ( generation == line ) )
+		goto err;
+	*(generation++) = '\0';
+	entry->name = line;
+
+	/* Parse generation */
+	end = strchr ( generation, ',' );
+	if ( end )
+		*end = '\0';
+	entry->generation = strtoul ( generation, &end, 10 );
+	if ( ( end == generation ) || *end )
+		goto err;
+
+	return 1;
+
+ err:
+	errno = EINVAL;
+	return 0;
+}
+
+/**
+ * Parse SBAT CSV text
+ *
+ * @v csv		CSV text (not necessarily NUL-terminated)
+ * @v len		Maximum length of CSV text
+ * @ret sbat		SBAT component table, or NULL on error
+ *
+ * The same format is used both for the SBAT level variable and for
+ * the .sbat section of a PE image.  Parsing stops at the first NUL
+ * (if any), since PE sections are padded with zeros.  Where a
+ * component appears more than once, the hashed component table
+ * records the highest generation.
+ */
+struct efi_boot_sbat * efiboot_sbat_parse ( const char *csv, size_t len ) {
+	struct efi_boot_sbat *sbat;
+	struct efi_boot_sbat_entry *entry;
+	struct efi_boot_sbat_entry *existing;
+	struct hash_slot *slot;
+	const char *nul;
+	unsigned int hash;
+	unsigned int max;
+	unsigned int i;
+	char *line;
+	char *next;
+
+	/* Allocate and initialise table */
+	sbat = calloc ( 1, sizeof ( *sbat ) );
+	if ( ! sbat )
+		goto err_alloc;
+
+	/* Copy text, up to first NUL */
+	nul = memchr ( csv, '\0', len );
+	if ( nul )
+		len = ( nul - csv );
+	sbat->text = malloc ( len + 1 /* NUL */ );
+	if ( ! sbat->text )
+		goto err_text;
+	memcpy ( sbat->text, csv, len );
+	sbat->text[len] = '\0';
+
+	/* Allocate entries (at most one per line) and hash table */
+	max = 1;
+	for ( i = 0 ; i < len ; i++ ) {
+		if ( csv[i] == '\n' )
+			max++;
+	}
+	sbat->entries = calloc ( max, sizeof ( sbat->entries[0] ) );
+	if ( ! sbat->entries )
+		goto err_entries;
+	if ( ! hash_init ( &sbat->table, max ) )
+		goto err_table;
+
+	/* Parse lines */
+	for ( line = sbat->text ; line ; line = next ) {
+
+		/* Terminate line, ignoring any carriage return */
+		next = strchr ( line, '\n' );
+		if ( next )
+			*(next++) = '\0';
+		line[ strcspn ( line, "\r" ) ] = '\0';
+
+		/* Ignore empty lines */
+		if ( ! line[0] )
+			continue;
+
+		/* Parse line */
+		entry = &sbat->entries[sbat->count];
+		if ( ! efiboot_sbat_parse_line ( line, entry ) )
+			goto err_parse;
+		sbat->count++;
+
+		/* Add to hash table, recording the highest generation */
+		hash = efiboot_sbat_hash ( entry->name );
+		slot = hash_find ( &sbat->table, hash, entry->name,
+				   efiboot_sbat_same );
+		existing = slot->value;
+		if ( ( ! existing ) ||
+		     ( existing->generation < entry->generation ) ) {
+			hash_set ( &sbat->table, slot, entry->name, entry,
+				   hash );
+		}
+	}
+
+	return sbat;
+
+ err_parse:
+	hash_free ( &sbat->table );
+ err_table:
+	free ( sbat->entries );
+ err_entries:
+	free ( sbat->text );
+ err_text:
+	free ( sbat );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Load SBAT level
+ *
+ * @ret sbat		SBAT component table, or NULL on error
+ */
+struct efi_boot_sbat * efiboot_sbat_level ( void ) {
+	struct efi_boot_sbat *sbat;
+	uint32_t attributes;
+	void *data;
+	size_t len;
+
+	/* Read SBAT level variable */
+	if ( ! efivars_read_guid ( EFIBOOT_SBAT_GUID, EFIBOOT_SBAT_LEVEL,
+				   &data, &len, &attributes ) )
+		return NULL;
+
+	/* Parse SBAT level */
+	sbat = efiboot_sbat_parse ( data, len );
+	free ( data );
+
+	return sbat;
+}
+
+/**
+ * Parse SBAT metadata from PE image
+ *
+ * @v image		PE image file contents
+ * @v len		Length of PE image file
+ * @ret sbat		SBAT component table, or NULL on error
+ *
+ * An image with no .sbat section produces an empty table.
+ */
+struct efi_boot_sbat * efiboot_sbat_image ( const void *image, size_t len ) {
+	const EFI_IMAGE_DOS_HEADER *dos = image;
+	const EFI_IMAGE_FILE_HEADER *file;
+	const EFI_IMAGE_SECTION_HEADER *section;
+	const uint32_t *signature;
+	size_t offset;
+	size_t size;
+	unsigned int i;
+
+	/* Parse DOS header */
+	if ( ( len < sizeof ( *dos ) ) ||
+	     ( dos->e_magic != EFI_IMAGE_DOS_SIGNATURE ) )
+		goto err_format;
+
+	/* Parse PE signature and file header */
+	offset = dos->e_lfanew;
+	if ( ( offset > len ) ||
+	     ( ( len - offset ) <
+	       ( sizeof ( *signature ) + sizeof ( *file ) ) ) )
+		goto err_format;
+	signature = ( image + offset );
+	if ( *signature != EFI_IMAGE_NT_SIGNATURE )
+		goto err_format;
+	file = ( image + offset + sizeof ( *signature ) );
+
+	/* Locate section table */
+	offset += ( sizeof ( *signature ) + sizeof ( *file ) +
+		    file->SizeOfOptionalHeader );
+	if ( ( offset > len ) ||
+	     ( ( ( len - offset ) / sizeof ( *section ) ) <
+	       file->NumberOfSections ) )
+		goto err_format;
+	section = ( image + offset );
+
+	/* Find .sbat section */
+	for ( i = 0 ; i < file->NumberOfSections ; i++, section++ ) {
+		if ( strncmp ( ( ( const char * ) section->Name ),
+			       EFIBOOT_SBAT_SECTION,
+			       sizeof ( section->Name ) ) != 0 )
+			continue;
+		offset = section->PointerToRawData;
+		size = section->SizeOfRawData;
+		if ( section->Misc.VirtualSize < size )
+			size = section->Misc.VirtualSize;
+		if ( ( offset > len ) || ( size > ( len - offset ) ) )
+			goto err_format;
+		return efiboot_sbat_parse ( ( image + offset ), size );
+	}
+
+	/* No .sbat section */
+	return efiboot_sbat_parse ( "", 0 );
+
+ err_format:
+	errno = EINVAL;
+	return NULL;
+}
+
+/**
+ * Get number of SBAT component entries
+ *
+ * @v sbat		SBAT component table
+ * @ret count		Number of entries
+ */
+unsigned int efiboot_sbat_count ( const struct efi_boot_sbat *sbat ) {
+	return sbat->count;
+}
+
+/**
+ * Get SBAT component entry
+ *
+ * @v sbat		SBAT component table
+ * @v index		Entry index
+ * @v generation	Component generation to fill in
+ * @ret name		Component name
+ */
+const char * efiboot_sbat_component ( const struct efi_boot_sbat *sbat,
+				      unsigned int index,
+				      unsigned long *generation ) {
+	const struct efi_boot_sbat_entry *entry = &sbat->entries[index];
+
+	*generation = entry->generation;
+	return entry->name;
+}
+
+/**
+ * Get SBAT component generation
+ *
+ * @v sbat		SBAT component table
+ * @v name		Component name
+ * @ret generation	Component generation (or zero if not present)
+ */
+unsigned long efiboot_sbat_generation ( const struct efi_boot_sbat *sbat,
+					const char *name ) {
+	const struct efi_boot_sbat_entry *entry;
+
+	entry = efiboot_sbat_slot ( sbat, name )->value;
+	return ( entry ? entry->generation : 0 );
+}
+
+/**
+ * Check PE image SBAT metadata against SBAT level
+ *
+ * @v level		SBAT level
+ * @v image		PE image SBAT metadata
+ * @ret name		Revoked component name, or NULL if not revoked
+ *
+ * An image is revoked if any of its components has a generation
+ * lower than that listed for the same component in the SBAT level.
+ * As with shim, an image with no SBAT metadata at all is revoked by
+ * any nonempty SBAT level.
+ */
+const char * efiboot_sbat_revoked ( const struct efi_boot_sbat *level,
+				    const struct efi_boot_sbat *image ) {
+	const struct efi_boot_sbat_entry *entry;
+	unsigned int i;
+
+	/* Reject images with no SBAT metadata */
+	if ( level->count && ( ! image->count ) )
+		return level->entries[0].name;
+
+	/* Check each component against the hashed SBAT level */
+	for ( i = 0 ; i < image->count ; i++ ) {
+		entry = &image->entries[i];
+		if ( entry->generation <
+		     efiboot_sbat_generation ( level, entry->name ) )
+			return entry->name;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free SBAT component table
+ *
+ * @v sbat		SBAT component table (or NULL)
+ */
+void efiboot_sbat_free ( struct efi_boot_sbat *sbat ) {
+
+	/* Do nothing if no table */
+	if ( ! sbat )
+		return;
+
+	hash_free ( &sbat->table );
+	free ( sbat->entries );
+	free ( sbat->text );
+	free ( sbat );
+}
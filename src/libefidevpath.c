@@ -10,11 +10,13 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <ctype.h>
 #include <Uefi/UefiBaseType.h>
 #include <Protocol/DevicePath.h>
 #include <Protocol/DebugPort.h>
+#include <Library/BaseLib.h>
 #include <Library/DevicePathLib.h>
 #include <efidevpath.h>
 
@@ -170,6 +172,104 @@ EFI_DEVICE_PATH_PROTOCOL * efidp_from_text ( const char *text,
 	return NULL;
 }
 
+/**
+ * Construct list of device paths from textual representations
+ *
+ * @v texts		Textual representations (in UTF-8)
+ * @v count		Number of textual representations (must be at least 1)
+ * @v allow_implausible	Allow implausible device paths
+ * @v offset		Offset at which to place first device path
+ * @v len		Total length of device paths to fill in
+ * @ret block		Block containing device paths, or NULL on error
+ *
+ * The device paths are placed consecutively within a single block,
+ * starting at @c offset bytes from the start of the block.  The
+ * initial @c offset bytes are left uninitialised for use by the
+ * caller (e.g. to hold a list of pointers to the device paths).
+ *
+ * The block is allocated using malloc() and must eventually be freed
+ * by the caller.
+ */
+void * efidp_from_texts ( const char **texts, unsigned int count,
+			  bool allow_implausible, size_t offset,
+			  size_t *len ) {
+	EFI_DEVICE_PATH_PROTOCOL **efidps;
+	EFI_DEVICE_PATH_PROTOCOL *efidp;
+	CHAR16 *efitexts;
+	CHAR16 *efitext;
+	size_t pathlen;
+	void *block = NULL;
+	void *path;
+	unsigned int i;
+
+	/* Sanity check */
+	if ( ! count ) {
+		errno = EINVAL;
+		goto err_sanity;
+	}
+
+	/* Convert all texts to EFI strings using a single conversion */
+	efitexts = utf8s_to_efi ( texts, count );
+	if ( ! efitexts )
+		goto err_efitexts;
+
+	/* Allocate list of EFI device paths */
+	efidps = calloc ( count, sizeof ( efidps[0] ) );
+	if ( ! efidps )
+		goto err_efidps;
+
+	/* Convert each EFI string to a device path, calculating the
+	 * total length so that the block can be allocated only once.
+	 */
+	*len = 0;
+	efitext = efitexts;
+	for ( i = 0 ; i < count ; i++ ) {
+
+		/* Convert to EFI device path */
+		efidp = UefiDevicePathLibConvertTextToDevicePath ( efitext );
+		if ( ! efidp ) {
+			errno = EINVAL;
+			goto err_efidp;
+		}
+		efidps[i] = efidp;
+
+		/* Check for plausibility */
+		if ( ! ( allow_implausible || efidp_plausible ( efidp ) ) )
+			goto err_implausible;
+
+		/* Accumulate length */
+		*len += efidp_len ( efidp );
+
+		/* Move to next EFI string */
+		efitext += ( StrLen ( efitext ) + 1 /* NUL */ );
+	}
+
+	/* Allocate block */
+	block = malloc ( offset + *len );
+	if ( ! block )
+		goto err_block;
+
+	/* Copy device paths into block */
+	path = ( block + offset );
+	for ( i = 0 ; i < count ; i++ ) {
+		pathlen = efidp_len ( efidps[i] );
+		memcpy ( path, efidps[i], pathlen );
+		path += pathlen;
+	}
+
+ err_block:
+ err_implausible:
+ err_efidp:
+	for ( i = 0 ; i < count ; i++ )
+		free ( efidps[i] );
+	free ( efidps );
+ err_efidps:
+	free ( efitexts );
+ err_efitexts:
+ err_sanity:
+	return block;
+}
+
 /**
  * Get textual representation of device path
  *
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * EFI short-form device path expansion index
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efidevpath.h>
+
+#include "hash.h"
+
+/** A short-form device path expansion index
+ *
+ * Each hash table slot is keyed by an indexed device path node, and
+ * holds the full device path containing that node.
+ */
+struct efidp_index {
+	/** Hash table */
+	struct hash_table table;
+};
+
+/** Initial hash table capacity */
+#define EFIDP_INDEX_MIN_COUNT 32
+
+/**
+ * Get device path node length
+ *
+ * @v node		Device path node (not necessarily aligned)
+ * @ret len		Length of node
+ */
+static size_t efidp_index_node_len ( const EFI_DEVICE_PATH_PROTOCOL *node ) {
+	return ( node->Length[0] | ( node->Length[1] << 8 ) );
+}
+
+/**
+ * Check if device path node is a partition identified by signature
+ *
+ * @v node		Device path node
+ * @ret is_partition	Node is a hard disk partition with a signature
+ *
+ * Firmware matches a short-form HD() node against full device paths
+ * using only the partition signature, since the partition number,
+ * start and size are not required to be present in the short form.
+ */
+static bool efidp_index_is_partition ( const EFI_DEVICE_PATH_PROTOCOL *node ) {
+	const HARDDRIVE_DEVICE_PATH *hd = ( ( const void * ) node );
+
+	return ( ( node->Type == MEDIA_DEVICE_PATH ) &&
+		 ( node->SubType == MEDIA_HARDDRIVE_DP ) &&
+		 ( efidp_index_node_len ( node ) >= sizeof ( *hd ) ) &&
+		 ( hd->SignatureType != 0 ) );
+}
+
+/**
+ * Get device path node key
+ *
+ * @v node		Device path node
+ * @v len		Length of key to fill in
+ * @ret key		Key
+ *
+ * The key is the partition signature for partition nodes, and the
+ * whole node for any other node.
+ */
+static const uint8_t * efidp_index_key ( const EFI_DEVICE_PATH_PROTOCOL *node,
+					 size_t *len ) {
+	const HARDDRIVE_DEVICE_PATH *hd = ( ( const void * ) node );
+
+	/* Use partition signature, if applicable */
+	if ( efidp_index_is_partition ( node ) ) {
+		*len = sizeof ( hd->Signature );
+		return hd->Signature;
+	}
+
+	/* Otherwise, use whole node */
+	*len = efidp_index_node_len ( node );
+	return ( ( const uint8_t * ) node );
+}
+
+/**
+ * Calculate device path node key hash
+ *
+ * @v node		Device path node
+ * @ret hash		Hash value
+ */
+static unsigned int efidp_index_hash ( const EFI_DEVICE_PATH_PROTOCOL *node ) {
+	const uint8_t *key;
+	unsigned int hash;
+	size_t len;
+
+	/* Use FNV-1a over the key, including the node type */
+	hash = hash_fnv ( HASH_FNV_INIT, &node->Type, sizeof ( node->Type ) );
+	hash = hash_fnv ( hash, &node->SubType, sizeof ( node->SubType ) );
+	key = efidp_index_key ( node, &len );
+	return hash_fnv ( hash, key, len );
+}
+
+/**
+ * Check if device path nodes have the same key
+ *
+ * @v key_node		Device path node held in index
+ * @v other_node	Device path node being looked up
+ * @ret same		Nodes have the same key
+ */
+static bool efidp_index_same ( const void *key_node,
+			       const void *other_node ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node = key_node;
+	const EFI_DEVICE_PATH_PROTOCOL *other = other_node;
+	const uint8_t *key;
+	const uint8_t *other_key;
+	size_t len;
+	size_t other_len;
+
+	if ( ( node->Type != other->Type ) ||
+	     ( node->SubType != other->SubType ) )
+		return false;
+	key = efidp_index_key ( node, &len );
+	other_key = efidp_index_key ( other, &other_len );
+	return ( ( len == other_len ) &&
+		 ( memcmp ( key, other_key, len ) == 0 ) );
+}
+
+/**
+ * Get offset of indexed node within full device path
+ *
+ * @v slot		Occupied hash table slot
+ * @ret offset		Offset of node within full device path
+ */
+static size_t efidp_index_offset ( const struct hash_slot *slot ) {
+	return ( slot->key - slot->value );
+}
+
+/**
+ * Create short-form device path expansion index
+ *
+ * @ret index		Device path index, or NULL on error
+ */
+struct efidp_index * efidp_index_new ( void ) {
+	struct efidp_index *index;
+
+	/* Allocate and initialise index */
+	index = calloc ( 1, sizeof ( *index ) );
+	if ( ! index )
+		goto err_alloc;
+	if ( ! hash_init ( &index->table, EFIDP_INDEX_MIN_COUNT ) )
+		goto err_table;
+
+	return index;
+
+ err_table:
+	free ( index );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Add full device path to short-form device path expansion index
+ *
+ * @v index		Device path index
+ * @v path		Full device path
+ * @ret ok		Success indicator
+ *
+ * Every node of the device path is indexed, so that any short-form
+ * device path starting with a matching node may be expanded.  Where
+ * a node appears in several device paths, the index retains the
+ * longest expansion (i.e. the node found at the greatest depth).
+ *
+ * The device path is not copied, and must remain valid for the
+ * lifetime of the index.  No alignment is required.
+ */
+int efidp_index_add ( struct efidp_index *index,
+		      const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	struct hash_slot *slot;
+	unsigned int hash;
+	size_t offset;
+	size_t len;
+
+	/* Index each node, up to the end of the first instance */
+	for ( offset = 0 ; ; offset += len ) {
+		node = ( ( ( const void * ) path ) + offset );
+		len = efidp_index_node_len ( node );
+		if ( node->Type == END_DEVICE_PATH_TYPE )
+			break;
+		if ( len < sizeof ( *node ) ) {
+			errno = EINVAL;
+			return 0;
+		}
+
+		/* Grow hash table if necessary */
+		if ( ! hash_reserve ( &index->table ) )
+			return 0;
+
+		/* Record node, retaining the longest expansion */
+		hash = efidp_index_hash ( node );
+		slot = hash_find ( &index->table, hash, node,
+				   efidp_index_same );
+		if ( ( ! slot->key ) ||
+		     ( efidp_index_offset ( slot ) < offset ) ) {
+			hash_set ( &index->table, slot, node,
+				   ( ( void * ) path ), hash );
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Expand short-form device path
+ *
+ * @v index		Device path index
+ * @v path		Short-form device path
+ * @ret full		Full device path, or NULL on error
+ *
+ * The full device path is constructed from the portion of an indexed
+ * device path preceding the node matching the first node of the
+ * short-form device path, followed by the whole of the short-form
+ * device path.  A device path that is already in full form will
+ * generally expand to itself.  The full device path is allocated
+ * using malloc() and must eventually be freed by the caller.
+ */
+EFI_DEVICE_PATH_PROTOCOL *
+efidp_index_expand ( const struct efidp_index *index,
+		     const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	struct hash_slot *slot;
+	EFI_DEVICE_PATH_PROTOCOL *full;
+	size_t offset;
+	size_t len;
+
+	/* Find matching node */
+	if ( path->Type == END_DEVICE_PATH_TYPE )
+		goto err_notfound;
+	slot = hash_find ( &index->table, efidp_index_hash ( path ), path,
+			   efidp_index_same );
+	if ( ! slot->key )
+		goto err_notfound;
+	offset = efidp_index_offset ( slot );
+
+	/* Calculate length of short-form device path */
+	for ( len = 0 ; ; len += efidp_index_node_len ( node ) ) {
+		node = ( ( ( const void * ) path ) + len );
+		if ( node->Type == END_DEVICE_PATH_TYPE )
+			break;
+	}
+	len += sizeof ( *node );
+
+	/* Construct full device path */
+	full = malloc ( offset + len );
+	if ( ! full )
+		return NULL;
+	memcpy ( full, slot->value, offset );
+	memcpy ( ( ( ( void * ) full ) + offset ), path, len );
+
+	return full;
+
+ err_notfound:
+	errno = ENOENT;
+	return NULL;
+}
+
+/**
+ * Shorten full device path
+ *
+ * @v path		Full device path
+ * @ret shortened	Short-form device path (within full device path)
+ *
+ * A device path to a hard disk partition identified by signature may
+ * be shortened to begin at the partition node, since firmware will
+ * expand such a short-form device path by matching the partition
+ * signature.  Any other device path is returned unchanged.
+ */
+const EFI_DEVICE_PATH_PROTOCOL *
+efidp_shorten ( const EFI_DEVICE_PATH_PROTOCOL *path ) {
+	const EFI_DEVICE_PATH_PROTOCOL *node;
+	size_t len;
+
+	/* Find first partition node, if any */
+	for ( node = path ; node->Type != END_DEVICE_PATH_TYPE ;
+	      node = ( ( ( const void * ) node ) + len ) ) {
+		if ( efidp_index_is_partition ( node ) )
+			return node;
+		len = efidp_index_node_len ( node );
+		if ( len < sizeof ( *node ) )
+			break;
+	}
+
+	return path;
+}
+
+/**
+ * Free short-form device path expansion index
+ *
+ * @v index		Device path index (or NULL)
+ */
+void efidp_index_free ( struct efidp_index *index ) {
+
+	/* Do nothing if no index */
+	if ( ! index )
+		return;
+
+	hash_free ( &index->table );
+	free ( index );
+}
@@ -23,6 +23,52 @@
 /** Buffer size increment */
 #define BUFSZ 512
 
+/**
+ * Append converted string to output buffer using iconv
+ *
+ * @v cd		Conversion descriptor
+ * @v in		Input string
+ * @v inlen		Length of input string (in bytes)
+ * @v buf		Output buffer (will be reallocated as needed)
+ * @v len		Allocated length of output buffer
+ * @v outlen		Unused length of output buffer
+ * @ret ok		Success indicator
+ */
+static int convert_append ( iconv_t cd, const char *in, size_t inlen,
+			    void **buf, size_t *len, size_t *outlen ) {
+	int grow = ( ! *outlen );
+	char *out;
+	void *tmp;
+
+	/* Convert string */
+	while ( 1 ) {
+
+		/* (Re)allocate output buffer, if applicable */
+		if ( grow ) {
+			tmp = realloc ( *buf, ( *len + BUFSZ ) );
+			if ( ! tmp )
+				return 0;
+			*buf = tmp;
+			*len += BUFSZ;
+			*outlen += BUFSZ;
+		}
+
+		/* Update output pointer */
+		out = ( *buf + *len - *outlen );
+
+		/* Convert as much input as possible */
+		if ( iconv ( cd, ( ( ICONV_CONST char ** ) &in ), &inlen, &out,
+			     outlen ) != ( ( size_t ) -1 ) ) {
+			break;
+		}
+		if ( errno != E2BIG )
+			return 0;
+		grow = 1;
+	}
+
+	return 1;
+}
+
 /**
  * Convert string between character encodings using iconv
  *
@@ -30,17 +76,18 @@
  * @v inlen		Length of input string (in bytes)
  * @v incode		Input string encoding
  * @v outcode		Output string encoding
+ * @v nullen		Length of NUL terminator to append (in bytes)
  * @ret out		Output string, or NULL on error
  *
  * The output string is allocated using malloc() and must eventually
  * be freed by the caller.
  */
 static void * convert_string ( const char *in, size_t inlen,
-			       const char *incode, const char *outcode ) {
+			       const char *incode, const char *outcode,
+			       size_t nullen ) {
 	void *buf = NULL;
 	size_t len = 0;
 	size_t outlen = 0;
-	char *out;
 	void *tmp;
 	iconv_t cd;
 
@@ -49,35 +96,27 @@ static void * convert_string ( const char *in, size_t inlen,
 		goto err_open;
 
 	/* Convert string */
-	while ( 1 ) {
+	if ( ! convert_append ( cd, in, inlen, &buf, &len, &outlen ) )
+		goto err_convert;
 
-		/* (Re)allocate output buffer */
-		len += BUFSZ;
-		tmp = realloc ( buf, len );
+	/* Append NUL terminator, if applicable */
+	if ( outlen < nullen ) {
+		tmp = realloc ( buf, ( len + nullen ) );
 		if ( ! tmp )
 			goto err_realloc;
 		buf = tmp;
-
-		/* Update output pointer */
-		outlen += BUFSZ;
-		out = ( buf + len - outlen );
-
-		/* Convert as much input as possible */
-		if ( iconv ( cd, ( ( ICONV_CONST char ** ) &in ), &inlen, &out,
-			     &outlen ) != ( ( size_t ) -1 ) ) {
-			break;
-		}
-		if ( errno != E2BIG )
-			goto err_convert;
+		len += nullen;
+		outlen += nullen;
 	}
+	memset ( ( buf + len - outlen ), 0, nullen );
 
 	/* Close conversion */
 	iconv_close ( cd );
 
 	return buf;
 
- err_convert:
  err_realloc:
+ err_convert:
 	free ( buf );
 	iconv_close ( cd );
  err_open:
@@ -95,7 +134,51 @@ static void * convert_string ( const char *in, size_t inlen,
  */
 CHAR16 * utf8_to_efi ( const char *utf8 ) {
 	size_t len = ( strlen ( utf8 ) + 1 /* NUL */ );
-	return convert_string ( utf8, len, "UTF-8", "UCS-2LE" );
+	return convert_string ( utf8, len, "UTF-8", "UCS-2LE", 0 );
+}
+
+/**
+ * Convert list of UTF-8 strings to consecutive EFI UCS2-LE strings
+ *
+ * @v utf8		Input strings
+ * @v count		Number of input strings
+ * @ret out		Output strings, or NULL on error
+ *
+ * The output strings are placed consecutively (each with its own NUL
+ * terminator) within a single buffer, using a single conversion
+ * descriptor.  The buffer is allocated using malloc() and must
+ * eventually be freed by the caller.
+ */
+CHAR16 * utf8s_to_efi ( const char **utf8, unsigned int count ) {
+	void *buf = NULL;
+	size_t len = 0;
+	size_t outlen = 0;
+	unsigned int i;
+	iconv_t cd;
+
+	/* Open conversion */
+	if ( ( cd = iconv_open ( "UCS-2LE", "UTF-8" ) ) == ( ( iconv_t ) -1 ) )
+		goto err_open;
+
+	/* Convert strings */
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( ! convert_append ( cd, utf8[i],
+					( strlen ( utf8[i] ) + 1 /* NUL */ ),
+					&buf, &len, &outlen ) ) {
+			goto err_convert;
+		}
+	}
+
+	/* Close conversion */
+	iconv_close ( cd );
+
+	return buf;
+
+ err_convert:
+	free ( buf );
+	iconv_close ( cd );
+ err_open:
+	return NULL;
 }
 
 /**
@@ -109,5 +192,31 @@ CHAR16 * utf8_to_efi ( const char *utf8 ) {
  */
 char * efi_to_utf8 ( const CHAR16 *efi ) {
 	size_t len = StrSize ( efi );
-	return convert_string ( ( ( char * ) efi ), len, "UCS-2LE", "UTF-8" );
+	return convert_string ( ( ( char * ) efi ), len,
+				"UCS-2LE", "UTF-8", 0 );
+}
+
+/**
+ * Convert length-delimited EFI UCS2-LE string to UTF-8 string
+ *
+ * @v efi		Input string (not necessarily NUL-terminated)
+ * @v len		Maximum length of input string (in bytes)
+ * @ret out		Output string, or NULL on error
+ *
+ * Conversion stops at the first NUL character, if any.  The output
+ * string is allocated using malloc() and must eventually be freed by
+ * the caller.
+ */
+char * efin_to_utf8 ( const CHAR16 *efi, size_t len ) {
+	size_t count;
+
+	/* Find length of string, excluding any NUL terminator */
+	for ( count = 0 ; ( ( ( count + 1 ) * sizeof ( efi[0] ) ) <= len ) ;
+	      count++ ) {
+		if ( ! efi[count] )
+			break;
+	}
+	return convert_string ( ( ( char * ) efi ),
+				( count * sizeof ( efi[0] ) ),
+				"UCS-2LE", "UTF-8", 1 );
 }
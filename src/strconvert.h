@@ -13,6 +13,8 @@
 #include <Uefi/UefiBaseType.h>
 
 extern CHAR16 * utf8_to_efi ( const char *utf8 );
+extern CHAR16 * utf8s_to_efi ( const char **utf8, unsigned int count );
 extern char * efi_to_utf8 ( const CHAR16 *efi );
+extern char * efin_to_utf8 ( const CHAR16 *efi, size_t len );
 
 #endif /* _STRCONVERT_H */
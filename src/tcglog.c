@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * TCG event log parsing
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <Guid/GlobalVariable.h>
+#include <efidevpath.h>
+#include <efibootdev.h>
+
+#include "tcglog.h"
+
+/** EFI global variable GUID */
+static const EFI_GUID global_guid = EFI_GLOBAL_VARIABLE;
+
+/**
+ * Consume data from TCG event log
+ *
+ * @v log		TCG event log
+ * @v len		Length to consume
+ * @ret data		Consumed data, or NULL if log is truncated
+ */
+static const void * tcg_take ( struct tcg_log *log, size_t len ) {
+	const void *data = ( log->data + log->offset );
+
+	/* Check length */
+	if ( len > ( log->len - log->offset ) ) {
+		errno = EINVAL;
+		return NULL;
+	}
+	log->offset += len;
+
+	return data;
+}
+
+/**
+ * Consume 16-bit value from TCG event log
+ *
+ * @v log		TCG event log
+ * @v value		Value to fill in
+ * @ret ok		Success indicator
+ */
+static int tcg_take_u16 ( struct tcg_log *log, uint16_t *value ) {
+	const void *data;
+
+	/* Consume (potentially unaligned) value */
+	data = tcg_take ( log, sizeof ( *value ) );
+	if ( ! data )
+		return 0;
+	memcpy ( value, data, sizeof ( *value ) );
+
+	return 1;
+}
+
+/**
+ * Consume 32-bit value from TCG event log
+ *
+ * @v log		TCG event log
+ * @v value		Value to fill in
+ * @ret ok		Success indicator
+ */
+static int tcg_take_u32 ( struct tcg_log *log, uint32_t *value ) {
+	const void *data;
+
+	/* Consume (potentially unaligned) value */
+	data = tcg_take ( log, sizeof ( *value ) );
+	if ( ! data )
+		return 0;
+	memcpy ( value, data, sizeof ( *value ) );
+
+	return 1;
+}
+
+/**
+ * Open TCG event log
+ *
+ * @v log		TCG event log to fill in
+ * @v data		Log contents
+ * @v len		Length of log
+ * @ret ok		Success indicator
+ *
+ * The log always begins with an event in the legacy SHA-1 format.
+ * If this event is a specification identifier, then all subsequent
+ * events use the crypto agile format with the listed digest
+ * algorithms.
+ */
+int tcg_open ( struct tcg_log *log, const void *data, size_t len ) {
+	const struct tcg_event_header *header;
+	const struct tcg_spec_id *spec;
+	const struct tcg_algorithm *algorithms;
+	uint32_t event_len;
+
+	/* Initialise log */
+	memset ( log, 0, sizeof ( *log ) );
+	log->data = data;
+	log->len = len;
+
+	/* Parse first event */
+	if ( ! ( ( header = tcg_take ( log, sizeof ( *header ) ) ) &&
+		 tcg_take ( log, TCG_SHA1_LEN ) &&
+		 tcg_take_u32 ( log, &event_len ) &&
+		 ( spec = tcg_take ( log, event_len ) ) ) )
+		return 0;
+
+	/* Identify crypto agile format, if applicable */
+	if ( ( header->type != EV_NO_ACTION ) ||
+	     ( event_len < sizeof ( *spec ) ) ||
+	     ( memcmp ( spec->signature, TCG_SPEC_ID_SIGNATURE,
+			sizeof ( spec->signature ) ) != 0 ) ) {
+		/* Legacy format: rewind to parse first event normally */
+		log->offset = 0;
+		return 1;
+	}
+	if ( ( spec->count > TCG_MAX_ALGORITHMS ) ||
+	     ( spec->count > ( ( event_len - sizeof ( *spec ) ) /
+			       sizeof ( *algorithms ) ) ) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	algorithms = ( ( ( const void * ) spec ) + sizeof ( *spec ) );
+	memcpy ( log->algorithms, algorithms,
+		 ( spec->count * sizeof ( *algorithms ) ) );
+	log->count = spec->count;
+	log->agile = true;
+
+	return 1;
+}
+
+/**
+ * Get digest length
+ *
+ * @v log		TCG event log
+ * @v id		Algorithm identifier
+ * @ret len		Digest length, or 0 if unknown
+ */
+static size_t tcg_digest_len ( struct tcg_log *log, uint16_t id ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < log->count ; i++ ) {
+		if ( log->algorithms[i].id == id )
+			return log->algorithms[i].len;
+	}
+	return 0;
+}
+
+/**
+ * Read next event from TCG event log
+ *
+ * @v log		TCG event log
+ * @v event		Event to fill in
+ * @ret rc		1 if an event was read, 0 at end of log, or -1 on error
+ *
+ * The event data is not copied, and remains within the log.
+ */
+int tcg_next ( struct tcg_log *log, struct tcg_event *event ) {
+	const struct tcg_event_header *header;
+	uint16_t id;
+	uint32_t count;
+	uint32_t len;
+	size_t digest_len;
+	unsigned int i;
+
+	/* Check for end of log */
+	if ( log->offset == log->len )
+		return 0;
+
+	/* Parse event header */
+	header = tcg_take ( log, sizeof ( *header ) );
+	if ( ! header )
+		return -1;
+
+	/* Skip digests */
+	if ( log->agile ) {
+		if ( ! tcg_take_u32 ( log, &count ) )
+			return -1;
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( ! tcg_take_u16 ( log, &id ) )
+				return -1;
+			digest_len = tcg_digest_len ( log, id );
+			if ( ! digest_len ) {
+				errno = ENOTSUP;
+				return -1;
+			}
+			if ( ! tcg_take ( log, digest_len ) )
+				return -1;
+		}
+	} else {
+		if ( ! tcg_take ( log, TCG_SHA1_LEN ) )
+			return -1;
+	}
+
+	/* Parse event data */
+	if ( ! tcg_take_u32 ( log, &len ) )
+		return -1;
+	memset ( event, 0, sizeof ( *event ) );
+	event->pcr = header->pcr;
+	event->type = header->type;
+	event->len = len;
+	event->data = tcg_take ( log, event->len );
+	if ( ! event->data )
+		return -1;
+
+	return 1;
+}
+
+/**
+ * Get event type name
+ *
+ * @v type		Event type
+ * @ret name		Event type name
+ */
+const char * tcg_type_name ( uint32_t type ) {
+
+	switch ( type ) {
+	case EV_EFI_VARIABLE_BOOT:
+		return "EV_EFI_VARIABLE_BOOT";
+	case EV_EFI_BOOT_SERVICES_APPLICATION:
+		return "EV_EFI_BOOT_SERVICES_APPLICATION";
+	case EV_EFI_VARIABLE_BOOT2:
+		return "EV_EFI_VARIABLE_BOOT2";
+	default:
+		return "<unknown>";
+	}
+}
+
+/**
+ * Decode boot services application event
+ *
+ * @v event		Event
+ * @ret ok		Success indicator
+ */
+int tcg_decode_image ( struct tcg_event *event ) {
+	const struct tcg_image_event *image = event->data;
+	const EFI_DEVICE_PATH_PROTOCOL *path;
+
+	/* Locate device path.  A zero length would instruct
+	 * efidp_valid() to ignore the length entirely, so reject any
+	 * length too short to hold even an end node.
+	 */
+	if ( ( event->len < sizeof ( *image ) ) ||
+	     ( image->path_len > ( event->len - sizeof ( *image ) ) ) ||
+	     ( image->path_len < sizeof ( *path ) ) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	path = ( event->data + sizeof ( *image ) );
+	if ( ! efidp_valid ( path, image->path_len ) )
+		return 0;
+	event->path = path;
+
+	/* Decode device path */
+	event->text = efidp_to_text ( path, false, false );
+	if ( ! event->text )
+		return 0;
+
+	return 1;
+}
+
+/**
+ * Decode boot variable event
+ *
+ * @v event		Event
+ * @v entries		Boot entries
+ * @ret ok		Success indicator
+ */
+int tcg_decode_variable ( struct tcg_event *event,
+			  struct efi_boot_entry **entries ) {
+	const struct tcg_variable_event *var = event->data;
+	const void *name;
+	const void *data;
+	CHAR16 c;
+	struct efi_boot_entry *entry;
+	EFI_LOAD_OPTION *option;
+	size_t len;
+	unsigned int i;
+	int same;
+
+	/* Locate name and data */
+	if ( ( event->len < sizeof ( *var ) ) ||
+	     ( var->name_len > ( ( event->len - sizeof ( *var ) ) /
+				 sizeof ( c ) ) ) ||
+	     ( var->len > ( event->len - sizeof ( *var ) -
+			    ( var->name_len * sizeof ( c ) ) ) ) ) {
+		errno = EINVAL;
+		return 0;
+	}
+	name = ( event->data + sizeof ( *var ) );
+	data = ( name + ( var->name_len * sizeof ( c ) ) );
+
+	/* Extract name (which is always ASCII for boot variables) */
+	for ( i = 0 ; ( ( i < var->name_len ) &&
+			( i < ( sizeof ( event->name ) - 1 ) ) ) ; i++ ) {
+		memcpy ( &c, ( name + ( i * sizeof ( c ) ) ), sizeof ( c ) );
+		event->name[i] = ( ( c < 0x80 ) ? c : '?' );
+	}
+
+	/* Ignore anything other than load options */
+	if ( memcmp ( &var->guid, &global_guid, sizeof ( var->guid ) ) != 0 )
+		return 1;
+	if ( ( strlen ( event->name ) != 8 ) ||
+	     ( strncmp ( event->name, "Boot", 4 ) != 0 ) ||
+	     ( strspn ( ( event->name + 4 ),
+			"0123456789ABCDEF" ) != 4 ) )
+		return 1;
+
+	/* Decode load option (from an aligned copy, since the log
+	 * provides no alignment guarantees).
+	 */
+	option = malloc ( var->len );
+	if ( ! option )
+		return 0;
+	memcpy ( option, data, var->len );
+	event->option = efiboot_from_option ( option, var->len );
+	free ( option );
+	if ( ! event->option )
+		return 0;
+	event->text = strdup ( efiboot_path_text ( event->option, 0 ) ?
+			       efiboot_path_text ( event->option, 0 ) : "" );
+	if ( ! event->text )
+		return 0;
+
+	/* Correlate with boot entry of the same name */
+	for ( ; entries && ( entry = *entries ) ; entries++ ) {
+		if ( strcmp ( efiboot_name ( entry ), event->name ) != 0 )
+			continue;
+		event->entry = entry;
+		option = efiboot_to_option ( entry, &len );
+		if ( ! option )
+			return 0;
+		same = ( ( len == var->len ) &&
+			 ( memcmp ( option, data, len ) == 0 ) );
+		free ( option );
+		event->modified = ( ! same );
+		break;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Decode event
+ *
+ * @v event		Event
+ * @v entries		Boot entries (or NULL)
+ * @ret ok		Success indicator
+ *
+ * Events of types that are not relevant to boot entries are left
+ * undecoded.
+ */
+int tcg_decode ( struct tcg_event *event, struct efi_boot_entry **entries ) {
+
+	switch ( event->type ) {
+	case EV_EFI_BOOT_SERVICES_APPLICATION:
+		return tcg_decode_image ( event );
+	case EV_EFI_VARIABLE_BOOT:
+	case EV_EFI_VARIABLE_BOOT2:
+		return tcg_decode_variable ( event, entries );
+	default:
+		return 1;
+	}
+}
+
+/**
+ * Free decoded event contents
+ *
+ * @v event		Event
+ */
+void tcg_clear ( struct tcg_event *event ) {
+
+	free ( event->text );
+	event->text = NULL;
+	if ( event->option )
+		efiboot_free ( event->option );
+	event->option = NULL;
+}
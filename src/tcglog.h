@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * TCG event log parsing
+ *
+ */
+
+#ifndef _TCGLOG_H
+#define _TCGLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efibootdev.h>
+
+/** Event contains no measurement */
+#define EV_NO_ACTION 0x00000003
+
+/** Event measures a boot variable */
+#define EV_EFI_VARIABLE_BOOT 0x80000002
+
+/** Event measures a boot services application */
+#define EV_EFI_BOOT_SERVICES_APPLICATION 0x80000003
+
+/** Event measures a boot variable (including BootOrder) */
+#define EV_EFI_VARIABLE_BOOT2 0x8000000c
+
+/** Crypto agile log format signature */
+#define TCG_SPEC_ID_SIGNATURE "Spec ID Event03"
+
+/** SHA-1 digest length (used by the legacy log format) */
+#define TCG_SHA1_LEN 20
+
+/** Maximum number of digest algorithms */
+#define TCG_MAX_ALGORITHMS 16
+
+/** A TCG event header */
+struct tcg_event_header {
+	/** PCR index */
+	uint32_t pcr;
+	/** Event type */
+	uint32_t type;
+} __attribute__ (( packed ));
+
+/** A TCG crypto agile log specification identifier event */
+struct tcg_spec_id {
+	/** Signature */
+	char signature[16];
+	/** Platform class */
+	uint32_t platform;
+	/** Specification minor version */
+	uint8_t minor;
+	/** Specification major version */
+	uint8_t major;
+	/** Specification errata */
+	uint8_t errata;
+	/** Size of UINTN */
+	uint8_t uintn;
+	/** Number of digest algorithms */
+	uint32_t count;
+} __attribute__ (( packed ));
+
+/** A TCG digest algorithm */
+struct tcg_algorithm {
+	/** Algorithm identifier */
+	uint16_t id;
+	/** Digest length */
+	uint16_t len;
+} __attribute__ (( packed ));
+
+/** A TCG boot services application event */
+struct tcg_image_event {
+	/** Image location in memory */
+	uint64_t addr;
+	/** Image length in memory */
+	uint64_t len;
+	/** Image link-time address */
+	uint64_t link;
+	/** Device path length */
+	uint64_t path_len;
+} __attribute__ (( packed ));
+
+/** A TCG variable event */
+struct tcg_variable_event {
+	/** Vendor GUID */
+	EFI_GUID guid;
+	/** Name length (in characters, not NUL-terminated) */
+	uint64_t name_len;
+	/** Data length */
+	uint64_t len;
+} __attribute__ (( packed ));
+
+/** A TCG event log */
+struct tcg_log {
+	/** Log contents */
+	const void *data;
+	/** Length of log */
+	size_t len;
+	/** Current offset */
+	size_t offset;
+	/** Log uses crypto agile format */
+	bool agile;
+	/** Number of digest algorithms */
+	unsigned int count;
+	/** Digest algorithms */
+	struct tcg_algorithm algorithms[TCG_MAX_ALGORITHMS];
+};
+
+/** An extracted TCG event */
+struct tcg_event {
+	/** PCR index */
+	uint32_t pcr;
+	/** Event type */
+	uint32_t type;
+	/** Event data (within the log) */
+	const void *data;
+	/** Length of event data */
+	size_t len;
+	/** Loaded image device path (within the log, if decoded) */
+	const EFI_DEVICE_PATH_PROTOCOL *path;
+	/** Textual representation of device path (if decoded) */
+	char *text;
+	/** Measured variable name (for variable events) */
+	char name[32];
+	/** Measured load option (for variable events, if decoded) */
+	struct efi_boot_entry *option;
+	/** Correlated boot entry (if any) */
+	struct efi_boot_entry *entry;
+	/** Measured load option differs from correlated boot entry */
+	bool modified;
+};
+
+extern int tcg_open ( struct tcg_log *log, const void *data, size_t len );
+extern int tcg_next ( struct tcg_log *log, struct tcg_event *event );
+extern const char * tcg_type_name ( uint32_t type );
+extern int tcg_decode_image ( struct tcg_event *event );
+extern int tcg_decode_variable ( struct tcg_event *event,
+				 struct efi_boot_entry **entries );
+extern int tcg_decode ( struct tcg_event *event,
+			struct efi_boot_entry **entries );
+extern void tcg_clear ( struct tcg_event *event );
+
+#endif /* _TCGLOG_H */
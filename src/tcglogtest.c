@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * TCG event log parsing self-tests
+ *
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <string.h>
+#include <errno.h>
+#include <cmocka.h>
+#include <Uefi/UefiBaseType.h>
+#include <Protocol/DevicePath.h>
+#include <efidevpath.h>
+
+#include "tcglog.h"
+#include "tcglogtest.h"
+
+/** An event type not relevant to boot entries (EV_IPL) */
+#define TCG_TEST_UNKNOWN 0x0000000d
+
+/** SHA-256 algorithm identifier */
+#define TCG_TEST_SHA256 0x000b
+
+/** SHA-256 digest length */
+#define TCG_TEST_SHA256_LEN 32
+
+/** A test event log under construction */
+struct tcg_test_log {
+	/** Log contents */
+	uint8_t data[512];
+	/** Length of log */
+	size_t len;
+};
+
+/** A loaded image device path: Pci(0x1,0x1) */
+static const uint8_t tcg_test_path[] = {
+	0x01, 0x01, 0x06, 0x00, 0x01, 0x01,
+	0x7f, 0xff, 0x04, 0x00,
+};
+
+/**
+ * Append data to test event log
+ *
+ * @v log		Test event log
+ * @v data		Data
+ * @v len		Length of data
+ */
+static void tcg_test_append ( struct tcg_test_log *log, const void *data,
+			      size_t len ) {
+
+	assert_true ( len <= ( sizeof ( log->data ) - log->len ) );
+	memcpy ( ( log->data + log->len ), data, len );
+	log->len += len;
+}
+
+/**
+ * Append event to test event log
+ *
+ * @v log		Test event log
+ * @v type		Event type
+ * @v agile		Use crypto agile format
+ * @v data		Event data
+ * @v len		Length of event data
+ */
+static void tcg_test_event ( struct tcg_test_log *log, uint32_t type,
+			     bool agile, const void *data, uint32_t len ) {
+	static const uint8_t digest[TCG_TEST_SHA256_LEN];
+	struct tcg_event_header header;
+	uint32_t count = 1;
+	uint16_t id = TCG_TEST_SHA256;
+
+	header.pcr = 4;
+	header.type = type;
+	tcg_test_append ( log, &header, sizeof ( header ) );
+	if ( agile ) {
+		tcg_test_append ( log, &count, sizeof ( count ) );
+		tcg_test_append ( log, &id, sizeof ( id ) );
+		tcg_test_append ( log, digest, TCG_TEST_SHA256_LEN );
+	} else {
+		tcg_test_append ( log, digest, TCG_SHA1_LEN );
+	}
+	tcg_test_append ( log, &len, sizeof ( len ) );
+	tcg_test_append ( log, data, len );
+}
+
+/**
+ * Append boot services application event to test event log
+ *
+ * @v log		Test event log
+ * @v path_len		Recorded device path length
+ * @v len		Length of device path actually present
+ */
+static void tcg_test_image ( struct tcg_test_log *log, uint64_t path_len,
+			     size_t len ) {
+	uint8_t data[ sizeof ( struct tcg_image_event ) +
+		      sizeof ( tcg_test_path ) ];
+	struct tcg_image_event image;
+
+	memset ( &image, 0, sizeof ( image ) );
+	image.path_len = path_len;
+	memcpy ( data, &image, sizeof ( image ) );
+	memcpy ( ( data + sizeof ( image ) ), tcg_test_path, len );
+	tcg_test_event ( log, EV_EFI_BOOT_SERVICES_APPLICATION, false,
+			 data, ( sizeof ( image ) + len ) );
+}
+
+/**
+ * Check that parsing test event log fails
+ *
+ * @v log		Test event log
+ * @v len		Length of log to parse
+ * @v error		Expected error
+ */
+static void assert_tcg_truncated ( struct tcg_test_log *log, size_t len,
+				   int error ) {
+	struct tcg_log parsed;
+	struct tcg_event event;
+	int rc;
+
+	assert_true ( tcg_open ( &parsed, log->data, len ) );
+	do {
+		rc = tcg_next ( &parsed, &event );
+	} while ( rc > 0 );
+	assert_int_equal ( rc, -1 );
+	assert_int_equal ( errno, error );
+}
+
+/** Test TCG event log parsing */
+void test_tcglog ( void **state ) {
+	static const char ipl[] = "grub_cmd: boot";
+	struct tcg_test_log log;
+	struct tcg_log parsed;
+	struct tcg_event event;
+	size_t full_len;
+
+	( void ) state;
+
+	/* Construct legacy format log */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_event ( &log, TCG_TEST_UNKNOWN, false, ipl, sizeof ( ipl ) );
+	tcg_test_image ( &log, sizeof ( tcg_test_path ),
+			 sizeof ( tcg_test_path ) );
+	full_len = log.len;
+
+	/* Check that unknown event types are extracted but ignored */
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_false ( parsed.agile );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_int_equal ( event.type, TCG_TEST_UNKNOWN );
+	assert_int_equal ( event.len, sizeof ( ipl ) );
+	assert_memory_equal ( event.data, ipl, sizeof ( ipl ) );
+	assert_string_equal ( tcg_type_name ( event.type ), "<unknown>" );
+	assert_true ( tcg_decode ( &event, NULL ) );
+	assert_null ( event.path );
+	assert_null ( event.text );
+	tcg_clear ( &event );
+
+	/* Check boot services application event */
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_int_equal ( event.type, EV_EFI_BOOT_SERVICES_APPLICATION );
+	assert_true ( tcg_decode ( &event, NULL ) );
+	assert_non_null ( event.path );
+	assert_int_equal ( efidp_len ( event.path ),
+			   sizeof ( tcg_test_path ) );
+	assert_non_null ( event.text );
+	tcg_clear ( &event );
+	assert_null ( event.text );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 0 );
+
+	/* Check that truncated events are rejected */
+	assert_tcg_truncated ( &log, ( full_len - 1 ), EINVAL );
+	assert_tcg_truncated ( &log, ( full_len - sizeof ( tcg_test_path ) -
+				       sizeof ( struct tcg_image_event ) - 1 ),
+			       EINVAL );
+	assert_false ( tcg_open ( &parsed, log.data,
+				  ( sizeof ( struct tcg_event_header ) +
+				    TCG_SHA1_LEN ) ) );
+	assert_int_equal ( errno, EINVAL );
+
+	/* Check that zero-length device paths are rejected */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_image ( &log, 0, sizeof ( tcg_test_path ) );
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_false ( tcg_decode ( &event, NULL ) );
+	assert_int_equal ( errno, EINVAL );
+	assert_null ( event.path );
+	tcg_clear ( &event );
+
+	/* Check that device paths shorter than an end node are rejected */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_image ( &log, 2, 2 );
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_false ( tcg_decode ( &event, NULL ) );
+	assert_int_equal ( errno, EINVAL );
+	tcg_clear ( &event );
+
+	/* Check that device path lengths overrunning the event are
+	 * rejected.
+	 */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_image ( &log, ( sizeof ( tcg_test_path ) + 1 ),
+			 sizeof ( tcg_test_path ) );
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_false ( tcg_decode ( &event, NULL ) );
+	assert_int_equal ( errno, EINVAL );
+	tcg_clear ( &event );
+
+	/* Check that truncated image events are rejected */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_event ( &log, EV_EFI_BOOT_SERVICES_APPLICATION, false,
+			 tcg_test_path, sizeof ( tcg_test_path ) );
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_false ( tcg_decode ( &event, NULL ) );
+	assert_int_equal ( errno, EINVAL );
+	tcg_clear ( &event );
+
+	/* Check that truncated variable events are rejected */
+	memset ( &log, 0, sizeof ( log ) );
+	tcg_test_event ( &log, EV_EFI_VARIABLE_BOOT, false,
+			 tcg_test_path, sizeof ( tcg_test_path ) );
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_false ( tcg_decode ( &event, NULL ) );
+	assert_int_equal ( errno, EINVAL );
+	tcg_clear ( &event );
+}
+
+/** Test TCG crypto agile event log parsing */
+void test_tcglogagile ( void **state ) {
+	struct {
+		struct tcg_spec_id spec;
+		struct tcg_algorithm algorithms[1];
+	} __attribute__ (( packed )) spec;
+	static const char ipl[] = "grub_cmd: boot";
+	struct tcg_test_log log;
+	struct tcg_log parsed;
+	struct tcg_event event;
+	size_t len;
+
+	( void ) state;
+
+	/* Construct crypto agile format log */
+	memset ( &log, 0, sizeof ( log ) );
+	memset ( &spec, 0, sizeof ( spec ) );
+	memcpy ( spec.spec.signature, TCG_SPEC_ID_SIGNATURE,
+		 sizeof ( spec.spec.signature ) );
+	spec.spec.count = 1;
+	spec.algorithms[0].id = TCG_TEST_SHA256;
+	spec.algorithms[0].len = TCG_TEST_SHA256_LEN;
+	tcg_test_event ( &log, EV_NO_ACTION, false, &spec, sizeof ( spec ) );
+	len = log.len;
+	tcg_test_event ( &log, TCG_TEST_UNKNOWN, true, ipl, sizeof ( ipl ) );
+
+	/* Check parsing */
+	assert_true ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_true ( parsed.agile );
+	assert_int_equal ( parsed.count, 1 );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 1 );
+	assert_int_equal ( event.type, TCG_TEST_UNKNOWN );
+	assert_memory_equal ( event.data, ipl, sizeof ( ipl ) );
+	assert_true ( tcg_decode ( &event, NULL ) );
+	tcg_clear ( &event );
+	assert_int_equal ( tcg_next ( &parsed, &event ), 0 );
+
+	/* Check that truncated digests are rejected */
+	len += ( sizeof ( struct tcg_event_header ) + sizeof ( uint32_t ) +
+		 sizeof ( uint16_t ) + 1 );
+	assert_tcg_truncated ( &log, len, EINVAL );
+
+	/* Check that unknown digest algorithms are rejected */
+	spec.algorithms[0].id = ( TCG_TEST_SHA256 + 1 );
+	memcpy ( ( log.data + sizeof ( struct tcg_event_header ) +
+		   TCG_SHA1_LEN + sizeof ( uint32_t ) ),
+		 &spec, sizeof ( spec ) );
+	assert_tcg_truncated ( &log, log.len, ENOTSUP );
+
+	/* Check that overlong algorithm lists are rejected */
+	spec.spec.count = 2;
+	memcpy ( ( log.data + sizeof ( struct tcg_event_header ) +
+		   TCG_SHA1_LEN + sizeof ( uint32_t ) ),
+		 &spec, sizeof ( spec ) );
+	assert_false ( tcg_open ( &parsed, log.data, log.len ) );
+	assert_int_equal ( errno, EINVAL );
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (C) 2020 Michael Brown <mbrown@fensystems.co.uk>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-Patent
+ *
+ * TCG event log parsing self-tests
+ *
+ */
+
+#ifndef _TCGLOGTEST_H
+#define _TCGLOGTEST_H
+
+extern void test_tcglog ( void **state );
+extern void test_tcglogagile ( void **state );
+
+#endif /* _TCGLOGTEST_H */